@@ -0,0 +1,169 @@
+#pragma once
+
+#include <array>
+#include <bitset>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "DecodeCache.h"
+#include "../Memory/Range.h"
+
+// A straight line run of instructions, ending with
+// a branch and its delay slot or at an instruction
+// that needs the CPU to check for interrupts.
+struct CodeBlock {
+    uint32_t startPc = 0;
+
+    // Physical pages the block was built from
+    uint32_t firstPage = 0;
+    uint32_t lastPage = 0;
+
+    // Cycles spent fetching each instruction when running
+    // uncached, it's the same for every word in the block.
+    int fetchCycles = 0;
+
+    // What running every instruction costs, before memory accesses
+    // and fetches, see 'CPU::baseCycles'
+    int cycles = 0;
+
+    std::vector<DecodedInstruction> instructions;
+
+    // Host code for the block, see 'Recompiler::compile'
+    void* code = nullptr;
+    uint32_t codeGeneration = 0;
+    bool codeCached = false;
+};
+
+/**
+ * Blocks are stored per 4KB page of RAM or BIOS, by the word they start at.
+ *
+ * Any store into a RAM page that holds code marks that page as dirty,
+ * the blocks on it are then thrown away the next time the CPU looks
+ * one up. Blocks are allowed to run one word into the next page for
+ * a delay slot, so a dirty page also drops the page before it.
+ */
+class BlockCache {
+    public:
+        static constexpr uint32_t PAGE_SHIFT     = DecodeCache::PAGE_SHIFT;
+        static constexpr uint32_t WORDS_PER_PAGE = DecodeCache::WORDS_PER_PAGE;
+
+        // RAM pages come first, then the BIOS ones
+        static constexpr uint32_t RAM_PAGES   = DecodeCache::RAM_PAGES;
+        static constexpr uint32_t TOTAL_PAGES = RAM_PAGES + DecodeCache::BIOS_PAGES;
+
+        static constexpr size_t MAX_BLOCK_LENGTH = 64;
+
+        static bool isBranch(const Instruction& instruction) {
+            if (instruction.func == 0)
+                return instruction.subfunc == 0x08 || instruction.subfunc == 0x09; // JR, JALR
+
+            return instruction.func >= 0x01 && instruction.func <= 0x07;
+        }
+
+        // Instructions that always raise an exception or can change
+        // the interrupt state have to be the last one in a block
+        static bool endsBlock(const Instruction& instruction) {
+            if (instruction.func == 0)
+                return instruction.subfunc == 0x0C || instruction.subfunc == 0x0D; // SYSCALL, BREAK
+
+            return instruction.func == 0x10 || instruction.func == 0x11 || instruction.func == 0x13;
+        }
+
+        static bool isStore(const Instruction& instruction) {
+            return (instruction.func >= 0x28 && instruction.func <= 0x2E) || instruction.func == 0x3A;
+        }
+
+        // Converts a CPU address into a physical page/word index,
+        // returns false if there's no code to cache there.
+        static bool locate(uint32_t addr, uint32_t& page, uint32_t& word) {
+            uint32_t absAddr = map::maskRegion(addr);
+            uint32_t offset = 0;
+
+            if (map::RAM.contains(absAddr, offset)) {
+                offset &= DecodeCache::RAM_MASK;
+                page = offset >> PAGE_SHIFT;
+            } else if (map::BIOS.contains(absAddr, offset)) {
+                page = RAM_PAGES + (offset >> PAGE_SHIFT);
+            } else {
+                return false;
+            }
+
+            word = (offset >> 2) & (WORDS_PER_PAGE - 1);
+
+            return true;
+        }
+
+        // Returns the slot for a block starting at 'addr', or nullptr if
+        // the address can't hold cached code. The slot may be empty.
+        std::unique_ptr<CodeBlock>* lookup(uint32_t addr) {
+            uint32_t page = 0, word = 0;
+
+            if (!locate(addr, page, word))
+                return nullptr;
+
+            if (dirtyPages[page])
+                flushPage(page);
+
+            if (page + 1 < TOTAL_PAGES && dirtyPages[page + 1])
+                flushPage(page + 1);
+
+            std::unique_ptr<Page>& blocks = pages[page];
+
+            if (!blocks)
+                blocks = std::make_unique<Page>();
+
+            return &(*blocks)[word];
+        }
+
+        // Called once a block has been built, so stores to its pages get noticed
+        void registerBlock(const CodeBlock& block) {
+            codePages[block.firstPage] = true;
+            codePages[block.lastPage] = true;
+        }
+
+        // Fed by every store into RAM
+        inline void markDirty(uint32_t ramOffset) {
+            uint32_t page = (ramOffset & DecodeCache::RAM_MASK) >> PAGE_SHIFT;
+
+            if (codePages[page])
+                dirtyPages[page] = true;
+        }
+
+        [[nodiscard]] bool isDirty(const CodeBlock& block) const {
+            return dirtyPages[block.firstPage] || dirtyPages[block.lastPage];
+        }
+
+        // Lets generated code poll a page without calling back into C++
+        [[nodiscard]] const bool* dirtyFlag(uint32_t page) const {
+            return &dirtyPages[page];
+        }
+
+        void reset() {
+            for (auto& page : pages)
+                page.reset();
+
+            codePages.reset();
+            dirtyPages.fill(false);
+        }
+
+    private:
+        using Page = std::array<std::unique_ptr<CodeBlock>, WORDS_PER_PAGE>;
+
+        // Drops every block that could contain code from 'page'
+        void flushPage(uint32_t page) {
+            pages[page].reset();
+
+            if (page > 0 && page != RAM_PAGES)
+                pages[page - 1].reset();
+
+            codePages[page] = false;
+            dirtyPages[page] = false;
+        }
+
+    private:
+        std::array<std::unique_ptr<Page>, TOTAL_PAGES> pages;
+
+        std::bitset<TOTAL_PAGES> codePages;
+        std::array<bool, TOTAL_PAGES> dirtyPages{};
+};
@@ -272,28 +272,59 @@ int GTE::command(gte::Command& cmd) {
     this->lm = cmd.lm;
     
     switch (cmd.cmd) {
-        case 0x01: rtps(); return 13;
-        case 0x06: nclip(); return 8;
-        case 0x0c: op(); return 5;
-        case 0x10: dpcs(); return 7;
-        case 0x11: intpl(); return 7;
-        case 0x12: mvmva(cmd.mvmvaMultiplyMatrix, cmd.mvmvaMultiplyVector, cmd.mvmvaTranslationVector); return 17;
-        case 0x13: ncds(); return 13;
-        case 0x14: cdp(); return 13;
-        case 0x16: ncdt(); return 19;
-        case 0x1b: nccs(); return 13;
-        case 0x1c: cc(); return 6;
-        case 0x1e: ncs(); return 9;
-        case 0x20: nct(); return 15;
-        case 0x2a: dpct(); return 19;
-        case 0x28: sqr(); return 10;
-        case 0x29: dcpl(); return 15;
-        case 0x2d: avsz3(); return 6;
-        case 0x2e: avsz4(); return 8;
-        case 0x30: rtpt(); return 16;
-        case 0x3d: gpf(); return 6;
-        case 0x3e: gpl(); return 6;
-        case 0x3f: ncct(); return 13;
+        case 0x01: rtps(); break;
+        case 0x06: nclip(); break;
+        case 0x0c: op(); break;
+        case 0x10: dpcs(); break;
+        case 0x11: intpl(); break;
+        case 0x12: mvmva(cmd.mvmvaMultiplyMatrix, cmd.mvmvaMultiplyVector, cmd.mvmvaTranslationVector); break;
+        case 0x13: ncds(); break;
+        case 0x14: cdp(); break;
+        case 0x16: ncdt(); break;
+        case 0x1b: nccs(); break;
+        case 0x1c: cc(); break;
+        case 0x1e: ncs(); break;
+        case 0x20: nct(); break;
+        case 0x2a: dpct(); break;
+        case 0x28: sqr(); break;
+        case 0x29: dcpl(); break;
+        case 0x2d: avsz3(); break;
+        case 0x2e: avsz4(); break;
+        case 0x30: rtpt(); break;
+        case 0x3d: gpf(); break;
+        case 0x3e: gpl(); break;
+        case 0x3f: ncct(); break;
+        default:
+            break;
+    }
+    
+    return cycles(cmd.cmd);
+}
+
+int GTE::cycles(uint32_t cmd) {
+    switch (cmd) {
+        case 0x01: return 13;
+        case 0x06: return 8;
+        case 0x0c: return 5;
+        case 0x10: return 7;
+        case 0x11: return 7;
+        case 0x12: return 17;
+        case 0x13: return 13;
+        case 0x14: return 13;
+        case 0x16: return 19;
+        case 0x1b: return 13;
+        case 0x1c: return 6;
+        case 0x1e: return 9;
+        case 0x20: return 15;
+        case 0x2a: return 19;
+        case 0x28: return 10;
+        case 0x29: return 15;
+        case 0x2d: return 6;
+        case 0x2e: return 8;
+        case 0x30: return 16;
+        case 0x3d: return 6;
+        case 0x3e: return 6;
+        case 0x3f: return 13;
         default:
             return 1;
     }
@@ -221,6 +221,9 @@ private:
     void write(uint8_t n, uint32_t d);
     int command(gte::Command& cmd);
     
+    // What 'command' returns for a command number, without running it
+    static int cycles(uint32_t cmd);
+    
     void reset() {
         // Reset vector registers
         for (auto& vec : v) vec = gte::Vector<int16_t>();
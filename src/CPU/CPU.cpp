@@ -12,7 +12,9 @@
 #include <optional>
 #include <unordered_set>
 
+#ifndef PSX_HEADLESS
 #include "imgui.h"
+#endif
 #include "../Utils/Bitwise.h"
 
 /**
@@ -56,7 +58,7 @@ int CPU::executeNextInstruction() {
 
     extraCycles = 0;
 
-    Instruction instruction{fetchInstruction(pc)};
+    DecodedInstruction* decoded = &fetchDecoded(pc);
 
     IRQ::step();
 
@@ -64,7 +66,7 @@ int CPU::executeNextInstruction() {
         ((_cop0.cause & _cop0.sr & 0x400) != 0) &&
         ((_cop0.sr & 0x1) != 0);
 
-    const bool delayIrqUntilAfterThisInstruction = irqPending && isCop2Command(instruction.op);
+    const bool delayIrqUntilAfterThisInstruction = irqPending && isCop2Command(decoded->instruction.op);
 
     if (irqPending && !delayIrqUntilAfterThisInstruction) {
         exception(Interrupt);
@@ -73,7 +75,7 @@ int CPU::executeNextInstruction() {
 
         extraCycles = 0;
 
-        instruction = Instruction(fetchInstruction(pc));
+        decoded = &fetchDecoded(pc);
     }
 
     // increment the PC
@@ -85,7 +87,7 @@ int CPU::executeNextInstruction() {
     }
 
     // Executes the instruction
-    const int cycles = decodeAndExecute(instruction) + extraCycles;
+    const int cycles = (this->*decoded->handler)(decoded->instruction) + extraCycles;
 
     // Shift load registers
     if(loads[0].index != 32)
@@ -103,131 +105,416 @@ int CPU::executeNextInstruction() {
     return cycles;
 }
 
-int CPU::decodeAndExecuteSubFunctions(Instruction& instruction) {
-    using OpHandler = int (CPU::*)(Instruction&);
-    static const std::unordered_map<uint32_t, OpHandler> table = {
-        {0b000000, &CPU::opsll},
-        {0b100101, &CPU::opor},
-        {0b000111, &CPU::opsrav},
-        {0b100111, &CPU::opnor},
-        {0b101011, &CPU::opsltu},
-        {0b100001, &CPU::opaddu},
-        {0b001000, &CPU::opjr},
-        {0b100100, &CPU::opand},
-        {0b100000, &CPU::opadd},
-        {0b001001, &CPU::opjalr},
-        {0b100011, &CPU::opsubu},
-        {0b000011, &CPU::opsra},
-        {0b011010, &CPU::opdiv},
-        {0b010010, &CPU::opmflo},
-        {0b010000, &CPU::opmfhi},
-        {0b000010, &CPU::opsrl},
-        {0b011011, &CPU::opdivu},
-        {0b101010, &CPU::opslt},
-        {0b001100, &CPU::opSyscall},
-        {0b001101, &CPU::opbreak},
-        {0b010011, &CPU::opmtlo},
-        {0b010001, &CPU::opmthi},
-        {0b000100, &CPU::opsllv},
-        {0b100110, &CPU::opxor},
-        {0b011001, &CPU::opmultu},
-        {0b000110, &CPU::opsrlv},
-        {0b011000, &CPU::opmult},
-        {0b100010, &CPU::opsub}
-    };
+int CPU::executeNext() {
+    switch (executionMode) {
+        case ExecutionMode::CachedBlocks: return executeBlock();
+        case ExecutionMode::Recompiler:   return executeRecompiled();
+        default:                          return executeNextInstruction();
+    }
+}
 
-    auto it = table.find(instruction.subfunc);
-    if (it != table.end())
-        return (this->*it->second)(instruction);
+int CPU::executeBlock() {
+    CodeBlock* block = enterBlock();
 
-    opillegal(instruction);
-    printf("Unhandled sub instruction %0x8. Function call was: %x\n", instruction.op, instruction.subfunc);
-    std::cerr << "";
+    if (!block)
+        return executeNextInstruction();
 
-    return 0;
+    return runBlock(*block);
 }
 
-uint32_t CPU::fetchInstruction(uint32_t addr) {
-    uint32_t value = interconnect.loadInstruction(addr);
+int CPU::executeRecompiled() {
+    CodeBlock* block = enterBlock();
 
-    if (interconnect.lastICacheMiss)
-        extraCycles += instructionFetchCycles(addr);
+    if (!block)
+        return executeNextInstruction();
 
-    return value;
+    const bool cached = interconnect._cacheControl.isCacheEnabled() && pc < 0xA0000000;
+
+    Recompiler::BlockFunction function = recompiler.compile(*this, *block, cached);
+
+    if (!function)
+        return runBlock(*block);
+
+    extraCycles = 0;
+
+    const uint64_t result = function(this);
+
+    recompiler.rethrowPending();
+
+    const int cycles = static_cast<int>(result & 0xFFFFFFFF);
+    const int executed = static_cast<int>(result >> 32);
+
+    if (!cached) {
+        interconnect.lastICacheMiss = true;
+        extraCycles += block->fetchCycles * executed;
+    }
+
+    checkForTTY();
+
+    return cycles + extraCycles;
 }
 
-int CPU::instructionFetchCycles(uint32_t addr) const {
-    uint32_t absAddr = map::maskRegion(addr);
-    uint32_t offset = 0;
+CodeBlock* CPU::enterBlock() {
+    // Delay slots left over from single stepping
+    // and misaligned jumps are done the slow way
+    if (branchSlot || pc % 4 != 0)
+        return nullptr;
 
-    if (map::SCRATCHPAD.contains(absAddr, offset))
-        return 0;
+    std::unique_ptr<CodeBlock>* slot = interconnect.blockCache.lookup(pc);
 
-    if (map::RAM.contains(absAddr, offset))
-        return 3;
+    if (!slot)
+        return nullptr;
 
-    if (map::BIOS.contains(absAddr, offset))
-        return 5;
+    IRQ::step();
 
-    return memoryAccessCycles(addr, 4, false);
+    const bool irqPending =
+        ((_cop0.cause & _cop0.sr & 0x400) != 0) &&
+        ((_cop0.sr & 0x1) != 0);
+
+    // Let the interpreter deal with entering the handler
+    if (irqPending)
+        return nullptr;
+
+    if (!*slot || (*slot)->startPc != pc)
+        buildBlock(*slot);
+
+    return slot->get();
 }
 
-int CPU::memoryAccessCycles(uint32_t addr, uint8_t size, bool write) const {
-    (void)size;
-    (void)write;
+int CPU::runBlock(CodeBlock& block) {
+    const bool cached = interconnect._cacheControl.isCacheEnabled() && pc < 0xA0000000;
 
-    uint32_t absAddr = map::maskRegion(addr);
-    uint32_t offset = 0;
+    extraCycles = 0;
 
-    if (map::SCRATCHPAD.contains(absAddr, offset))
-        return 0;
+    int executed = 0;
 
-    if (map::RAM.contains(absAddr, offset))
-        return 3;
+    for (DecodedInstruction& decoded : block.instructions) {
+        const uint32_t addr = pc;
 
-    if (map::BIOS.contains(absAddr, offset))
-        return 5;
+        currentpc = pc;
 
-    if (map::IRQ_CONTROL.contains(absAddr, offset))
-        return 2;
+        delaySlot = branchSlot;
+        branchSlot = false;
 
-    if (map::DMA.contains(absAddr, offset))
-        return 2;
+        delayJumpSlot = jumpSlot;
+        jumpSlot = false;
 
-    if (map::GPU.contains(absAddr, offset))
-        return 2;
+        if (cached) {
+            interconnect.lastICacheMiss = interconnect.instructionCacheMiss(addr, decoded.instruction.op);
 
-    // Making ps1-test/timer be 2 cycles too long,
-    // making this return 0 seems to fix it
-    // Ok apparently duckstation gets 1013 and not 1011
-    if (map::TIMERS.contains(absAddr, offset))
-        return 2;
+            if (interconnect.lastICacheMiss)
+                extraCycles += block.fetchCycles;
+        }
 
-    if (map::CDROM.contains(absAddr, offset))
-        return 2;
+        pc = nextpc;
+        nextpc += 4;
 
-    if (map::MDEC.contains(absAddr, offset))
-        return 2;
+        (this->*decoded.handler)(decoded.instruction);
+        executed++;
 
-    if (map::SPU.contains(absAddr, offset))
-        return 2;
+        // Shift load registers
+        if(loads[0].index != 32)
+            set_reg(loads[0].index, loads[0].value);
 
-    if (map::PADMEMCARD.contains(absAddr, offset))
-        return 2;
+        loads[0] = loads[1];
+        loads[1].index = 32;
 
-    if (map::MEMCONTROL.contains(absAddr, offset))
-        return 2;
+        // Exceptions jump away, and stores may have just rewritten the block
+        if (pc != addr + 4 || interconnect.blockCache.isDirty(block))
+            break;
+    }
 
-    if (map::CACHECONTROL.contains(absAddr, offset))
-        return 2;
+    // Every uncached fetch costs the same, so it's charged at once
+    if (!cached) {
+        interconnect.lastICacheMiss = true;
+        extraCycles += block.fetchCycles * executed;
+    }
 
-    if (map::EXPANSION1.contains(absAddr, offset))
-        return 8;
+    // Added up by 'buildBlock', only a block left early has to count again
+    int cycles = block.cycles;
 
-    if (map::EXPANSION2.contains(absAddr, offset))
-        return 2;
+    if (executed < static_cast<int>(block.instructions.size())) {
+        cycles = 0;
 
-    return 1;
+        for (int n = 0; n < executed; n++)
+            cycles += baseCycles(block.instructions[n].instruction);
+    }
+
+    checkForTTY();
+
+    return cycles + extraCycles;
+}
+
+int CPU::baseCycles(const Instruction& instruction) {
+    switch (instruction.func) {
+        case 0x00:
+            switch (instruction.subfunc) {
+                case 0x18: case 0x19: return 12; // MULT, MULTU
+                case 0x1A: case 0x1B: return 36; // DIV, DIVU
+                default:
+                    // Unknown ones end up in 'decodeAndExecuteSubFunctions'
+                    return specialHandlers[instruction.subfunc] ? 1 : 0;
+            }
+        case 0x12:
+            // GTE commands, the moves take one like everything else
+            if (instruction.op & (1 << 25))
+                return GTE::cycles(instruction.op & 0x3F);
+
+            return 1;
+        default:
+            return 1;
+    }
+}
+
+CodeBlock& CPU::buildBlock(std::unique_ptr<CodeBlock>& slot) {
+    if (!slot)
+        slot = std::make_unique<CodeBlock>();
+
+    CodeBlock& block = *slot;
+
+    uint32_t page = 0, word = 0;
+    BlockCache::locate(pc, page, word);
+
+    block.startPc = pc;
+    block.firstPage = page;
+    block.lastPage = page;
+    block.fetchCycles = instructionFetchCycles(pc);
+    block.cycles = 0;
+    block.instructions.clear();
+    block.code = nullptr;
+
+    bool inDelaySlot = false;
+
+    for (uint32_t addr = pc;; addr += 4) {
+        if (!BlockCache::locate(addr, page, word))
+            break;
+
+        // Only a delay slot is allowed to run into the next page
+        if (page != block.firstPage && !(inDelaySlot && page == block.firstPage + 1))
+            break;
+
+        DecodedInstruction decoded;
+        decoded.instruction = Instruction(interconnect.peekInstruction(addr));
+        decoded.handler = resolveHandler(decoded.instruction);
+
+        block.instructions.push_back(decoded);
+        block.lastPage = page;
+        block.cycles += baseCycles(decoded.instruction);
+
+        if (inDelaySlot)
+            break;
+
+        if (BlockCache::isBranch(decoded.instruction))
+            inDelaySlot = true;
+        else if (BlockCache::endsBlock(decoded.instruction) || block.instructions.size() >= BlockCache::MAX_BLOCK_LENGTH)
+            break;
+    }
+
+    interconnect.blockCache.registerBlock(block);
+
+    return block;
+}
+
+const CPU::OpHandler CPU::primaryHandlers[64] = {
+    /* 00 */ &CPU::decodeAndExecuteSubFunctions, // SPECIAL
+    /* 01 */ &CPU::opbxx,                        // BCOND / REGIMM
+    /* 02 */ &CPU::opj,
+    /* 03 */ &CPU::opjal,
+    /* 04 */ &CPU::opbeq,
+    /* 05 */ &CPU::opbne,
+    /* 06 */ &CPU::opblez,
+    /* 07 */ &CPU::opbqtz,                       // BGTZ
+
+    /* 08 */ &CPU::addi,
+    /* 09 */ &CPU::addiu,
+    /* 0A */ &CPU::opslti,
+    /* 0B */ &CPU::opsltiu,
+    /* 0C */ &CPU::opandi,
+    /* 0D */ &CPU::opori,
+    /* 0E */ &CPU::opxori,
+    /* 0F */ &CPU::oplui,
+
+    /* 10 */ &CPU::opcop0,
+    /* 11 */ &CPU::opcop1,
+    /* 12 */ &CPU::opcop2,
+    /* 13 */ &CPU::opcop3,
+
+    /* 14 */ &CPU::opillegal,
+    /* 15 */ &CPU::opillegal,
+    /* 16 */ &CPU::opillegal,
+    /* 17 */ &CPU::opillegal,
+    /* 18 */ &CPU::opillegal,
+    /* 19 */ &CPU::opillegal,
+    /* 1A */ &CPU::opillegal,
+    /* 1B */ &CPU::opillegal,
+
+    /* 1C */ &CPU::opillegal,
+    /* 1D */ &CPU::opillegal,
+    /* 1E */ &CPU::opillegal,
+    /* 1F */ &CPU::opillegal,
+
+    /* 20 */ &CPU::oplb,
+    /* 21 */ &CPU::oplh,
+    /* 22 */ &CPU::oplwl,
+    /* 23 */ &CPU::oplw,
+    /* 24 */ &CPU::oplbu,
+    /* 25 */ &CPU::oplhu,
+    /* 26 */ &CPU::oplwr,
+    /* 27 */ &CPU::opillegal,
+
+    /* 28 */ &CPU::opsb,
+    /* 29 */ &CPU::opsh,
+    /* 2A */ &CPU::opswl,
+    /* 2B */ &CPU::opsw,
+    /* 2C */ &CPU::opillegal,
+    /* 2D */ &CPU::opillegal,
+    /* 2E */ &CPU::opswr,
+    /* 2F */ &CPU::opillegal,
+
+    /* 30 */ &CPU::oplwc0,
+    /* 31 */ &CPU::oplwc1,
+    /* 32 */ &CPU::oplwc2,
+    /* 33 */ &CPU::oplwc3,
+    /* 34 */ &CPU::opillegal,
+    /* 35 */ &CPU::opillegal,
+    /* 36 */ &CPU::opillegal,
+    /* 37 */ &CPU::opillegal,
+
+    /* 38 */ &CPU::opswc0,
+    /* 39 */ &CPU::opswc1,
+    /* 3A */ &CPU::opswc2,
+    /* 3B */ &CPU::opswc3,
+    /* 3C */ &CPU::opillegal,
+    /* 3D */ &CPU::opillegal,
+    /* 3E */ &CPU::opillegal,
+    /* 3F */ &CPU::opillegal
+};
+
+// Missing entries are illegal instructions
+const CPU::OpHandler CPU::specialHandlers[64] = {
+    /* 00 */ &CPU::opsll,
+    /* 01 */ nullptr,
+    /* 02 */ &CPU::opsrl,
+    /* 03 */ &CPU::opsra,
+    /* 04 */ &CPU::opsllv,
+    /* 05 */ nullptr,
+    /* 06 */ &CPU::opsrlv,
+    /* 07 */ &CPU::opsrav,
+
+    /* 08 */ &CPU::opjr,
+    /* 09 */ &CPU::opjalr,
+    /* 0A */ nullptr,
+    /* 0B */ nullptr,
+    /* 0C */ &CPU::opSyscall,
+    /* 0D */ &CPU::opbreak,
+    /* 0E */ nullptr,
+    /* 0F */ nullptr,
+
+    /* 10 */ &CPU::opmfhi,
+    /* 11 */ &CPU::opmthi,
+    /* 12 */ &CPU::opmflo,
+    /* 13 */ &CPU::opmtlo,
+    /* 14 */ nullptr,
+    /* 15 */ nullptr,
+    /* 16 */ nullptr,
+    /* 17 */ nullptr,
+
+    /* 18 */ &CPU::opmult,
+    /* 19 */ &CPU::opmultu,
+    /* 1A */ &CPU::opdiv,
+    /* 1B */ &CPU::opdivu,
+    /* 1C */ nullptr,
+    /* 1D */ nullptr,
+    /* 1E */ nullptr,
+    /* 1F */ nullptr,
+
+    /* 20 */ &CPU::opadd,
+    /* 21 */ &CPU::opaddu,
+    /* 22 */ &CPU::opsub,
+    /* 23 */ &CPU::opsubu,
+    /* 24 */ &CPU::opand,
+    /* 25 */ &CPU::opor,
+    /* 26 */ &CPU::opxor,
+    /* 27 */ &CPU::opnor,
+
+    /* 28 */ nullptr,
+    /* 29 */ nullptr,
+    /* 2A */ &CPU::opslt,
+    /* 2B */ &CPU::opsltu,
+    /* 2C */ nullptr,
+    /* 2D */ nullptr,
+    /* 2E */ nullptr,
+    /* 2F */ nullptr,
+
+    /* 30 */ nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr,
+    /* 38 */ nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr
+};
+
+int CPU::decodeAndExecuteSubFunctions(Instruction& instruction) {
+    OpHandler handler = specialHandlers[instruction.subfunc];
+    if (handler)
+        return (this->*handler)(instruction);
+
+    opillegal(instruction);
+    printf("Unhandled sub instruction %0x8. Function call was: %x\n", instruction.op, instruction.subfunc);
+    std::cerr << "";
+
+    return 0;
+}
+
+DecodedInstruction& CPU::fetchDecoded(uint32_t addr) {
+    DecodedInstruction* decoded = interconnect.decodeCache.lookup(addr);
+
+    if (decoded && decoded->handler) {
+        // Already decoded, only the I-Cache timing is left to do
+        interconnect.lastICacheMiss = interconnect.instructionCacheMiss(addr, decoded->instruction.op);
+
+        if (interconnect.lastICacheMiss)
+            extraCycles += instructionFetchCycles(addr);
+
+        return *decoded;
+    }
+
+    if (!decoded) {
+        decoded = &uncachedInstruction;
+        decoded->instruction = Instruction(fetchInstruction(addr));
+        decoded->handler = resolveHandler(decoded->instruction);
+
+        return *decoded;
+    }
+
+    // The slot outlives the I-Cache line, so it gets the word in memory.
+    // A line left over from before a store would go stale in here.
+    decoded->instruction = Instruction(interconnect.peekInstruction(addr));
+    decoded->handler = resolveHandler(decoded->instruction);
+
+    interconnect.lastICacheMiss = interconnect.instructionCacheMiss(addr, decoded->instruction.op);
+
+    if (interconnect.lastICacheMiss)
+        extraCycles += instructionFetchCycles(addr);
+
+    return *decoded;
+}
+
+uint32_t CPU::fetchInstruction(uint32_t addr) {
+    uint32_t value = interconnect.loadInstruction(addr);
+
+    if (interconnect.lastICacheMiss)
+        extraCycles += instructionFetchCycles(addr);
+
+    return value;
+}
+
+int CPU::instructionFetchCycles(uint32_t addr) const {
+    return memoryAccessCycles(addr, 4, false);
+}
+
+int CPU::memoryAccessCycles(uint32_t addr, uint8_t size, bool write) const {
+    (void)size;
+    (void)write;
+
+    // Wait states for every page and I/O register live in the page table
+    return interconnect.pageTable.accessCycles(map::maskRegion(addr));
 }
 
 static const char* hangRegName(uint32_t reg) {
@@ -270,6 +557,7 @@ void CPU::recordMemoryAccess(uint32_t addr, uint32_t value, uint8_t size, bool w
 }
 
 void CPU::showDisassembler() {
+#ifndef PSX_HEADLESS
     if (!disasmState.show)
         return;
 
@@ -607,6 +895,7 @@ void CPU::showDisassembler() {
     }
 
     ImGui::End();
+#endif
 }
 
 // TODO; THOSE ARE NOT COMPLETED!
@@ -703,7 +992,7 @@ DisassembledInstruction CPU::disassemble(Instruction& inst, uint32_t address) {
             break;
 
         default:
-            ss << "OP_" << std::hex << inst.func;
+            ss << "OP_" << std::hex << static_cast<uint32_t>(inst.func);
             break;
     }
 
@@ -2482,6 +2771,7 @@ void CPU::reset() {
         regs[i] = 0;
 
     interconnect.reset();
+    recompiler.reset();
     _cop0.reset();
     gte.reset();
 }
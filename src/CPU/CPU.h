@@ -6,7 +6,10 @@
 #include <unordered_map>
 #include <unordered_set>
 
+#include "BlockCache.h"
+#include "DecodeCache.h"
 #include "Instruction.h"
+#include "Recompiler/Recompiler.h"
 #include "../Memory/interconnect.h"
 #include "COP/Stolen/gte/gte.h"
 
@@ -129,12 +132,34 @@ enum Exception {
     Overflow = 0xc,
 };
 
+enum class ExecutionMode {
+    // One instruction at a time
+    Interpreter,
+    // Whole blocks at a time, see 'CPU::executeBlock'
+    CachedBlocks,
+    // Blocks compiled to host code, see 'CPU::executeRecompiled'
+    Recompiler,
+};
+
 class CPU {
     public:
         CPU() : currentpc(0), nextpc(pc + 4), regs() {}
         CPU(Interconnect interconnect) : currentpc(0), nextpc(pc + 4), regs{}, interconnect(std::move(interconnect)) {}
         
+        using OpHandler = int (CPU::*)(Instruction&);
+        
         int executeNextInstruction();
+        
+        // Runs the next instruction or block, depending on 'executionMode'
+        int executeNext();
+        
+        // Runs the cached block of instructions starting at 'pc', only
+        // checking for interrupts and the TTY once for the whole block.
+        // Falls back to 'executeNextInstruction' when it can't.
+        int executeBlock();
+        
+        // Same as 'executeBlock' but runs the block as host code
+        int executeRecompiled();
         inline int decodeAndExecute(Instruction& instruction) {
             // Gotta decode the instructions using the;
             // Playstation R3000 processor
@@ -143,97 +168,41 @@ class CPU {
             // TODO; Handle cycles correctly - Currently all instructions are 2 cycles:
             // https://gist.github.com/allkern/b6ab6db6ac32f1489ad571af6b48ae8b
             
-            static constexpr size_t TABLE_SIZE = 64;
-            
-            using OpHandler = int (CPU::*)(Instruction&);
-            
-            static OpHandler lookupTable[TABLE_SIZE] = {
-                /* 00 */ &CPU::decodeAndExecuteSubFunctions, // SPECIAL
-                /* 01 */ &CPU::opbxx,                        // BCOND / REGIMM
-                /* 02 */ &CPU::opj,
-                /* 03 */ &CPU::opjal,
-                /* 04 */ &CPU::opbeq,
-                /* 05 */ &CPU::opbne,
-                /* 06 */ &CPU::opblez,
-                /* 07 */ &CPU::opbqtz,                       // BGTZ
-                
-                /* 08 */ &CPU::addi,
-                /* 09 */ &CPU::addiu,
-                /* 0A */ &CPU::opslti,
-                /* 0B */ &CPU::opsltiu,
-                /* 0C */ &CPU::opandi,
-                /* 0D */ &CPU::opori,
-                /* 0E */ &CPU::opxori,
-                /* 0F */ &CPU::oplui,
-                
-                /* 10 */ &CPU::opcop0,
-                /* 11 */ &CPU::opcop1,
-                /* 12 */ &CPU::opcop2,
-                /* 13 */ &CPU::opcop3,
-                
-                /* 14 */ &CPU::opillegal,
-                /* 15 */ &CPU::opillegal,
-                /* 16 */ &CPU::opillegal,
-                /* 17 */ &CPU::opillegal,
-                /* 18 */ &CPU::opillegal,
-                /* 19 */ &CPU::opillegal,
-                /* 1A */ &CPU::opillegal,
-                /* 1B */ &CPU::opillegal,
-                
-                /* 1C */ &CPU::opillegal,
-                /* 1D */ &CPU::opillegal,
-                /* 1E */ &CPU::opillegal,
-                /* 1F */ &CPU::opillegal,
-                
-                /* 20 */ &CPU::oplb,
-                /* 21 */ &CPU::oplh,
-                /* 22 */ &CPU::oplwl,
-                /* 23 */ &CPU::oplw,
-                /* 24 */ &CPU::oplbu,
-                /* 25 */ &CPU::oplhu,
-                /* 26 */ &CPU::oplwr,
-                /* 27 */ &CPU::opillegal,
-                
-                /* 28 */ &CPU::opsb,
-                /* 29 */ &CPU::opsh,
-                /* 2A */ &CPU::opswl,
-                /* 2B */ &CPU::opsw,
-                /* 2C */ &CPU::opillegal,
-                /* 2D */ &CPU::opillegal,
-                /* 2E */ &CPU::opswr,
-                /* 2F */ &CPU::opillegal,
-                
-                /* 30 */ &CPU::oplwc0,
-                /* 31 */ &CPU::oplwc1,
-                /* 32 */ &CPU::oplwc2,
-                /* 33 */ &CPU::oplwc3,
-                /* 34 */ &CPU::opillegal,
-                /* 35 */ &CPU::opillegal,
-                /* 36 */ &CPU::opillegal,
-                /* 37 */ &CPU::opillegal,
+            return (this->*resolveHandler(instruction))(instruction);
+        }
+        
+        // Picks the handler for an instruction, looking
+        // through the SPECIAL table if it needs to.
+        static OpHandler resolveHandler(const Instruction& instruction) {
+            if (instruction.func == 0) {
+                OpHandler handler = specialHandlers[instruction.subfunc];
                 
-                /* 38 */ &CPU::opswc0,
-                /* 39 */ &CPU::opswc1,
-                /* 3A */ &CPU::opswc2,
-                /* 3B */ &CPU::opswc3,
-                /* 3C */ &CPU::opillegal,
-                /* 3D */ &CPU::opillegal,
-                /* 3E */ &CPU::opillegal,
-                /* 3F */ &CPU::opillegal
-            };
-            
-            int cycles = 0;
-            uint32_t func = instruction.func;
-            
-            OpHandler handler = lookupTable[func];
-            if (handler)
-                cycles = (this->*handler)(instruction);
+                // Unknown sub functions still go through
+                // 'decodeAndExecuteSubFunctions' so they get reported
+                return handler ? handler : &CPU::decodeAndExecuteSubFunctions;
+            }
             
-            return cycles;
+            return primaryHandlers[instruction.func];
         }
         
+        // What the handler 'resolveHandler' picks returns, without running it.
+        // Memory accesses and fetches go into 'extraCycles' on top.
+        static int baseCycles(const Instruction& instruction);
+        
         int decodeAndExecuteSubFunctions(Instruction& instruction);
         uint32_t fetchInstruction(uint32_t addr);
+        
+        // Fetches the instruction at 'addr' from the decode cache,
+        // decoding and caching it first if it isn't there yet.
+        DecodedInstruction& fetchDecoded(uint32_t addr);
+        
+        // Returns the block starting at 'pc', or nullptr if
+        // the next instruction has to go through the interpreter
+        CodeBlock* enterBlock();
+        int runBlock(CodeBlock& block);
+        
+        // Decodes the block starting at 'pc' into 'slot'
+        CodeBlock& buildBlock(std::unique_ptr<CodeBlock>& slot);
 
         int instructionFetchCycles(uint32_t addr) const;
         int memoryAccessCycles(uint32_t addr, uint8_t size, bool write) const;
@@ -546,6 +515,14 @@ class CPU {
             return (cpu.*Fn)(inst);
         }
         
+        // Indexed by bits [31:26] and bits [5:0] respectively
+        static const OpHandler primaryHandlers[64];
+        static const OpHandler specialHandlers[64];
+        
+        // Used for instructions that are fetched from
+        // outside of RAM and the BIOS, which aren't cached
+        DecodedInstruction uncachedInstruction;
+        
     public:
         // Sets by the current instruction; if a branch occured,
         // and the next instruction will be in the delay slot.
@@ -583,6 +560,8 @@ class CPU {
         uint32_t regs[32];
         
         bool paused = false;
+        
+        ExecutionMode executionMode = ExecutionMode::Interpreter;
         bool stepRequested = false;
         bool stepUntilBranchTakenRequested = false;
         bool stepUntilBranchNotTakenRequested = false;
@@ -594,6 +573,8 @@ class CPU {
         
         COP0 _cop0;
         
+        Recompiler recompiler;
+        
     private:
         //COP2 _cop2;
         GTE gte;
@@ -6,6 +6,7 @@
 #include <iostream>
 #include <sstream>
 #include <string>
+#include <utility>
 #include <vector>
 
 #include "CPU.h"
@@ -42,6 +43,9 @@ struct Runner {
     int failed = 0;
     std::vector<std::string> failures;
 
+    // Goes in front of every failure, tells the execution modes apart
+    std::string prefix;
+
     void expect(const std::string& name, bool ok, const std::string& detail = {}) {
         if (ok) {
             passed++;
@@ -49,7 +53,7 @@ struct Runner {
         }
 
         failed++;
-        failures.push_back(detail.empty() ? name : name + ": " + detail);
+        failures.push_back(prefix + (detail.empty() ? name : name + ": " + detail));
     }
 
     void expectEq(const std::string& name, uint32_t got, uint32_t wanted) {
@@ -63,18 +67,21 @@ struct Runner {
             passed++;
         } catch (const std::exception& e) {
             failed++;
-            failures.push_back(name + ": threw " + e.what());
+            failures.push_back(prefix + name + ": threw " + e.what());
         } catch (...) {
             failed++;
-            failures.push_back(name + ": threw unknown exception");
+            failures.push_back(prefix + name + ": threw unknown exception");
         }
     }
 };
 
+// In the block modes every 'run' is a whole block starting at that
+// instruction, the rest of it NOPs or a branch's delay slot
 struct CpuHarness {
     CPU cpu;
 
-    CpuHarness() {
+    explicit CpuHarness(ExecutionMode mode = ExecutionMode::Interpreter) {
+        cpu.executionMode = mode;
         cpu.branchSlot = false;
         cpu.jumpSlot = false;
         cpu.delaySlot = false;
@@ -102,7 +109,8 @@ struct CpuHarness {
     }
 
     void writeRam32(uint32_t addr, uint32_t value) {
-        cpu.interconnect._ram.store<uint32_t>(addr, value);
+        // Goes through the interconnect so decoded instructions get invalidated
+        cpu.interconnect.store<uint32_t>(addr, value);
     }
 
     uint32_t readRam32(uint32_t addr) {
@@ -120,7 +128,17 @@ struct CpuHarness {
     int run(uint32_t opcode) {
         writeRam32(cpu.pc, opcode);
         writeRam32(cpu.pc + 4, 0);
-        return cpu.executeNextInstruction();
+        return step();
+    }
+
+    int step() {
+        return cpu.executeNext();
+    }
+
+    // Where a branch goes after its delay slot, which
+    // the block modes have already run by then
+    uint32_t target() const {
+        return cpu.branchSlot ? cpu.nextpc : cpu.pc;
     }
 
     void commitLoad() {
@@ -132,16 +150,16 @@ struct CpuHarness {
     }
 };
 
-void expectException(Runner& runner, const std::string& name, uint32_t opcode, Exception cause) {
-    CpuHarness h;
+void expectException(Runner& runner, ExecutionMode mode, const std::string& name, uint32_t opcode, Exception cause) {
+    CpuHarness h(mode);
     h.run(opcode);
     runner.expectEq(name + " cause", h.causeCode(), static_cast<uint32_t>(cause));
     runner.expectEq(name + " pc", h.cpu.pc, ExceptionHandler);
 }
 
-void testSpecial(Runner& runner) {
+void testSpecial(Runner& runner, ExecutionMode mode) {
     runner.test("SPECIAL shifts", [&] {
-        CpuHarness h;
+        CpuHarness h(mode);
         h.cpu.set_reg(2, 0x80000001);
         h.run(r(0, 2, 3, 4, 0x00)); runner.expectEq("sll", h.cpu.reg(3), 0x00000010);
         h.run(r(0, 2, 4, 4, 0x02)); runner.expectEq("srl", h.cpu.reg(4), 0x08000000);
@@ -153,7 +171,7 @@ void testSpecial(Runner& runner) {
     });
 
     runner.test("SPECIAL logic and compare", [&] {
-        CpuHarness h;
+        CpuHarness h(mode);
         h.cpu.set_reg(2, 0xf0f0000f);
         h.cpu.set_reg(3, 0x0ff00ff0);
         h.run(r(2, 3, 4, 0, 0x24)); runner.expectEq("and", h.cpu.reg(4), 0x00f00000);
@@ -167,7 +185,7 @@ void testSpecial(Runner& runner) {
     });
 
     runner.test("SPECIAL arithmetic", [&] {
-        CpuHarness h;
+        CpuHarness h(mode);
         h.cpu.set_reg(2, 10);
         h.cpu.set_reg(3, 3);
         h.run(r(2, 3, 4, 0, 0x20)); runner.expectEq("add", h.cpu.reg(4), 13);
@@ -181,7 +199,7 @@ void testSpecial(Runner& runner) {
     });
 
     runner.test("SPECIAL hi lo", [&] {
-        CpuHarness h;
+        CpuHarness h(mode);
         h.cpu.set_reg(2, 0xfffffff0);
         h.cpu.set_reg(3, 3);
         h.run(r(2, 3, 0, 0, 0x18)); runner.expectEq("mult lo", h.cpu.lo, 0xffffffd0);
@@ -199,26 +217,26 @@ void testSpecial(Runner& runner) {
     });
 
     runner.test("SPECIAL jumps and traps", [&] {
-        CpuHarness h;
+        CpuHarness h(mode);
         h.cpu.set_reg(2, CodeBase + 0x40);
         h.run(r(2, 0, 0, 0, 0x08));
-        runner.expectEq("jr nextpc", h.cpu.nextpc, CodeBase + 0x40);
+        runner.expectEq("jr target", h.target(), CodeBase + 0x40);
 
-        CpuHarness h2;
+        CpuHarness h2(mode);
         h2.cpu.set_reg(2, CodeBase + 0x80);
         h2.run(r(2, 0, 31, 0, 0x09));
         runner.expectEq("jalr link", h2.cpu.reg(31), CodeBase + 8);
-        runner.expectEq("jalr nextpc", h2.cpu.nextpc, CodeBase + 0x80);
+        runner.expectEq("jalr target", h2.target(), CodeBase + 0x80);
 
-        expectException(runner, "syscall", r(0, 0, 0, 0, 0x0c), SysCall);
-        expectException(runner, "break", r(0, 0, 0, 0, 0x0d), Break);
-        expectException(runner, "illegal special", r(0, 0, 0, 0, 0x3f), IllegalInstruction);
+        expectException(runner, mode, "syscall", r(0, 0, 0, 0, 0x0c), SysCall);
+        expectException(runner, mode, "break", r(0, 0, 0, 0, 0x0d), Break);
+        expectException(runner, mode, "illegal special", r(0, 0, 0, 0, 0x3f), IllegalInstruction);
     });
 }
 
-void testImmediateAndBranches(Runner& runner) {
+void testImmediateAndBranches(Runner& runner, ExecutionMode mode) {
     runner.test("Immediate arithmetic and logic", [&] {
-        CpuHarness h;
+        CpuHarness h(mode);
         h.cpu.set_reg(2, 0xfffffff0);
         h.run(i(0x08, 2, 3, 0x000f)); runner.expectEq("addi", h.cpu.reg(3), 0xffffffff);
         h.run(i(0x09, 2, 4, 0x0010)); runner.expectEq("addiu", h.cpu.reg(4), 0);
@@ -231,52 +249,60 @@ void testImmediateAndBranches(Runner& runner) {
     });
 
     runner.test("Jumps", [&] {
-        CpuHarness h;
+        CpuHarness h(mode);
         h.run(j(0x02, 0x80010400));
-        runner.expectEq("j nextpc", h.cpu.nextpc, 0x80010400);
-        CpuHarness h2;
+        runner.expectEq("j target", h.target(), 0x80010400);
+        CpuHarness h2(mode);
         h2.run(j(0x03, 0x80010800));
         runner.expectEq("jal link", h2.cpu.reg(31), CodeBase + 8);
-        runner.expectEq("jal nextpc", h2.cpu.nextpc, 0x80010800);
+        runner.expectEq("jal target", h2.target(), 0x80010800);
     });
 
     runner.test("Branches", [&] {
-        CpuHarness h;
+        CpuHarness h(mode);
         h.cpu.set_reg(2, 5);
         h.cpu.set_reg(3, 5);
-        h.run(i(0x04, 2, 3, 4)); runner.expectEq("beq taken", h.cpu.nextpc, CodeBase + 4 + 16);
-        CpuHarness h2;
+        h.run(i(0x04, 2, 3, 4)); runner.expectEq("beq taken", h.target(), CodeBase + 4 + 16);
+        CpuHarness h2(mode);
         h2.cpu.set_reg(2, 5);
         h2.cpu.set_reg(3, 6);
-        h2.run(i(0x05, 2, 3, 4)); runner.expectEq("bne taken", h2.cpu.nextpc, CodeBase + 4 + 16);
-        CpuHarness h3;
+        h2.run(i(0x05, 2, 3, 4)); runner.expectEq("bne taken", h2.target(), CodeBase + 4 + 16);
+        CpuHarness h3(mode);
         h3.cpu.set_reg(2, 0xffffffff);
-        h3.run(i(0x06, 2, 0, 4)); runner.expectEq("blez taken", h3.cpu.nextpc, CodeBase + 4 + 16);
-        CpuHarness h4;
+        h3.run(i(0x06, 2, 0, 4)); runner.expectEq("blez taken", h3.target(), CodeBase + 4 + 16);
+        CpuHarness h4(mode);
         h4.cpu.set_reg(2, 1);
-        h4.run(i(0x07, 2, 0, 4)); runner.expectEq("bgtz taken", h4.cpu.nextpc, CodeBase + 4 + 16);
-        CpuHarness h5;
+        h4.run(i(0x07, 2, 0, 4)); runner.expectEq("bgtz taken", h4.target(), CodeBase + 4 + 16);
+        CpuHarness h5(mode);
         h5.cpu.set_reg(2, 0xffffffff);
-        h5.run(i(0x01, 2, 0x00, 4)); runner.expectEq("bltz taken", h5.cpu.nextpc, CodeBase + 4 + 16);
-        CpuHarness h6;
+        h5.run(i(0x01, 2, 0x00, 4)); runner.expectEq("bltz taken", h5.target(), CodeBase + 4 + 16);
+        CpuHarness h6(mode);
         h6.cpu.set_reg(2, 0);
-        h6.run(i(0x01, 2, 0x01, 4)); runner.expectEq("bgez taken", h6.cpu.nextpc, CodeBase + 4 + 16);
-        CpuHarness h7;
+        h6.run(i(0x01, 2, 0x01, 4)); runner.expectEq("bgez taken", h6.target(), CodeBase + 4 + 16);
+        CpuHarness h7(mode);
         h7.cpu.set_reg(2, 0xffffffff);
         h7.run(i(0x01, 2, 0x10, 4));
         runner.expectEq("bltzal link", h7.cpu.reg(31), CodeBase + 8);
-        runner.expectEq("bltzal target", h7.cpu.nextpc, CodeBase + 4 + 16);
-        CpuHarness h8;
+        runner.expectEq("bltzal target", h7.target(), CodeBase + 4 + 16);
+        CpuHarness h8(mode);
         h8.cpu.set_reg(2, 0);
         h8.run(i(0x01, 2, 0x11, 4));
         runner.expectEq("bgezal link", h8.cpu.reg(31), CodeBase + 8);
-        runner.expectEq("bgezal target", h8.cpu.nextpc, CodeBase + 4 + 16);
+        runner.expectEq("bgezal target", h8.target(), CodeBase + 4 + 16);
+        CpuHarness h9(mode);
+        h9.cpu.set_reg(2, 5);
+        h9.run(i(0x04, 2, 0, 4)); runner.expectEq("beq not taken", h9.target(), CodeBase + 8);
+        CpuHarness h10(mode);
+        h10.cpu.set_reg(2, 1);
+        h10.run(i(0x01, 2, 0x10, 4));
+        runner.expectEq("bltzal not taken link", h10.cpu.reg(31), CodeBase + 8);
+        runner.expectEq("bltzal not taken", h10.target(), CodeBase + 8);
     });
 }
 
-void testMemory(Runner& runner) {
+void testMemory(Runner& runner, ExecutionMode mode) {
     runner.test("Loads and stores", [&] {
-        CpuHarness h;
+        CpuHarness h(mode);
         h.cpu.set_reg(1, DataBase);
         h.cpu.set_reg(2, 0x88776655);
         h.run(i(0x2b, 1, 2, 0)); runner.expectEq("sw", h.readRam32(DataBase), 0x88776655);
@@ -294,7 +320,7 @@ void testMemory(Runner& runner) {
     });
 
     runner.test("Unaligned word helpers", [&] {
-        CpuHarness h;
+        CpuHarness h(mode);
         h.cpu.set_reg(1, DataBase);
         h.cpu.set_reg(2, 0x11223344);
         h.writeRam32(DataBase, 0xaabbccdd);
@@ -312,15 +338,67 @@ void testMemory(Runner& runner) {
         runner.expectEq("swr", h.readRam32(DataBase + 12), 0x3344ccdd);
     });
 
-    expectException(runner, "lw misaligned", i(0x23, 1, 2, 1), LoadAddressError);
-    expectException(runner, "sw misaligned", i(0x2b, 1, 2, 1), StoreAddressError);
-    expectException(runner, "lh misaligned", i(0x21, 1, 2, 1), LoadAddressError);
-    expectException(runner, "sh misaligned", i(0x29, 1, 2, 1), StoreAddressError);
+    runner.test("Self modifying code", [&] {
+        CpuHarness h(mode);
+        h.run(i(0x09, 0, 2, 1));
+        runner.expectEq("first decode", h.cpu.reg(2), 1);
+
+        // Overwrite the instruction that just ran and run it again
+        h.cpu.set_reg(1, CodeBase);
+        h.cpu.set_reg(3, i(0x09, 0, 2, 2));
+        h.run(i(0x2b, 1, 3, 0));
+        h.cpu.pc = CodeBase;
+        h.cpu.nextpc = CodeBase + 4;
+        h.step();
+        runner.expectEq("decode after store", h.cpu.reg(2), 2);
+    });
+
+    runner.test("Self modifying code with the I-Cache on", [&] {
+        CpuHarness h(mode);
+        h.cpu.interconnect._cacheControl = CacheControl(0x800);
+        h.run(i(0x09, 0, 2, 1));
+        runner.expect("first fetch misses", h.cpu.interconnect.lastICacheMiss);
+
+        // The I-Cache line still holds the old word, the decoded one mustn't
+        h.writeRam32(CodeBase, i(0x09, 0, 2, 2));
+        h.cpu.pc = CodeBase;
+        h.cpu.nextpc = CodeBase + 4;
+        h.step();
+        runner.expectEq("decode after store", h.cpu.reg(2), 2);
+        runner.expect("second fetch hits", !h.cpu.interconnect.lastICacheMiss);
+    });
+
+    runner.test("Page table", [&] {
+        CpuHarness h(mode);
+        Interconnect& bus = h.cpu.interconnect;
+
+        // KSEG0 and a KSEG1 mirror 6MB further up land on the same word
+        bus.store<uint32_t>(DataBase, 0x12345678);
+        runner.expectEq("ram mirror", bus.load<uint32_t>(DataBase + 0x20600000), 0x12345678);
+
+        bus.store<uint16_t>(0x1F800010, 0xBEEF);
+        runner.expectEq("scratchpad", bus.load<uint16_t>(0x1F800010), 0xBEEF);
+
+        bus.store<uint32_t>(0x1F801074, 0x5);
+        runner.expectEq("irq mask", bus.load<uint32_t>(0x1F801074), 0x5);
+
+        runner.expectEq("ram cycles", h.cpu.memoryAccessCycles(0x80000000, 4, false), 3);
+        runner.expectEq("scratchpad cycles", h.cpu.memoryAccessCycles(0x1F800000, 4, false), 0);
+        runner.expectEq("timer cycles", h.cpu.memoryAccessCycles(0x1F801100, 4, false), 2);
+        runner.expectEq("ram size cycles", h.cpu.memoryAccessCycles(0x1F801060, 4, false), 1);
+        runner.expectEq("expansion 1 cycles", h.cpu.memoryAccessCycles(0x1F000000, 1, false), 8);
+        runner.expectEq("cache control cycles", h.cpu.memoryAccessCycles(0xFFFE0130, 4, false), 2);
+    });
+
+    expectException(runner, mode, "lw misaligned", i(0x23, 1, 2, 1), LoadAddressError);
+    expectException(runner, mode, "sw misaligned", i(0x2b, 1, 2, 1), StoreAddressError);
+    expectException(runner, mode, "lh misaligned", i(0x21, 1, 2, 1), LoadAddressError);
+    expectException(runner, mode, "sh misaligned", i(0x29, 1, 2, 1), StoreAddressError);
 }
 
-void testCoprocessors(Runner& runner) {
+void testCoprocessors(Runner& runner, ExecutionMode mode) {
     runner.test("COP0", [&] {
-        CpuHarness h;
+        CpuHarness h(mode);
         h.cpu.set_reg(2, 0x12345678);
         h.run(cop(0x10, 0x04, 2, 12)); runner.expectEq("mtc0 sr", h.cpu._cop0.sr, 0x12345678);
         h.run(cop(0x10, 0x00, 3, 12)); h.commitLoad(); runner.expectEq("mfc0 sr", h.cpu.reg(3), 0x12345678);
@@ -329,7 +407,7 @@ void testCoprocessors(Runner& runner) {
     });
 
     runner.test("COP2 data and control moves", [&] {
-        CpuHarness h;
+        CpuHarness h(mode);
         h.cpu.set_reg(2, 0x12345678);
         h.run(cop(0x12, 0x04, 2, 0));
         h.run(cop(0x12, 0x00, 3, 0)); h.commitLoad();
@@ -341,7 +419,7 @@ void testCoprocessors(Runner& runner) {
     });
 
     runner.test("LWC2 SWC2", [&] {
-        CpuHarness h;
+        CpuHarness h(mode);
         h.cpu.set_reg(1, DataBase);
         h.writeRam32(DataBase, 0xcafebabe);
         h.run(i(0x32, 1, 0, 0));
@@ -356,24 +434,174 @@ void testCoprocessors(Runner& runner) {
         };
 
         for (uint8_t command : commands) {
-            CpuHarness h;
+            CpuHarness h(mode);
             h.cpu.set_reg(2, 0x00001000);
             h.run(cop(0x12, 0x06, 2, 26));
             h.run(0x4a000000 | command);
         }
     });
 
-    expectException(runner, "COP1", cop(0x11, 0, 0, 0), CoprocessorError);
-    expectException(runner, "COP3", cop(0x13, 0, 0, 0), CoprocessorError);
-    expectException(runner, "LWC0", i(0x30, 0, 0, 0), CoprocessorError);
-    expectException(runner, "LWC1", i(0x31, 0, 0, 0), CoprocessorError);
-    expectException(runner, "LWC3", i(0x33, 0, 0, 0), CoprocessorError);
-    expectException(runner, "SWC0", i(0x38, 0, 0, 0), CoprocessorError);
-    expectException(runner, "SWC1", i(0x39, 0, 0, 0), CoprocessorError);
-    expectException(runner, "SWC3", i(0x3b, 0, 0, 0), CoprocessorError);
+    expectException(runner, mode, "COP1", cop(0x11, 0, 0, 0), CoprocessorError);
+    expectException(runner, mode, "COP3", cop(0x13, 0, 0, 0), CoprocessorError);
+    expectException(runner, mode, "LWC0", i(0x30, 0, 0, 0), CoprocessorError);
+    expectException(runner, mode, "LWC1", i(0x31, 0, 0, 0), CoprocessorError);
+    expectException(runner, mode, "LWC3", i(0x33, 0, 0, 0), CoprocessorError);
+    expectException(runner, mode, "SWC0", i(0x38, 0, 0, 0), CoprocessorError);
+    expectException(runner, mode, "SWC1", i(0x39, 0, 0, 0), CoprocessorError);
+    expectException(runner, mode, "SWC3", i(0x3b, 0, 0, 0), CoprocessorError);
 }
 
-void testIllegalPrimaryOpcodes(Runner& runner) {
+// Runs from CodeBase until 'endPc' is reached, or gives up after 'maxSteps'.
+// Returns the cycles it took.
+int runUntil(CpuHarness& h, ExecutionMode mode, uint32_t endPc, int maxSteps = 64) {
+    h.cpu.executionMode = mode;
+
+    int cycles = 0;
+
+    for (int n = 0; n < maxSteps && h.cpu.pc != endPc; n++)
+        cycles += h.cpu.executeNext();
+
+    return cycles;
+}
+
+void testBlocks(Runner& runner, ExecutionMode mode, const std::string& prefix) {
+    runner.test(prefix + " loop", [&] {
+        CpuHarness h;
+        h.writeRam32(CodeBase + 0, i(0x09, 0, 2, 0));
+        h.writeRam32(CodeBase + 4, i(0x09, 2, 2, 1));
+        h.writeRam32(CodeBase + 8, i(0x05, 2, 4, 0xfffe));
+        h.writeRam32(CodeBase + 12, 0);
+        h.writeRam32(CodeBase + 16, i(0x09, 0, 5, 7));
+        h.writeRam32(CodeBase + 20, j(0x02, CodeBase + 20));
+        h.writeRam32(CodeBase + 24, 0);
+        h.cpu.set_reg(4, 5);
+
+        runUntil(h, mode, CodeBase + 20);
+
+        runner.expectEq(prefix + " loop counter", h.cpu.reg(2), 5);
+        runner.expectEq(prefix + " after loop", h.cpu.reg(5), 7);
+        runner.expectEq(prefix + " pc", h.cpu.pc, CodeBase + 20);
+    });
+
+    runner.test(prefix + " self modifying code", [&] {
+        CpuHarness h;
+        h.writeRam32(CodeBase + 0, i(0x2b, 1, 3, 8));
+        h.writeRam32(CodeBase + 4, i(0x09, 0, 2, 1));
+        h.writeRam32(CodeBase + 8, i(0x09, 0, 2, 1));
+        h.writeRam32(CodeBase + 12, j(0x02, CodeBase + 12));
+        h.writeRam32(CodeBase + 16, 0);
+        h.cpu.set_reg(1, CodeBase);
+        h.cpu.set_reg(3, i(0x09, 0, 2, 2));
+
+        // The store rewrites a later instruction of the block it's in
+        runUntil(h, mode, CodeBase + 12);
+
+        runner.expectEq(prefix + " rewritten instruction", h.cpu.reg(2), 2);
+        runner.expectEq(prefix + " pc", h.cpu.pc, CodeBase + 12);
+    });
+
+    runner.test(prefix + " matches interpreter", [&] {
+        // Load delays, a taken and a not taken branch, a jal/jr pair,
+        // inline ALU ops and an overflow exception at the end
+        const uint32_t program[] = {
+            i(0x0f, 0, 1, 0x8002),           // lui   $1, 0x8002
+            i(0x09, 0, 2, 0x1234),           // addiu $2, $0, 0x1234
+            i(0x2b, 1, 2, 0),                // sw    $2, 0($1)
+            i(0x23, 1, 3, 0),                // lw    $3, 0($1)
+            r(0, 3, 4, 0, 0x21),             // addu  $4, $0, $3  (old $3)
+            r(0, 3, 5, 0, 0x21),             // addu  $5, $0, $3  (loaded $3)
+            i(0x23, 1, 6, 0),                // lw    $6, 0($1)
+            i(0x09, 0, 6, 5),                // addiu $6, $0, 5   (cancels the load)
+            i(0x04, 0, 0, 2),                // beq   $0, $0, +2
+            r(0, 6, 7, 4, 0x00),             // sll   $7, $6, 4   (delay slot)
+            i(0x09, 0, 8, 1),                // addiu $8, $0, 1   (skipped)
+            i(0x05, 0, 0, 1),                // bne   $0, $0, +1
+            r(6, 7, 9, 0, 0x2a),             // slt   $9, $6, $7
+            j(0x03, CodeBase + 0x44),        // jal   CodeBase + 0x44
+            i(0x0a, 6, 10, 0xffff),          // slti  $10, $6, -1
+            r(11, 11, 13, 0, 0x20),          // add   $13, $11, $11 (overflows)
+            0,
+            i(0x0f, 0, 11, 0x7fff),          // lui   $11, 0x7fff
+            i(0x0d, 11, 11, 0xffff),         // ori   $11, $11, 0xffff
+            r(31, 0, 0, 0, 0x08),            // jr    $31
+            r(7, 6, 12, 0, 0x27),            // nor   $12, $7, $6
+        };
+
+        CpuHarness interpreted, compiled;
+
+        for (size_t n = 0; n < sizeof(program) / sizeof(program[0]); n++) {
+            interpreted.writeRam32(CodeBase + n * 4, program[n]);
+            compiled.writeRam32(CodeBase + n * 4, program[n]);
+        }
+
+        runUntil(interpreted, ExecutionMode::Interpreter, ExceptionHandler);
+        runUntil(compiled, mode, ExceptionHandler);
+
+        runner.expectEq(prefix + " reached handler", compiled.cpu.pc, ExceptionHandler);
+        runner.expectEq(prefix + " cause", compiled.causeCode(), static_cast<uint32_t>(Overflow));
+        runner.expectEq(prefix + " epc", compiled.cpu._cop0.epc, interpreted.cpu._cop0.epc);
+
+        for (uint32_t reg = 1; reg < 32; reg++)
+            runner.expectEq(prefix + " $" + std::to_string(reg), compiled.cpu.reg(reg), interpreted.cpu.reg(reg));
+    });
+
+    runner.test(prefix + " cycles match interpreter", [&] {
+        // Multiply, divide, a GTE command and memory accesses, then a jump
+        // away so both stop at the same place
+        const uint32_t program[] = {
+            i(0x09, 0, 1, 7),                // addiu $1, $0, 7
+            i(0x09, 0, 2, 3),                // addiu $2, $0, 3
+            r(1, 2, 0, 0, 0x18),             // mult  $1, $2
+            r(1, 2, 0, 0, 0x1a),             // div   $1, $2
+            r(0, 0, 3, 0, 0x12),             // mflo  $3
+            0x4a000006,                      // nclip
+            i(0x0f, 0, 4, 0x8002),           // lui   $4, 0x8002
+            i(0x2b, 4, 3, 0),                // sw    $3, 0($4)
+            i(0x23, 4, 5, 0),                // lw    $5, 0($4)
+            j(0x02, CodeBase + 0x40),        // j     CodeBase + 0x40
+            0,
+        };
+
+        CpuHarness interpreted, blocks;
+
+        for (size_t n = 0; n < sizeof(program) / sizeof(program[0]); n++) {
+            interpreted.writeRam32(CodeBase + n * 4, program[n]);
+            blocks.writeRam32(CodeBase + n * 4, program[n]);
+        }
+
+        const int wanted = runUntil(interpreted, ExecutionMode::Interpreter, CodeBase + 0x40);
+
+        runner.expectEq(prefix + " cycles", runUntil(blocks, mode, CodeBase + 0x40), wanted);
+        runner.expectEq(prefix + " $3", blocks.cpu.reg(3), 2);
+    });
+
+    runner.test(prefix + " unhandled load", [&] {
+        CpuHarness h;
+        h.writeRam32(CodeBase + 0, i(0x0f, 0, 1, 0x1f90));
+        h.writeRam32(CodeBase + 4, i(0x23, 1, 2, 0));
+        h.writeRam32(CodeBase + 8, j(0x02, CodeBase + 8));
+        h.writeRam32(CodeBase + 12, 0);
+
+        bool threw = false;
+
+        try {
+            runUntil(h, mode, CodeBase + 8);
+        } catch (const std::exception&) {
+            threw = true;
+        }
+
+        runner.expect(prefix + " load error reaches the caller", threw);
+    });
+}
+
+void testBlockCache(Runner& runner) {
+    testBlocks(runner, ExecutionMode::CachedBlocks, "Block cache");
+
+    if (Recompiler().isSupported())
+        testBlocks(runner, ExecutionMode::Recompiler, "Recompiler");
+}
+
+void testIllegalPrimaryOpcodes(Runner& runner, ExecutionMode mode) {
     const uint8_t opcodes[] = {
         0x14, 0x15, 0x16, 0x17, 0x18, 0x19, 0x1a, 0x1b,
         0x1c, 0x1d, 0x1e, 0x1f, 0x27, 0x2c, 0x2d, 0x2f,
@@ -381,7 +609,7 @@ void testIllegalPrimaryOpcodes(Runner& runner) {
     };
 
     for (uint8_t opcode : opcodes) {
-        expectException(runner, "illegal primary " + std::to_string(opcode), i(opcode, 0, 0, 0), IllegalInstruction);
+        expectException(runner, mode, "illegal primary " + std::to_string(opcode), i(opcode, 0, 0, 0), IllegalInstruction);
     }
 }
 }
@@ -389,11 +617,28 @@ void testIllegalPrimaryOpcodes(Runner& runner) {
 bool CpuInstructionTests::runAll() {
     Runner runner;
 
-    testSpecial(runner);
-    testImmediateAndBranches(runner);
-    testMemory(runner);
-    testCoprocessors(runner);
-    testIllegalPrimaryOpcodes(runner);
+    // Every instruction test runs through blocks and host code as well
+    std::vector<std::pair<ExecutionMode, std::string>> modes = {
+        {ExecutionMode::Interpreter, ""},
+        {ExecutionMode::CachedBlocks, "Block cache: "},
+    };
+
+    if (Recompiler().isSupported())
+        modes.emplace_back(ExecutionMode::Recompiler, "Recompiler: ");
+
+    for (const auto& [mode, prefix] : modes) {
+        runner.prefix = prefix;
+
+        testSpecial(runner, mode);
+        testImmediateAndBranches(runner, mode);
+        testMemory(runner, mode);
+        testCoprocessors(runner, mode);
+        testIllegalPrimaryOpcodes(runner, mode);
+    }
+
+    runner.prefix.clear();
+
+    testBlockCache(runner);
 
     std::cerr << "CPU instruction tests: " << runner.passed << " passed, " << runner.failed << " failed\n";
 
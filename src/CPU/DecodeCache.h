@@ -0,0 +1,90 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <memory>
+
+#include "Instruction.h"
+#include "../Memory/Range.h"
+
+class CPU;
+
+// An instruction word that has already been decoded,
+// along with the handler that will execute it.
+struct DecodedInstruction {
+    using Handler = int (CPU::*)(Instruction&);
+
+    Instruction instruction{0};
+
+    // Null when the slot is empty or was invalidated
+    Handler handler = nullptr;
+};
+
+/**
+ * Keeps a decoded copy of every instruction word executed from RAM or the BIOS,
+ * so the CPU doesn't have to fetch, decode and look up the handler each time.
+ *
+ * Slots are allocated a 4KB page at a time the first time code runs from it.
+ * Any store into RAM drops the word it touched, so self modifying code,
+ * DMA uploads and EXE loading are always picked up.
+ */
+class DecodeCache {
+    public:
+        static constexpr uint32_t PAGE_SHIFT     = 12;
+        static constexpr uint32_t WORDS_PER_PAGE = (1u << PAGE_SHIFT) / 4;
+
+        // Only the first 2MB of RAM are real, the rest are mirrors
+        static constexpr uint32_t RAM_MASK   = 0x1FFFFF;
+        static constexpr uint32_t RAM_PAGES  = (RAM_MASK + 1) >> PAGE_SHIFT;
+        static constexpr uint32_t BIOS_PAGES = (512 * 1024) >> PAGE_SHIFT;
+
+        // Returns the slot for the word at 'addr', or nullptr if
+        // the address isn't in RAM or the BIOS. The slot may be empty.
+        inline DecodedInstruction* lookup(uint32_t addr) {
+            uint32_t absAddr = map::maskRegion(addr);
+            uint32_t offset = 0;
+
+            if (map::RAM.contains(absAddr, offset))
+                return slot(ramPages, offset & RAM_MASK);
+
+            if (map::BIOS.contains(absAddr, offset))
+                return slot(biosPages, offset);
+
+            return nullptr;
+        }
+
+        // Drops the word containing the given RAM offset
+        inline void invalidateRam(uint32_t offset) {
+            offset &= RAM_MASK;
+
+            Page* page = ramPages[offset >> PAGE_SHIFT].get();
+
+            if (page)
+                (*page)[(offset >> 2) & (WORDS_PER_PAGE - 1)].handler = nullptr;
+        }
+
+        void reset() {
+            for (auto& page : ramPages)
+                page.reset();
+
+            for (auto& page : biosPages)
+                page.reset();
+        }
+
+    private:
+        using Page = std::array<DecodedInstruction, WORDS_PER_PAGE>;
+
+        template<size_t N>
+        static DecodedInstruction* slot(std::array<std::unique_ptr<Page>, N>& pages, uint32_t offset) {
+            std::unique_ptr<Page>& page = pages[offset >> PAGE_SHIFT];
+
+            if (!page)
+                page = std::make_unique<Page>();
+
+            return &(*page)[(offset >> 2) & (WORDS_PER_PAGE - 1)];
+        }
+
+    private:
+        std::array<std::unique_ptr<Page>, RAM_PAGES> ramPages;
+        std::array<std::unique_ptr<Page>, BIOS_PAGES> biosPages;
+};
@@ -6,12 +6,12 @@
 class Instruction {
     public:
         Instruction(uint32_t op) : op(op) {
-            func    = (op >> 26) & 0x3F;
-            rs      = (op >> 21) & 0x1F;
-            rt      = (op >> 16) & 0x1F;
-            rd      = (op >> 11) & 0x1F;
-            shamt   = (op >> 6)  & 0x1F;
-            subfunc =  op        & 0x3F;
+            func    = static_cast<uint8_t>((op >> 26) & 0x3F);
+            rs      = static_cast<uint8_t>((op >> 21) & 0x1F);
+            rt      = static_cast<uint8_t>((op >> 16) & 0x1F);
+            rd      = static_cast<uint8_t>((op >> 11) & 0x1F);
+            shamt   = static_cast<uint8_t>((op >> 6)  & 0x1F);
+            subfunc = static_cast<uint8_t>( op        & 0x3F);
             
             imm     =  op & 0xFFFF;
             imm_se  = (int16_t)(op & 0xFFFF);
@@ -75,14 +75,16 @@ class Instruction {
         uint32_t op;
         
     public:
-        uint32_t func;        // bits 31:26
-        uint32_t rs;          // bits 25:21
-        uint32_t rt;          // bits 20:16
-        uint32_t rd;          // bits 15:11
-        uint32_t shamt;       // bits 10:6
-        uint32_t subfunc;     // bits 5:0
+        // The register and function fields are kept as bytes so a decoded
+        // instruction stays small enough to be cached for every word.
+        uint8_t func;         // bits 31:26
+        uint8_t rs;           // bits 25:21
+        uint8_t rt;           // bits 20:16
+        uint8_t rd;           // bits 15:11
+        uint8_t shamt;        // bits 10:6
+        uint8_t subfunc;      // bits 5:0
         
-        uint32_t imm;         // zero-extended imm
         int16_t imm_se;       // sign-extended imm
+        uint32_t imm;         // zero-extended imm
         uint32_t jump;        // 26-bit jump target
 };
@@ -0,0 +1,687 @@
+#include "Recompiler.h"
+
+#include <cstddef>
+#include <vector>
+
+#include "X64Emitter.h"
+#include "../CPU.h"
+
+#if defined(__x86_64__) && !defined(_WIN32)
+#include <sys/mman.h>
+#define RECOMPILER_X64_SYSV
+#endif
+
+namespace {
+    // Instructions that can't raise an exception or touch memory,
+    // these get emitted inline instead of calling their handler.
+    bool canInline(const Instruction& instruction) {
+        if (instruction.func == 0) {
+            switch (instruction.subfunc) {
+                case 0x00: // SLL
+                case 0x02: // SRL
+                case 0x03: // SRA
+                case 0x21: // ADDU
+                case 0x23: // SUBU
+                case 0x24: // AND
+                case 0x25: // OR
+                case 0x26: // XOR
+                case 0x27: // NOR
+                case 0x2A: // SLT
+                case 0x2B: // SLTU
+                    return true;
+                default:
+                    return false;
+            }
+        }
+
+        switch (instruction.func) {
+            case 0x09: // ADDIU
+            case 0x0A: // SLTI
+            case 0x0B: // SLTIU
+            case 0x0C: // ANDI
+            case 0x0D: // ORI
+            case 0x0E: // XORI
+            case 0x0F: // LUI
+                return true;
+            default:
+                return false;
+        }
+    }
+
+    // How an instruction gets compiled
+    enum class Emit {
+        // Calls the handler
+        Handler,
+        // Done inline, see 'canInline'
+        Inline,
+        // LB, LH, LW, LBU and LHU, inline for RAM
+        Load,
+        // SB, SH and SW, inline for RAM
+        Store,
+        // Branches and jumps, inline unless they sit in a delay slot
+        // and their target depends on the branch before them
+        Branch,
+    };
+
+    Emit classify(const Instruction& instruction, bool inDelaySlot) {
+        if (canInline(instruction))
+            return Emit::Inline;
+
+        if (BlockCache::isBranch(instruction))
+            return inDelaySlot ? Emit::Handler : Emit::Branch;
+
+        switch (instruction.func) {
+            case 0x20: case 0x21: case 0x23: case 0x24: case 0x25:
+                return Emit::Load;
+            case 0x28: case 0x29: case 0x2B:
+                return Emit::Store;
+            default:
+                return Emit::Handler;
+        }
+    }
+
+    // Generated code walks the page table itself
+    static_assert(sizeof(map::Page) == 16 && offsetof(map::Page, host) == 0);
+
+    class BlockCompiler {
+        public:
+            BlockCompiler(X64Emitter& emitter, CPU& cpu, const void* invalidateCode)
+                : e(emitter), cpu(cpu), invalidateCode(invalidateCode) {}
+
+            // Offset of one of the CPU's members from rbx
+            int32_t disp(const void* member) const {
+                return static_cast<int32_t>(static_cast<const uint8_t*>(member) - reinterpret_cast<const uint8_t*>(&cpu));
+            }
+
+            int32_t regDisp(uint32_t index) const {
+                return disp(&cpu.regs[index]);
+            }
+
+            void loadReg(X64Emitter::Reg reg, uint32_t index) {
+                if (index == 0)
+                    e.zero(reg);
+                else
+                    e.movRegMem(reg, regDisp(index));
+            }
+
+            // Same as 'CPU::set_reg' with the value in eax
+            void storeReg(uint32_t index) {
+                if (index == 0)
+                    return;
+
+                e.movMemReg(regDisp(index), X64Emitter::EAX);
+                cancelLoad(index);
+            }
+
+            // Writing a register cancels a pending load to it
+            void cancelLoad(uint32_t index) {
+                if (load0Empty)
+                    return;
+
+                X64Emitter::Label skip;
+
+                e.cmpMemImm32(disp(&cpu.loads[0].index), index);
+                e.jne(skip);
+                e.movMemImm32(disp(&cpu.loads[0].index), 32);
+                e.bind(skip);
+            }
+
+            // Same as 'CPU::setLoad' with the value in eax
+            void setLoad(uint32_t index) {
+                if (index == 0)
+                    return;
+
+                cancelLoad(index);
+
+                e.movMemImm32(disp(&cpu.loads[1].index), index);
+                e.movMemReg(disp(&cpu.loads[1].value), X64Emitter::EAX);
+            }
+
+            void emitInline(const Instruction& instruction) {
+                const uint32_t rs = instruction.rs;
+                const uint32_t rt = instruction.rt;
+                const uint32_t rd = instruction.rd;
+                const uint32_t imm = instruction.imm;
+                const auto immSe = static_cast<uint32_t>(static_cast<int32_t>(instruction.imm_se));
+
+                if (instruction.func == 0) {
+                    // Nothing to do for NOPs and anything else writing to $zero
+                    if (rd == 0)
+                        return;
+
+                    switch (instruction.subfunc) {
+                        case 0x00:
+                            loadReg(X64Emitter::EAX, rt);
+                            if (instruction.shamt)
+                                e.shl(X64Emitter::EAX, instruction.shamt);
+                            break;
+                        case 0x02:
+                            loadReg(X64Emitter::EAX, rt);
+                            if (instruction.shamt)
+                                e.shr(X64Emitter::EAX, instruction.shamt);
+                            break;
+                        case 0x03:
+                            loadReg(X64Emitter::EAX, rt);
+                            if (instruction.shamt)
+                                e.sar(X64Emitter::EAX, instruction.shamt);
+                            break;
+                        default:
+                            loadReg(X64Emitter::EAX, rs);
+                            loadReg(X64Emitter::ECX, rt);
+
+                            switch (instruction.subfunc) {
+                                case 0x21: e.add(X64Emitter::EAX, X64Emitter::ECX); break;
+                                case 0x23: e.sub(X64Emitter::EAX, X64Emitter::ECX); break;
+                                case 0x24: e.and_(X64Emitter::EAX, X64Emitter::ECX); break;
+                                case 0x25: e.or_(X64Emitter::EAX, X64Emitter::ECX); break;
+                                case 0x26: e.xor_(X64Emitter::EAX, X64Emitter::ECX); break;
+                                case 0x27:
+                                    e.or_(X64Emitter::EAX, X64Emitter::ECX);
+                                    e.not_(X64Emitter::EAX);
+                                    break;
+                                case 0x2A:
+                                    e.cmp(X64Emitter::EAX, X64Emitter::ECX);
+                                    e.setlEax();
+                                    break;
+                                case 0x2B:
+                                    e.cmp(X64Emitter::EAX, X64Emitter::ECX);
+                                    e.setbEax();
+                                    break;
+                                default:
+                                    break;
+                            }
+                            break;
+                    }
+
+                    storeReg(rd);
+                    return;
+                }
+
+                if (rt == 0)
+                    return;
+
+                switch (instruction.func) {
+                    case 0x09: loadReg(X64Emitter::EAX, rs); e.addImm(immSe); break;
+                    case 0x0A:
+                        loadReg(X64Emitter::EAX, rs);
+                        e.cmpImm(immSe);
+                        e.setlEax();
+                        break;
+                    case 0x0B:
+                        loadReg(X64Emitter::EAX, rs);
+                        e.cmpImm(immSe);
+                        e.setbEax();
+                        break;
+                    case 0x0C: loadReg(X64Emitter::EAX, rs); e.andImm(imm); break;
+                    case 0x0D: loadReg(X64Emitter::EAX, rs); e.orImm(imm); break;
+                    case 0x0E: loadReg(X64Emitter::EAX, rs); e.xorImm(imm); break;
+                    case 0x0F: e.movRegImm(X64Emitter::EAX, imm << 16); break;
+                    default: break;
+                }
+
+                storeReg(rt);
+            }
+
+            // Leaves 'reg(rs) + imm' in eax, jumps to 'slow' if it isn't
+            // aligned to 'size' or isn't in RAM. Otherwise adds the page's
+            // wait states and leaves the host pointer in rdx, and the
+            // physical address in eax.
+            void ramAddress(const Instruction& instruction, uint8_t size, X64Emitter::Label& slow) {
+                loadReg(X64Emitter::EAX, instruction.rs);
+
+                if (instruction.imm_se)
+                    e.addImm(static_cast<uint32_t>(static_cast<int32_t>(instruction.imm_se)));
+
+                if (size > 1) {
+                    e.testImm(size - 1u);
+                    e.jne(slow);
+                }
+
+                // KUSEG's first 512MB, KSEG0 and KSEG1 are the only ones
+                // 'map::maskRegion' masks down to 512MB
+                e.movRegReg(X64Emitter::ECX, X64Emitter::EAX);
+                e.shr(X64Emitter::ECX, 29);
+                e.movRegImm(X64Emitter::EDX, 0x31);
+                e.bt(X64Emitter::EDX, X64Emitter::ECX);
+                e.jae(slow);
+
+                e.andRegImm(X64Emitter::EAX, 0x1FFFFFFF);
+
+                // rdx = &pages[eax >> PAGE_SHIFT]
+                e.movRegReg(X64Emitter::ECX, X64Emitter::EAX);
+                e.shr(X64Emitter::ECX, PageTable::PAGE_SHIFT);
+                e.shl(X64Emitter::ECX, 4);
+                e.movRdxImm64(cpu.interconnect.pageTable.data());
+                e.addRdxRcx();
+
+                // RAM pages are always backed all the way through
+                e.cmpRdxMem8(static_cast<int8_t>(offsetof(map::Page, region)), static_cast<uint8_t>(map::Region::Ram));
+                e.jne(slow);
+
+                e.movzxRdxMem8(X64Emitter::ECX, static_cast<int8_t>(offsetof(map::Page, cycles)));
+                e.addCyclesReg(X64Emitter::ECX);
+
+                e.movRdxRdxMem();
+                e.movRegReg(X64Emitter::ECX, X64Emitter::EAX);
+                e.andRegImm(X64Emitter::ECX, PageTable::PAGE_MASK);
+                e.addRdxRcx();
+            }
+
+            // Same as the load handlers for RAM
+            void emitLoad(const Instruction& instruction, X64Emitter::Label& slow) {
+                const uint8_t size = (instruction.func & 3) == 3 ? 4 : (instruction.func & 3) + 1;
+
+                // Word loads mirror into the scratchpad with only the data
+                // cache enabled, see 'Interconnect::load'
+                if (size == 4) {
+                    e.movRegMem(X64Emitter::ECX, disp(&cpu.interconnect._cacheControl.val));
+                    e.andRegImm(X64Emitter::ECX, 0x88);
+                    e.cmpRegImm(X64Emitter::ECX, 0x80);
+                    e.je(slow);
+                }
+
+                ramAddress(instruction, size, slow);
+
+                e.loadRdx(size, instruction.func < 0x24);
+                setLoad(instruction.rt);
+            }
+
+            // Same as the store handlers for RAM
+            void emitStore(const Instruction& instruction, X64Emitter::Label& slow) {
+                const uint8_t size = (instruction.func & 3) == 3 ? 4 : (instruction.func & 3) + 1;
+
+                // Isolated cache
+                e.testMemImm32(disp(&cpu._cop0.sr), 0x10000);
+                e.jne(slow);
+
+                // Data write breakpoints, see 'CPU::checkDataWriteBreakpoint'
+                e.movRegMem(X64Emitter::ECX, disp(&cpu._cop0.dcic));
+                e.andRegImm(X64Emitter::ECX, 0xCA000000);
+                e.cmpRegImm(X64Emitter::ECX, 0xCA000000);
+                e.je(slow);
+
+                ramAddress(instruction, size, slow);
+
+                loadReg(X64Emitter::ECX, instruction.rt);
+                e.storeRdx(size);
+
+                e.callEax(invalidateCode);
+            }
+
+            // Same as the branch and jump handlers outside of a delay slot, where
+            // 'pc' is always 'addr + 4'. 'last' blocks have already set the pc.
+            void emitBranch(const Instruction& instruction, uint32_t addr, bool last, X64Emitter::Label& slow) {
+                const uint32_t next = addr + 8;
+                const uint32_t target = addr + 4 + (static_cast<uint32_t>(static_cast<int32_t>(instruction.imm_se)) << 2);
+
+                X64Emitter::Label notTaken;
+
+                // JR and JALR, misaligned targets raise an exception
+                if (instruction.func == 0) {
+                    loadReg(X64Emitter::EAX, instruction.rs);
+                    e.testImm(3);
+                    e.jne(slow);
+                }
+
+                // Not taken carries on after the delay slot
+                if (!last && (instruction.func == 0x01 || instruction.func >= 0x04))
+                    e.movMemImm32(disp(&cpu.nextpc), next);
+
+                e.movMemImm8(disp(&cpu.branchSlot), 1);
+
+                switch (instruction.func) {
+                    case 0x00:
+                        if (instruction.subfunc == 0x09)
+                            link(instruction.rd, next);
+
+                        e.movMemReg(disp(&cpu.nextpc), X64Emitter::EAX);
+                        break;
+                    case 0x01: {
+                        const bool isbgez = (instruction.op >> 16) & 1;
+
+                        loadReg(X64Emitter::EAX, instruction.rs);
+
+                        if (((instruction.op >> 17) & 0xF) == 0x8)
+                            link(31, next);
+
+                        e.testEax();
+
+                        if (isbgez)
+                            e.js(notTaken);
+                        else
+                            e.jns(notTaken);
+
+                        e.movMemImm32(disp(&cpu.nextpc), target);
+                        break;
+                    }
+                    case 0x03:
+                        link(31, next);
+                        [[fallthrough]];
+                    case 0x02:
+                        e.movMemImm32(disp(&cpu.nextpc), ((addr + 4) & 0xF0000000) | (instruction.jump << 2));
+                        break;
+                    case 0x04:
+                    case 0x05:
+                        loadReg(X64Emitter::EAX, instruction.rs);
+                        loadReg(X64Emitter::ECX, instruction.rt);
+                        e.cmp(X64Emitter::EAX, X64Emitter::ECX);
+
+                        if (instruction.func == 0x04)
+                            e.jne(notTaken);
+                        else
+                            e.je(notTaken);
+
+                        e.movMemImm32(disp(&cpu.nextpc), target);
+                        break;
+                    default:
+                        loadReg(X64Emitter::EAX, instruction.rs);
+                        e.cmpImm(0);
+
+                        // BLEZ, BGTZ
+                        if (instruction.func == 0x06)
+                            e.jg(notTaken);
+                        else
+                            e.jle(notTaken);
+
+                        e.movMemImm32(disp(&cpu.nextpc), target);
+                        break;
+                }
+
+                e.movMemImm8(disp(&cpu.jumpSlot), 1);
+                e.bind(notTaken);
+            }
+
+            // Same as 'CPU::set_reg' with a known value, leaves eax alone
+            void link(uint32_t index, uint32_t value) {
+                if (index == 0)
+                    return;
+
+                e.movMemImm32(regDisp(index), value);
+                cancelLoad(index);
+            }
+
+            // Same as the end of 'CPU::runBlock', skipping what's known to be empty
+            void shiftLoads() {
+                if (load0Empty && load1Empty)
+                    return;
+
+                if (!load0Empty) {
+                    X64Emitter::Label skip;
+
+                    e.movRegMem(X64Emitter::EAX, disp(&cpu.loads[0].index));
+                    e.cmpImm(32);
+                    e.je(skip);
+                    e.movRegMem(X64Emitter::ECX, disp(&cpu.loads[0].value));
+                    e.movIndexedReg(regDisp(0), X64Emitter::ECX);
+                    e.bind(skip);
+                }
+
+                // Both fields of 'loads[1]' move over at once
+                e.movRaxMem64(disp(&cpu.loads[1]));
+                e.movMem64Rax(disp(&cpu.loads[0]));
+                e.movMemImm32(disp(&cpu.loads[1].index), 32);
+
+                load0Empty = load1Empty;
+                load1Empty = true;
+            }
+
+            void moveSlots() {
+                e.movRegMem8(X64Emitter::EAX, disp(&cpu.branchSlot));
+                e.movMem8Reg(disp(&cpu.delaySlot), X64Emitter::EAX);
+                e.movMemImm8(disp(&cpu.branchSlot), 0);
+
+                e.movRegMem8(X64Emitter::EAX, disp(&cpu.jumpSlot));
+                e.movMem8Reg(disp(&cpu.delayJumpSlot), X64Emitter::EAX);
+                e.movMemImm8(disp(&cpu.jumpSlot), 0);
+            }
+
+            void checkICache(uint32_t addr, uint32_t word, int fetchCycles) {
+                ICache& line = cpu.interconnect.icache[(addr & 0xFFC) >> 2];
+                const uint32_t tag = (addr & 0xFFFFF000) >> 12;
+
+                X64Emitter::Label miss, hit, done;
+
+                e.cmpMemImm8(disp(&line.valid), 0);
+                e.je(miss);
+                e.cmpMemImm32(disp(&line.tag), tag);
+                e.je(hit);
+
+                e.bind(miss);
+                e.movMemImm8(disp(&line.valid), 1);
+                e.movMemImm32(disp(&line.tag), tag);
+                e.movMemImm32(disp(&line.data), word);
+                e.addMemImm32(disp(&cpu.extraCycles), static_cast<uint32_t>(fetchCycles));
+                e.movMemImm8(disp(&cpu.interconnect.lastICacheMiss), 1);
+                e.jmp(done);
+
+                e.bind(hit);
+                e.movMemImm8(disp(&cpu.interconnect.lastICacheMiss), 0);
+
+                e.bind(done);
+            }
+
+            void setPc(uint32_t addr) {
+                e.movMemImm32(disp(&cpu.currentpc), addr);
+                e.movMemImm32(disp(&cpu.pc), addr + 4);
+                e.movMemImm32(disp(&cpu.nextpc), addr + 8);
+            }
+
+            // pc = nextpc; nextpc += 4; for the delay slot of a branch
+            void followBranch(uint32_t addr) {
+                e.movMemImm32(disp(&cpu.currentpc), addr);
+                e.movRegMem(X64Emitter::EAX, disp(&cpu.nextpc));
+                e.movMemReg(disp(&cpu.pc), X64Emitter::EAX);
+                e.addImm(4);
+                e.movMemReg(disp(&cpu.nextpc), X64Emitter::EAX);
+            }
+
+        public:
+            // What's known about the load delay slots at this point
+            bool load0Empty = false;
+            bool load1Empty = false;
+
+        private:
+            X64Emitter& e;
+            CPU& cpu;
+
+            // 'Recompiler::invalidateCode'
+            const void* invalidateCode;
+    };
+}
+
+Recompiler::Recompiler() {
+#ifdef RECOMPILER_X64_SYSV
+    void* memory = mmap(nullptr, CODE_SIZE, PROT_READ | PROT_WRITE | PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+    if (memory != MAP_FAILED)
+        code = static_cast<uint8_t*>(memory);
+#endif
+}
+
+Recompiler::~Recompiler() {
+#ifdef RECOMPILER_X64_SYSV
+    if (code)
+        munmap(code, CODE_SIZE);
+#endif
+}
+
+void Recompiler::reset() {
+    used = 0;
+    generation++;
+}
+
+void Recompiler::rethrowPending() {
+    if (!pendingException)
+        return;
+
+    std::exception_ptr exception = pendingException;
+    pendingException = nullptr;
+
+    std::rethrow_exception(exception);
+}
+
+void Recompiler::invalidateCode(CPU* cpu, uint32_t absAddr) noexcept {
+    cpu->interconnect.invalidateCode(absAddr);
+}
+
+int Recompiler::callHandler(CPU* cpu, DecodedInstruction* decoded) noexcept {
+    try {
+        return (cpu->*decoded->handler)(decoded->instruction);
+    } catch (...) {
+        cpu->recompiler.pendingException = std::current_exception();
+        return -1;
+    }
+}
+
+Recompiler::BlockFunction Recompiler::compile(CPU& cpu, CodeBlock& block, bool cached) {
+    if (!code)
+        return nullptr;
+
+    if (block.code && block.codeGeneration == generation && block.codeCached == cached)
+        return reinterpret_cast<BlockFunction>(block.code);
+
+    if (CODE_SIZE - used < MAX_BLOCK_CODE)
+        reset();
+
+    uint8_t* start = code + used;
+
+    X64Emitter e(start, MAX_BLOCK_CODE);
+    BlockCompiler compiler(e, cpu, reinterpret_cast<const void*>(&Recompiler::invalidateCode));
+
+    const size_t count = block.instructions.size();
+
+    X64Emitter::Label epilogue, fault;
+    std::vector<X64Emitter::Label> exits(count);
+
+    const bool* firstDirty = cpu.interconnect.blockCache.dirtyFlag(block.firstPage);
+    const bool* lastDirty = cpu.interconnect.blockCache.dirtyFlag(block.lastPage);
+
+    e.prologue();
+
+    for (size_t i = 0; i < count; i++) {
+        DecodedInstruction& decoded = block.instructions[i];
+        const Instruction& instruction = decoded.instruction;
+
+        const uint32_t addr = block.startPc + static_cast<uint32_t>(i) * 4;
+        const bool inDelaySlot = i > 0 && BlockCache::isBranch(block.instructions[i - 1].instruction);
+        const bool last = i + 1 == count;
+        const Emit emit = classify(instruction, inDelaySlot);
+
+        // Past the second instruction the slots are already cleared,
+        // unless a branch just set them
+        if (i <= 1 || inDelaySlot)
+            compiler.moveSlots();
+
+        if (cached)
+            compiler.checkICache(addr, instruction.op, block.fetchCycles);
+
+        // Only handlers look at the pc, so it's written out for them, for
+        // stores that may leave the block and at the very end. Loads and
+        // branches write it on their way to the handler.
+        const bool setPc = emit == Emit::Handler || emit == Emit::Store || last;
+
+        if (inDelaySlot)
+            compiler.followBranch(addr);
+        else if (setPc)
+            compiler.setPc(addr);
+
+        const auto callHandler = [&] {
+            e.call(reinterpret_cast<const void*>(&Recompiler::callHandler), &decoded);
+            e.testEax();
+            e.js(fault);
+            e.addCyclesReg(X64Emitter::EAX);
+
+            compiler.load1Empty = false;
+        };
+
+        if (emit == Emit::Inline) {
+            compiler.emitInline(instruction);
+            e.addCycles(1);
+        } else if (emit == Emit::Handler) {
+            callHandler();
+        } else {
+            X64Emitter::Label slow, done;
+
+            if (emit == Emit::Load)
+                compiler.emitLoad(instruction, slow);
+            else if (emit == Emit::Store)
+                compiler.emitStore(instruction, slow);
+            else
+                compiler.emitBranch(instruction, addr, last, slow);
+
+            e.addCycles(static_cast<uint8_t>(CPU::baseCycles(instruction)));
+
+            if (emit == Emit::Load)
+                compiler.load1Empty = false;
+
+            // Anything the inline code can't do goes through the handler
+            if (!slow.patches.empty()) {
+                e.jmp(done);
+                e.bind(slow);
+
+                if (!inDelaySlot && !setPc)
+                    compiler.setPc(addr);
+
+                callHandler();
+
+                if (!last) {
+                    e.cmpMemImm32(compiler.disp(&cpu.pc), addr + 4);
+                    e.jne(exits[i]);
+                }
+
+                e.bind(done);
+            }
+        }
+
+        compiler.shiftLoads();
+
+        if (emit == Emit::Inline || emit == Emit::Branch || emit == Emit::Load || last)
+            continue;
+
+        // Exceptions jump away, and stores may have just rewritten the block
+        if (emit == Emit::Handler) {
+            e.cmpMemImm32(compiler.disp(&cpu.pc), addr + 4);
+            e.jne(exits[i]);
+        }
+
+        if (BlockCache::isStore(instruction)) {
+            e.cmpMemImm8(compiler.disp(firstDirty), 0);
+            e.jne(exits[i]);
+
+            if (lastDirty != firstDirty) {
+                e.cmpMemImm8(compiler.disp(lastDirty), 0);
+                e.jne(exits[i]);
+            }
+        }
+    }
+
+    e.movRegImm(X64Emitter::EDX, static_cast<uint32_t>(count));
+    e.bind(epilogue);
+    e.epilogue();
+
+    for (size_t i = 0; i < count; i++) {
+        if (exits[i].patches.empty())
+            continue;
+
+        e.bind(exits[i]);
+        e.movRegImm(X64Emitter::EDX, static_cast<uint32_t>(i + 1));
+        e.jmp(epilogue);
+    }
+
+    // The exception gets rethrown, so the count doesn't matter
+    e.bind(fault);
+    e.zero(X64Emitter::EDX);
+    e.jmp(epilogue);
+
+    if (e.overflowed())
+        return nullptr;
+
+    // Keep every block 16 byte aligned
+    used += (e.size() + 15) & ~static_cast<size_t>(15);
+
+    block.code = start;
+    block.codeGeneration = generation;
+    block.codeCached = cached;
+
+    return reinterpret_cast<BlockFunction>(block.code);
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+
+class CPU;
+struct CodeBlock;
+struct DecodedInstruction;
+
+/**
+ * Turns cached blocks into x86-64 code.
+ *
+ * Simple ALU instructions, branches, the load delay shift and the I-Cache
+ * lookup are emitted inline, and so are loads and stores that land in RAM,
+ * going through the page table. Everything else calls the instruction's
+ * handler, so the generated code behaves exactly like 'CPU::runBlock'.
+ *
+ * Only x86-64 hosts using the System V calling convention are supported,
+ * anywhere else 'isSupported' is false and the CPU keeps interpreting blocks.
+ */
+class Recompiler {
+    public:
+        // Returns the cycles spent in the low 32 bits,
+        // and how many instructions ran in the high ones.
+        using BlockFunction = uint64_t (*)(CPU*);
+
+        Recompiler();
+        ~Recompiler();
+
+        Recompiler(const Recompiler&) = delete;
+        Recompiler& operator=(const Recompiler&) = delete;
+
+        [[nodiscard]] bool isSupported() const { return code != nullptr; }
+
+        // Returns the host code for 'block', compiling it if needed.
+        // Returns nullptr if the block can't be compiled.
+        BlockFunction compile(CPU& cpu, CodeBlock& block, bool cached);
+
+        // Throws whatever a handler threw while running generated code
+        void rethrowPending();
+
+        // Drops all the generated code
+        void reset();
+
+    private:
+        // Generated code calls handlers through this, exceptions
+        // can't unwind through it so they're stored and rethrown later.
+        static int callHandler(CPU* cpu, DecodedInstruction* decoded) noexcept;
+
+        // Inline stores call this, same as 'Interconnect::store' for RAM
+        static void invalidateCode(CPU* cpu, uint32_t absAddr) noexcept;
+
+    private:
+        static constexpr size_t CODE_SIZE = 32 * 1024 * 1024;
+
+        // Worst case size of a single block
+        static constexpr size_t MAX_BLOCK_CODE = 256 * 1024;
+
+        uint8_t* code = nullptr;
+        size_t used = 0;
+
+        // Bumped on every reset so blocks know their code is gone
+        uint32_t generation = 1;
+
+        std::exception_ptr pendingException;
+};
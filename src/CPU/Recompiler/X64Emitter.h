@@ -0,0 +1,238 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <initializer_list>
+#include <vector>
+
+/**
+ * Just enough of an x86-64 assembler for the recompiler.
+ *
+ * Memory operands are [rbx + disp32], rbx always holds the CPU, or
+ * [rdx] for host memory found through the page table. Only eax, ecx
+ * and edx are used as scratch registers.
+ * Jumps are always rel32 and get patched once their label is bound.
+ */
+class X64Emitter {
+    public:
+        enum Reg : uint8_t {
+            EAX = 0,
+            ECX = 1,
+            EDX = 2,
+        };
+
+        struct Label {
+            int32_t offset = -1;
+            std::vector<size_t> patches;
+        };
+
+        X64Emitter(uint8_t* buffer, size_t capacity) : buffer(buffer), capacity(capacity) {}
+
+        [[nodiscard]] size_t size() const { return used; }
+        [[nodiscard]] bool overflowed() const { return overflow; }
+
+        // push rbx; push r12; push r13; mov rbx, rdi; xor r12d, r12d
+        void prologue() {
+            emit({0x53, 0x41, 0x54, 0x41, 0x55});
+            emit({0x48, 0x89, 0xFB});
+            emit({0x45, 0x31, 0xE4});
+        }
+
+        // Returns (edx << 32) | r12d
+        void epilogue() {
+            emit({0x44, 0x89, 0xE0});       // mov eax, r12d
+            emit({0x48, 0xC1, 0xE2, 0x20}); // shl rdx, 32
+            emit({0x48, 0x09, 0xD0});       // or rax, rdx
+            emit({0x41, 0x5D, 0x41, 0x5C, 0x5B, 0xC3});
+        }
+
+        void movRegMem(Reg reg, int32_t disp) { emit8(0x8B); modrmDisp(reg, disp); }
+        void movMemReg(int32_t disp, Reg reg) { emit8(0x89); modrmDisp(reg, disp); }
+
+        void movMemImm32(int32_t disp, uint32_t imm) { emit8(0xC7); modrmDisp(0, disp); emit32(imm); }
+        void movMemImm8(int32_t disp, uint8_t imm) { emit8(0xC6); modrmDisp(0, disp); emit8(imm); }
+
+        void movRegMem8(Reg reg, int32_t disp) { emit8(0x8A); modrmDisp(reg, disp); }
+        void movMem8Reg(int32_t disp, Reg reg) { emit8(0x88); modrmDisp(reg, disp); }
+
+        void movRaxMem64(int32_t disp) { emit8(0x48); emit8(0x8B); modrmDisp(EAX, disp); }
+        void movMem64Rax(int32_t disp) { emit8(0x48); emit8(0x89); modrmDisp(EAX, disp); }
+
+        // mov [rbx + rax * 4 + disp], reg
+        void movIndexedReg(int32_t disp, Reg reg) {
+            emit8(0x89);
+            emit8(0x84 | (reg << 3));
+            emit8(0x83);
+            emit32(static_cast<uint32_t>(disp));
+        }
+
+        void movRegImm(Reg reg, uint32_t imm) { emit8(0xB8 + reg); emit32(imm); }
+        void movRegReg(Reg dst, Reg src) { aluRR(0x89, dst, src); }
+        void zero(Reg reg) { emit8(0x31); emit8(0xC0 | (reg << 3) | reg); }
+
+        void addMemImm32(int32_t disp, uint32_t imm) { emit8(0x81); modrmDisp(0, disp); emit32(imm); }
+        void cmpMemImm32(int32_t disp, uint32_t imm) { emit8(0x81); modrmDisp(7, disp); emit32(imm); }
+        void cmpMemImm8(int32_t disp, uint8_t imm) { emit8(0x80); modrmDisp(7, disp); emit8(imm); }
+        void testMemImm32(int32_t disp, uint32_t imm) { emit8(0xF7); modrmDisp(0, disp); emit32(imm); }
+
+        // Register to register ALU ops, 'dst op= src'
+        void add(Reg dst, Reg src) { aluRR(0x01, dst, src); }
+        void sub(Reg dst, Reg src) { aluRR(0x29, dst, src); }
+        void or_(Reg dst, Reg src) { aluRR(0x09, dst, src); }
+        void and_(Reg dst, Reg src) { aluRR(0x21, dst, src); }
+        void xor_(Reg dst, Reg src) { aluRR(0x31, dst, src); }
+        void cmp(Reg dst, Reg src) { aluRR(0x39, dst, src); }
+        void not_(Reg reg) { emit8(0xF7); emit8(0xD0 | reg); }
+
+        // ALU ops with an immediate, only on eax
+        void addImm(uint32_t imm) { emit8(0x05); emit32(imm); }
+        void orImm(uint32_t imm) { emit8(0x0D); emit32(imm); }
+        void andImm(uint32_t imm) { emit8(0x25); emit32(imm); }
+        void xorImm(uint32_t imm) { emit8(0x35); emit32(imm); }
+        void cmpImm(uint32_t imm) { emit8(0x3D); emit32(imm); }
+        void testImm(uint32_t imm) { emit8(0xA9); emit32(imm); }
+
+        // Same on any register
+        void andRegImm(Reg reg, uint32_t imm) { emit8(0x81); emit8(0xE0 | reg); emit32(imm); }
+        void cmpRegImm(Reg reg, uint32_t imm) { emit8(0x81); emit8(0xF8 | reg); emit32(imm); }
+
+        // Carry = bit 'bit' of 'base'
+        void bt(Reg base, Reg bit) { emit({0x0F, 0xA3}); emit8(0xC0 | (bit << 3) | base); }
+
+        void shl(Reg reg, uint8_t amount) { emit8(0xC1); emit8(0xE0 | reg); emit8(amount); }
+        void shr(Reg reg, uint8_t amount) { emit8(0xC1); emit8(0xE8 | reg); emit8(amount); }
+        void sar(Reg reg, uint8_t amount) { emit8(0xC1); emit8(0xF8 | reg); emit8(amount); }
+
+        // eax = (flags) ? 1 : 0
+        void setlEax() { emit({0x0F, 0x9C, 0xC0, 0x0F, 0xB6, 0xC0}); }
+        void setbEax() { emit({0x0F, 0x92, 0xC0, 0x0F, 0xB6, 0xC0}); }
+
+        void testEax() { emit({0x85, 0xC0}); }
+
+        // r12d holds the cycles spent so far
+        void addCyclesReg(Reg reg) { emit({0x41, 0x01}); emit8(0xC4 | (reg << 3)); }
+        void addCycles(uint8_t cycles) { emit({0x41, 0x83, 0xC4, cycles}); }
+
+        // rdx = pointer; rdx += rcx; rdx = [rdx]
+        void movRdxImm64(const void* pointer) { emit({0x48, 0xBA}); emit64(reinterpret_cast<uint64_t>(pointer)); }
+        void addRdxRcx() { emit({0x48, 0x01, 0xCA}); }
+        void movRdxRdxMem() { emit({0x48, 0x8B, 0x12}); }
+
+        // Bytes at [rdx + disp]
+        void cmpRdxMem8(int8_t disp, uint8_t imm) { emit({0x80, 0x7A}); emit8(static_cast<uint8_t>(disp)); emit8(imm); }
+        void movzxRdxMem8(Reg reg, int8_t disp) { emit({0x0F, 0xB6}); emit8(0x42 | (reg << 3)); emit8(static_cast<uint8_t>(disp)); }
+
+        // eax = [rdx], 'size' bytes zero or sign extended
+        void loadRdx(uint8_t size, bool sign) {
+            switch (size) {
+                case 1: emit({0x0F, static_cast<uint8_t>(sign ? 0xBE : 0xB6), 0x02}); break;
+                case 2: emit({0x0F, static_cast<uint8_t>(sign ? 0xBF : 0xB7), 0x02}); break;
+                default: emit({0x8B, 0x02}); break;
+            }
+        }
+
+        // [rdx] = the low 'size' bytes of ecx
+        void storeRdx(uint8_t size) {
+            switch (size) {
+                case 1: emit({0x88, 0x0A}); break;
+                case 2: emit({0x66, 0x89, 0x0A}); break;
+                default: emit({0x89, 0x0A}); break;
+            }
+        }
+
+        // call function(rbx, arg)
+        void call(const void* function, const void* arg) {
+            emit({0x48, 0x89, 0xDF}); // mov rdi, rbx
+            emit({0x48, 0xBE});       // mov rsi, imm64
+            emit64(reinterpret_cast<uint64_t>(arg));
+            emit({0x48, 0xB8});       // mov rax, imm64
+            emit64(reinterpret_cast<uint64_t>(function));
+            emit({0xFF, 0xD0});       // call rax
+        }
+
+        // call function(rbx, eax)
+        void callEax(const void* function) {
+            emit({0x48, 0x89, 0xDF}); // mov rdi, rbx
+            emit({0x89, 0xC6});       // mov esi, eax
+            emit({0x48, 0xB8});       // mov rax, imm64
+            emit64(reinterpret_cast<uint64_t>(function));
+            emit({0xFF, 0xD0});       // call rax
+        }
+
+        void jmp(Label& label) { emit8(0xE9); reference(label); }
+        void je(Label& label) { emit({0x0F, 0x84}); reference(label); }
+        void jne(Label& label) { emit({0x0F, 0x85}); reference(label); }
+        void js(Label& label) { emit({0x0F, 0x88}); reference(label); }
+        void jns(Label& label) { emit({0x0F, 0x89}); reference(label); }
+        void jae(Label& label) { emit({0x0F, 0x83}); reference(label); }
+        void jg(Label& label) { emit({0x0F, 0x8F}); reference(label); }
+        void jle(Label& label) { emit({0x0F, 0x8E}); reference(label); }
+
+        void bind(Label& label) {
+            label.offset = static_cast<int32_t>(used);
+
+            for (size_t patch : label.patches)
+                patch32(patch, static_cast<uint32_t>(label.offset - static_cast<int32_t>(patch + 4)));
+
+            label.patches.clear();
+        }
+
+    private:
+        void emit8(uint8_t value) {
+            if (used >= capacity) {
+                overflow = true;
+                return;
+            }
+
+            buffer[used++] = value;
+        }
+
+        void emit(std::initializer_list<uint8_t> bytes) {
+            for (uint8_t byte : bytes)
+                emit8(byte);
+        }
+
+        void emit32(uint32_t value) {
+            for (int i = 0; i < 4; i++)
+                emit8(static_cast<uint8_t>(value >> (i * 8)));
+        }
+
+        void emit64(uint64_t value) {
+            emit32(static_cast<uint32_t>(value));
+            emit32(static_cast<uint32_t>(value >> 32));
+        }
+
+        void patch32(size_t at, uint32_t value) {
+            if (at + 4 > capacity)
+                return;
+
+            std::memcpy(buffer + at, &value, 4);
+        }
+
+        // mod = 10, rm = rbx
+        void modrmDisp(uint8_t reg, int32_t disp) {
+            emit8(0x83 | (reg << 3));
+            emit32(static_cast<uint32_t>(disp));
+        }
+
+        void aluRR(uint8_t op, Reg dst, Reg src) {
+            emit8(op);
+            emit8(0xC0 | (src << 3) | dst);
+        }
+
+        void reference(Label& label) {
+            size_t at = used;
+            emit32(0);
+
+            if (label.offset >= 0)
+                patch32(at, static_cast<uint32_t>(label.offset - static_cast<int32_t>(at + 4)));
+            else
+                label.patches.push_back(at);
+        }
+
+    private:
+        uint8_t* buffer;
+        size_t capacity;
+        size_t used = 0;
+        bool overflow = false;
+};
@@ -8,6 +8,8 @@
 
 #include "../CPU/CPU.h"
 #include "../CPU/CPUTests.h"
+#include "../Memory/CDROM/CDROMTests.h"
+#include "../Memory/MDEC/MDECTests.h"
 #include "../Memory/IO/SIO.h"
 
 // #include "../Memory/Bios/Bios.h"
@@ -598,7 +600,7 @@ void runFrame() {
         bool stepped = false;
 
         if (!cpu->paused) {
-            cycles = cpu->executeNextInstruction();
+            cycles = cpu->executeNext();
         } else if (cpu->stepRequested) {
             cycles  = cpu->executeNextInstruction();
             stepped = true;
@@ -659,12 +661,9 @@ void runFrame() {
 
         bool didVBlank = false;
 
+        // Devices only run once one of them is due, see 'Scheduler'
         if (!cpu->paused) {
-            for (uint32_t i = 0; i < cycles; i++) {
-                if (cpu->interconnect.step(1)) {
-                    didVBlank = true;
-                }
-            }
+            didVBlank = cpu->interconnect.advance(cycles);
         }
 
         if (didVBlank) {
@@ -920,7 +919,7 @@ static void ShowFileBrowser(bool *p_open, CPU *cpu) {
                         if (extension == ".exe") {
                             handleLoadExe(f.path);
                             *p_open = false;
-                        } else if (extension == ".cue" || extension == ".bin") {
+                        } else if (extension == ".cue" || extension == ".bin" || extension == ".chd") {
                             cpu->interconnect._cdrom.swapDisk(f.path);
                             *p_open = false;
                         }
@@ -953,6 +952,12 @@ int main(int argc, char *argv[]) {
     //if (!GpuTimingTests::runAll())
     //    return 1;
 
+    //if (!MdecTests::runAll())
+    //    return 1;
+
+    //if (!CdromTests::runAll())
+    //    return 1;
+
     // Was used for debuging
     //_CrtSetDbgFlag(_CRTDBG_ALLOC_MEM_DF | _CRTDBG_LEAK_CHECK_DF);
 
@@ -973,6 +978,9 @@ int main(int argc, char *argv[]) {
      */
     gpu = std::make_unique<Emulator::Gpu>();
 
+    // The windowed build always draws with GL, the window comes with it
+    auto* renderer = static_cast<Emulator::Renderer*>(gpu->renderer);
+
     cpu = std::make_unique<CPU>(Interconnect(gpu.get()));
 
     // TODO; For now, manually load in disc
@@ -1036,13 +1044,13 @@ int main(int argc, char *argv[]) {
 
     //CpuInstructionTests::runAll();
 
-    glfwSetKeyCallback(gpu->renderer->window, Emulator::IO::SIO::keyCallback);
+    glfwSetKeyCallback(renderer->window, Emulator::IO::SIO::keyCallback);
 
     IMGUI_CHECKVERSION();
     ImGui::CreateContext();
     ImGuiIO &io = ImGui::GetIO();
     ImGui::StyleColorsDark();
-    ImGui_ImplGlfw_InitForOpenGL(gpu->renderer->window, true);
+    ImGui_ImplGlfw_InitForOpenGL(renderer->window, true);
     ImGui_ImplOpenGL3_Init("#version 130");
 
     double                                fps       = 0.0;
@@ -1059,7 +1067,7 @@ int main(int argc, char *argv[]) {
 
     glfwSwapInterval(1);
 
-    while (!glfwWindowShouldClose(gpu->renderer->window)) {
+    while (!glfwWindowShouldClose(renderer->window)) {
         render = false;
 
         glfwPollEvents();
@@ -1081,7 +1089,7 @@ int main(int argc, char *argv[]) {
                 frames    = 0;
 
                 int width, height;
-                glfwGetFramebufferSize(gpu->renderer->window, &width, &height);
+                glfwGetFramebufferSize(renderer->window, &width, &height);
                 glViewport(0, 0, width, height);
 
                 //std::cerr << "FPS: " << std::to_string(fps) << " - " << std::to_string(gpu->frames) << "\n";
@@ -1090,7 +1098,7 @@ int main(int argc, char *argv[]) {
             }
         }
 
-        if (glfwGetWindowAttrib(gpu->renderer->window, GLFW_ICONIFIED)) {
+        if (glfwGetWindowAttrib(renderer->window, GLFW_ICONIFIED)) {
             // ImGui_ImplGlfw_Sleep(10);
             continue;
         }
@@ -1108,16 +1116,16 @@ int main(int argc, char *argv[]) {
 
             /*static bool f = true;
 
-            if (glfwGetKey(gpu->renderer->window, GLFW_KEY_N) == GLFW_PRESS && f) {
+            if (glfwGetKey(renderer->window, GLFW_KEY_N) == GLFW_PRESS && f) {
                 f                         = false;
-                gpu->renderer->renderVRAM = !gpu->renderer->renderVRAM;
+                renderer->renderVRAM = !renderer->renderVRAM;
             }
 
-            if (glfwGetKey(gpu->renderer->window, GLFW_KEY_N) == GLFW_RELEASE) {
+            if (glfwGetKey(renderer->window, GLFW_KEY_N) == GLFW_RELEASE) {
                 f = true;
             }*/
 
-            /*if(glfwGetKey(gpu->renderer->window, GLFW_KEY_N) == GLFW_PRESS && loadNextTest) {
+            /*if(glfwGetKey(renderer->window, GLFW_KEY_N) == GLFW_PRESS && loadNextTest) {
                 loadNextTest = false;
 
                 if(currentIndex + 1 < testPaths.size()) {
@@ -1130,7 +1138,7 @@ int main(int argc, char *argv[]) {
                 }
             }
 
-            if(glfwGetKey(gpu->renderer->window, GLFW_KEY_N) == GLFW_RELEASE) {
+            if(glfwGetKey(renderer->window, GLFW_KEY_N) == GLFW_RELEASE) {
                 loadNextTest = true;
             }*/
         }
@@ -1144,7 +1152,7 @@ int main(int argc, char *argv[]) {
         ImGui::End();*/
 
         /*int winW, winH;
-        glfwGetFramebufferSize(gpu->renderer->window, &winW, &winH);
+        glfwGetFramebufferSize(renderer->window, &winW, &winH);
 
         float x1 = (gpu->drawingAreaLeft   / 1024.0f) * winW;
         float y1 = (gpu->drawingAreaTop    / 512.0f)  * winH;
@@ -1169,51 +1177,84 @@ int main(int argc, char *argv[]) {
                 ImGui::EndMenu();
             }
 
+            if (ImGui::BeginMenu("CPU")) {
+                if (ImGui::MenuItem("Interpreter", nullptr, cpu->executionMode == ExecutionMode::Interpreter))
+                    cpu->executionMode = ExecutionMode::Interpreter;
+
+                if (ImGui::MenuItem("Block Cache", nullptr, cpu->executionMode == ExecutionMode::CachedBlocks))
+                    cpu->executionMode = ExecutionMode::CachedBlocks;
+
+                if (ImGui::MenuItem("Recompiler", nullptr, cpu->executionMode == ExecutionMode::Recompiler,
+                                    cpu->recompiler.isSupported()))
+                    cpu->executionMode = ExecutionMode::Recompiler;
+
+                ImGui::Separator();
+
+                if (ImGui::MenuItem("MDEC Thread", nullptr, cpu->interconnect.mdec.threaded()))
+                    cpu->interconnect.mdec.setThreaded(!cpu->interconnect.mdec.threaded());
+
+                if (ImGui::MenuItem("CD-ROM Read-Ahead", nullptr, cpu->interconnect._cdrom.readAheadWindow() != 0))
+                    cpu->interconnect._cdrom.setReadAhead(cpu->interconnect._cdrom.readAheadWindow() ? 0 : ReadAhead::DEFAULT_WINDOW);
+
+                // Takes effect with the next disc loaded
+                if (ImGui::MenuItem("Preload Disc Into RAM", nullptr, cpu->interconnect._cdrom.preloadsDisc()))
+                    cpu->interconnect._cdrom.setPreloadDisc(!cpu->interconnect._cdrom.preloadsDisc());
+
+                ImGui::EndMenu();
+            }
+
             if (ImGui::BeginMenu("GPU")) {
                 ImGui::MenuItem("Show VRAM", nullptr, &showVramViewer);
-                ImGui::MenuItem("Main Window: Display Area Only", nullptr, &gpu->renderer->cropToDisplayArea);
-                ImGui::MenuItem("Main Window: Full VRAM Debug", "N", &gpu->renderer->renderVRAM);
+                ImGui::MenuItem("Main Window: Display Area Only", nullptr, &renderer->cropToDisplayArea);
+                ImGui::MenuItem("Main Window: Full VRAM Debug", "N", &renderer->renderVRAM);
+
+                if (ImGui::MenuItem("Software Rendering", nullptr, gpu->softwareRendering()))
+                    gpu->setSoftwareRendering(!gpu->softwareRendering());
+
+                // GL has to stay on this thread, so it's software rendering only
+                if (ImGui::MenuItem("GPU Thread", nullptr, gpu->threaded(), gpu->canRunThreaded()))
+                    gpu->setThreaded(!gpu->threaded());
 
                 ImGui::EndMenu();
             }
 
             if (ImGui::BeginMenu("Post-Processing Settings")) {
                 if (ImGui::BeginMenu("Bloom Settings")) {
-                    ImGui::SliderFloat("Bloom Threshold", &gpu->renderer->threshold, -5.0f, 5.0f);
-                    ImGui::SliderFloat("Bloom Blur Radius", &gpu->renderer->blurRadius, 0.0f, 10.0f);
-                    ImGui::SliderInt("Bloom Passes", &gpu->renderer->bloomPasses, 0, 50);
-                    ImGui::SliderFloat("Bloom Intensity", &gpu->renderer->bloomIntensity, 0.0f, 5.0f);
-                    ImGui::Checkbox("Enable bloom", &gpu->renderer->enableBloom);
+                    ImGui::SliderFloat("Bloom Threshold", &renderer->threshold, -5.0f, 5.0f);
+                    ImGui::SliderFloat("Bloom Blur Radius", &renderer->blurRadius, 0.0f, 10.0f);
+                    ImGui::SliderInt("Bloom Passes", &renderer->bloomPasses, 0, 50);
+                    ImGui::SliderFloat("Bloom Intensity", &renderer->bloomIntensity, 0.0f, 5.0f);
+                    ImGui::Checkbox("Enable bloom", &renderer->enableBloom);
 
                     ImGui::EndMenu();
                 }
 
                 if (ImGui::BeginMenu("Upscaling Quality")) {
-                    ImGui::Checkbox("Enable Upscaling", &gpu->renderer->enableUpscaling);
-                    ImGui::SliderInt("Sample Radius", &gpu->renderer->sampleRadius, 1, 16);
-                    ImGui::SliderFloat("LOD Bias", &gpu->renderer->lodBias, -1.0f, 1.0f);
-                    ImGui::SliderFloat("Kernel B", &gpu->renderer->kernelB, -1.0f, 1.0f);
-                    ImGui::SliderFloat("Kernel C", &gpu->renderer->kernelC, -1.0f, 1.0f);
-                    ImGui::SliderFloat("Sharpness", &gpu->renderer->sharpness, 0.0f, 5.0f);
-                    ImGui::SliderFloat("Edge Threshold", &gpu->renderer->edgeThreshold, 0.0f, 0.5f);
-                    ImGui::Checkbox("Adaptive Sharpening", &gpu->renderer->enableAdaptiveSharpening);
+                    ImGui::Checkbox("Enable Upscaling", &renderer->enableUpscaling);
+                    ImGui::SliderInt("Sample Radius", &renderer->sampleRadius, 1, 16);
+                    ImGui::SliderFloat("LOD Bias", &renderer->lodBias, -1.0f, 1.0f);
+                    ImGui::SliderFloat("Kernel B", &renderer->kernelB, -1.0f, 1.0f);
+                    ImGui::SliderFloat("Kernel C", &renderer->kernelC, -1.0f, 1.0f);
+                    ImGui::SliderFloat("Sharpness", &renderer->sharpness, 0.0f, 5.0f);
+                    ImGui::SliderFloat("Edge Threshold", &renderer->edgeThreshold, 0.0f, 0.5f);
+                    ImGui::Checkbox("Adaptive Sharpening", &renderer->enableAdaptiveSharpening);
 
                     ImGui::EndMenu();
                 }
 
                 if (ImGui::BeginMenu("Color Adjustments")) {
-                    ImGui::SliderFloat("Contrast", &gpu->renderer->contrast, 0.5f, 2.0f);
-                    ImGui::SliderFloat("Saturation", &gpu->renderer->saturation, 0.0f, 2.0f);
-                    ImGui::SliderFloat("Gamma", &gpu->renderer->gamma, 0.1f, 5.0f);
+                    ImGui::SliderFloat("Contrast", &renderer->contrast, 0.5f, 2.0f);
+                    ImGui::SliderFloat("Saturation", &renderer->saturation, 0.0f, 2.0f);
+                    ImGui::SliderFloat("Gamma", &renderer->gamma, 0.1f, 5.0f);
 
                     ImGui::EndMenu();
                 }
 
                 if (ImGui::BeginMenu("CRT Effects")) {
-                    ImGui::SliderFloat("Scanline", &gpu->renderer->scanline, 0.0f, 1.0f);
-                    ImGui::SliderFloat("Halation", &gpu->renderer->halation, 0.0f, 0.3f);
-                    ImGui::SliderFloat("Dither Strength", &gpu->renderer->ditherStrength, 0.0f, 0.02f);
-                    ImGui::SliderFloat("Film Grain", &gpu->renderer->noiseStrength, 0.0f, 0.1f);
+                    ImGui::SliderFloat("Scanline", &renderer->scanline, 0.0f, 1.0f);
+                    ImGui::SliderFloat("Halation", &renderer->halation, 0.0f, 0.3f);
+                    ImGui::SliderFloat("Dither Strength", &renderer->ditherStrength, 0.0f, 0.02f);
+                    ImGui::SliderFloat("Film Grain", &renderer->noiseStrength, 0.0f, 0.1f);
 
                     ImGui::EndMenu();
                 }
@@ -1288,12 +1329,13 @@ int main(int argc, char *argv[]) {
         ImGui::Render();
 
         if (render) {
+            gpu->sync();
             gpu->vram->endTransfer();
-            gpu->renderer->renderFrame();
+            renderer->renderFrame();
 
             // glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
             ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
-            glfwSwapBuffers(gpu->renderer->window);
+            glfwSwapBuffers(renderer->window);
 
             frames++;
         } else {
@@ -1301,7 +1343,11 @@ int main(int argc, char *argv[]) {
         }
     }
 
-    glfwDestroyWindow(gpu->renderer->window);
+    // The GPU's textures and buffers go before the context does
+    GLFWwindow* window = renderer->window;
+    gpu.reset();
+
+    glfwDestroyWindow(window);
     glfwTerminate();
 
     return 0;
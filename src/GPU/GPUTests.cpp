@@ -4,11 +4,13 @@
 #include <exception>
 #include <iomanip>
 #include <iostream>
+#include <memory>
 #include <sstream>
 #include <string>
 #include <vector>
 
 #include "Gpu.h"
+#include "../Memory/interconnect.h"
 
 namespace {
     std::string hex32(uint32_t value) {
@@ -134,6 +136,144 @@ namespace {
         });
     }
 
+    void testCyclesUntilCrtcEvent(Runner &runner) {
+        runner.test("GPU cycles until CRTC event", [&] {
+            Emulator::Gpu gpu = makeTimingGpu();
+
+            // Over a few lines, so wraps and blanking edges are in there
+            for (int i = 0; i < 64; i++) {
+                const uint32_t next = gpu.ticksUntilNextCRTCEvent();
+                const uint32_t cycles = gpu.cyclesUntilNextCRTCEvent();
+
+                // Same conversion as 'step', a cycle is more than one tick but less than two
+                const uint64_t ticks = (uint64_t(cycles) * Emulator::Gpu::NTSC_CRTC_NUM + gpu._gpuFrac) / Emulator::Gpu::CRTC_DEN;
+                const uint64_t short_ = (uint64_t(cycles - 1) * Emulator::Gpu::NTSC_CRTC_NUM + gpu._gpuFrac) / Emulator::Gpu::CRTC_DEN;
+
+                runner.expect("one cycle short stops before the event", short_ < next);
+                runner.expect("lands on the event or the tick after it", ticks == next || ticks == next + 1u);
+
+                uint32_t hpos = gpu._hpos + static_cast<uint32_t>(ticks);
+                uint32_t scanLine = gpu._scanLine;
+
+                if (hpos >= gpu.htotal()) {
+                    hpos -= gpu.htotal();
+                    scanLine = (scanLine + 1) % gpu.vtotal();
+                }
+
+                gpu.step(cycles);
+                runner.expectEq("hpos after the event", gpu._hpos, hpos);
+                runner.expectEq("scanline after the event", gpu._scanLine, scanLine);
+            }
+        });
+    }
+
+    // Everything the timers and the CRTC can be told apart by, taken through
+    // the registers like the CPU would. IRQs are cleared after each look.
+    std::vector<uint64_t> deviceState(Interconnect &bus, uint32_t vblanks) {
+        const Emulator::Gpu &gpu = *bus._gpu;
+        std::vector<uint64_t> state = {
+            gpu._hpos, gpu._scanLine, gpu.frames, gpu._gpuFrac, gpu.dot,
+            gpu.isInHBlank, gpu.isInVBlank, vblanks, bus._irq.getStatus(),
+        };
+
+        for (uint32_t timer = 0; timer < 3; timer++) {
+            state.push_back(bus._timers.load(timer << 4));
+            state.push_back(bus._timers.load((timer << 4) | 4));
+        }
+
+        bus._irq.acknowledge(0);
+
+        return state;
+    }
+
+    // The dot clock reset every line, HBlanks and the system clock / 8, all
+    // three firing their IRQ on a target
+    void startTimers(Interconnect &bus) {
+        bus._irq.reset();
+        bus._irq.setMask(0x7FF);
+
+        bus._timers.store(0x04, 0x015B);
+        bus._timers.store(0x08, 0x0100);
+        bus._timers.store(0x14, 0x0158);
+        bus._timers.store(0x18, 0x0032);
+        bus._timers.store(0x24, 0x0258);
+        bus._timers.store(0x28, 0x03E8);
+
+        bus.reschedule();
+    }
+
+    void testSchedulerCatchUp(Runner &runner) {
+        runner.test("GPU scheduler catch up", [&] {
+            // A little over a frame, looked at every 20000 cycles
+            constexpr uint32_t SPAN = 600000;
+            constexpr uint32_t CHECK = 20000;
+
+            Emulator::Gpu steppedGpu = makeTimingGpu();
+            auto stepped = std::make_unique<Interconnect>();
+            stepped->_gpu = &steppedGpu;
+            startTimers(*stepped);
+
+            std::vector<std::vector<uint64_t>> expected;
+            uint32_t vblanks = 0;
+
+            for (uint32_t cycle = 1; cycle <= SPAN; cycle++) {
+                vblanks += stepped->step(1);
+
+                if (cycle % CHECK == 0)
+                    expected.push_back(deviceState(*stepped, vblanks));
+            }
+
+            Emulator::Gpu scheduledGpu = makeTimingGpu();
+            auto scheduled = std::make_unique<Interconnect>();
+            scheduled->_gpu = &scheduledGpu;
+            startTimers(*scheduled);
+
+            vblanks = 0;
+            uint32_t cycle = 0;
+            size_t checks = 0;
+
+            // Uneven steps like instructions take, register reads catch up
+            for (uint32_t i = 0; cycle < SPAN; i++) {
+                const uint32_t cycles = std::min(1 + (i * 7) % 5, CHECK - cycle % CHECK);
+
+                vblanks += scheduled->advance(cycles);
+                cycle += cycles;
+
+                if (cycle % CHECK == 0) {
+                    scheduled->catchUp();
+                    vblanks += scheduled->vblankPending;
+                    scheduled->vblankPending = false;
+
+                    const bool same = checks < expected.size() && deviceState(*scheduled, vblanks) == expected[checks];
+                    runner.expect("same state at cycle " + std::to_string(cycle), same);
+                    checks++;
+                }
+            }
+
+            runner.expectEq("checks", checks, expected.size());
+        });
+
+        runner.test("SPU scheduler deadline", [&] {
+            Emulator::Gpu gpu = makeTimingGpu();
+            auto interconnect = std::make_unique<Interconnect>();
+            interconnect->_gpu = &gpu;
+
+            // Lines the SPU up with a sample boundary
+            interconnect->spu.step(interconnect->spu.cyclesUntilEvent());
+            runner.expectEq("a sample away", interconnect->spu.cyclesUntilEvent(), 768);
+
+            interconnect->spu.step(100);
+            runner.expectEq("partway to the next sample", interconnect->spu.cyclesUntilEvent(), 668);
+
+            // Nothing else is due that soon
+            interconnect->spu.step(667);
+            interconnect->reschedule();
+
+            const Scheduler& scheduler = interconnect->scheduler;
+            runner.expectEq("due on the next sample", scheduler.nextDeadline() - scheduler.timestamp(), 1);
+        });
+    }
+
     void testPalTiming(Runner &runner) {
         runner.test("GPU PAL timing", [&] {
             Emulator::Gpu gpu = makeTimingGpu();
@@ -166,6 +306,685 @@ namespace {
             runner.expectStatusBit("odd bit cleared in vblank", gpu.status(), 31, false);
         });
     }
+
+    void testWithoutRenderer(Runner &runner) {
+        runner.test("GPU with the null renderer", [&] {
+            Emulator::Gpu gpu = makeTimingGpu();
+
+            // Monochrome triangle, has nowhere to go but mustn't crash
+            gpu.gp0(0x20FF0000);
+            gpu.gp0(0x00000000);
+            gpu.gp0(0x00000010);
+            gpu.gp0(0x00100000);
+
+            // CPU to VRAM, 2x1 pixels at (16, 8)
+            gpu.gp0(0xA0000000);
+            gpu.gp0(0x00080010);
+            gpu.gp0(0x00010002);
+            gpu.gp0(0x7FFF1234);
+
+            // VRAM to CPU of the same pixels
+            gpu.gp0(0xC0000000);
+            gpu.gp0(0x00080010);
+            gpu.gp0(0x00010002);
+
+            runner.expectEq("GPUREAD after CPU to VRAM", gpu.read(), 0x7FFF1234);
+            runner.expectStatusBit("ready for commands", gpu.status(), 26, true);
+
+            // 2x1 pixels at (1023, 8) wrap around to the left edge
+            gpu.vram->endTransfer();
+
+            gpu.gp0(0xA0000000);
+            gpu.gp0(0x000803FF);
+            gpu.gp0(0x00010002);
+
+            // Marked when the transfer starts, the end of it flushes them. Tile
+            // rows are stored bottom up too.
+            const uint32_t tileRow = (511 - 8) / Emulator::VRAM::TILE_SIZE;
+
+            runner.expect("right tile dirty", gpu.vram->tileDirty[tileRow * gpu.vram->tilesX + gpu.vram->tilesX - 1]);
+            runner.expect("wrapped tile dirty", gpu.vram->tileDirty[tileRow * gpu.vram->tilesX]);
+            runner.expect("other tiles clean", !gpu.vram->tileDirty[tileRow * gpu.vram->tilesX + 1]);
+
+            gpu.gp0(0x7FFF001F);
+
+            runner.expectEq("right edge", gpu.vram->pixel15(1023, 8), 0x001F);
+            runner.expectEq("wrapped pixel", gpu.vram->pixel15(0, 8), 0x7FFF);
+        });
+    }
+
+    void testDirtyRects(Runner &runner) {
+        runner.test("VRAM dirty rectangles", [&] {
+            Emulator::Gpu gpu = makeTimingGpu();
+            Emulator::VRAM& vram = *gpu.vram;
+
+            vram.takeDirtyRects();
+
+            // A 320x240 frame at the top left is a single upload, rows are bottom up
+            vram.markDirty(0, 0, 320, 240);
+            auto rects = vram.takeDirtyRects();
+
+            runner.expectEq("one rectangle for a frame", rects.size(), 1);
+            runner.expectEq("frame x", rects[0].x, 0);
+            runner.expectEq("frame y", rects[0].y, 256);
+            runner.expectEq("frame width", rects[0].width, 320);
+            runner.expectEq("frame height", rects[0].height, 256);
+
+            runner.expect("cleared after taking", vram.takeDirtyRects().empty());
+
+            // Far apart areas stay apart
+            vram.markDirty(0, 0, 32, 32);
+            vram.markDirty(512, 256, 64, 32);
+            rects = vram.takeDirtyRects();
+
+            runner.expectEq("two rectangles", rects.size(), 2);
+            runner.expectEq("combined width", rects[0].width + rects[1].width, 96);
+
+            // Mostly covered bounding box goes up in one piece
+            vram.markDirty(0, 0, 128, 96);
+            vram.markDirty(0, 96, 96, 32);
+            rects = vram.takeDirtyRects();
+
+            runner.expectEq("dense area in one upload", rects.size(), 1);
+            runner.expectEq("dense width", rects[0].width, 128);
+            runner.expectEq("dense height", rects[0].height, 128);
+        });
+    }
+
+    void testImageBlock(Runner &runner) {
+        runner.test("GPU image load from a block DMA", [&] {
+            Emulator::Gpu words = makeTimingGpu();
+            Emulator::Gpu block = makeTimingGpu();
+
+            // 9x3 across the right edge, with masked pixels that have to survive
+            std::vector<uint32_t> data(14);
+            for (size_t i = 0; i < data.size(); i++)
+                data[i] = (0x1000 + i * 2) | ((0x1001 + i * 2) << 16);
+
+            for (Emulator::Gpu* gpu : {&words, &block}) {
+                gpu->vram->setPixel(1021, 11, 0x8123);
+                gpu->vram->setPixel(2, 12, 0x8456);
+
+                gpu->gp0(0xE6000003);
+                gpu->gp0(0xA0000000);
+                gpu->gp0((11 << 16) | 1020);
+                gpu->gp0((3 << 16) | 9);
+            }
+
+            for (uint32_t word : data)
+                words.gp0(word);
+
+            const size_t taken = block.gp0ImageBlock(reinterpret_cast<const uint8_t*>(data.data()), data.size());
+
+            runner.expectEq("odd pixel count takes every word", taken, data.size());
+            runner.expect("transfer finished", block.gp0Mode == Emulator::Command);
+
+            bool same = true;
+            for (uint32_t y = 11; y < 14; y++)
+                for (uint32_t x = 1020; x < 1029; x++)
+                    same &= words.vram->pixel15(x, y) == block.vram->pixel15(x, y);
+
+            runner.expect("same pixels as word by word", same);
+            runner.expectEq("masked pixel kept", block.vram->pixel15(1021, 11), 0x8123);
+            runner.expectEq("wrapped pixel", block.vram->pixel15(0, 11), 0x9004);
+            runner.expectEq("masked wrapped pixel kept", block.vram->pixel15(2, 12), 0x8456);
+
+            // Nothing to take outside a transfer
+            runner.expectEq("no transfer", block.gp0ImageBlock(reinterpret_cast<const uint8_t*>(data.data()), 1), 0);
+
+            // Threaded, the data goes to the GPU thread in one push, only as much
+            // as the transfer still needs
+            Emulator::Gpu threaded = makeTimingGpu();
+            threaded.setThreaded(true);
+
+            threaded.vram->setPixel(1021, 11, 0x8123);
+            threaded.vram->setPixel(2, 12, 0x8456);
+
+            for (uint32_t word : {0xE6000003u, 0xA0000000u, (11u << 16) | 1020u, (3u << 16) | 9u})
+                threaded.gp0(word);
+
+            std::vector<uint32_t> more = data;
+            more.push_back(0xE1000205);
+
+            runner.expect("running threaded", threaded.threaded());
+            runner.expectEq("threaded takes the transfer's words", threaded.gp0ImageBlock(reinterpret_cast<const uint8_t*>(more.data()), more.size()), data.size());
+            runner.expectEq("nothing past the transfer", threaded.gp0ImageBlock(reinterpret_cast<const uint8_t*>(more.data()), more.size()), 0);
+
+            threaded.sync();
+
+            bool sameThreaded = true;
+            for (uint32_t y = 11; y < 14; y++)
+                for (uint32_t x = 1020; x < 1029; x++)
+                    sameThreaded &= words.vram->pixel15(x, y) == threaded.vram->pixel15(x, y);
+
+            runner.expect("threaded transfer finished", threaded.gp0Mode == Emulator::Command);
+            runner.expect("threaded same pixels as word by word", sameThreaded);
+        });
+    }
+
+    void testTextureCache(Runner &runner) {
+        runner.test("GPU decoded texture pages", [&] {
+            Emulator::Gpu gpu = makeTimingGpu();
+            gpu.setSoftwareRendering(true, 1);
+
+            gpu.gp0(0xE3000000);
+            gpu.gp0(0xE407FDFF);
+            gpu.gp0(0xE5000000);
+
+            // 16 entry CLUT at (0, 480)
+            gpu.gp0(0xA0000000);
+            gpu.gp0(0x01E00000);
+            gpu.gp0(0x00010010);
+
+            for (uint32_t i = 0; i < 16; i += 2)
+                gpu.gp0((0x100 + i) | ((0x101 + i) << 16));
+
+            // Indices 2, 0, 3, 0 at the start of the 4-bit page at (64, 0)
+            gpu.gp0(0xA0000000);
+            gpu.gp0(0x00000040);
+            gpu.gp0(0x00010001);
+            gpu.gp0(0x00000302);
+
+            const auto drawStrip = [&] {
+                gpu.gp0(0xE1000001);
+                gpu.gp0(0x65000000);
+                gpu.gp0(0x006400C8);
+                gpu.gp0(0x78000000);
+                gpu.gp0(0x00010004);
+            };
+
+            drawStrip();
+
+            runner.expectEq("first texel", gpu.vram->pixel15(200, 100), 0x102);
+            runner.expectEq("third texel", gpu.vram->pixel15(202, 100), 0x103);
+            runner.expectEq("through getPixel4", gpu.vram->getPixel4(3, 0, 0, 480, 64, 0), 0x100);
+            runner.expectEq("8-bit read of the same page", gpu.vram->getPixel8(1, 0, 0, 480, 64, 0), 0x103);
+
+            const Emulator::TextureCache::Key key = {64, 0, 0, 480, 0};
+            bool recycled = true;
+
+            // Writes elsewhere leave the page alone
+            gpu.gp0(0x02000000);
+            gpu.gp0(0x00000200);
+            gpu.gp0(0x00100040);
+
+            gpu.vram->textures.find(key, recycled);
+            runner.expect("kept after an unrelated fill", !recycled);
+
+            // New CLUT entry 2 has to show up in the next draw
+            gpu.gp0(0xA0000000);
+            gpu.gp0(0x01E00002);
+            gpu.gp0(0x00010001);
+            gpu.gp0(0x00007FFF);
+
+            drawStrip();
+
+            runner.expectEq("CLUT change picked up", gpu.vram->pixel15(200, 100), 0x7FFF);
+            runner.expectEq("rest of the strip", gpu.vram->pixel15(202, 100), 0x103);
+        });
+    }
+
+    // Software rendering, with the drawing area covering all of VRAM and no offset
+    void startDrawing(Emulator::Gpu &gpu) {
+        gpu.setSoftwareRendering(true, 1);
+
+        gpu.gp0(0xE3000000);
+        gpu.gp0(0xE407FDFF);
+        gpu.gp0(0xE5000000);
+    }
+
+    // 'pixels' row after row through GP0(A0h)
+    void loadImage(Emulator::Gpu &gpu, uint32_t x, uint32_t y, uint32_t width, const std::vector<uint16_t> &pixels) {
+        const auto height = static_cast<uint32_t>(pixels.size() / width);
+
+        gpu.gp0(0xA0000000);
+        gpu.gp0((y << 16) | x);
+        gpu.gp0((height << 16) | width);
+
+        for (size_t i = 0; i < pixels.size(); i += 2)
+            gpu.gp0(pixels[i] | (i + 1 < pixels.size() ? pixels[i + 1] << 16 : 0u));
+    }
+
+    // Raw textured triangle (0, y), (size, y), (0, y + size), with the
+    // texture coordinates starting at (0, 0), so pixel (x, y + v) gets texel (x, v)
+    void texturedTriangle(Emulator::Gpu &gpu, uint32_t y, uint32_t size, uint32_t clut, uint32_t page) {
+        gpu.gp0(0x25000000);
+        gpu.gp0(y << 16);
+        gpu.gp0(clut << 16);
+        gpu.gp0((y << 16) | size);
+        gpu.gp0((page << 16) | size);
+        gpu.gp0((y + size) << 16);
+        gpu.gp0(size << 8);
+    }
+
+    void testRasterizerPixels(Runner &runner) {
+        runner.test("GPU software rasterizer, Gouraud shading", [&] {
+            Emulator::Gpu gpu = makeTimingGpu();
+            startDrawing(gpu);
+
+            // Red (0, 0), green (16, 0), blue (0, 16)
+            gpu.gp0(0x300000FF);
+            gpu.gp0(0x00000000);
+            gpu.gp0(0x0000FF00);
+            gpu.gp0(0x00000010);
+            gpu.gp0(0x00FF0000);
+            gpu.gp0(0x00100000);
+
+            runner.expectEq("red vertex", gpu.vram->pixel15(0, 0), 0x001F);
+            runner.expectEq("half way to green", gpu.vram->pixel15(8, 0), 0x0210);
+            runner.expectEq("half way to blue", gpu.vram->pixel15(0, 8), 0x4010);
+            runner.expectEq("inside", gpu.vram->pixel15(4, 4), 0x2110);
+        });
+
+        runner.test("GPU software rasterizer, lines", [&] {
+            Emulator::Gpu gpu = makeTimingGpu();
+            startDrawing(gpu);
+
+            // Green (0, 10) to (6, 13), both ends drawn
+            gpu.gp0(0x4000FF00);
+            gpu.gp0(0x000A0000);
+            gpu.gp0(0x000D0006);
+
+            runner.expectEq("first end", gpu.vram->pixel15(0, 10), 0x03E0);
+            runner.expectEq("middle", gpu.vram->pixel15(3, 12), 0x03E0);
+            runner.expectEq("last end", gpu.vram->pixel15(6, 13), 0x03E0);
+            runner.expectEq("off the line", gpu.vram->pixel15(1, 10), 0);
+
+            // Red (0, 20) to blue (4, 20)
+            gpu.gp0(0x500000FF);
+            gpu.gp0(0x00140000);
+            gpu.gp0(0x00FF0000);
+            gpu.gp0(0x00140004);
+
+            runner.expectEq("red end", gpu.vram->pixel15(0, 20), 0x001F);
+            runner.expectEq("shaded middle", gpu.vram->pixel15(2, 20), 0x4010);
+            runner.expectEq("blue end", gpu.vram->pixel15(4, 20), 0x7C00);
+        });
+
+        runner.test("GPU software rasterizer, dithering", [&] {
+            Emulator::Gpu gpu = makeTimingGpu();
+            startDrawing(gpu);
+
+            // Dithering on, a shaded triangle that stays at about 128 gray
+            gpu.gp0(0xE1000200);
+            gpu.gp0(0x30808080);
+            gpu.gp0(0x00000000);
+            gpu.gp0(0x00808081);
+            gpu.gp0(0x00000010);
+            gpu.gp0(0x00808080);
+            gpu.gp0(0x00100000);
+
+            runner.expectEq("dithered down", gpu.vram->pixel15(0, 0), 0x3DEF);
+            runner.expectEq("left alone", gpu.vram->pixel15(1, 0), 0x4210);
+            runner.expectEq("second row, down", gpu.vram->pixel15(1, 1), 0x3DEF);
+            runner.expectEq("second row, up", gpu.vram->pixel15(2, 1), 0x4210);
+
+            // Flat triangles aren't dithered
+            gpu.gp0(0x20808080);
+            gpu.gp0(0x00000020);
+            gpu.gp0(0x00000030);
+            gpu.gp0(0x00100020);
+
+            runner.expectEq("flat", gpu.vram->pixel15(32, 0), 0x4210);
+
+            // Neither is anything with dithering off
+            gpu.gp0(0xE1000000);
+            gpu.gp0(0x30808080);
+            gpu.gp0(0x00000040);
+            gpu.gp0(0x00808081);
+            gpu.gp0(0x00000050);
+            gpu.gp0(0x00808080);
+            gpu.gp0(0x00100040);
+
+            runner.expectEq("dithering off", gpu.vram->pixel15(64, 0), 0x4210);
+        });
+
+        runner.test("GPU software rasterizer, mask bit", [&] {
+            Emulator::Gpu gpu = makeTimingGpu();
+            startDrawing(gpu);
+
+            // Set the mask bit on a red 4x1 rectangle at (0, 30)
+            gpu.gp0(0xE6000001);
+            gpu.gp0(0x600000FF);
+            gpu.gp0(0x001E0000);
+            gpu.gp0(0x00010004);
+
+            runner.expectEq("mask bit set", gpu.vram->pixel15(3, 30), 0x801F);
+
+            // Check it, a green 8x1 rectangle over it only fills the rest
+            gpu.gp0(0xE6000002);
+            gpu.gp0(0x6000FF00);
+            gpu.gp0(0x001E0000);
+            gpu.gp0(0x00010008);
+
+            runner.expectEq("masked pixel kept", gpu.vram->pixel15(0, 30), 0x801F);
+            runner.expectEq("last masked pixel kept", gpu.vram->pixel15(3, 30), 0x801F);
+            runner.expectEq("unmasked pixel drawn", gpu.vram->pixel15(4, 30), 0x03E0);
+            runner.expectEq("without setting the bit", gpu.vram->pixel15(7, 30), 0x03E0);
+        });
+
+        runner.test("GPU software rasterizer, textured triangles", [&] {
+            Emulator::Gpu gpu = makeTimingGpu();
+            startDrawing(gpu);
+
+            // 15-bit 32x32 texture at (512, 0), texel (u, v) is 1 + u + v * 32
+            const auto texel = [](uint32_t u, uint32_t v) { return 1 + u + v * 32; };
+            std::vector<uint16_t> pixels;
+
+            for (uint32_t v = 0; v < 32; v++)
+                for (uint32_t u = 0; u < 32; u++)
+                    pixels.push_back(static_cast<uint16_t>(texel(u, v)));
+
+            loadImage(gpu, 512, 0, 32, pixels);
+            texturedTriangle(gpu, 40, 32, 0, 0x108);
+
+            runner.expectEq("15-bit first texel", gpu.vram->pixel15(0, 40), texel(0, 0));
+            runner.expectEq("15-bit along the row", gpu.vram->pixel15(5, 40), texel(5, 0));
+            runner.expectEq("15-bit further down", gpu.vram->pixel15(3, 47), texel(3, 7));
+
+            // Same texture through a window, X mask 1 and X offset 1 turn on bit 3 of U
+            gpu.gp0(0xE2000401);
+            texturedTriangle(gpu, 300, 16, 0, 0x108);
+            gpu.gp0(0xE2000000);
+
+            runner.expectEq("windowed texel", gpu.vram->pixel15(1, 300), texel(9, 0));
+            runner.expectEq("windowed, second row", gpu.vram->pixel15(2, 301), texel(10, 1));
+            runner.expectEq("windowed, already in it", gpu.vram->pixel15(9, 300), texel(9, 0));
+
+            // 4-bit page at (576, 0), indices 1 to 8, CLUT at (0, 480)
+            std::vector<uint16_t> clut;
+
+            for (uint16_t i = 0; i < 16; i++)
+                clut.push_back(0x1000 | i);
+
+            loadImage(gpu, 0, 480, 16, clut);
+            loadImage(gpu, 576, 0, 1, {0x4321, 0x8765});
+            texturedTriangle(gpu, 100, 4, 0x7800, 0x0009);
+
+            runner.expectEq("4-bit first row", gpu.vram->pixel15(2, 100), 0x1003);
+            runner.expectEq("4-bit second row", gpu.vram->pixel15(1, 101), 0x1006);
+
+            // 8-bit page at (640, 0), indices 1 to 8, CLUT at (0, 481)
+            clut.clear();
+
+            for (uint16_t i = 0; i < 256; i++)
+                clut.push_back(0x2000 | i);
+
+            loadImage(gpu, 0, 481, 256, clut);
+            loadImage(gpu, 640, 0, 2, {0x0201, 0x0403, 0x0605, 0x0807});
+            texturedTriangle(gpu, 200, 4, 0x7840, 0x008A);
+
+            runner.expectEq("8-bit first row", gpu.vram->pixel15(3, 200), 0x2004);
+            runner.expectEq("8-bit second row", gpu.vram->pixel15(1, 201), 0x2006);
+        });
+    }
+
+    void testSoftwareRasterizer(Runner &runner) {
+        runner.test("GPU software rasterizer", [&] {
+            Emulator::Gpu gpu = makeTimingGpu();
+            gpu.setSoftwareRendering(true, 1);
+
+            // Drawing area covers all of VRAM, no offset
+            gpu.gp0(0xE3000000);
+            gpu.gp0(0xE407FDFF);
+            gpu.gp0(0xE5000000);
+
+            // Red monochrome triangle (0, 0), (4, 0), (0, 4)
+            gpu.gp0(0x200000FF);
+            gpu.gp0(0x00000000);
+            gpu.gp0(0x00000004);
+            gpu.gp0(0x00040000);
+
+            runner.expectEq("top left corner", gpu.vram->pixel15(0, 0), 0x001F);
+            runner.expectEq("top edge", gpu.vram->pixel15(3, 0), 0x001F);
+            runner.expectEq("right vertex", gpu.vram->pixel15(4, 0), 0);
+            runner.expectEq("inside the diagonal", gpu.vram->pixel15(1, 2), 0x001F);
+            runner.expectEq("on the diagonal", gpu.vram->pixel15(2, 2), 0);
+
+            // Additive (B+F) semi-transparent 2x1 rectangle drawn twice at (8, 0)
+            const auto drawBlended = [&] {
+                gpu.gp0(0x62000080);
+                gpu.gp0(0x00000008);
+                gpu.gp0(0x00010002);
+            };
+
+            gpu.gp0(0xE1000020);
+            drawBlended();
+
+            runner.expectEq("blended once", gpu.vram->pixel15(8, 0), 0x0010);
+            runner.expectEq("blended once, right pixel", gpu.vram->pixel15(9, 0), 0x0010);
+            runner.expectEq("outside the rectangle", gpu.vram->pixel15(10, 0), 0);
+
+            drawBlended();
+
+            runner.expectEq("blended twice", gpu.vram->pixel15(8, 0), 0x001F);
+            runner.expectEq("blended twice, right pixel", gpu.vram->pixel15(9, 0), 0x001F);
+
+            // Comes back out through GPUREAD without a GL readback
+            gpu.gp0(0xC0000000);
+            gpu.gp0(0x00000008);
+            gpu.gp0(0x00010002);
+
+            runner.expectEq("GPUREAD after drawing", gpu.read(), 0x001F001F);
+        });
+    }
+
+    void testGp0Decoding(Runner &runner) {
+        runner.test("GPU GP0 opcode decoding", [&] {
+            Emulator::Gpu gpu = makeTimingGpu();
+            gpu.setSoftwareRendering(true, 1);
+
+            gpu.gp0(0xE3000000);
+            gpu.gp0(0xE407FDFF);
+            gpu.gp0(0xE5000000);
+
+            // GP0(10h) is a NOP, the fill right after it has to go through
+            gpu.gp0(0x10000000);
+            gpu.gp0(0x020000FF);
+            gpu.gp0(0x00000000);
+            gpu.gp0(0x00010010);
+
+            runner.expectEq("fill after a NOP", gpu.vram->pixel15(15, 0), 0x001F);
+
+            // GP0(9Fh) mirrors GP0(80h), copy (0, 0) to (32, 0)
+            gpu.gp0(0x9F000000);
+            gpu.gp0(0x00000000);
+            gpu.gp0(0x00000020);
+            gpu.gp0(0x00010001);
+
+            runner.expectEq("mirrored VRAM copy", gpu.vram->pixel15(32, 0), 0x001F);
+
+            // GP0(41h) is GP0(40h) with the ignored texture bit set
+            gpu.gp0(0x41FF0000);
+            gpu.gp0(0x00040000);
+            gpu.gp0(0x00040003);
+
+            runner.expectEq("line with ignored bits", gpu.vram->pixel15(2, 4), 0x7C00);
+            runner.expect("ready for the next command", (gpu.status() >> 26) & 1);
+        });
+    }
+
+    // Overlapping semi-transparent shaded triangles in the top left 256x128,
+    // so any reordering shows up in the blended result
+    std::vector<uint32_t> blendedTriangles() {
+        uint32_t seed = 12345;
+        auto next = [&seed] {
+            seed = seed * 1103515245 + 12345;
+            return seed >> 8;
+        };
+
+        std::vector<uint32_t> commands = {0xE3000000, 0xE407FDFF, 0xE5000000, 0xE1000220};
+
+        for (int i = 0; i < 500; i++) {
+            commands.push_back(0x32000000 | (next() & 0xFFFFFF));
+
+            for (int v = 0; v < 3; v++) {
+                if (v > 0)
+                    commands.push_back(next() & 0xFFFFFF);
+
+                commands.push_back(((next() % 128) << 16) | (next() % 256));
+            }
+        }
+
+        return commands;
+    }
+
+    // Raw textured quads from the 15-bit page at (512, 0), with the page
+    // loaded again halfway through. Queued quads have to sample the first load.
+    std::vector<uint32_t> overwrittenPage() {
+        uint32_t seed = 6789;
+        auto next = [&seed] {
+            seed = seed * 1103515245 + 12345;
+            return seed >> 8;
+        };
+
+        std::vector<uint32_t> commands = {0xE3000000, 0xE407FDFF, 0xE5000000};
+
+        for (uint32_t load = 0; load < 2; load++) {
+            commands.push_back(0xA0000000);
+            commands.push_back(0x00000200);
+            commands.push_back(0x01000100);
+
+            // No zero texels, those would be transparent
+            for (uint32_t i = 0; i < 256 * 256 / 2; i++)
+                commands.push_back((next() | 0x00010001) & 0x7FFF7FFF);
+
+            for (int quad = 0; quad < 100; quad++) {
+                const uint32_t x = next() % 200, y = next() % 100;
+                const uint32_t w = 1 + next() % 56, h = 1 + next() % 28;
+                const uint32_t u = next() % 200, v = next() % 200;
+
+                commands.push_back(0x2D000000);
+                commands.push_back((y << 16) | x);
+                commands.push_back((v << 8) | u);
+                commands.push_back((y << 16) | (x + w));
+                commands.push_back(0x01080000 | (v << 8) | (u + w));
+                commands.push_back(((y + h) << 16) | x);
+                commands.push_back(((v + h) << 8) | u);
+                commands.push_back(((y + h) << 16) | (x + w));
+                commands.push_back(((v + h) << 8) | (u + w));
+            }
+        }
+
+        return commands;
+    }
+
+    // Draws 'commands' and reads the top left 256x128 back, which has to wait for any threads
+    std::vector<uint32_t> drawAndRead(Emulator::Gpu &gpu, const std::vector<uint32_t> &commands) {
+        for (uint32_t command : commands)
+            gpu.gp0(command);
+
+        gpu.gp0(0xC0000000);
+        gpu.gp0(0x00000000);
+        gpu.gp0(0x00800100);
+
+        std::vector<uint32_t> words(256 * 128 / 2);
+
+        for (uint32_t &word : words)
+            word = gpu.read();
+
+        return words;
+    }
+
+    // One GPU at a time, the drawing offset is shared between them
+    int compareDrawing(Emulator::Gpu &a, Emulator::Gpu &b, const std::vector<uint32_t> &commands) {
+        const std::vector<uint32_t> first = drawAndRead(a, commands);
+        const std::vector<uint32_t> second = drawAndRead(b, commands);
+
+        int mismatches = 0;
+
+        for (size_t i = 0; i < first.size(); i++) {
+            if (first[i] != second[i])
+                mismatches++;
+        }
+
+        return mismatches;
+    }
+
+    void testThreadedRasterizer(Runner &runner) {
+        runner.test("GPU threaded rasterizer", [&] {
+            Emulator::Gpu single = makeTimingGpu();
+            Emulator::Gpu threaded = makeTimingGpu();
+
+            single.setSoftwareRendering(true, 1);
+            threaded.setSoftwareRendering(true, 4);
+
+            runner.expectEq("words differing from a single thread", compareDrawing(single, threaded, blendedTriangles()), 0);
+        });
+
+        runner.test("GPU threaded rasterizer 15-bit texture writes", [&] {
+            Emulator::Gpu single = makeTimingGpu();
+            Emulator::Gpu threaded = makeTimingGpu();
+
+            single.setSoftwareRendering(true, 1);
+            threaded.setSoftwareRendering(true, 4);
+
+            runner.expectEq("words differing from a single thread", compareDrawing(single, threaded, overwrittenPage()), 0);
+        });
+    }
+
+    void testGpuThread(Runner &runner) {
+        runner.test("GPU command thread", [&] {
+            Emulator::Gpu inline_ = makeTimingGpu();
+            Emulator::Gpu threaded = makeTimingGpu();
+
+            inline_.setSoftwareRendering(true, 1);
+            threaded.setSoftwareRendering(true, 4);
+            threaded.setThreaded(true);
+
+            runner.expect("running threaded", threaded.threaded());
+            runner.expectEq("words differing from inline GP0", compareDrawing(inline_, threaded, blendedTriangles()), 0);
+
+            // GPUSTAT comes from the shadow, which is current after a sync
+            threaded.gp0(0xE1000205);
+            threaded.sync();
+
+            runner.expectEq("texpage bits", threaded.status() & 0x7FF, 0x205);
+            runner.expectStatusBit("ready for commands", threaded.status(), 26, true);
+        });
+
+        runner.test("GPU command thread status without a sync", [&] {
+            Emulator::Gpu gpu = makeTimingGpu();
+            gpu.setSoftwareRendering(true, 1);
+            gpu.setThreaded(true);
+
+            // Keeps the thread busy for a while, nothing below waits for it
+            for (uint32_t word : blendedTriangles())
+                gpu.gp0(word);
+
+            gpu.gp0(0xE1000385);
+            runner.expectEq("texpage bits, depth 3 is 15-bit", gpu.status() & 0x7FF, 0x305);
+
+            // Image data and vertices that look like E1h/E6h aren't commands
+            for (uint32_t word : {0xA0000000u, 0x00000000u, 0x00020002u, 0xE1000000u, 0xE6000003u})
+                gpu.gp0(word);
+
+            gpu.gp0(0x20000000);
+            gpu.gp0(0xE1000000);
+            gpu.gp0(0xE6000003);
+            gpu.gp0(0x00100010);
+
+            runner.expectEq("unchanged by parameters", gpu.status() & 0x1FFF, 0x305);
+
+            // Textured polygons bring their own texture depth, 8-bit here
+            for (uint32_t word : {0x24808080u, 0x00000000u, 0x00000000u, 0x00000010u, 0x00800000u, 0x00100000u, 0x00000000u})
+                gpu.gp0(word);
+
+            runner.expectEq("texture depth from a polygon", gpu.status() & 0x1FFF, 0x285);
+
+            gpu.gp0(0xE6000003);
+            gpu.gp0(0x1F000000);
+
+            const uint32_t queued = gpu.status();
+
+            runner.expectStatusBit("set mask bit", queued, 11, true);
+            runner.expectStatusBit("check mask bit", queued, 12, true);
+            runner.expectStatusBit("IRQ", queued, 24, true);
+
+            gpu.sync();
+            runner.expectEq("same once the thread is done", gpu.status() & 0x1FFF, queued & 0x1FFF);
+        });
+    }
 } // namespace
 
 bool GpuTimingTests::runAll() {
@@ -174,8 +993,19 @@ bool GpuTimingTests::runAll() {
     testNtscHorizontalTiming(runner);
     testNtscVerticalTiming(runner);
     testCpuCycleToCrtcTicks(runner);
+    testCyclesUntilCrtcEvent(runner);
+    testSchedulerCatchUp(runner);
     testPalTiming(runner);
     testStatusOddLineBit(runner);
+    testWithoutRenderer(runner);
+    testDirtyRects(runner);
+    testImageBlock(runner);
+    testTextureCache(runner);
+    testSoftwareRasterizer(runner);
+    testRasterizerPixels(runner);
+    testGp0Decoding(runner);
+    testThreadedRasterizer(runner);
+    testGpuThread(runner);
 
     std::cerr << "GPU timing tests: " << runner.passed << " passed, " << runner.failed << " failed\n";
 
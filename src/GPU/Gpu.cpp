@@ -4,7 +4,11 @@
 #include <cassert>
 #include <deque>
 
+#ifndef PSX_HEADLESS
 #include "Rendering/Renderer.h"
+#endif
+#include "Rendering/NullRenderer.h"
+#include "Rendering/Rasterizer.h"
 #include "VRAM.h"
 
 #include <ios>
@@ -24,35 +28,119 @@ namespace {
     }
 }
 
-static const Emulator::Gpu::BitField polygonFields[] = {
-    {"rgb",               0, 24},
-    {"isRawTexture",     24, 1},
-    {"isSemiTransparent",25, 1},
-    {"isTextured",       26, 1},
-    {"isFourVerts",      27, 1},
-    {"isGouraud",        28, 1},
-};
-
-static const Emulator::Gpu::BitField lineFields[] = {
-    {"rgb",               0, 24},
-    {"isSemiTransparent",25, 1},
-    {"isPolyline",       27, 1},
-    {"gouraud",          28, 1},
-};
-
-static const Emulator::Gpu::BitField rectangleFields[] = {
-    {"rgb",               0, 24},
-    {"isRawTexture",      24, 1},
-    {"isSemiTransparent", 25, 1},
-    {"isTextured",        26, 1},
-    /**
-     * 0 (00)      variable size
-     * 1 (01)      single pixel (1x1)
-     * 2 (10)      8x8 sprite
-     * 3 (11)      16x16 sprite
-     */
-    {"rectangleSize",     27, 2},
-};
+constexpr std::array<Emulator::Gpu::Gp0Descriptor, 256> Emulator::Gpu::makeGp0Descriptors() {
+    std::array<Gp0Descriptor, 256> table{};
+    
+    for (uint32_t opcode = 0; opcode < 256; opcode++) {
+        auto& command = table[opcode];
+        
+        // Bits 24-28 of the command word, same meaning for every draw command
+        const bool rawTexture      = opcode & 0x01;
+        const bool semiTransparent = opcode & 0x02;
+        const bool textured        = opcode & 0x04;
+        
+        switch (opcode >> 5) {
+            case 0b001: {
+                const bool fourVerts = opcode & 0x08;
+                const bool shaded    = opcode & 0x10;
+                
+                command.kind = Gp0Kind::Polygon;
+                command.vertices = fourVerts ? 4 : 3;
+                command.shaded = shaded;
+                command.textured = textured;
+                command.rawTexture = textured && rawTexture;
+                command.semiTransparent = semiTransparent;
+                
+                // Color of every vertex but the first, which is in the command word
+                command.words = 1 + command.vertices
+                    + (shaded ? command.vertices - 1 : 0)
+                    + (textured ? command.vertices : 0);
+                command.handler = &Gpu::gp0Polygon;
+                
+                break;
+            }
+            case 0b010: {
+                // Lines can't be textured, bits 24 and 26 do nothing
+                const bool polyLine = opcode & 0x08;
+                const bool shaded   = opcode & 0x10;
+                
+                command.kind = polyLine ? Gp0Kind::PolyLine : Gp0Kind::Line;
+                command.vertices = 2;
+                command.shaded = shaded;
+                command.semiTransparent = semiTransparent;
+                
+                if (polyLine) {
+                    command.handler = shaded ? &Gpu::gp0ShadedPolyLine : &Gpu::gp0PolyLineMono;
+                } else {
+                    command.words = shaded ? 4 : 3;
+                    command.handler = shaded ? &Gpu::gp0ShadedLine : &Gpu::gp0MonoLine;
+                }
+                
+                break;
+            }
+            case 0b011: {
+                const uint8_t rectangleSize = (opcode >> 3) & 3;
+                
+                command.kind = Gp0Kind::Rectangle;
+                command.vertices = 1;
+                command.textured = textured;
+                command.rawTexture = textured && rawTexture;
+                command.semiTransparent = semiTransparent;
+                command.rectangleSize = rectangleSize;
+                
+                // Only variable sized ones have a size word
+                command.words = 2 + (rectangleSize == 0 ? 1 : 0) + (textured ? 1 : 0);
+                command.handler = &Gpu::gp0Rectangle;
+                
+                break;
+            }
+            case 0b100:
+                command = {Gp0Kind::Other, 4};
+                command.handler = &Gpu::gp0VramToVram;
+                
+                break;
+            case 0b101:
+                command = {Gp0Kind::Other, 3};
+                command.handler = &Gpu::gp0ImageLoad;
+                
+                break;
+            case 0b110:
+                command = {Gp0Kind::Other, 3};
+                command.handler = &Gpu::gp0ImageStore;
+                
+                break;
+            default:
+                // GP0(04h-1Eh), GP0(E0h), GP0(E7h-FFh) are all NOPs
+                break;
+        }
+    }
+    
+    table[0x01] = {Gp0Kind::Other, 1};
+    table[0x01].handler = &Gpu::gp0ClearCache;
+    
+    table[0x02] = {Gp0Kind::Other, 3};
+    table[0x02].handler = &Gpu::gp0FillVRam;
+    
+    table[0x1F] = {Gp0Kind::Irq};
+    
+    void (Gpu::*const environment[])(uint32_t) = {
+        &Gpu::gp0DrawMode,
+        &Gpu::gp0TextureWindow,
+        &Gpu::gp0DrawingAreaTopLeft,
+        &Gpu::gp0DrawingAreaBottomRight,
+        &Gpu::gp0DrawingOffset,
+        &Gpu::gp0MaskBitSetting,
+    };
+    
+    for (uint32_t i = 0; i < 6; i++) {
+        table[0xE1 + i] = {Gp0Kind::Other, 1};
+        table[0xE1 + i].handler = environment[i];
+    }
+    
+    return table;
+}
+
+const std::array<Emulator::Gpu::Gp0Descriptor, 256> Emulator::Gpu::gp0Descriptors = makeGp0Descriptors();
 
 Emulator::Gpu::Gpu(bool enableRendering)
     : pageBaseX(0),
@@ -74,15 +162,103 @@ Emulator::Gpu::Gpu(bool enableRendering)
       interrupt(false),
       dmaDirection(DmaDirection::Off),
       displayHorizFlip(false) {
-        if (enableRendering) {
+#ifndef PSX_HEADLESS
+        if (enableRendering)
             renderer = new Renderer(*this);
-            vram = new VRAM(*this);
-        }
+#endif
+        
+        // Without GL everything the guest sees still goes through VRAM
+        if (!renderer)
+            renderer = new NullRenderer();
+        
+        vram = new VRAM(*this, renderer->ownsContext());
 
         //renderer->init();
         reset();
 }
 
+Emulator::Gpu::~Gpu() {
+    // The GPU thread draws through all of these, and the rasterizer's
+    // workers write to VRAM
+    gpuThread.stop();
+    
+    delete rasterizer;
+    delete vram;
+    delete renderer;
+}
+
+void Emulator::Gpu::setSoftwareRendering(bool enabled, unsigned threads) {
+    if (enabled == softwareRendering())
+        return;
+    
+    sync();
+    
+    if (enabled) {
+        // Whatever GL drew so far has to be in VRAM before the rasterizer takes over
+        renderer->flushDrawCommands();
+        renderer->readbackToVram(0, 0, vram->MAX_WIDTH, vram->MAX_HEIGHT);
+        renderer->waitForReadbacks();
+        
+        if (threads == 0)
+            threads = std::thread::hardware_concurrency();
+        
+        rasterizer = new Rasterizer(*this, threads);
+        return;
+    }
+    
+    delete rasterizer;
+    rasterizer = nullptr;
+    
+    if (!canRunThreaded())
+        setThreaded(false);
+    
+    // And the other way around, GL continues drawing on top of VRAM,
+    // with the state it missed in the meantime
+    renderer->setSemiTransparencyMode(semiTransparency);
+    renderer->setDrawingArea(drawingAreaLeft, drawingAreaRight, drawingAreaTop, drawingAreaBottom);
+    renderer->setTextureWindow(textureWindowXMask, textureWindowYMask, textureWindowXOffset, textureWindowYOffset);
+    
+    vram->markDirty(0, 0, vram->MAX_WIDTH, vram->MAX_HEIGHT);
+    vram->endTransfer();
+    vram->copyToTexture(0, 0, 0, 0, vram->MAX_WIDTH, vram->MAX_HEIGHT, renderer->sceneTexture());
+}
+
+void Emulator::Gpu::waitForReadbacks() const {
+    if (!rasterizer)
+        renderer->waitForReadbacks();
+}
+
+bool Emulator::Gpu::canRunThreaded() const {
+    // GL calls have to stay on the thread owning the context
+    return !renderer->ownsContext() || rasterizer;
+}
+
+void Emulator::Gpu::setThreaded(bool enabled) {
+    if (!enabled) {
+        gpuThread.stop();
+        return;
+    }
+    
+    if (threaded() || !canRunThreaded())
+        return;
+    
+    reframeGp0();
+    gpuThread.publishStatus(gp0StatusBits());
+    gpuThread.start([this](const uint32_t* words, size_t count) {
+        // Image data pushed by 'gp0ImageBlock' goes in a row at a time here too
+        size_t done = writeImageWords(reinterpret_cast<const uint8_t*>(words), count);
+        
+        if (done == 0) {
+            executeGp0(*words);
+            done = 1;
+        }
+        
+        gpuThread.publishStatus(gp0StatusBits());
+        
+        return done;
+    });
+}
+
 bool Emulator::Gpu::step(uint32_t cpuCycles) {
     lastDotTicks = 0;
 
@@ -177,6 +353,14 @@ uint32_t Emulator::Gpu::ticksUntilNextCRTCEvent() const {
     return std::max(next, 1u);
 }
 
+uint32_t Emulator::Gpu::cyclesUntilNextCRTCEvent() const {
+    uint64_t num = vmode == VMode::Pal ? PAL_CRTC_NUM : NTSC_CRTC_NUM;
+    uint64_t needed = uint64_t(ticksUntilNextCRTCEvent()) * CRTC_DEN - _gpuFrac;
+
+    // Round up, 'step' only converts whole GPU ticks
+    return static_cast<uint32_t>(std::max<uint64_t>((needed + num - 1) / num, 1));
+}
+
 /*bool Emulator::Gpu::step(uint32_t cycles) {
     /**
      * Dots per scanline are, depending on horizontal resolution, and on PAL/NTSC:
@@ -283,31 +467,21 @@ uint32_t Emulator::Gpu::ticksUntilNextCRTCEvent() const {
 uint32_t Emulator::Gpu::status() {
     // https://psx-spx.consoledev.net/graphicsprocessingunitgpu/#1f801814h-gpustat-gpu-status-register-r
     
-    uint32_t status = 0;
+    // GP0 state belongs to the GPU thread when there's one, it leaves a copy
+    // behind. That copy lags the words still queued, the bits they set come
+    // from what was pushed.
+    uint32_t status;
     
-    // Bits 0-3: Texture page X base (N * 64)
-    status |= (static_cast<uint32_t>(pageBaseX) & 0x0F) << 0;
-
-    // Bit 4: Texture page Y base 1 (N * 256)
-    status |= (static_cast<uint32_t>(pageBaseY) & 0x01) << 4;
-
-    // Bits 5-6: Semi-transparency mode
-    status |= (static_cast<uint32_t>(semiTransparency) & 0x03) << 5; // Mask to 2 bits
-
-    // Bits 7-8: Texture page color depth
-    status |= (static_cast<uint32_t>(textureDepth) & 0x03) << 7; // Mask to 2 bits
-
-    // Bit 9: Dither 24bit to 15bit (0=Off, 1=Enabled)
-    status |= static_cast<uint32_t>(dithering ? 1 : 0) << 9;
-
-    // Bit 10: Interlace Drawing (0=All Lines, 1=Inactive Lines)
-    status |= static_cast<uint32_t>(drawToDisplay ? 1 : 0) << 10;
-
-    // Bit 11: Set Mask-bit when drawing (0=No, 1=Yes)
-    status |= static_cast<uint32_t>(forceSetMaskBit ? 1 : 0) << 11;
-
-    // Bit 12: Don't draw to masked areas (0=Always, 1=Not to masked areas)
-    status |= static_cast<uint32_t>(preserveMaskedPixels ? 1 : 0) << 12;
+    if (threaded()) {
+        if (!pushed.known) {
+            sync();
+            reframeGp0();
+        }
+        
+        status = (gpuThread.statusBits() & ~PUSHED_STATUS_BITS) | pushed.status;
+    } else {
+        status = gp0StatusBits();
+    }
 
     // Bit 13: Interlace Field (0 = Top, 1 = Bottom)
     // (or, always 1 when GP1(08h).5=0)
@@ -318,9 +492,6 @@ uint32_t Emulator::Gpu::status() {
     // Bit 14: Flip screen horizontally (0=Off, 1=On, v1 only)
     status |= static_cast<uint32_t>(displayHorizFlip ? 1 : 0) << 14;
 
-    // GPUSTAT.15: bit1 of texpage Y base on 2 MB VRAM GPUs.
-    status |= static_cast<uint32_t>(textureDisable ? 1 : 0) << 15;
-
     status |= hres.intoStatus();
 
     status |= (static_cast<uint32_t>(vres) & 0x01) << 19;
@@ -337,36 +508,8 @@ uint32_t Emulator::Gpu::status() {
     // Bit 23: Display enable (0=Enabled, 1=Disabled)
     status |= static_cast<uint32_t>(displayEnabled ? 0 : 1) << 23;
 
-    // Bit 24: Interrupt request (0=Off, 1=IRQ)
-    status |= static_cast<uint32_t>(interrupt ? 1 : 0) << 24;
-
-    const uint32_t readyForCommand = readyToReceiveCommandWord() ? 1u : 0u;
-    const uint32_t readyToReadVram = readyToSendVramToCpu() ? 1u : 0u;
-    const uint32_t readyForDmaBlock = readyToReceiveDmaBlock() ? 1u : 0u;
-
-    // Bit 26: Ready to receive command word (0=No, 1=Ready)
-    // Cleared while the GPU is receiving parameters/image data or serving GPUREAD image data.
-    status |= readyForCommand << 26;
-
-    // Bit 27: Ready to send VRAM to CPU (0=No, 1=Ready)
-    /**
-     * Bit27: Gets set after sending GP0(C0h) and its parameters,
-     * and stays set until all data words are received; used as DMA request in DMA Mode 3.
-     */
-    status |= readyToReadVram << 27;
-
-    // Bit 28: Ready to receive DMA block (0=No, 1=Ready)
-    /**
-     * Bit28: Normally, this bit gets cleared when the command execution is busy
-     * (ie. once when the command and all of its parameters are received),
-     * however, for Polygon and Line Rendering commands,
-     * the bit gets cleared immediately after receiving the command word
-     * (ie. before receiving the vertex parameters).
-     * The bit is used as DMA request in DMA Mode 2, accordingly,
-     * the DMA would probably hang if the Polygon/Line parameters,
-     * are transferred in a separate DMA block (ie. the DMA probably starts ONLY on command words).
-     */
-    status |= readyForDmaBlock << 28;
+    const uint32_t readyToReadVram = (status >> 27) & 1u;
+    const uint32_t readyForDmaBlock = (status >> 28) & 1u;
 
     // Bits 29-30: DMA Direction (0=Off, 1=?, 2=CPUtoGP0, 3=GPUREADtoCPU)
     status |= (static_cast<uint32_t>(dmaDirection) & 0x03) << 29;
@@ -386,7 +529,7 @@ uint32_t Emulator::Gpu::status() {
     if (dmaDirection == DmaDirection::Off) {
         dma = 0;
     } else if (dmaDirection == DmaDirection::Fifo) {
-        dma = (readMode != VRam) ? 1u : 0u; // FIFO not more than half full. Approx until real FIFO level exists.
+        dma = readyToReadVram ^ 1u; // FIFO not more than half full. Approx until real FIFO level exists.
     } else if (dmaDirection == DmaDirection::CpuToGp0) {
         dma = readyForDmaBlock;
     } else if (dmaDirection == DmaDirection::VRamToCpu) {
@@ -398,920 +541,257 @@ uint32_t Emulator::Gpu::status() {
     return status;
 }
 
-bool Emulator::Gpu::readyToReceiveCommandWord() const {
-    return readMode != VRam && gp0Mode == Command && gp0CommandRemaining == 0;
-}
-
-bool Emulator::Gpu::readyToSendVramToCpu() const {
-    return readMode == VRam;
-}
-
-bool Emulator::Gpu::readyToReceiveDmaBlock() const {
-    if (readMode == VRam) {
-        return false;
-    }
-    
-    if (gp0Mode == VRam) {
-        return true;
-    }
-    
-    return gp0Mode == Command && gp0CommandRemaining == 0;
-}
-
-uint8_t lastCmd;
-uint32_t lastOp;
-std::deque<uint32_t> prvOps;
-std::unordered_map<std::string, uint32_t> fields;
-void Emulator::Gpu::gp0(uint32_t val) {
-    // Testing
-    if (gp0CommandRemaining > 0 && lastCmd != 0) {
-        gp0CommandRemaining--;
-        gp0Command.pushWord(val);
-        
-        // First command is gp0QuadMonoOpaque
-        // which is the background of the boot screen
-        if (gp0CommandRemaining == 0) {
-            uint32_t in = gp0Command.index(0);
-            
-            switch (gp0Mode) {
-                case Gp0Mode::Polygon: {
-                    const bool gouraud   = fields["isGouraud"];
-                    const bool fourVerts = fields["isFourVerts"];
-                    const bool textured  = fields["isTextured"];
-                    const bool rawTexture = textured && fields["isRawTexture"];
-
-                    const bool isTextured = textured;
-                    const uint8_t verticesCount = fourVerts ? 4 : 3;
-
-                    Color c0 = Color::fromGp0(in);
-                    Position positions[verticesCount];
-                    Color colors[verticesCount];
-                    UV uvs[verticesCount];
-
-                    uint8_t idx = 0;
-                    uint8_t stepping = 1 + (gouraud ? 1 : 0) + (isTextured ? 1 : 0);
-
-                    uint16_t clut = isTextured ? gp0Command.index(2) >> 16 : 0;
-                    uint16_t page = isTextured ? gp0Command.index(1 + stepping + 1) >> 16 : 0;
-
-                    for (int i = 1; i < gp0Command.len; i += stepping) {
-                        colors[idx] = (gouraud && i != 1)
-                            ? Color::fromGp0(gp0Command.index(i - 1))
-                            : c0;
-
-                        if (isTextured)
-                            uvs[idx] = UV::fromGp0(gp0Command.index(i + 1), clut, page, *this);
-
-                        positions[idx] = Position::fromGp0(gp0Command.index(i));
-                        idx++;
-                    }
-
-                    if (fourVerts)
-                        renderer->pushQuad(positions, colors, uvs, curAttribute);
-                    else
-                        renderer->pushTriangle(positions, colors, uvs, curAttribute);
-
-                    break;
-                    /*const bool gouraud         = fields["isGouraud"];
-                    const bool fourVerts       = fields["isFourVerts"];
-                    const bool textured  = fields["isTextured"];
-                    const bool rawTexture = textured && fields["isRawTexture"];
-
-                    const bool isTextured = textured;
-                    
-                    const uint8_t verticesCount = fourVerts ? 4 : 3;
-                    
-                    Color c0 = Color::fromGp0(in);
-                    Position positions[verticesCount];
-                    Color colors[verticesCount];
-                    UV uvs[verticesCount];
-                    
-                    uint8_t idx = 0;
-                    uint8_t stepping = 1 + gouraud + (isTextured ? 1 : 0);
-                    
-                    uint16_t clut = isTextured ? gp0Command.index(1 + 1) >> 16 : 0;
-                    uint16_t page = isTextured ? gp0Command.index(1 + stepping + 1) >> 16 : 0;
-                    
-                    for (int i = 1; i < gp0Command.len; i += stepping) {
-                        if (gouraud && i != 1) {
-                            // It says, if doing flat shading then,
-                            // there is no more colors to be sent per vertex
-                            colors[idx] = Color::fromGp0(gp0Command.index(i - 1));
-                        } else {
-                            colors[idx] = c0;
-                        }
-                        
-                        if (isTextured) {
-                            uvs[idx] = UV::fromGp0(gp0Command.index(i + 1), clut, page, *this);
-                        }
-                        
-                        positions[idx] = Position::fromGp0(gp0Command.index(i));
-                        
-                        idx++;
-                    }
-                    
-                    if (fourVerts) {
-                        renderer->pushQuad(positions, colors, uvs, curAttribute);
-                    } else {
-                        renderer->pushTriangle(positions, colors, uvs, curAttribute);
-                    }*/
-                }
-                case Gp0Mode::Line: {
-                    
-                    break;
-                }
-                case Gp0Mode::Rectangle: {
-                    const bool textured = fields["isTextured"] != 0;
-                    const bool rawTexture = textured && fields["isRawTexture"];
-                    const bool isTextured = textured;
-
-                    const uint8_t rectangleSize   = fields["rectangleSize"];
-                    
-                    const Position p0 = Position::fromGp0(gp0Command.index(1));
-                    const Color c0    = Color::fromGp0(in);
-                    UV uv0;
-                    
-                    if (isTextured) {
-                        const auto c = static_cast<uint16_t>(gp0Command.index(2) >> 16);
-                        uv0 = UV::fromGp0(gp0Command.index(2), c, pageBaseX, pageBaseY, *this);
-                    }
-                    
-                    uint16_t width = 0;
-                    uint16_t height = 0;
-                    
-                    /**
-                     * 0 (00)      variable size
-                     * 1 (01)      single pixel (1x1)
-                     * 2 (10)      8x8 sprite
-                     * 3 (11)      16x16 sprite
-                     */
-                    if (rectangleSize == 0) {
-                        uint32_t sizeData = gp0Command.index(isTextured ? 3 : 2);
-                        
-                        width = sizeData & 0xFFFF;
-                        height = sizeData >> 16;
-                        
-                        // Max size of 1023x511
-                        // but textured max; 256,256
-                        // TODO; It doesn't say (im probably just blind),
-                        // TODO; that it should clamp it or just ignore,
-                        // TODO; any rectangles outside of those areas?
-                        if (isTextured) {
-                            width = std::clamp<uint16_t>(width, 0, 256);
-                            height = std::clamp<uint16_t>(height, 0, 256);
-                        } else {
-                            width = std::clamp<uint16_t>(width, 0, 1023);
-                            height = std::clamp<uint16_t>(height, 0, 511);
-                        }
-                    } else if (rectangleSize == 1) {
-                        width = height = 1;
-                    } else if (rectangleSize == 2) {
-                        width = height = 8;
-                    } else if (rectangleSize == 3) {
-                        width = height = 16;
-                    }
-                    
-                    //uint8_t opcode = (in >> 24) & 0xFF;
-                    renderRectangle(p0, c0, uv0, width, height);
-                    
-                    break;
-                }
-            }
-            
-            gp0Mode = Command;
-        }
-        
-        return;
-    }
+uint32_t Emulator::Gpu::gp0StatusBits() const {
+    uint32_t status = 0;
     
-    if(gp0CommandRemaining == 0 && gp0Mode == Command) {
-        gp0Command.clear();
-        
-        uint8_t opcode = (val >> 24) & 0xFF;
-        uint8_t cmd = (val >> 29) & 0x7;
-        
-        // Polygon
-        if (cmd == 0b001) {
-            lastCmd = cmd;
-            
-            fields = decodeFields(val, polygonFields, std::size(polygonFields));
-            gp0Mode = Gp0Mode::Polygon;
-
-            bool gouraud         = fields["isGouraud"];
-            bool fourVerts       = fields["isFourVerts"];
-            bool semiTransparent = fields["isSemiTransparent"];
-            bool textured        = fields["isTextured"];
-            bool rawTexture      = textured && fields["isRawTexture"];
-            
-            TextureMode mode;
-            if (!textured)
-                mode = ColorOnly;
-            else if (rawTexture)
-                mode = TextureOnly;
-            else
-                mode = TextureColor;
-            
-            // IDE having weird issue so I gotta do a check
-            curAttribute = { semiTransparent, textured && !rawTexture, mode };
-            
-            uint8_t verticesCount = fourVerts ? 4 : 3;
-            bool isTextured = textured || rawTexture;
-            
-            uint8_t colorsCount = gouraud ? (verticesCount - 1) : 0;
-            uint8_t uvsCount = isTextured ? (verticesCount) : 0;
-
-            gp0CommandRemaining = (verticesCount + colorsCount + uvsCount);
-            gp0Command.pushWord(val);
-            
-            return;
-        } /*else if (cmd == 0b010) {
-            //lastCmd = cmd;
-            
-            //fields = decodeFields(val, lineFields, std::size(lineFields));
-            //gp0Mode = Gp0Mode::Line;
-        }*/ else if (cmd == 0b011) {
-            lastCmd = cmd;
-            
-            fields = decodeFields(val, rectangleFields, std::size(rectangleFields));
-            gp0Mode = Gp0Mode::Rectangle;
-            
-            // gp0VarRectangleMonoOpaque
-            bool semiTransparent = fields["isSemiTransparent"] != 0;
-            bool textured        = fields["isTextured"] != 0;
-            bool rawTexture      = textured && fields["isRawTexture"];
-            uint8_t rectangleSize = fields["rectangleSize"];
-            
-            TextureMode mode;
-            if (!textured)
-                mode = ColorOnly;
-            else if (rawTexture)
-                mode = TextureOnly;
-            else
-                mode = TextureColor;
-            
-            // Rectangle doesn't have blending
-            curAttribute = { semiTransparent, textured && !rawTexture, mode};
-
-            curAttribute.setTextureDepth(static_cast<int>(textureDepth));
-            
-            // If it's a variable size then,
-            // it'll contain an extra word
-            uint8_t verticesCount = 1 + ((rectangleSize == 0) ? 1 : 0) + (textured ? 1 : 0);
-            
-            gp0CommandRemaining = verticesCount;
-            gp0Command.pushWord(val);
-            
-            return;
-        }
-        
-        if (cmd != 0 && cmd != 4 && cmd != 5 && cmd != 6 && cmd != 7) {
-            //printf("f\n");
-        }
-        
-        lastCmd = 0;
-        
-        switch (opcode) {
-            case 0x00:
-                gp0CommandRemaining = 0;
-                Gp0CommandMethod    = &Gpu::gp0Nop;
-                
-                return;
-            case 0x01:
-                gp0CommandRemaining = 1;
-                Gp0CommandMethod    = &Gpu::gp0ClearCache;
-                
-                break;
-            case 0x1F:
-                //   GP0(1Fh)                 - Interrupt Request (IRQ1)
-                
-                interrupt = true;
-                // IRQ::trigger(IRQ::GPU);
-                // assert(false);
-                
-                return;
-            case 0x02:
-                
-                gp0CommandRemaining = 3;
-                Gp0CommandMethod    = &Gpu::gp0FillVRam;
-                
-                break;
-            case 0x03:
-                //   GP0(03h)                 - Unknown (does take up FIFO space!!!)
-                
-                printf("WTF? CMD; = %x\n", cmd);
-                
-                return;
-            case 0x20: /*
-             case 0x21:*/
-            {
-                // GP0(20h) - Monochrome three-point polygon, opaque
-
-                gp0CommandRemaining = 4;
-                Gp0CommandMethod    = &Gpu::gp0TriangleMonoOpaque;
-
-                break;
-            }
-            case 0x22: /*
-             case 0x23:*/
-            {
-                // GP0(22h) - Monochrome three-point polygon, semi-transparent
-
-                curAttribute = {1, 0, ColorOnly};
-
-                gp0CommandRemaining = 4;
-                Gp0CommandMethod    = &Gpu::gp0TriangleMonoOpaque;
-
-                break;
-            }
-            case 0x24: {
-                // GP0(24h) - Textured three-point polygon, opaque, texture-blending
-
-                curAttribute = {0, 1, TextureMode::TextureColor};
-
-                gp0CommandRemaining = 7;
-                Gp0CommandMethod    = &Gpu::gp0TriangleTexturedOpaque;
-
-                break;
-            }
-            case 0x25: {
-                // GP0(25h) - Textured three-point polygon, opaque, raw-texture
-
-                curAttribute = {0, 0, TextureMode::TextureOnly};
-
-                gp0CommandRemaining = 7;
-                Gp0CommandMethod    = &Gpu::gp0TriangleRawTexturedOpaque;
-
-                break;
-            }
-            case 0x26: {
-                // GP0(26h) - Textured three-point polygon, semi-transparent, texture-blending
-
-                curAttribute = {1, 1, TextureMode::TextureColor};
-
-                gp0CommandRemaining = 7;
-                Gp0CommandMethod    = &Gpu::gp0TriangleTexturedOpaque;
-
-                break;
-            }
-            case 0x27: {
-                // GP0(27h) - Textured three-point polygon, semi-transparent, raw-texture
-
-                curAttribute = {1, 0, TextureMode::TextureOnly};
-
-                gp0CommandRemaining = 7;
-                Gp0CommandMethod    = &Gpu::gp0TriangleRawTexturedOpaque;
-
-                break;
-            }
-            case 0x2C: {
-                // GP0(2Ch) - Textured four-point polygon, opaque, texture-blending
-                // Used to draw the sony text & the text from the menus
-
-                curAttribute = {0, 1, TextureMode::TextureColor};
-
-                gp0CommandRemaining = 9;
-                Gp0CommandMethod    = &Gpu::gp0QuadTextureBlendOpaque;
-
-                break;
-            }
-            case 0x2D: {
-                // GP0(2Dh) - Textured four-point polygon, opaque, raw-texture
-                // Used to draw the background of buttons in the menu
-
-                curAttribute = {0, 0, TextureMode::TextureOnly};
-
-                gp0CommandRemaining = 9;
-                Gp0CommandMethod    = &Gpu::gp0QuadRawTextureBlendOpaque;
-
-                break;
-            }
-            case 0x2E: {
-                // GP0(2Eh) - Textured four-point polygon, semi-transparent, texture-blending
-
-                curAttribute = {1, 1, TextureMode::TextureColor};
-
-                gp0CommandRemaining = 9;
-                Gp0CommandMethod    = &Gpu::gp0QuadTextureBlendOpaque;
-
-                break;
-            }
-            case 0x2F: {
-                // GP0(2Fh) - Textured four-point polygon, semi-transparent, raw-texture
-
-                curAttribute = {1, 0, TextureMode::TextureOnly};
-
-                gp0CommandRemaining = 9;
-                Gp0CommandMethod    = &Gpu::gp0QuadRawTextureBlendOpaque;
-
-                break;
-            }
-            case 0x28:
-                // GP0(28h) - Monochrome four-point polygon, opaque
-                // Used to draw the background
-                
-                curAttribute = {0, 0, TextureMode::ColorOnly};
-                
-                gp0CommandRemaining = 5;
-                Gp0CommandMethod    = &Gpu::gp0QuadMonoOpaque;
-                
-                break;
-            case 0x29: {
-                // TODO; Check why tf tekken 3 calls this
-                // Undocumented/Nonsense
-                /* 
-                 * These commands have texture-blending disabled,
-                 * which is nonsense because they are using untextured polygons anyways,
-                 * ie. they are probably same as GP0(20h,22h,28h,2Ah,30h,32h,38h,3Ah).
-                 */
-                curAttribute = {0, 0, TextureMode::ColorOnly};
-                
-                gp0CommandRemaining = 5;
-                Gp0CommandMethod    = &Gpu::gp0QuadMonoOpaque;
-
-                break;
-            }
-            case 0x2A: /*
-            case 0x2B: */
-            {
-                // GP0(2Ah) - Monochrome four-point polygon, semi-transparent
-
-                curAttribute = {true, false, ColorOnly};
-
-                gp0CommandRemaining = 5;
-                Gp0CommandMethod    = &Gpu::gp0QuadMonoOpaque;
-
-                break;
-            }
-            case 0x30: /*
-             case 0x31:*/
-            {
-                // GP0(30h) - Shaded three-point polygon, opaque
-                // Used to draw the diamond(2 triangles)
-
-                curAttribute = {0, 0, ColorOnly};
-
-                gp0CommandRemaining = 6;
-                Gp0CommandMethod    = &Gpu::gp0TriangleShadedOpaque;
-
-                break;
-            }
-            case 0x32: /*
-             case 0x33:*/
-            {
-                // GP0(32h) - Shaded three-point polygon, semi-transparent
-
-                curAttribute = {1, 0, ColorOnly};
-
-                gp0CommandRemaining = 6;
-                Gp0CommandMethod    = &Gpu::gp0TriangleShadedOpaque;
-
-                break;
-            }
-            case 0x34: /*
-             case 0x35:*/
-            {
-                // GP0(34h) - Shaded Textured three-point polygon, opaque, texture-blending
-
-                curAttribute = {0, 1, TextureMode::TextureColor};
-
-                gp0CommandRemaining = 9;
-                Gp0CommandMethod    = &Gpu::gp0TriangleTexturedShadedOpaque;
-
-                break;
-            }
-            case 0x36: /*
-             case 0x37:*/
-            {
-                // GP0(36h) - Shaded Textured three-point polygon, semi-transparent, tex-blend
-
-                curAttribute = {1, 1, TextureMode::TextureColor};
-
-                gp0CommandRemaining = 9;
-                Gp0CommandMethod    = &Gpu::gp0TriangleTexturedShadedOpaque;
-
-                break;
-            }
-            case 0x38: /*
-             case 0x39:*/
-                // GP0(38h) - Shaded four-point polygon, opaque
-                // Used to draw the diamond background, and the unique colored triangles
-
-                curAttribute = {0, 0, TextureMode::ColorOnly};
-
-                gp0CommandRemaining = 8;
-                Gp0CommandMethod    = &Gpu::gp0QuadShadedOpaque;
-
-                break;
-            case 0x3A:
-            case 0x3B:
-                // GP0(3Ah) - Shaded four-point polygon, semi-transparent
-
-                curAttribute = {1, 0, TextureMode::ColorOnly};
-
-                gp0CommandRemaining = 8;
-                Gp0CommandMethod    = &Gpu::gp0QuadShadedOpaque;
-
-                break;
-            case 0x3C:
-            case 0x3D: {
-                // GP0(3Ch) - Shaded Textured four-point polygon, opaque, texture-blending
-
-                curAttribute = {0, 1, TextureMode::TextureColor};
-
-                gp0CommandRemaining = 12;
-                Gp0CommandMethod    = &Gpu::gp0QuadTexturedShadedOpaque;
-
-                break;
-            }
-            case 0x3E:
-            case 0x3F: {
-                // GP0(3Eh) - Shaded Textured four-point polygon, semi-transparent, tex-blend
-
-                curAttribute = {1, 1, TextureMode::TextureColor};
-
-                gp0CommandRemaining = 12;
-                Gp0CommandMethod    = &Gpu::gp0QuadTexturedShadedOpaque;
-
-                break;
-            }
-            case 0x40: {
-                //  GP0(40h) - Monochrome line, opaque
-
-                curAttribute = {0, 0, TextureMode::ColorOnly};
-
-                gp0CommandRemaining = 3;
-                Gp0CommandMethod    = &Gpu::gp0MonoLine;
-
-                break;
-            }
-            case 0x42: {
-                //  GP0(42h) - Monochrome line, semi-transparent
-
-                curAttribute = {1, 1, TextureMode::ColorOnly};
-
-                gp0CommandRemaining = 3;
-                Gp0CommandMethod    = &Gpu::gp0MonoLine;
-
-                break;
-            }
-            case 0x48: {
-                // GP0(48h) - Monochrome Poly-line, opaque
-
-                curAttribute = {0, 0, TextureMode::ColorOnly};
-
-                gp0CommandRemaining = 1;
-                Gp0CommandMethod    = &Gpu::gp0PolyLineMono;
-                gp0Mode             = PolyLine;
-
-                break;
-            }
-            case 0x4A: {
-                // GP0(4Ah) - Monochrome Poly-line, semi-transparent
-
-                curAttribute = {1, 0, TextureMode::ColorOnly};
-
-                gp0CommandRemaining = 1;
-                Gp0CommandMethod    = &Gpu::gp0PolyLineMono;
-                gp0Mode             = PolyLine;
-
-                break;
-            }
-            case 0x50: {
-                //  GP0(50h) - Shaded line, opaque
-                curAttribute = {0, 0, TextureMode::ColorOnly};
-
-                gp0CommandRemaining = 4;
-                Gp0CommandMethod    = &Gpu::gp0ShadedLine;
-
-                break;
-            }
-            case 0x52: {
-                //  GP0(52h) - Shaded line, semi-transparent
-                curAttribute = {1, 0, TextureMode::ColorOnly};
-
-                gp0CommandRemaining = 4;
-                Gp0CommandMethod    = &Gpu::gp0ShadedLine;
-
-                break;
-            }
-            case 0x58: {
-                //  GP0(58h) - Shaded Poly-line, opaque
-
-                curAttribute = {0, 0, TextureMode::ColorOnly};
-
-                gp0CommandRemaining = 1;
-                Gp0CommandMethod    = &Gpu::gp0ShadedPolyLine;
-                gp0Mode             = PolyLine;
-
-                break;
-            }
-            case 0x5A: {
-                // GP0(5Ah) - Shaded Poly-line, semi-transparent
-
-                curAttribute = {1, 0, TextureMode::ColorOnly};
-
-                gp0CommandRemaining = 1;
-                Gp0CommandMethod    = &Gpu::gp0ShadedPolyLine;
-                gp0Mode             = PolyLine;
-
-                break;
-            }
-            case 0x60: {
-                // GP0(60h) - Monochrome Rectangle (variable size) (opaque)
-
-                gp0CommandRemaining = 3;
-                Gp0CommandMethod    = &Gpu::gp0VarRectangleMonoOpaque;
-
-                break;
-            }
-            case 0x62: {
-                // GP0(62h) - Monochrome Rectangle (variable size) (semi-transparent)
-
-                curAttribute = {true, false, ColorOnly};
-
-                gp0CommandRemaining = 3;
-                Gp0CommandMethod    = &Gpu::gp0VarRectangleMonoOpaque;
-
-                break;
-            }
-            case 0x64: {
-                // GP0(64h) - Textured Rectangle, variable size, opaque, texture-blending
-
-                curAttribute = {0, 1, TextureMode::TextureColor};
-
-                gp0CommandRemaining = 4;
-                Gp0CommandMethod    = &Gpu::gp0VarTexturedRectangleMonoOpaque;
-
-                break;
-            }
-            case 0x65: {
-                // GP0(65h) - Textured Rectangle, variable size, opaque, raw-texture
-                // Used to draw title screens
-
-                curAttribute = {0, 0, TextureMode::TextureOnly};
-
-                gp0CommandRemaining = 4;
-                Gp0CommandMethod    = &Gpu::gp0VarTexturedRectangleMonoOpaque;
-
-                break;
-            }
-            case 0x66: {
-                // GP0(66h) - Textured Rectangle, variable size, semi-transp, texture-blendin
-
-                curAttribute = {1, 1, TextureMode::TextureColor};
-
-                gp0CommandRemaining = 4;
-                Gp0CommandMethod    = &Gpu::gp0VarTexturedRectangleMonoOpaque;
-
-                break;
-            }
-            case 0x67: {
-                // GP0(67h) - Textured Rectangle, variable size, semi-transp, raw-texture
-
-                curAttribute = {1, 0, TextureMode::TextureOnly};
-
-                gp0CommandRemaining = 4;
-                Gp0CommandMethod    = &Gpu::gp0VarTexturedRectangleMonoOpaque;
-
-                break;
-            }
-            case 0x68: {
-                // GP0(68h) - Monochrome Rectangle (1x1) (Dot) (opaque)
-
-                gp0CommandRemaining = 2;
-                Gp0CommandMethod    = &Gpu::gp0DotRectangleMonoOpaque;
-
-                break;
-            }
-            case 0x6A: {
-                // GP0(6Ah) - Monochrome Rectangle (1x1) (Dot) (semi-transparent)
-
-                curAttribute = {true, false, ColorOnly};
-
-                gp0CommandRemaining = 2;
-                Gp0CommandMethod    = &Gpu::gp0DotRectangleMonoOpaque;
-
-                break;
-            }
-            case 0x70: {
-                // GP0(70h) - Monochrome Rectangle (8x8) (opaque)
-
-                gp0CommandRemaining = 2;
-                Gp0CommandMethod    = &Gpu::gp08RectangleMonoOpaque;
-
-                break;
-            }
-            case 0x72: {
-                // GP0(72h) - Monochrome Rectangle (8x8) (semi-transparent)
-
-                curAttribute = {true, false, ColorOnly};
-
-                gp0CommandRemaining = 2;
-                Gp0CommandMethod    = &Gpu::gp08RectangleMonoOpaque;
-
-                break;
-            }
-            case 0x74: {
-                // GP0(74h) - Textured Rectangle, 8x8, opaque, texture-blending
-
-                curAttribute = {0, 1, TextureMode::TextureColor};
-
-                gp0CommandRemaining = 3;
-                Gp0CommandMethod    = &Gpu::gp08RectangleTexturedOpaqu;
-
-                break;
-            }
-            case 0x75: {
-                // GP0(75h) - Textured Rectangle, 8x8, opaque, raw-texture
-
-                curAttribute = {0, 0, TextureMode::TextureOnly};
-
-                gp0CommandRemaining = 3;
-                Gp0CommandMethod    = &Gpu::gp08RectangleTexturedOpaqu;
-
-                break;
-            }
-            case 0x76: {
-                // GP0(76h) - Textured Rectangle, 8x8, semi-transparent, texture-blending
-
-                curAttribute = {1, 1, TextureMode::TextureColor};
+    // Bits 0-3: Texture page X base (N * 64)
+    status |= (static_cast<uint32_t>(pageBaseX) & 0x0F) << 0;
 
-                gp0CommandRemaining = 3;
-                Gp0CommandMethod    = &Gpu::gp08RectangleTexturedOpaqu;
+    // Bit 4: Texture page Y base 1 (N * 256)
+    status |= (static_cast<uint32_t>(pageBaseY) & 0x01) << 4;
 
-                break;
-            }
-            case 0x77: {
-                // GP0(77h) - Textured Rectangle, 8x8, semi-transparent, raw-texture
+    // Bits 5-6: Semi-transparency mode
+    status |= (static_cast<uint32_t>(semiTransparency) & 0x03) << 5; // Mask to 2 bits
 
-                curAttribute = {1, 0, TextureMode::TextureOnly};
+    // Bits 7-8: Texture page color depth
+    status |= (static_cast<uint32_t>(textureDepth) & 0x03) << 7; // Mask to 2 bits
 
-                gp0CommandRemaining = 3;
-                Gp0CommandMethod    = &Gpu::gp08RectangleTexturedOpaqu;
+    // Bit 9: Dither 24bit to 15bit (0=Off, 1=Enabled)
+    status |= static_cast<uint32_t>(dithering ? 1 : 0) << 9;
 
-                break;
-            }
-            case 0x78: {
-                // GP0(78h) - Monochrome Rectangle (16x16) (opaque)
+    // Bit 10: Interlace Drawing (0=All Lines, 1=Inactive Lines)
+    status |= static_cast<uint32_t>(drawToDisplay ? 1 : 0) << 10;
 
-                gp0CommandRemaining = 2;
-                Gp0CommandMethod    = &Gpu::gp016RectangleMonoOpaque;
+    // Bit 11: Set Mask-bit when drawing (0=No, 1=Yes)
+    status |= static_cast<uint32_t>(forceSetMaskBit ? 1 : 0) << 11;
 
-                break;
-            }
-            case 0x7A: {
-                // GP0(7Ah) - Monochrome Rectangle (16x16) (semi-transparent)
+    // Bit 12: Don't draw to masked areas (0=Always, 1=Not to masked areas)
+    status |= static_cast<uint32_t>(preserveMaskedPixels ? 1 : 0) << 12;
 
-                curAttribute = {true, false, ColorOnly};
+    // GPUSTAT.15: bit1 of texpage Y base on 2 MB VRAM GPUs.
+    status |= static_cast<uint32_t>(textureDisable ? 1 : 0) << 15;
 
-                gp0CommandRemaining = 2;
-                Gp0CommandMethod    = &Gpu::gp016RectangleMonoOpaque;
+    // Bit 24: Interrupt request (0=Off, 1=IRQ)
+    status |= static_cast<uint32_t>(interrupt ? 1 : 0) << 24;
 
-                break;
-            }
-            case 0x7C: {
-                // GP0(7Ch) - Textured Rectangle, 16x16, opaque, texture-blending
+    const uint32_t readyForCommand = readyToReceiveCommandWord() ? 1u : 0u;
+    const uint32_t readyToReadVram = readyToSendVramToCpu() ? 1u : 0u;
+    const uint32_t readyForDmaBlock = readyToReceiveDmaBlock() ? 1u : 0u;
 
-                curAttribute = {0, 1, TextureMode::TextureColor};
+    // Bit 26: Ready to receive command word (0=No, 1=Ready)
+    // Cleared while the GPU is receiving parameters/image data or serving GPUREAD image data.
+    status |= readyForCommand << 26;
 
-                gp0CommandRemaining = 3;
-                Gp0CommandMethod    = &Gpu::gp016RectangleTextured;
+    // Bit 27: Ready to send VRAM to CPU (0=No, 1=Ready)
+    /**
+     * Bit27: Gets set after sending GP0(C0h) and its parameters,
+     * and stays set until all data words are received; used as DMA request in DMA Mode 3.
+     */
+    status |= readyToReadVram << 27;
 
-                break;
-            }
-            case 0x7D: {
-                // GP0(7Dh) - Textured Rectangle, 16x16, opaque, raw-texture
+    // Bit 28: Ready to receive DMA block (0=No, 1=Ready)
+    /**
+     * Bit28: Normally, this bit gets cleared when the command execution is busy
+     * (ie. once when the command and all of its parameters are received),
+     * however, for Polygon and Line Rendering commands,
+     * the bit gets cleared immediately after receiving the command word
+     * (ie. before receiving the vertex parameters).
+     * The bit is used as DMA request in DMA Mode 2, accordingly,
+     * the DMA would probably hang if the Polygon/Line parameters,
+     * are transferred in a separate DMA block (ie. the DMA probably starts ONLY on command words).
+     */
+    status |= readyForDmaBlock << 28;
 
-                curAttribute = {0, 1, TextureMode::TextureOnly};
+    return status;
+}
 
-                gp0CommandRemaining = 3;
-                Gp0CommandMethod    = &Gpu::gp016RectangleTextured;
+bool Emulator::Gpu::readyToReceiveCommandWord() const {
+    return readMode != VRam && gp0Mode == Command && gp0CommandRemaining == 0;
+}
 
-                break;
-            }
-            case 0x7E: {
-                // GP0(7Eh) - Textured Rectangle, 16x16, semi-transparent, texture-blending
+bool Emulator::Gpu::readyToSendVramToCpu() const {
+    return readMode == VRam;
+}
 
-                curAttribute = {1, 1, TextureMode::TextureColor};
+bool Emulator::Gpu::readyToReceiveDmaBlock() const {
+    if (readMode == VRam) {
+        return false;
+    }
+    
+    if (gp0Mode == VRam) {
+        return true;
+    }
+    
+    return gp0Mode == Command && gp0CommandRemaining == 0;
+}
 
-                gp0CommandRemaining = 3;
-                Gp0CommandMethod    = &Gpu::gp016RectangleTextured;
+void Emulator::Gpu::gp0(uint32_t val) {
+    if (threaded()) {
+        frameGp0(val);
+        gpuThread.push(val);
+    } else {
+        executeGp0(val);
+    }
+}
 
+void Emulator::Gpu::frameGp0(uint32_t val) {
+    // Follows 'executeGp0', minus running anything
+    if (!pushed.known)
+        return;
+    
+    if (pushed.words > 0) {
+        pushed.words--;
+        
+        // Textured polygons set the texture depth, see 'UV::fromGp0'
+        if (static_cast<int>(pushed.words) == pushed.pageWord) {
+            pushed.status = (pushed.status & ~0x180u) | ((val >> 16) & 0x180);
+            pushed.pageWord = -1;
+        }
+        
+        if (pushed.words > 0 || !pushed.imageHeader)
+            return;
+        
+        // Last header word, the size, same as 'gp0ImageLoad'
+        pushed.imageHeader = false;
+        
+        if (displayDepth == DisplayDepth::D24Bits) {
+            pushed.known = false;
+            return;
+        }
+        
+        const uint32_t w = (((val & 0x3FF) - 1) & 0x3FF) + 1;
+        const uint32_t h = ((((val >> 16) & 0x1FF) - 1) & 0x1FF) + 1;
+        
+        // Two pixels a word
+        pushed.words = (w * h + 1) / 2;
+        pushed.image = true;
+        
+        return;
+    }
+    
+    if (!pushed.polyLine) {
+        const Gp0Descriptor& command = gp0Descriptors[(val >> 24) & 0xFF];
+        pushed.image = false;
+        
+        switch (command.kind) {
+            case Gp0Kind::Nop:
+                return;
+            case Gp0Kind::Irq:
+                pushed.status |= 1u << 24;
+                return;
+            case Gp0Kind::PolyLine:
+                pushed.polyLine = true;
                 break;
-            }
-            case 0x7F: {
-                // GP0(7Fh) - Textured Rectangle, 16x16, semi-transparent, raw-texture
-                
-                curAttribute = {1, 0, TextureMode::TextureOnly};
-                
-                gp0CommandRemaining = 3;
-                Gp0CommandMethod    = &Gpu::gp016RectangleTextured;
+            default:
+                pushed.words = command.words - 1;
+                pushed.imageHeader = command.handler == &Gpu::gp0ImageLoad;
+                pushed.pageWord = pageWord(command);
                 
-                break;
-            }
-            case 0x80: {
-                gp0CommandRemaining = 4;
-                Gp0CommandMethod    = &Gpu::gp0VramToVram;
+                // Same bits as 'gp0DrawMode' and 'gp0MaskBitSetting' leave
+                if (command.handler == &Gpu::gp0DrawMode) {
+                    uint32_t bits = val & 0x7FF;
+                    
+                    // Texture depth 3 is 15-bit
+                    if (((val >> 7) & 3) == 3)
+                        bits &= ~(1u << 7);
+                    
+                    if (newTextureDisable && ((val >> 11) & 1))
+                        bits |= 1u << 15;
+                    
+                    pushed.status = (pushed.status & ~(0x7FFu | (1u << 15))) | bits;
+                } else if (command.handler == &Gpu::gp0MaskBitSetting) {
+                    pushed.status = (pushed.status & ~(3u << 11)) | ((val & 3) << 11);
+                }
                 
+                return;
+        }
+    }
+    
+    if ((val & 0xf000f000) == 0x50005000)
+        pushed.polyLine = false;
+}
+
+int Emulator::Gpu::pageWord(const Gp0Descriptor& command) {
+    if (command.kind != Gp0Kind::Polygon || !command.textured)
+        return -1;
+    
+    // Same place 'gp0Polygon' takes it from, counted from the end
+    const int stepping = 1 + (command.shaded ? 1 : 0) + 1;
+    
+    return command.words - 1 - (stepping + 2);
+}
+
+void Emulator::Gpu::reframeGp0() {
+    pushed = {};
+    pushed.status = gp0StatusBits() & PUSHED_STATUS_BITS;
+    
+    switch (gp0Mode) {
+        case Command:
+            pushed.words = gp0CommandRemaining;
+            pushed.imageHeader = gp0CommandRemaining > 0 && Gp0CommandMethod == &Gpu::gp0ImageLoad;
+            
+            if (gp0CommandRemaining > 0 && pageWord(gp0Descriptors[lastOp]) < static_cast<int>(gp0CommandRemaining))
+                pushed.pageWord = pageWord(gp0Descriptors[lastOp]);
+            
+            break;
+        case PolyLine:
+            pushed.polyLine = true;
+            break;
+        case VRam: {
+            if (displayDepth == DisplayDepth::D24Bits) {
+                pushed.known = false;
                 break;
             }
-            case 0xA0:
-                gp0CommandRemaining = 3;
-                Gp0CommandMethod    = &Gpu::gp0ImageLoad;
-                
-                break;
-            case 0xC0:
-            case 0xC1:
-            case 0xC2:
-            case 0xC3:
-            case 0xC4:
-            case 0xC5:
-            case 0xC6:
-            case 0xC7:
-            case 0xC8:
-            case 0xC9:
-            case 0xCA:
-            case 0xCB:
-            case 0xCC:
-            case 0xCD:
-            case 0xCE:
-            case 0xCF:
-            case 0xD0:
-            case 0xD1:
-            case 0xD2:
-            case 0xD3:
-            case 0xD4:
-            case 0xD5:
-            case 0xD6:
-            case 0xD7:
-            case 0xD8:
-            case 0xD9:
-            case 0xDA:
-            case 0xDB:
-            case 0xDC:
-            case 0xDD:
-            case 0xDE:
-            case 0xDF:
-                gp0CommandRemaining = 3;
-                Gp0CommandMethod    = &Gpu::gp0ImageStore;
-                
-                break;
-            case 0xE1:
-                gp0CommandRemaining = 1;
-                Gp0CommandMethod    = &Gpu::gp0DrawMode;
-                
-                break;
-            case 0xE2:
-                gp0CommandRemaining = 1;
-                Gp0CommandMethod    = &Gpu::gp0TextureWindow;
-                
-                break;
-            case 0xE3:
-                gp0CommandRemaining = 1;
-                Gp0CommandMethod    = &Gpu::gp0DrawingAreaTopLeft;
-                
-                break;
-            case 0xE4:
-                gp0CommandRemaining = 1;
-                Gp0CommandMethod    = &Gpu::gp0DrawingAreaBottomRight;
-                
-                break;
-            case 0xE5:
-                gp0CommandRemaining = 1;
-                Gp0CommandMethod    = &Gpu::gp0DrawingOffset;
+            
+            const uint32_t halfwords = (endY - curY - 1) * (endX - startX) + (endX - curX);
+            pushed.words = (halfwords + 1) / 2;
+            pushed.image = true;
+            
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+void Emulator::Gpu::executeGp0(uint32_t val) {
+    if(gp0CommandRemaining == 0 && gp0Mode == Command) {
+        gp0Command.clear();
+        
+        const uint8_t opcode = (val >> 24) & 0xFF;
+        const Gp0Descriptor& command = gp0Descriptors[opcode];
+        
+        switch (command.kind) {
+            case Gp0Kind::Nop:
+                return;
+            case Gp0Kind::Irq:
+                //   GP0(1Fh)                 - Interrupt Request (IRQ1)
                 
-                break;
-            case 0xE6:
-                gp0CommandRemaining = 1;
-                Gp0CommandMethod    = &Gpu::gp0MaskBitSetting;
+                interrupt = true;
+                // IRQ::trigger(IRQ::GPU);
                 
+                return;
+            case Gp0Kind::PolyLine:
+                gp0Mode = PolyLine;
                 break;
             default:
-                // TODO; idk probably doing smth wrong but Tekken 3 calls those but they dont exists?
-                
-                /**
-                 * GP0(35h,37h,3Dh,3Fh) - Undocumented/Nonsense (Raw Texture + UNUSED shading)
-                 * These are undocumented inefficient nonsense commands: Parameters are same as for
-                 * GP0(34h,36h,3Ch,3Eh), ie. with colors for all vertices, but without actually using that colors.
-                 * Instead, the commands are rendering raw textures without blending. In other words, the commands have
-                 * same function as GP0(25h,27h,2Dh,2Fh), but with additional/unused parameters (and possible
-                 * additional/unused internal gouraud shading calculations). For whatever reason, Castlevania is
-                 * actually using these nonsense commands, namely GP0(3Dh) and GP0(3Fh).
-                 *
-                 * GP0(21h,23h,29h,2Bh,31h,33h,39h,3Bh) - Undocumented/Nonsense
-                 * These commands have texture-blending disabled, which is nonsense because they are using untextured
-                 * polygons anyways, ie. they are probably same as GP0(20h,22h,28h,2Ah,30h,32h,38h,3Ah).
-                 */
-                printf("Unhandled GP0 command %x last; %x cmd? = %x\n", opcode, lastOp, cmd);
-                
-                return;
+                break;
         }
         
-        lastOp = opcode;
-        prvOps.push_front(opcode);
+        TextureMode mode;
+        if (!command.textured)
+            mode = ColorOnly;
+        else if (command.rawTexture)
+            mode = TextureOnly;
+        else
+            mode = TextureColor;
+        
+        curAttribute = { command.semiTransparent, command.textured && !command.rawTexture, mode };
         
-        if (prvOps.size() > 7)
-            prvOps.pop_back();
+        gp0CommandRemaining = command.words;
+        Gp0CommandMethod    = command.handler;
+        
+        lastOp = opcode;
     }
     
     switch (gp0Mode) {
@@ -1326,7 +806,7 @@ void Emulator::Gpu::gp0(uint32_t val) {
                 curAttribute.setSemiTransparencyMode(semiTransparency);
                 
                 // All of the parameters optioned; run the command
-                Gp0CommandMethod(*this, val);
+                (this->*Gp0CommandMethod)(val);
                 
                 // Reset current attributes
                 curAttribute = { 0, 0, TextureMode::ColorOnly };
@@ -1339,21 +819,7 @@ void Emulator::Gpu::gp0(uint32_t val) {
                     curX = startX;
                     
                     if (++curY >= endY) {
-                        // Signal VRAM that image has finished loading.
-                        //vram->endTransfer();
-                        
-                        gp0CommandRemaining = 0;
-                        gp0Mode = Command;
-                        
-                        uint32_t w = endX - startX;
-                        uint32_t h = endY - startY;
-                        
-                        vram->flushRegion(startX, startY, w, h);
-                        
-                        uint32_t glY = (512 - startY) - h;
-                        
-                        renderer->flushDrawCommands();
-                        vram->copyToTexture(startX, glY, startX, glY, w, h, renderer->sceneTex[renderer->curTex]);
+                        finishImageLoad();
                         
                         return true;
                     }
@@ -1459,10 +925,10 @@ void Emulator::Gpu::gp0(uint32_t val) {
                     //vram->reset();
                 }
             } else {
-                vram->setPixel(curX, curY, val & 0xFFFF);
+                vram->writePixel(curX, curY, val & 0xFFFF);
                 if(step()) return;
                 
-                vram->setPixel(curX, curY, (val >> 16) & 0xFFFF);
+                vram->writePixel(curX, curY, (val >> 16) & 0xFFFF);
                 if(step()) return;
             }
             break;
@@ -1481,7 +947,7 @@ void Emulator::Gpu::gp0(uint32_t val) {
                 curAttribute.setSemiTransparencyMode(semiTransparency);
                 
                 // Termination code
-                Gp0CommandMethod(*this, val);
+                (this->*Gp0CommandMethod)(val);
                 
                 gp0Mode = Command;
                 gp0CommandRemaining = 0;
@@ -1530,7 +996,8 @@ void Emulator::Gpu::gp0DrawMode(uint32_t val) {
     // Upload texture depth to GPU
     /*renderer->setTextureDepth(static_cast<int>(textureDepth));*/
     setTextureDepth(textureDepth);
-    renderer->setSemiTransparencyMode(semiTransparency);
+    if (!rasterizer)
+        renderer->setSemiTransparencyMode(semiTransparency);
 
     // Dither 24bit to 15bit (0=Off/strip LSBs, 1=Dither Enabled) ;GPUSTAT.9
     dithering = ((val >> 9) & 1) != 0;
@@ -1544,7 +1011,8 @@ void Emulator::Gpu::gp0DrawingAreaTopLeft(uint32_t val) {
     drawingAreaTop = static_cast<int16_t>((val >> 10) & 0x3FF); // Y: bits 10-19
     drawingAreaLeft = static_cast<int16_t>(val & 0x3FF);         // X: bits 0-9
 
-    renderer->setDrawingArea(drawingAreaLeft, drawingAreaRight, drawingAreaTop, drawingAreaBottom);
+    if (!rasterizer)
+        renderer->setDrawingArea(drawingAreaLeft, drawingAreaRight, drawingAreaTop, drawingAreaBottom);
 }
 
 void Emulator::Gpu::gp0DrawingAreaBottomRight(uint32_t val) {
@@ -1558,11 +1026,12 @@ void Emulator::Gpu::gp0DrawingAreaBottomRight(uint32_t val) {
     
     // TODO;
     //renderer->setDrawingArea(0, 0, width, height);
-    renderer->setDrawingArea(drawingAreaLeft, drawingAreaRight, drawingAreaTop, drawingAreaBottom);
+    if (!rasterizer)
+        renderer->setDrawingArea(drawingAreaLeft, drawingAreaRight, drawingAreaTop, drawingAreaBottom);
     //renderer->setDrawingArea(0, 0, 1024, 512);
 }
 
-void Emulator::Gpu::gp0DrawingOffset(const uint32_t val) const {
+void Emulator::Gpu::gp0DrawingOffset(const uint32_t val) {
     // bits 0..10  = X offset (11-bit signed)
     // bits 11..21 = Y offset (11-bit signed)
     /*auto signExtend11 = [](uint32_t v) -> int32_t {
@@ -1610,11 +1079,13 @@ void Emulator::Gpu::gp0TextureWindow(uint32_t val) {
     assert(textureWindowXOffset == 0);
     assert(textureWindowYOffset == 0);*/
     
-    renderer->setTextureWindow(textureWindowXMask, textureWindowYMask, textureWindowXOffset, textureWindowYOffset);
+    if (!rasterizer)
+        renderer->setTextureWindow(textureWindowXMask, textureWindowYMask, textureWindowXOffset, textureWindowYOffset);
 }
 
 void Emulator::Gpu::gp0MaskBitSetting(uint32_t val) {
-    renderer->flushDrawCommands();
+    if (!rasterizer)
+        renderer->flushDrawCommands();
 
     forceSetMaskBit = (val & 1) != 0;
     preserveMaskedPixels = (val & 2) != 0;
@@ -1636,7 +1107,7 @@ void Emulator::Gpu::gp0QuadMonoOpaque(uint32_t val) {
         Color::fromGp0(gp0Command.buffer[0]),
     };
     
-    renderer->pushQuad(positions, colors, {}, curAttribute);
+    drawQuad(positions, colors, nullptr);
 }
 
 void Emulator::Gpu::gp0TriangleShadedOpaque(uint32_t val) {
@@ -1652,7 +1123,7 @@ void Emulator::Gpu::gp0TriangleShadedOpaque(uint32_t val) {
         Color::fromGp0(gp0Command.index(4)),
     };
     
-    renderer->pushTriangle(positions, colors, {}, curAttribute);
+    drawTriangle(positions, colors, nullptr);
 }
 
 void Emulator::Gpu::gp0TriangleTexturedShadedOpaque(uint32_t val) {
@@ -1677,7 +1148,7 @@ void Emulator::Gpu::gp0TriangleTexturedShadedOpaque(uint32_t val) {
         UV::fromGp0(gp0Command.index(8), c, p, *this),
     };
     
-    renderer->pushTriangle(positions, colors, uvs, curAttribute);
+    drawTriangle(positions, colors, uvs);
 }
 
 void Emulator::Gpu::gp0QuadShadedOpaque(uint32_t val) {
@@ -1695,7 +1166,7 @@ void Emulator::Gpu::gp0QuadShadedOpaque(uint32_t val) {
         Color::fromGp0(gp0Command.buffer[6]),
     };
     
-    renderer->pushQuad(positions, colors, {}, curAttribute);
+    drawQuad(positions, colors, nullptr);
 }
 
 void Emulator::Gpu::gp0QuadTexturedShadedOpaque(uint32_t val) {
@@ -1723,7 +1194,94 @@ void Emulator::Gpu::gp0QuadTexturedShadedOpaque(uint32_t val) {
         UV::fromGp0(gp0Command.index(11), c, p, *this),
     };
     
-    renderer->pushQuad(positions, colors, uvs, curAttribute);
+    drawQuad(positions, colors, uvs);
+}
+
+void Emulator::Gpu::gp0Polygon(uint32_t val) {
+    const Gp0Descriptor& command = gp0Descriptors[gp0Command.index(0) >> 24];
+    
+    const bool gouraud  = command.shaded;
+    const bool textured = command.textured;
+    
+    Color c0 = Color::fromGp0(gp0Command.index(0));
+    Position positions[4];
+    Color colors[4];
+    UV uvs[4];
+    
+    uint8_t stepping = 1 + (gouraud ? 1 : 0) + (textured ? 1 : 0);
+    
+    uint16_t clut = textured ? gp0Command.index(2) >> 16 : 0;
+    uint16_t page = textured ? gp0Command.index(1 + stepping + 1) >> 16 : 0;
+    
+    for (uint8_t idx = 0; idx < command.vertices; idx++) {
+        const uint32_t i = 1 + idx * stepping;
+        
+        colors[idx] = (gouraud && i != 1)
+            ? Color::fromGp0(gp0Command.index(i - 1))
+            : c0;
+        
+        if (textured)
+            uvs[idx] = UV::fromGp0(gp0Command.index(i + 1), clut, page, *this);
+        
+        positions[idx] = Position::fromGp0(gp0Command.index(i));
+    }
+    
+    if (command.vertices == 4)
+        drawQuad(positions, colors, uvs);
+    else
+        drawTriangle(positions, colors, uvs);
+}
+
+void Emulator::Gpu::gp0Rectangle(uint32_t val) {
+    const Gp0Descriptor& command = gp0Descriptors[gp0Command.index(0) >> 24];
+    
+    const bool textured = command.textured;
+    
+    const Position p0 = Position::fromGp0(gp0Command.index(1));
+    const Color c0    = Color::fromGp0(gp0Command.index(0));
+    UV uv0;
+    
+    if (textured) {
+        const auto c = static_cast<uint16_t>(gp0Command.index(2) >> 16);
+        uv0 = UV::fromGp0(gp0Command.index(2), c, pageBaseX, pageBaseY, *this);
+    }
+    
+    uint16_t width = 0;
+    uint16_t height = 0;
+    
+    /**
+     * 0 (00)      variable size
+     * 1 (01)      single pixel (1x1)
+     * 2 (10)      8x8 sprite
+     * 3 (11)      16x16 sprite
+     */
+    if (command.rectangleSize == 0) {
+        uint32_t sizeData = gp0Command.index(textured ? 3 : 2);
+        
+        width = sizeData & 0xFFFF;
+        height = sizeData >> 16;
+        
+        // Max size of 1023x511
+        // but textured max; 256,256
+        // TODO; It doesn't say (im probably just blind),
+        // TODO; that it should clamp it or just ignore,
+        // TODO; any rectangles outside of those areas?
+        if (textured) {
+            width = std::clamp<uint16_t>(width, 0, 256);
+            height = std::clamp<uint16_t>(height, 0, 256);
+        } else {
+            width = std::clamp<uint16_t>(width, 0, 1023);
+            height = std::clamp<uint16_t>(height, 0, 511);
+        }
+    } else if (command.rectangleSize == 1) {
+        width = height = 1;
+    } else if (command.rectangleSize == 2) {
+        width = height = 8;
+    } else if (command.rectangleSize == 3) {
+        width = height = 16;
+    }
+    
+    renderRectangle(p0, c0, uv0, width, height);
 }
 
 void Emulator::Gpu::gp0MonoLine(uint32_t val) {
@@ -1737,7 +1295,7 @@ void Emulator::Gpu::gp0MonoLine(uint32_t val) {
         Color::fromGp0(gp0Command.index(0)),
     };
     
-    renderer->pushLine(positions, colors, {}, curAttribute);
+    drawLine(positions, colors);
 }
 
 void Emulator::Gpu::gp0PolyLineMono(uint32_t val) {
@@ -1762,7 +1320,7 @@ void Emulator::Gpu::gp0PolyLineMono(uint32_t val) {
         Position positions[] = {prev, current};
         Color colors[] = {currentLineColor, currentLineColor};
         
-        renderer->pushLine(positions, colors, {}, curAttribute);
+        drawLine(positions, colors);
         
         prev = current;
     }
@@ -1779,7 +1337,7 @@ void Emulator::Gpu::gp0ShadedLine(uint32_t val) {
         Color::fromGp0(gp0Command.index(2)),
     };
     
-    renderer->pushLine(positions, colors, {}, curAttribute);
+    drawLine(positions, colors);
 }
 
 void Emulator::Gpu::gp0ShadedPolyLine(uint32_t val) {
@@ -1803,13 +1361,43 @@ void Emulator::Gpu::gp0ShadedPolyLine(uint32_t val) {
         Position positions[] = {p0, p1};
         Color colors[] = {c0, c1};
         
-        renderer->pushLine(positions, colors, {}, curAttribute);
+        drawLine(positions, colors);
         
         c0 = c1;
         p0 = p1;
     }
 }
 
+void Emulator::Gpu::drawTriangle(Position positions[], Color colors[], UV uvs[]) {
+    // Textured polygons got theirs from the texpage in 'UV::fromGp0'
+    if (!curAttribute.useTextures())
+        curAttribute.setSemiTransparencyMode(semiTransparency);
+    
+    if (rasterizer)
+        rasterizer->drawTriangle(positions, colors, uvs, curAttribute);
+    else
+        renderer->pushTriangle(positions, colors, uvs, curAttribute);
+}
+
+void Emulator::Gpu::drawQuad(Position positions[], Color colors[], UV uvs[]) {
+    if (!curAttribute.useTextures())
+        curAttribute.setSemiTransparencyMode(semiTransparency);
+    
+    if (rasterizer)
+        rasterizer->drawQuad(positions, colors, uvs, curAttribute);
+    else
+        renderer->pushQuad(positions, colors, uvs, curAttribute);
+}
+
+void Emulator::Gpu::drawLine(Position positions[], Color colors[]) {
+    curAttribute.setSemiTransparencyMode(semiTransparency);
+    
+    if (rasterizer)
+        rasterizer->drawLine(positions, colors, nullptr, curAttribute);
+    else
+        renderer->pushLine(positions, colors, nullptr, curAttribute);
+}
+
 void Emulator::Gpu::renderRectangle(Position position, Color color, UV uv, uint16_t width, uint16_t height) {
     //position.x += drawingXOffset;
     //position.y += drawingYOffset; 
@@ -1840,7 +1428,13 @@ void Emulator::Gpu::renderRectangle(Position position, Color color, UV uv, uint1
     if (rectangleTextureFlipX) std::swap(uvs[0], uvs[1]), std::swap(uvs[2], uvs[3]);
     if (rectangleTextureFlipY) std::swap(uvs[0], uvs[2]), std::swap(uvs[1], uvs[3]);
     
-    renderer->pushRectangle(positions, colors, uvs, curAttribute);
+    // Rectangles always use the GP0(E1h) texpage
+    curAttribute.setSemiTransparencyMode(semiTransparency);
+    
+    if (rasterizer)
+        rasterizer->drawRectangle(positions, colors, uvs, curAttribute);
+    else
+        renderer->pushRectangle(positions, colors, uvs, curAttribute);
 }
 
 void Emulator::Gpu::gp0VarRectangleMonoOpaque(uint32_t val) {
@@ -1928,6 +1522,8 @@ void Emulator::Gpu::gp0ClearCache(uint32_t val) {
 }
 
 void Emulator::Gpu::gp0FillVRam(uint32_t val) {
+    waitForReadbacks();
+    
     //uint32_t color =  gp0Command.index(0) & 0xFFFFFF;
     uint32_t c = gp0Command.index(0);
     uint32_t cords = gp0Command.index(1);
@@ -1953,14 +1549,19 @@ void Emulator::Gpu::gp0FillVRam(uint32_t val) {
     endX = std::min<int>(1024, startX + mask::endX(res & 0xffff));
     endY = std::min<int>(512, startY + mask::endY((res & 0xffff0000) >> 16));
     
+    if (rasterizer)
+        rasterizer->sync(startX, startY, endX - startX, endY - startY, true);
+    
     //assert(displayDepth == DisplayDepth::D24Bits && "Display depth is 24bits.. ;-;");
     
     // NAW I HAD ENDX AND ENDY SWAPPED
-    for(uint32_t y = startY; y < endY; y++) {
-        for(uint32_t x = startX; x < endX; x++) {
-            vram->setPixel(x, y, c0.toU32());
-        }
-    }
+    // Fills ignore the mask settings, so whole rows can be set at once
+    const auto color = static_cast<uint16_t>(c0.toU32());
+    
+    for(int y = startY; y < endY; y++)
+        std::fill(vram->line15(y) + startX, vram->line15(y) + endX, color);
+    
+    vram->markDirty(startX, startY, endX - startX, endY - startY);
     
     if (!renderVRamToScreen) return;
     //return; // TODO; Does weird shit
@@ -1969,11 +1570,12 @@ void Emulator::Gpu::gp0FillVRam(uint32_t val) {
     uint32_t w = endX - startX;
     uint32_t h = endY - startY;
 
-    vram->flushRegion(startX, startY, w, h);
-
     uint32_t glY = 512 - startY - h;
-    renderer->flushDrawCommands();
-    vram->copyToTexture(startX, glY, startX, glY, w, h, renderer->sceneTex[renderer->curTex]);
+    if (!rasterizer) {
+        vram->flushRegion(startX, startY, w, h);
+        renderer->flushDrawCommands();
+        vram->copyToTexture(startX, glY, startX, glY, w, h, renderer->sceneTexture());
+    }
     
     /*Position positions[] = {
         { startX, startY },  // 0 TL
@@ -2017,7 +1619,7 @@ void Emulator::Gpu::gp0TriangleMonoOpaque(uint32_t val) {
         Color::fromGp0(gp0Command.index(0)),
     };
     
-    renderer->pushTriangle(positions, colors, {}, curAttribute);
+    drawTriangle(positions, colors, nullptr);
 }
 
 void Emulator::Gpu::gp0TriangleTexturedOpaque(uint32_t val) {
@@ -2043,7 +1645,7 @@ void Emulator::Gpu::gp0TriangleTexturedOpaque(uint32_t val) {
         UV::fromGp0(gp0Command.index(6), c, p, *this),
     };
     
-    renderer->pushTriangle(positions, colors, uvs, curAttribute);
+    drawTriangle(positions, colors, uvs);
 }
 
 void Emulator::Gpu::gp0TriangleRawTexturedOpaque(uint32_t val) {
@@ -2062,7 +1664,7 @@ void Emulator::Gpu::gp0TriangleRawTexturedOpaque(uint32_t val) {
         UV::fromGp0(gp0Command.index(6), c, p, *this),
     };
     
-    renderer->pushTriangle(positions, {}, uvs, curAttribute);
+    drawTriangle(positions, nullptr, uvs);
 }
 
 void Emulator::Gpu::gp0QuadTextureBlendOpaque(uint32_t val) {
@@ -2090,7 +1692,7 @@ void Emulator::Gpu::gp0QuadTextureBlendOpaque(uint32_t val) {
         UV::fromGp0(gp0Command.index(8), c, p, *this),
     };
     
-    renderer->pushQuad(positions, colors, uvs, curAttribute);
+    drawQuad(positions, colors, uvs);
 }
 
 // FF
@@ -2112,10 +1714,12 @@ void Emulator::Gpu::gp0QuadRawTextureBlendOpaque(uint32_t val) {
         UV::fromGp0(gp0Command.index(8), c, p, *this),
     };
     
-    renderer->pushQuad(positions, {}, uvs, curAttribute);
+    drawQuad(positions, nullptr, uvs);
 }
 
 void Emulator::Gpu::gp0ImageLoad(uint32_t val) {
+    waitForReadbacks();
+    
     uint32_t cords = gp0Command.index(1);
     uint32_t res = gp0Command.index(2);
     
@@ -2149,9 +1753,81 @@ void Emulator::Gpu::gp0ImageLoad(uint32_t val) {
     
     endY = startY + h;
     
+    // Queued primitives below the transfer must not land on top of it,
+    // or read their 15-bit texels after it
+    if (rasterizer)
+        rasterizer->sync(x, y, w, h, true);
+    
+    vram->markDirty(x, y, w, h);
+    
     gp0Mode = VRam;
 }
 
+size_t Emulator::Gpu::gp0ImageBlock(const uint8_t* data, size_t words) {
+    if (!threaded())
+        return writeImageWords(data, words);
+    
+    // The GPU thread owns the transfer state, what was pushed says how much
+    // image data it's still waiting for
+    if (!pushed.known || !pushed.image || pushed.words == 0)
+        return 0;
+    
+    const size_t count = std::min<size_t>(words, pushed.words);
+    
+    gpuThread.push(data, count);
+    pushed.words -= count;
+    
+    return count;
+}
+
+size_t Emulator::Gpu::writeImageWords(const uint8_t* data, size_t words) {
+    // 24-bit transfers are decoded a halfword at a time by 'VRAM::setPixel'
+    if (gp0Mode != VRam || displayDepth == DisplayDepth::D24Bits)
+        return 0;
+    
+    const size_t pixels = words * 2;
+    size_t done = 0;
+    
+    while (done < pixels) {
+        const uint32_t count = std::min<size_t>(endX - curX, pixels - done);
+        
+        vram->writeRow(curX, curY, data + done * 2, count);
+        
+        done += count;
+        curX += count;
+        
+        if (curX < endX)
+            continue;
+        
+        curX = startX;
+        
+        if (++curY >= endY) {
+            finishImageLoad();
+            
+            break;
+        }
+    }
+    
+    // An odd pixel count drops the last halfword, same as 'executeGp0'
+    return (done + 1) / 2;
+}
+
+void Emulator::Gpu::finishImageLoad() {
+    gp0CommandRemaining = 0;
+    gp0Mode = Command;
+    
+    uint32_t w = endX - startX;
+    uint32_t h = endY - startY;
+    
+    uint32_t glY = (512 - startY) - h;
+    
+    if (!rasterizer) {
+        vram->flushRegion(startX, startY, w, h);
+        renderer->flushDrawCommands();
+        vram->copyToTexture(startX, glY, startX, glY, w, h, renderer->sceneTexture());
+    }
+}
+
 void Emulator::Gpu::gp0ImageStore(uint32_t val) {
     uint32_t cords = gp0Command.index(1); // this is supposed to be 3 ;-; Huh???
     uint32_t res = gp0Command.index(2);
@@ -2183,11 +1859,17 @@ void Emulator::Gpu::gp0ImageStore(uint32_t val) {
     endX = startX + width;
     endY = startY + height;
     
-    renderer->readbackToVram(startX, startY, width, height);
+    // The software rasterizer already draws into VRAM
+    if (rasterizer)
+        rasterizer->sync(startX, startY, width, height);
+    else
+        renderer->readbackToVram(startX, startY, width, height);
     readMode = VRam;
 }
 
-void Emulator::Gpu::gp0VramToVram(uint32_t val) const {
+void Emulator::Gpu::gp0VramToVram(uint32_t val) {
+    waitForReadbacks();
+    
     uint32_t cords = gp0Command.index(1);
     uint32_t dests = gp0Command.index(2);
     uint32_t res = gp0Command.index(3);
@@ -2228,6 +1910,11 @@ void Emulator::Gpu::gp0VramToVram(uint32_t val) const {
     
     bool dir = srcX < dstX;
     
+    if (rasterizer) {
+        rasterizer->sync(srcX, srcY, width, height);
+        rasterizer->sync(dstX, dstY, width, height, true);
+    }
+    
     for(uint32_t y = 0; y < height; y++) {
         for(uint32_t x = 0; x < width; x++) {
             uint32_t posX = (!dir) ? x : width - 1 - x;
@@ -2237,6 +1924,8 @@ void Emulator::Gpu::gp0VramToVram(uint32_t val) const {
         }
     }
     
+    vram->markDirty(dstX, dstY, width, height);
+    
     if (!renderVRamToScreen) return;
     
     // TODO; VERIFY THIS
@@ -2245,15 +1934,21 @@ void Emulator::Gpu::gp0VramToVram(uint32_t val) const {
     uint32_t w = width;
     uint32_t h = height;
     
-    vram->flushRegion(x, y, w, h);
-    
     uint32_t glY = (512 - y) - h;
     
-    renderer->flushDrawCommands();
-    vram->copyToTexture(x, glY, x, glY, w, h, renderer->sceneTex[renderer->curTex]);
+    if (!rasterizer) {
+        vram->flushRegion(x, y, w, h);
+        renderer->flushDrawCommands();
+        vram->copyToTexture(x, glY, x, glY, w, h, renderer->sceneTexture());
+    }
 }
 
 void Emulator::Gpu::gp1(uint32_t val) {
+    // GP1 touches GP0 state too (resets, IRQ acknowledge, GPU info), so
+    // it runs here once the GPU thread has caught up. It's rare enough,
+    // and keeps display timing changes exact for the CRTC.
+    sync();
+    
     uint32_t opcode = (val >> 24) & 0xFF;
     
     switch (opcode) {
@@ -2380,6 +2075,11 @@ void Emulator::Gpu::gp1(uint32_t val) {
             
             break;
     }
+    
+    if (threaded()) {
+        gpuThread.publishStatus(gp0StatusBits());
+        reframeGp0();
+    }
 }
 
 void Emulator::Gpu::gp1Reset(uint32_t val) {
@@ -2541,9 +2241,14 @@ void Emulator::Gpu::gp1AcknowledgeIrq(uint32_t val) {
 }
 
 uint32_t Emulator::Gpu::read() {
+    // Only place the CPU has to wait for drawing to finish
+    sync();
+    
     if(readMode == Command)
         return _read;
     
+    waitForReadbacks();
+    
     const auto step = [&]() {
         if (++curX >= endX) {
             curX = startX;
@@ -2561,10 +2266,16 @@ uint32_t Emulator::Gpu::read() {
     data |= vram->getPixel(curX, curY) << 16;
     step();
     
+    if (threaded() && readMode == Command)
+        gpuThread.publishStatus(gp0StatusBits());
+    
     return data;
 }
 
 void Emulator::Gpu::reset() {
+    sync();
+    waitForReadbacks();
+    
     pageBaseX = 0;
     pageBaseY = 0;
     semiTransparency = 0;
@@ -2615,10 +2326,7 @@ void Emulator::Gpu::reset() {
     _hpos = 0;
     frames = 0;
 
-    lastCmd = 0;
     lastOp = 0;
-    prvOps.clear();
-    fields.clear();
 
     updateDotClock();
     isInHBlank = calcHBlank();
@@ -2633,6 +2341,11 @@ void Emulator::Gpu::reset() {
     
     curAttribute = {};
     
+    if (threaded()) {
+        gpuThread.publishStatus(gp0StatusBits());
+        reframeGp0();
+    }
+    
     // TODO; ?
     //if (vram)
     //    vram->reset();
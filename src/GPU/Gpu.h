@@ -3,11 +3,16 @@
 #ifndef GPU_H
 #define GPU_H
 
+#include <array>
 #include <functional>
 #include <stdexcept>
+#include <cstdint>
 #include <string>
+#ifndef PSX_HEADLESS
 #include <GL/glew.h>
+#endif
 
+#include "GpuThread.h"
 #include "VRAM.h"
 
 // TODO; Please redo this shitty code WTF IS THIS ;-;
@@ -15,7 +20,8 @@
 // https://psx-spx.consoledev.net/graphicsprocessingunitgpu/
 
 namespace Emulator {
-    class Renderer;
+    class RenderBackend;
+    class Rasterizer;
     class VRAM;
 }
 
@@ -145,6 +151,8 @@ namespace Emulator {
         static constexpr uint32_t NTSC_TOTAL_LINES = 263;
         static constexpr uint32_t PAL_TOTAL_LINES = 314;
 
+    public:
+        // Video clock ticks per CPU cycle are NUM / DEN
         static constexpr uint64_t NTSC_CRTC_NUM = 715909;
         static constexpr uint64_t PAL_CRTC_NUM = 709379;
         static constexpr uint64_t CRTC_DEN = 451584;
@@ -189,7 +197,7 @@ namespace Emulator {
                     b = ( p        & 0x1F) << 3;
                 }
                 
-                Color(GLubyte r, GLubyte g, GLubyte b) : r(r), g(g), b(b) {
+                Color(uint8_t r, uint8_t g, uint8_t b) : r(r), g(g), b(b) {
                     
                 }
                 
@@ -211,7 +219,7 @@ namespace Emulator {
                     return color;
                 }
                 
-                GLubyte r, g, b;
+                uint8_t r, g, b;
             };
             
             struct UV {
@@ -234,6 +242,7 @@ namespace Emulator {
                     gpu.setTextureDepth(static_cast<Emulator::TextureDepth>(depth));
                     
                     gpu.curAttribute.setTextureDepth(depth);
+                    gpu.curAttribute.setSemiTransparencyMode((page >> 5) & 3);
                     
                     float u = static_cast<float>((val) & 0xFF);
                     float v = static_cast<float>((val >> 8) & 0xFF);
@@ -337,10 +346,37 @@ namespace Emulator {
                 bool useTextures() const { return textureMode() != ColorOnly; }
             };
             
-            struct BitField {
-                const char* name;
-                uint8_t start;
-                uint8_t length;
+            // How a GP0 command gets its parameters and is run
+            enum class Gp0Kind : uint8_t {
+                // Takes up a FIFO slot and nothing else
+                Nop,
+                Irq,
+                Polygon,
+                Line,
+                // Words until a termination code, see 'Gp0Mode::PolyLine'
+                PolyLine,
+                Rectangle,
+                // Anything else that's run once its parameters are in
+                Other,
+            };
+            
+            // Everything the opcode byte says about a GP0 command, see 'gp0Descriptors'
+            struct Gp0Descriptor {
+                Gp0Kind kind = Gp0Kind::Nop;
+                
+                // Including the command word itself
+                uint8_t words = 1;
+                uint8_t vertices = 0;
+                
+                bool shaded = false;
+                bool textured = false;
+                bool rawTexture = false;
+                bool semiTransparent = false;
+                
+                // 0 = Variable, 1 = 1x1, 2 = 8x8, 3 = 16x16
+                uint8_t rectangleSize = 0;
+                
+                void (Gpu::*handler)(uint32_t) = nullptr;
             };
             
             /*union Polygon {
@@ -361,10 +397,32 @@ namespace Emulator {
             
         public:
             Gpu(bool enableRendering = true);
+            ~Gpu();
+            
+            // Owns its renderer, VRAM and rasterizer
+            Gpu(const Gpu&) = delete;
+            Gpu& operator=(const Gpu&) = delete;
+            
+            // Runs GP0 on a thread of its own, see 'GpuThread'.
+            // Needs a backend that doesn't make GL calls, see 'canRunThreaded'
+            void setThreaded(bool enabled);
+            bool threaded() const { return gpuThread.running(); }
+            bool canRunThreaded() const;
+            
+            // Waits for the GPU thread to run everything queued so far
+            void sync() { gpuThread.sync(); }
+            
+            // Draws with 'Rasterizer' into VRAM instead of the GL renderer,
+            // 'threads' of 0 uses every hardware thread, 1 draws on the GPU's own
+            void setSoftwareRendering(bool enabled, unsigned threads = 0);
+            bool softwareRendering() const { return rasterizer != nullptr; }
             
             bool step(uint32_t cycles);
             bool stepCRTC(uint32_t ticks);
             uint32_t ticksUntilNextCRTCEvent() const;
+            
+            // CPU cycles 'step' needs to reach the next CRTC event
+            uint32_t cyclesUntilNextCRTCEvent() const;
 
             uint32_t dotClockDivider() const {
                 switch (hres.getResolution()) {
@@ -470,6 +528,12 @@ namespace Emulator {
             // Handles writes to the GP0 command register
             void gp0(uint32_t val);
             
+            // Takes image data from a block DMA a row at a time while a CPU to VRAM
+            // transfer is running, 'data' being 16-bit pixels as they sit in RAM.
+            // Returns how many words it took, 0 means they have to go through 'gp0'.
+            // Threaded, they go to the GPU thread in one push.
+            size_t gp0ImageBlock(const uint8_t* data, size_t words);
+            
             // GP0(0xE1): command
             void gp0DrawMode(uint32_t val);
             
@@ -480,7 +544,7 @@ namespace Emulator {
             void gp0DrawingAreaBottomRight(uint32_t val);
             
             // GP0(0xE5): Set Drawing Offset
-            void gp0DrawingOffset(uint32_t val) const;
+            void gp0DrawingOffset(uint32_t val);
             
             // GP0(0xE2): Set Texture Window
             void gp0TextureWindow(uint32_t val);
@@ -531,6 +595,12 @@ namespace Emulator {
             // GP0(0x3C): Shaded Texture Opaque Quad
             void gp0QuadTexturedShadedOpaque(uint32_t val);
             
+            // GP0(20h-3Fh): Every polygon, described by 'gp0Descriptors'
+            void gp0Polygon(uint32_t val);
+            
+            // GP0(60h-7Fh): Every rectangle, described by 'gp0Descriptors'
+            void gp0Rectangle(uint32_t val);
+            
             //  GP0(40h) - Monochrome line, opaque
             //  GP0(42h) - Monochrome line, semi-transparent
             void gp0MonoLine(uint32_t val);
@@ -547,6 +617,11 @@ namespace Emulator {
             // Helper function
             void renderRectangle(Position position, Color color, UV uv, uint16_t width, uint16_t height);
             
+            // Hand primitives to whichever backend is active
+            void drawTriangle(Position positions[], Color colors[], UV uvs[]);
+            void drawQuad(Position positions[], Color colors[], UV uvs[]);
+            void drawLine(Position positions[], Color colors[]);
+            
             // y tf do these say "MonoOpaque"???????
             void gp0VarRectangleMonoOpaque(uint32_t val);
             void gp0VarTexturedRectangleMonoOpaque(uint32_t val);
@@ -583,7 +658,7 @@ namespace Emulator {
             // From VRAM to CPU
             void gp0ImageStore(uint32_t val);
             
-            void gp0VramToVram(uint32_t val) const;
+            void gp0VramToVram(uint32_t val);
             
             // Handles writes to the GP1 command register
             void gp1(uint32_t val);
@@ -625,6 +700,31 @@ namespace Emulator {
             [[nodiscard]] bool readyToSendVramToCpu() const;
             [[nodiscard]] bool readyToReceiveDmaBlock() const;
             
+            // GPUSTAT bits that only change through GP0
+            [[nodiscard]] uint32_t gp0StatusBits() const;
+            
+            // Runs a GP0 word right away, on the GPU thread when there's one
+            void executeGp0(uint32_t val);
+            
+            // Brings 'pushed' up to date with a word going to the GPU thread
+            void frameGp0(uint32_t val);
+            
+            // 'pushed' from the GP0 state, only while the GPU thread is idle
+            void reframeGp0();
+            
+            // Words left after a textured polygon's texpage word, -1 without one
+            static int pageWord(const Gp0Descriptor& command);
+            
+            // Last pixel of a CPU to VRAM transfer went in
+            void finishImageLoad();
+            
+            // 'gp0ImageBlock' on the thread owning the GP0 state
+            size_t writeImageWords(const uint8_t* data, size_t words);
+            
+            // GL readbacks reach VRAM lazily, anything going through
+            // 'vram' on the CPU side has to let them land first
+            void waitForReadbacks() const;
+            
             void setTextureDepth(TextureDepth depth);
             
             uint32_t extract(uint32_t reg, uint8_t start, uint8_t len) {
@@ -632,14 +732,7 @@ namespace Emulator {
                 return (reg >> start) & mask;
             }
             
-            std::unordered_map<std::string, uint32_t> decodeFields(uint32_t reg, const BitField* fields, size_t count) {
-                std::unordered_map<std::string, uint32_t> out;
-                
-                for (size_t i = 0; i < count; i++)
-                    out[fields[i].name] = extract(reg, fields[i].start, fields[i].length);
-                
-                return out;
-            }
+            static constexpr std::array<Gp0Descriptor, 256> makeGp0Descriptors();
 
             bool areTexturesDisabled() {
                 return textureDisable & newTextureDisable;
@@ -730,6 +823,12 @@ namespace Emulator {
         private:
             Attributes curAttribute = {};
             
+            // GP0 decoding state, per GPU so it stays with the GPU thread
+            uint32_t lastOp = 0;
+            
+            // Indexed by the GP0 opcode byte, built at compile time
+            static const std::array<Gp0Descriptor, 256> gp0Descriptors;
+            
         public:
             // Buffer containing the current GP0 command
             CommandBuffer gp0Command;
@@ -742,11 +841,42 @@ namespace Emulator {
             Gp0Mode readMode = Command;
             
             // Pointer to the method implementing the current GP command
-            std::function<void(Gpu&, uint32_t)> Gp0CommandMethod;
+            void (Gpu::*Gp0CommandMethod)(uint32_t) = nullptr;
             
         public:
-            Renderer* renderer;
-            VRAM* vram;
+            // The GL 'Renderer', or a 'NullRenderer' when rendering is disabled
+            RenderBackend* renderer = nullptr;
+            VRAM* vram = nullptr;
+            
+            // Set while software rendering is enabled
+            Rasterizer* rasterizer = nullptr;
+            
+        private:
+            // Where the words pushed to the GPU thread so far leave the GP0
+            // command framing, and the GPUSTAT bits they set. GPUSTAT reads
+            // don't have to wait on the thread running them that way.
+            struct Gp0Framing {
+                // Still to come for the current command, image data included
+                uint32_t words = 0;
+                bool polyLine = false;
+                // 'words' are what's left of a CPU to VRAM header, or its data
+                bool imageHeader = false;
+                bool image = false;
+                // Lost track, 24-bit transfers end wherever 'VRAM::setPixel' says
+                bool known = true;
+                // 'words' once the texpage of a textured polygon is in, see 'pageWord'
+                int pageWord = -1;
+                
+                uint32_t status = 0;
+            };
+            
+            // E1h, E6h and the IRQ
+            static constexpr uint32_t PUSHED_STATUS_BITS = 0x1FFF | (1u << 15) | (1u << 24);
+            
+            Gp0Framing pushed;
+            
+            // Last, so it stops before anything it uses goes away
+            GpuThread gpuThread;
     };
 }
 #endif // GPU_H
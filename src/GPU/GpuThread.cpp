@@ -0,0 +1,83 @@
+#include "GpuThread.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+#include <thread>
+
+namespace {
+    // Polls for a while before going to sleep, GP0 words tend to come in bursts
+    constexpr int SPINS = 256;
+}
+
+void GpuThread::start(std::function<size_t(const uint32_t*, size_t)> execute) {
+    if (running())
+        return;
+
+    this->execute = std::move(execute);
+
+    ring = std::make_unique<Emulator::Utils::SpscRing<uint32_t>>(CAPACITY);
+    worker.start([this] { return drain(); }, SPINS);
+}
+
+void GpuThread::stop() {
+    if (!running())
+        return;
+
+    sync();
+    worker.stop();
+
+    ring.reset();
+}
+
+void GpuThread::push(uint32_t word) {
+    // Only fills up when the thread is far behind, give it some time
+    while (!ring->push(word))
+        std::this_thread::yield();
+
+    worker.wake();
+}
+
+void GpuThread::push(const uint8_t* data, size_t words) {
+    uint32_t chunk[256];
+    
+    while (words > 0) {
+        const size_t count = std::min(words, std::size(chunk));
+        std::memcpy(chunk, data, count * sizeof(uint32_t));
+        
+        for (size_t done = 0; done < count;) {
+            const size_t fits = ring->push(chunk + done, count - done);
+            
+            if (fits == 0)
+                std::this_thread::yield();
+            
+            done += fits;
+        }
+        
+        worker.wake();
+        
+        data += count * sizeof(uint32_t);
+        words -= count;
+    }
+}
+
+void GpuThread::sync() {
+    if (!running())
+        return;
+
+    worker.waitUntil([this] { return ring->empty(); });
+}
+
+bool GpuThread::drain() {
+    size_t run;
+    const uint32_t* words = ring->front(run);
+
+    if (!words)
+        return false;
+
+    do {
+        ring->pop(execute(words, run));
+    } while ((words = ring->front(run)));
+
+    return true;
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+
+#include "../Utils/SpscRing.h"
+#include "../Utils/Worker.h"
+
+/**
+ * Thread running GP0 words off a ring, see 'Gpu::setThreaded'.
+ *
+ * The CPU thread pushes, the GPU thread only pops a word once it has been
+ * executed. So an empty ring also means the GPU thread is done with
+ * everything it was handed, see 'sync'.
+ *
+ * It also keeps a copy of the GP0 owned GPUSTAT bits, updated after
+ * every word, so GPUSTAT reads never have to wait on the thread. The
+ * 'Gpu' fills in the ones set by words still queued, see 'frameGp0'.
+ */
+class GpuThread {
+    public:
+        // Words, a power of two
+        static constexpr size_t CAPACITY = 1 << 16;
+
+        ~GpuThread() { stop(); }
+
+        // 'execute' runs on the new thread, with the queued words that are in
+        // one piece. Returns how many of them it ran, at least one.
+        void start(std::function<size_t(const uint32_t*, size_t)> execute);
+        void stop();
+
+        [[nodiscard]] bool running() const { return worker.running(); }
+
+        void push(uint32_t word);
+        
+        // 'words' as they sit in RAM, in one go
+        void push(const uint8_t* data, size_t words);
+
+        // Waits until every word pushed so far has been executed
+        void sync();
+
+        void publishStatus(uint32_t bits) { status.store(bits, std::memory_order_release); }
+        [[nodiscard]] uint32_t statusBits() const { return status.load(std::memory_order_acquire); }
+
+    private:
+        // Everything queued so far, false if there was nothing
+        bool drain();
+
+    private:
+        std::function<size_t(const uint32_t*, size_t)> execute;
+
+        std::unique_ptr<Emulator::Utils::SpscRing<uint32_t>> ring;
+        Emulator::Utils::Worker worker;
+
+        std::atomic<uint32_t> status{0};
+};
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstdint>
+
+#include "RenderBackend.h"
+
+namespace Emulator {
+    /**
+     * Backend without a GL context, for headless builds and 'Gpu(false)'.
+     *
+     * It takes every primitive and state change the GPU hands over and drops it,
+     * everything the guest can observe (GPUSTAT, GPUREAD, VRAM transfers) is
+     * handled by 'Gpu' and 'VRAM' on their own.
+     */
+    class NullRenderer : public RenderBackend {
+        public:
+            void flushDrawCommands() override {}
+            void readbackToVram(uint32_t, uint32_t, uint32_t, uint32_t) override {}
+            void waitForReadbacks() override {}
+
+            [[nodiscard]] bool ownsContext() const override { return false; }
+            [[nodiscard]] GLuint sceneTexture() const override { return 0; }
+
+        public:
+            void pushLine(Emulator::Gpu::Position[], Emulator::Gpu::Color[], Emulator::Gpu::UV[], Emulator::Gpu::Attributes) override {}
+            void pushTriangle(Emulator::Gpu::Position[], Emulator::Gpu::Color[], Emulator::Gpu::UV[], Emulator::Gpu::Attributes) override {}
+            void pushQuad(Emulator::Gpu::Position[], Emulator::Gpu::Color[], Emulator::Gpu::UV[], Emulator::Gpu::Attributes) override {}
+            void pushRectangle(Emulator::Gpu::Position[], Emulator::Gpu::Color[], Emulator::Gpu::UV[], Emulator::Gpu::Attributes) override {}
+
+        public:
+            void setDrawingOffset(int16_t, int16_t) override {}
+            void setDrawingArea(uint16_t, uint16_t, uint16_t, uint16_t) const override {}
+            void setTextureWindow(uint8_t, uint8_t, uint8_t, uint8_t) override {}
+            void setSemiTransparencyMode(uint8_t) const override {}
+    };
+}
@@ -1,153 +1,897 @@
 ﻿#include "Rasterizer.h"
 
 #include <algorithm>
+#include <cstdlib>
 
-#include "glm/gtc/type_ptr.hpp"
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
-Emulator::Rasterizer::Rasterizer(Gpu& gpu) : gpu(gpu) {
-	
+#include "../VRAM.h"
+
+namespace {
+	using Emulator::Gpu;
+
+	// Added to 8-bit colors before they're cut down to 5 bits
+	constexpr int DITHER[4][4] = {
+		{-4,  0, -3,  1},
+		{ 2, -2,  3, -1},
+		{-3,  1, -4,  0},
+		{ 3, -1,  2, -2},
+	};
+
+	// GPU state a primitive is drawn with, gathered once per primitive
+	struct DrawState {
+		Emulator::VRAM* vram;
+
+		// Drawing area, all inclusive
+		int clipLeft, clipTop, clipRight, clipBottom;
+
+		Gpu::TextureMode mode;
+		int depth;
+		uint32_t clutX, clutY;
+		uint32_t pageX, pageY;
+
+		// 4/8-bit page through its CLUT, indexed by v * 256 + u
+		const uint16_t* texels;
+
+		// Texture window, applied as (uv & and) | or
+		uint32_t windowAndU, windowOrU;
+		uint32_t windowAndV, windowOrV;
+
+		bool semiTransparent;
+		int semiMode;
+		bool dither;
+		bool checkMask;
+		uint16_t setMask;
+
+		// A solid color with nothing to read back, spans can be filled whole
+		[[nodiscard]] bool plainFill() const {
+			return mode == Gpu::ColorOnly && !semiTransparent && !checkMask;
+		}
+	};
+
+	DrawState makeState(const Gpu& gpu, const Gpu::UV* uvs, const Gpu::Attributes attributes) {
+		DrawState s{};
+		s.vram = gpu.vram;
+
+		s.clipLeft   = std::clamp<int>(gpu.drawingAreaLeft, 0, 1023);
+		s.clipTop    = std::clamp<int>(gpu.drawingAreaTop, 0, 511);
+		s.clipRight  = std::clamp<int>(gpu.drawingAreaRight, 0, 1023);
+		s.clipBottom = std::clamp<int>(gpu.drawingAreaBottom, 0, 511);
+
+		s.mode  = uvs ? attributes.textureMode() : Gpu::ColorOnly;
+		s.depth = attributes.textureDepth();
+
+		if (s.mode != Gpu::ColorOnly) {
+			// See 'Gpu::UV::fromGp0' for how those are packed
+			const auto dataX = static_cast<uint32_t>(uvs[0].dataX);
+			const auto dataY = static_cast<uint32_t>(uvs[0].dataY);
+
+			s.clutX = dataX >> 16;
+			s.pageX = dataX & 0xFFFF;
+			s.clutY = dataY >> 16;
+			s.pageY = dataY & 0xFFFF;
+		}
+
+		s.windowAndU = ~(gpu.textureWindowXMask * 8u) & 0xFF;
+		s.windowOrU  = (gpu.textureWindowXOffset & gpu.textureWindowXMask) * 8u;
+		s.windowAndV = ~(gpu.textureWindowYMask * 8u) & 0xFF;
+		s.windowOrV  = (gpu.textureWindowYOffset & gpu.textureWindowYMask) * 8u;
+
+		s.semiTransparent = attributes.isSemiTransparent();
+		s.semiMode  = attributes.semiTransparencyMode();
+		s.dither    = gpu.dithering;
+		s.checkMask = gpu.preserveMaskedPixels;
+		s.setMask   = gpu.forceSetMaskBit ? 0x8000 : 0;
+
+		return s;
+	}
+
+	inline uint16_t sampleTexel(const DrawState& s, uint32_t u, uint32_t v) {
+		u = (u & s.windowAndU) | s.windowOrU;
+		v = (v & s.windowAndV) | s.windowOrV;
+
+		if (s.depth < 2)
+			return s.texels[v * Emulator::TextureCache::SIZE + u];
+
+		return s.vram->pixel15(s.pageX + u, s.pageY + v);
+	}
+
+	// B=Back (what's in VRAM), F=Front (the new pixel), both 5-bit
+	inline int blendChannel(int back, int front, int mode) {
+		switch (mode) {
+			case 0:  return (back + front) >> 1;
+			case 1:  return std::min(back + front, 31);
+			case 2:  return std::max(back - front, 0);
+			default: return std::min(back + (front >> 2), 31);
+		}
+	}
+
+	// Runs one pixel through texturing, dithering, blending and the mask test.
+	// 'r', 'g' and 'b' are the 8-bit vertex color, 'dither' already takes
+	// the GPU setting into account.
+	template<bool Textured>
+	inline void plot(const DrawState& s, uint16_t* dst, int x, int y, int r, int g, int b, uint32_t u, uint32_t v, bool dither) {
+		const uint16_t back = *dst;
+
+		if (s.checkMask && (back & 0x8000))
+			return;
+
+		uint16_t maskBit = s.setMask;
+		bool blend = s.semiTransparent;
+
+		if constexpr (Textured) {
+			const uint16_t texel = sampleTexel(s, u, v);
+
+			// Fully transparent
+			if (texel == 0)
+				return;
+
+			maskBit |= texel & 0x8000;
+			blend = blend && (texel & 0x8000);
+
+			if (s.mode == Gpu::TextureOnly) {
+				r = (texel & 0x1F) << 3;
+				g = ((texel >> 5) & 0x1F) << 3;
+				b = ((texel >> 10) & 0x1F) << 3;
+
+				dither = false;
+			} else {
+				// texel * color / 128, kept in 8 bits until the dither
+				r = ((texel & 0x1F) * r) >> 4;
+				g = (((texel >> 5) & 0x1F) * g) >> 4;
+				b = (((texel >> 10) & 0x1F) * b) >> 4;
+			}
+		}
+
+		if (dither) {
+			const int offset = DITHER[y & 3][x & 3];
+
+			r += offset;
+			g += offset;
+			b += offset;
+		}
+
+		r = std::clamp(r, 0, 255) >> 3;
+		g = std::clamp(g, 0, 255) >> 3;
+		b = std::clamp(b, 0, 255) >> 3;
+
+		if (blend) {
+			r = blendChannel(back & 0x1F, r, s.semiMode);
+			g = blendChannel((back >> 5) & 0x1F, g, s.semiMode);
+			b = blendChannel((back >> 10) & 0x1F, b, s.semiMode);
+		}
+
+		*dst = static_cast<uint16_t>(r | (g << 5) | (b << 10) | maskBit);
+	}
+
+	// Solid spans are the common case, so they're written 8 pixels at a time
+	inline void fillSpan(uint16_t* dst, int count, uint16_t value) {
+#if defined(__SSE2__)
+		const __m128i pixels = _mm_set1_epi16(static_cast<short>(value));
+
+		for (; count >= 8; count -= 8, dst += 8)
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(dst), pixels);
+#endif
+
+		for (; count > 0; count--)
+			*dst++ = value;
+	}
+
+	inline int floorDiv(int n, int d) {
+		return n >= 0 ? n / d : -((-n + d - 1) / d);
+	}
+
+	inline int ceilDiv(int n, int d) {
+		return -floorDiv(-n, d);
+	}
+
+	struct Vertex {
+		int x, y;
+		int r, g, b;
+		int u, v;
+	};
+
+	// w(x, y) = a * x + b * y + c, a pixel is inside while w >= 0
+	struct Edge {
+		int a, b, c;
+
+		Edge(const Vertex& p, const Vertex& q) {
+			a = p.y - q.y;
+			b = q.x - p.x;
+			c = (q.y - p.y) * p.x - (q.x - p.x) * p.y;
+
+			// Pixels right on an edge only belong to top and left edges
+			const bool topLeft = q.y < p.y || (q.y == p.y && q.x > p.x);
+
+			if (!topLeft)
+				c -= 1;
+		}
+
+		// Narrows [left, right] down to the inside of line 'y'
+		void clip(int y, int& left, int& right) const {
+			const int w = b * y + c;
+
+			if (a > 0)
+				left = std::max(left, ceilDiv(-w, a));
+			else if (a < 0)
+				right = std::min(right, floorDiv(w, -a));
+			else if (w < 0)
+				right = left - 1;
+		}
+	};
+
+	// Vertex attribute stepped across a triangle in 16.16 fixed point
+	struct Plane {
+		int64_t base = 0;
+		int64_t dx = 0;
+		int64_t dy = 0;
+		int x0 = 0;
+		int y0 = 0;
+
+		Plane() = default;
+
+		Plane(const Vertex& v0, const Vertex& v1, const Vertex& v2, int a0, int a1, int a2, int area) : x0(v0.x), y0(v0.y) {
+			const int64_t d1 = a1 - a0;
+			const int64_t d2 = a2 - a0;
+
+			dx = ((d1 * (v2.y - v0.y) - d2 * (v1.y - v0.y)) << 16) / area;
+			dy = ((d2 * (v1.x - v0.x) - d1 * (v2.x - v0.x)) << 16) / area;
+
+			base = (int64_t(a0) << 16) + 0x8000;
+		}
+
+		[[nodiscard]] int64_t at(int x, int y) const {
+			return base + dx * (x - x0) + dy * (y - y0);
+		}
+	};
+
+	inline int channel(int64_t value) {
+		return std::clamp(int(value >> 16), 0, 255);
+	}
+
+	template<bool Textured, bool Shaded>
+	void fillTriangle(const DrawState& s, Vertex v0, Vertex v1, Vertex v2) {
+		int area = (v1.x - v0.x) * (v2.y - v0.y) - (v1.y - v0.y) * (v2.x - v0.x);
+
+		if (area == 0)
+			return;
+
+		// Edges assume clockwise (on screen) vertices
+		if (area < 0) {
+			std::swap(v1, v2);
+			area = -area;
+		}
+
+		const int minX = std::max(std::min({v0.x, v1.x, v2.x}), s.clipLeft);
+		const int maxX = std::min(std::max({v0.x, v1.x, v2.x}), s.clipRight);
+		const int minY = std::max(std::min({v0.y, v1.y, v2.y}), s.clipTop);
+		const int maxY = std::min(std::max({v0.y, v1.y, v2.y}), s.clipBottom);
+
+		if (minX > maxX || minY > maxY)
+			return;
+
+		const Edge edges[3] = { Edge(v0, v1), Edge(v1, v2), Edge(v2, v0) };
+
+		Plane r, g, b, u, v;
+
+		if constexpr (Shaded) {
+			r = Plane(v0, v1, v2, v0.r, v1.r, v2.r, area);
+			g = Plane(v0, v1, v2, v0.g, v1.g, v2.g, area);
+			b = Plane(v0, v1, v2, v0.b, v1.b, v2.b, area);
+		}
+
+		if constexpr (Textured) {
+			u = Plane(v0, v1, v2, v0.u, v1.u, v2.u, area);
+			v = Plane(v0, v1, v2, v0.v, v1.v, v2.v, area);
+		}
+
+		const bool dither = s.dither && (Shaded || s.mode == Gpu::TextureColor);
+		const bool plain = !Textured && !Shaded && s.plainFill();
+		const auto flat = static_cast<uint16_t>(((v0.r >> 3) | ((v0.g >> 3) << 5) | ((v0.b >> 3) << 10)) | s.setMask);
+
+		for (int y = minY; y <= maxY; y++) {
+			int left = minX;
+			int right = maxX;
+
+			for (const Edge& edge : edges)
+				edge.clip(y, left, right);
+
+			if (left > right)
+				continue;
+
+			uint16_t* line = s.vram->line15(y);
+
+			if (plain) {
+				fillSpan(line + left, right - left + 1, flat);
+				continue;
+			}
+
+			int64_t rs = 0, gs = 0, bs = 0, us = 0, vs = 0;
+
+			if constexpr (Shaded) {
+				rs = r.at(left, y);
+				gs = g.at(left, y);
+				bs = b.at(left, y);
+			}
+
+			if constexpr (Textured) {
+				us = u.at(left, y);
+				vs = v.at(left, y);
+			}
+
+			for (int x = left; x <= right; x++) {
+				if constexpr (Shaded) {
+					plot<Textured>(s, line + x, x, y, channel(rs), channel(gs), channel(bs), channel(us), channel(vs), dither);
+
+					rs += r.dx;
+					gs += g.dx;
+					bs += b.dx;
+				} else {
+					plot<Textured>(s, line + x, x, y, v0.r, v0.g, v0.b, channel(us), channel(vs), dither);
+				}
+
+				if constexpr (Textured) {
+					us += u.dx;
+					vs += v.dx;
+				}
+			}
+		}
+	}
+
+	Vertex makeVertex(const Gpu::Position& position, const Gpu::Color* color, const Gpu::UV* uv) {
+		Vertex vertex{};
+		vertex.x = static_cast<int>(position.x);
+		vertex.y = static_cast<int>(position.y);
+
+		// Raw textures don't come with colors, 128 leaves texels as they are
+		vertex.r = color ? color->r : 128;
+		vertex.g = color ? color->g : 128;
+		vertex.b = color ? color->b : 128;
+
+		vertex.u = uv ? static_cast<int>(uv->u) : 0;
+		vertex.v = uv ? static_cast<int>(uv->v) : 0;
+
+		return vertex;
+	}
+
+	bool sameColor(const Vertex& a, const Vertex& b) {
+		return a.r == b.r && a.g == b.g && a.b == b.b;
+	}
+
+	// Rectangles are walked along the axes, 'du'/'dv' are -1 when flipped
+	void fillRectangle(const DrawState& s, const Vertex& origin, int du, int dv) {
+		const int left   = std::max(origin.x, s.clipLeft);
+		const int top    = std::max(origin.y, s.clipTop);
+
+		if (s.mode != Gpu::ColorOnly) {
+			for (int y = top; y <= s.clipBottom; y++) {
+				uint16_t* line = s.vram->line15(y);
+				const auto v = static_cast<uint32_t>(origin.v + dv * (y - origin.y)) & 0xFF;
+
+				for (int x = left; x <= s.clipRight; x++) {
+					const auto u = static_cast<uint32_t>(origin.u + du * (x - origin.x)) & 0xFF;
+
+					// Rectangles are never dithered
+					plot<true>(s, line + x, x, y, origin.r, origin.g, origin.b, u, v, false);
+				}
+			}
+		} else if (s.plainFill()) {
+			const auto value = static_cast<uint16_t>((origin.r >> 3) | ((origin.g >> 3) << 5) | ((origin.b >> 3) << 10) | s.setMask);
+
+			for (int y = top; y <= s.clipBottom; y++)
+				fillSpan(s.vram->line15(y) + left, s.clipRight - left + 1, value);
+		} else {
+			for (int y = top; y <= s.clipBottom; y++) {
+				uint16_t* line = s.vram->line15(y);
+
+				for (int x = left; x <= s.clipRight; x++)
+					plot<false>(s, line + x, x, y, origin.r, origin.g, origin.b, 0, 0, false);
+			}
+		}
+	}
+
+	void fillLine(const DrawState& s, const Vertex& a, const Vertex& b) {
+		const int dx = b.x - a.x;
+		const int dy = b.y - a.y;
+
+		const int steps = std::max(std::abs(dx), std::abs(dy));
+		const bool dither = s.dither && !sameColor(a, b);
+
+		// Both ends are drawn, everything is stepped in 16.16
+		int64_t x = (int64_t(a.x) << 16) + 0x8000;
+		int64_t y = (int64_t(a.y) << 16) + 0x8000;
+		int64_t r = (int64_t(a.r) << 16) + 0x8000;
+		int64_t g = (int64_t(a.g) << 16) + 0x8000;
+		int64_t bl = (int64_t(a.b) << 16) + 0x8000;
+
+		const int64_t stepX = steps ? (int64_t(dx) << 16) / steps : 0;
+		const int64_t stepY = steps ? (int64_t(dy) << 16) / steps : 0;
+		const int64_t stepR = steps ? (int64_t(b.r - a.r) << 16) / steps : 0;
+		const int64_t stepG = steps ? (int64_t(b.g - a.g) << 16) / steps : 0;
+		const int64_t stepB = steps ? (int64_t(b.b - a.b) << 16) / steps : 0;
+
+		for (int i = 0; i <= steps; i++) {
+			const int px = static_cast<int>(x >> 16);
+			const int py = static_cast<int>(y >> 16);
+
+			if (px >= s.clipLeft && px <= s.clipRight && py >= s.clipTop && py <= s.clipBottom)
+				plot<false>(s, s.vram->line15(py) + px, px, py, channel(r), channel(g), channel(bl), 0, 0, dither);
+
+			x += stepX;
+			y += stepY;
+			r += stepR;
+			g += stepG;
+			bl += stepB;
+		}
+	}
+
+	constexpr int TILE_SIZE = 32;
+	constexpr int TILES_X = 1024 / TILE_SIZE;
+	constexpr int TILES_Y = 512 / TILE_SIZE;
+
+	// Batches go out once the workers are idle and there's enough to share,
+	// or once they're this big regardless
+	constexpr size_t MIN_BATCH = 64;
+	constexpr size_t MAX_BATCH = 2048;
+
+	struct Rect {
+		int left, top, right, bottom;
+
+		[[nodiscard]] bool overlaps(const Rect& other) const {
+			return left <= other.right && other.left <= right && top <= other.bottom && other.top <= bottom;
+		}
+
+		bool operator==(const Rect& other) const {
+			return left == other.left && top == other.top && right == other.right && bottom == other.bottom;
+		}
+	};
 }
 
-void Emulator::Rasterizer::drawTriangle(const Emulator::Gpu::Position positions[], const Emulator::Gpu::Color colors[], const Emulator::Gpu::UV uvs[], const Gpu::Attributes attributes) const {
-	//drawLine(positions[0], positions[1], colors[0], colors[1]);
-	//drawLine(positions[1], positions[2], colors[1], colors[2]);
-	//drawLine(positions[2], positions[0], colors[2], colors[0]);
-		
-	/*if(positions[0].x == 658) {
-		printf("");
-	}*/
-	
-	//fillTrinagle(positions, colors, uvs, attributes);
+struct Emulator::Rasterizer::Primitive {
+	enum class Kind : uint8_t {
+		Triangle,
+		Rectangle,
+		Line,
+	};
+
+	Kind kind;
+	bool textured;
+	bool shaded;
+
+	DrawState state;
+
+	// Rectangles only use the first one, with their u/v step in the second
+	Vertex vertices[3];
+
+	// Covered area, already clipped to the drawing area
+	Rect bounds;
+};
+
+struct Emulator::Rasterizer::Batch {
+	std::vector<Primitive> primitives;
+
+	// Indices into 'primitives' for every tile, in submission order
+	std::vector<std::vector<uint32_t>> bins = std::vector<std::vector<uint32_t>>(TILES_X * TILES_Y);
+
+	// Tiles with a non-empty bin
+	std::vector<uint32_t> tiles;
+
+	// 15-bit texture pages, read straight out of VRAM while drawing
+	std::vector<Rect> sampled;
+
+	[[nodiscard]] bool touches(const Rect& area) const {
+		for (int ty = area.top / TILE_SIZE; ty <= area.bottom / TILE_SIZE; ty++) {
+			for (int tx = area.left / TILE_SIZE; tx <= area.right / TILE_SIZE; tx++) {
+				if (!bins[ty * TILES_X + tx].empty())
+					return true;
+			}
+		}
+
+		return false;
+	}
+
+	[[nodiscard]] bool samples(const Rect& area) const {
+		return std::any_of(sampled.begin(), sampled.end(), [&](const Rect& page) { return page.overlaps(area); });
+	}
+
+	// Pages are 256 wide and wrap around the right edge
+	void sample(int pageX, int pageY) {
+		const Rect pages[] = {
+			{pageX, pageY, std::min(pageX + 255, 1023), pageY + 255},
+			{0, pageY, pageX + 255 - 1024, pageY + 255},
+		};
+
+		for (const Rect& page : pages) {
+			if (page.left <= page.right && std::find(sampled.begin(), sampled.end(), page) == sampled.end())
+				sampled.push_back(page);
+		}
+	}
+
+	void clear() {
+		for (uint32_t tile : tiles)
+			bins[tile].clear();
+
+		tiles.clear();
+		sampled.clear();
+		primitives.clear();
+	}
+};
+
+Emulator::Rasterizer::Rasterizer(Gpu& gpu, unsigned threads) : gpu(gpu), filling(std::make_unique<Batch>()), inFlight(std::make_unique<Batch>()) {
+	if (threads < 2)
+		return;
+
+	for (unsigned i = 0; i < threads; i++)
+		workers.emplace_back(&Rasterizer::work, this);
 }
 
-void Emulator::Rasterizer::drawQuad(const Emulator::Gpu::Position positions[], const Emulator::Gpu::Color colors[], const Emulator::Gpu::UV uvs[], const Gpu::Attributes attributes) const {
-	return;
-	
-	// [2, 3, 0]
-	Gpu::Position tr1[] = { positions[2], positions[3], positions[0] };
-	drawTriangle(tr1, colors, {}, attributes);
-	
-	// [3, 0, 1]
-	Gpu::Position tr2[] = { positions[3], positions[0], positions[1] };
-	drawTriangle(tr2, colors, {}, attributes);
+Emulator::Rasterizer::~Rasterizer() {
+	flush();
+
+	{
+		std::lock_guard lock(mutex);
+		quit = true;
+	}
+
+	wake.notify_all();
+
+	for (std::thread& worker : workers)
+		worker.join();
 }
 
-void Emulator::Rasterizer::drawRectangle(const Emulator::Gpu::Position positions[], const Emulator::Gpu::Color colors[], const Emulator::Gpu::UV uvs[], const Gpu::Attributes attributes) const {
-	return;
-	
-	/*// [2, 3, 0]
-	Gpu::Position tr1[] = { positions[2], positions[3], positions[0] };
-	drawTriangle(tr1, colors, {}, attributes);
-	
-	// [3, 0, 1]
-	Gpu::Position tr2[] = { positions[3], positions[0], positions[1] };
-	drawTriangle(tr2, colors, {}, attributes);*/
-	
-	// [0, 1, 2]
-	Gpu::Position tr1[] = { positions[0], positions[1], positions[2] };
-	drawTriangle(tr1, colors, {}, attributes);
-	
-	// [0, 2, 3]
-	Gpu::Position tr2[] = { positions[0], positions[2], positions[3] };
-	drawTriangle(tr2, colors, {}, attributes);
+void Emulator::Rasterizer::drawTriangle(const Emulator::Gpu::Position positions[], const Emulator::Gpu::Color colors[], const Emulator::Gpu::UV uvs[], const Gpu::Attributes attributes) {
+	Primitive primitive{};
+	primitive.kind = Primitive::Kind::Triangle;
+	primitive.state = makeState(gpu, attributes.useTextures() ? uvs : nullptr, attributes);
+	primitive.textured = primitive.state.mode != Gpu::ColorOnly;
+
+	Vertex* v = primitive.vertices;
+
+	for (int i = 0; i < 3; i++)
+		v[i] = makeVertex(positions[i], colors ? &colors[i] : nullptr, primitive.textured ? &uvs[i] : nullptr);
+
+	const int minX = std::min({v[0].x, v[1].x, v[2].x});
+	const int maxX = std::max({v[0].x, v[1].x, v[2].x});
+	const int minY = std::min({v[0].y, v[1].y, v[2].y});
+	const int maxY = std::max({v[0].y, v[1].y, v[2].y});
+
+	// The GPU skips polygons larger than 1023x511
+	if (maxX - minX > 1023 || maxY - minY > 511)
+		return;
+
+	// Raw textures ignore the vertex colors
+	primitive.shaded = primitive.state.mode != Gpu::TextureOnly && !(sameColor(v[0], v[1]) && sameColor(v[0], v[2]));
+
+	const DrawState& s = primitive.state;
+	primitive.bounds = {
+		std::max(minX, s.clipLeft), std::max(minY, s.clipTop),
+		std::min(maxX, s.clipRight), std::min(maxY, s.clipBottom),
+	};
+
+	submit(primitive);
 }
 
-void Emulator::Rasterizer::drawLine(const Emulator::Gpu::Position& p1, const Emulator::Gpu::Position& p2, const Emulator::Gpu::Color& c1, const Emulator::Gpu::Color& c2) const {
-	return;
-	
-	int dx = abs(p2.x - p1.x);
-	int dy = abs(p2.y - p1.y);
-	int sx = p1.x < p2.x ? 1 : -1;
-	int sy = p1.y < p2.y ? 1 : -1;
-	int err = dx - dy;
-    
-	int x = p1.x;
-	int y = p1.y;
-    
-	while (true) {
-		//auto color = glm::mix(c1, c2, );
-		gpu.vram->writePixel(x, y, c1.toU32());
-        
-		if (x == p2.x && y == p2.y) break;
-		
-		int e2 = err * 2;
-		if (e2 > -dy) { err -= dy; x += sx; }
-		if (e2 < dx) { err += dx; y += sy; }
+void Emulator::Rasterizer::drawQuad(const Emulator::Gpu::Position positions[], const Emulator::Gpu::Color colors[], const Emulator::Gpu::UV uvs[], const Gpu::Attributes attributes) {
+	// The GPU splits quads into [0, 1, 2] and [1, 2, 3]
+	drawTriangle(positions, colors, uvs, attributes);
+
+	const Gpu::Position p[] = { positions[1], positions[2], positions[3] };
+
+	Gpu::Color c[3];
+	Gpu::UV uv[3];
+
+	for (int i = 0; i < 3; i++) {
+		if (colors)
+			c[i] = colors[i + 1];
+
+		if (uvs)
+			uv[i] = uvs[i + 1];
 	}
+
+	drawTriangle(p, colors ? c : nullptr, uvs ? uv : nullptr, attributes);
 }
 
-void Emulator::Rasterizer::fillTrinagle(const Emulator::Gpu::Position positions[], const Emulator::Gpu::Color colors[], const Emulator::Gpu::UV uvs[], const Gpu::Attributes attributes) const {
-	// Sort the points by Y-coordinate (ascending)
-	Emulator::Gpu::Position vertices[3] = { positions[0], positions[1], positions[2] };
-	std::sort(vertices, vertices + 3, [](const Emulator::Gpu::Position& a, const Emulator::Gpu::Position& b) {
-		return a.y < b.y;
-	});
-	
-	// Get the sorted points
-	const Emulator::Gpu::Position& v0 = vertices[0];
-	const Emulator::Gpu::Position& v1 = vertices[1];
-	const Emulator::Gpu::Position& v2 = vertices[2];
-	
-	auto notZero = [this](float x) {
-		return (x == 0) ? 1e-6f : x; // Use a very small epsilon value
+void Emulator::Rasterizer::drawRectangle(const Emulator::Gpu::Position positions[], const Emulator::Gpu::Color colors[], const Emulator::Gpu::UV uvs[], const Gpu::Attributes attributes) {
+	Primitive primitive{};
+	primitive.kind = Primitive::Kind::Rectangle;
+	primitive.state = makeState(gpu, attributes.useTextures() ? uvs : nullptr, attributes);
+	primitive.textured = primitive.state.mode != Gpu::ColorOnly;
+
+	// See 'Gpu::renderRectangle' for the corner order
+	Vertex& origin = primitive.vertices[0];
+	origin = makeVertex(positions[0], colors, nullptr);
+
+	const int x1 = static_cast<int>(positions[3].x);
+	const int y1 = static_cast<int>(positions[3].y);
+
+	if (primitive.textured) {
+		// Flipped rectangles come with their corners swapped,
+		// the texture is then walked backwards from the first one
+		const bool flipX = uvs[1].u < uvs[0].u;
+		const bool flipY = uvs[2].v < uvs[0].v;
+
+		origin.u = static_cast<int>(flipX ? uvs[1].u : uvs[0].u);
+		origin.v = static_cast<int>(flipY ? uvs[2].v : uvs[0].v);
+
+		primitive.vertices[1].u = flipX ? -1 : 1;
+		primitive.vertices[1].v = flipY ? -1 : 1;
+	}
+
+	const DrawState& s = primitive.state;
+	primitive.bounds = {
+		std::max(origin.x, s.clipLeft), std::max(origin.y, s.clipTop),
+		std::min(x1 - 1, s.clipRight), std::min(y1 - 1, s.clipBottom),
 	};
-	
-	auto lerp = [](float start, float end, float t) {
-		return start + t * (end - start);
+
+	submit(primitive);
+}
+
+void Emulator::Rasterizer::drawLine(const Emulator::Gpu::Position positions[], const Emulator::Gpu::Color colors[], const Emulator::Gpu::UV uvs[], const Gpu::Attributes attributes) {
+	Primitive primitive{};
+	primitive.kind = Primitive::Kind::Line;
+	primitive.state = makeState(gpu, nullptr, attributes);
+
+	const Vertex& a = primitive.vertices[0] = makeVertex(positions[0], colors ? &colors[0] : nullptr, nullptr);
+	const Vertex& b = primitive.vertices[1] = makeVertex(positions[1], colors ? &colors[1] : nullptr, nullptr);
+
+	// Same limit as for polygons
+	if (std::abs(b.x - a.x) > 1023 || std::abs(b.y - a.y) > 511)
+		return;
+
+	const DrawState& s = primitive.state;
+	primitive.bounds = {
+		std::max(std::min(a.x, b.x), s.clipLeft), std::max(std::min(a.y, b.y), s.clipTop),
+		std::min(std::max(a.x, b.x), s.clipRight), std::min(std::max(a.y, b.y), s.clipBottom),
+	};
+
+	submit(primitive);
+}
+
+void Emulator::Rasterizer::sync(uint32_t x, uint32_t y, uint32_t width, uint32_t height, bool write) {
+	if (workers.empty() || width == 0 || height == 0)
+		return;
+
+	// Transfers wrap around the edges, those just wait for everything
+	if (x + width > 1024 || y + height > 512) {
+		flush();
+		return;
+	}
+
+	const Rect area = {
+		static_cast<int>(x), static_cast<int>(y),
+		static_cast<int>(x + width - 1), static_cast<int>(y + height - 1),
 	};
-	
-	auto interpolateColor = [](const Emulator::Gpu::Color& c1, const Emulator::Gpu::Color& c2, float t) {
-		return Emulator::Gpu::Color(
-			static_cast<GLubyte>(c1.r + t * (c2.r - c1.r)),
-			static_cast<GLubyte>(c1.g + t * (c2.g - c1.g)),
-			static_cast<GLubyte>(c1.b + t * (c2.b - c1.b))
-		);
+
+	if (filling->touches(area) || (write && filling->samples(area))) {
+		kick();
+		retire();
+	} else if (busy && (inFlight->touches(area) || (write && inFlight->samples(area)))) {
+		retire();
+	}
+}
+
+void Emulator::Rasterizer::flush() {
+	kick();
+	retire();
+}
+
+void Emulator::Rasterizer::submit(Primitive& primitive) {
+	const Rect& bounds = primitive.bounds;
+
+	if (bounds.left > bounds.right || bounds.top > bounds.bottom)
+		return;
+
+	if (workers.empty()) {
+		if (primitive.textured && primitive.state.depth < 2)
+			prepareTexture(primitive);
+
+		rasterize(primitive, bounds.left, bounds.top, bounds.right, bounds.bottom);
+		gpu.vram->markDirty(bounds.left, bounds.top, bounds.right - bounds.left + 1, bounds.bottom - bounds.top + 1);
+
+		return;
+	}
+
+	// Anything drawn earlier into the texture page or CLUT has to land first
+	if (primitive.textured) {
+		const DrawState& s = primitive.state;
+
+		sync(s.pageX, s.pageY, std::min<uint32_t>(64u << s.depth, 1024 - s.pageX), std::min<uint32_t>(256, 512 - s.pageY));
+
+		if (s.depth < 2) {
+			sync(s.clutX, s.clutY, std::min<uint32_t>(s.depth == 0 ? 16 : 256, 1024 - s.clutX), 1);
+			prepareTexture(primitive);
+		}
+	}
+
+	// Drawing over a 15-bit page read earlier in this batch, the tiles could
+	// go in any order. The batch in flight is always retired before this one.
+	if (filling->samples(bounds))
+		kick();
+
+	if (primitive.textured && primitive.state.depth == 2)
+		filling->sample(static_cast<int>(primitive.state.pageX), static_cast<int>(primitive.state.pageY));
+
+	Batch& batch = *filling;
+	const auto index = static_cast<uint32_t>(batch.primitives.size());
+
+	batch.primitives.push_back(primitive);
+
+	for (int ty = bounds.top / TILE_SIZE; ty <= bounds.bottom / TILE_SIZE; ty++) {
+		for (int tx = bounds.left / TILE_SIZE; tx <= bounds.right / TILE_SIZE; tx++) {
+			const uint32_t tile = ty * TILES_X + tx;
+
+			if (batch.bins[tile].empty())
+				batch.tiles.push_back(tile);
+
+			batch.bins[tile].push_back(index);
+		}
+	}
+
+	const bool idle = remaining.load(std::memory_order_acquire) == 0;
+
+	if (batch.primitives.size() >= MAX_BATCH || (idle && batch.primitives.size() >= MIN_BATCH))
+		kick();
+}
+
+void Emulator::Rasterizer::prepareTexture(Primitive& primitive) {
+	DrawState& s = primitive.state;
+
+	const TextureCache::Key key = {
+		static_cast<uint16_t>(s.pageX), static_cast<uint16_t>(s.pageY),
+		static_cast<uint16_t>(s.clutX), static_cast<uint16_t>(s.clutY), static_cast<uint8_t>(s.depth),
 	};
-	
-	// Scanline filling
-	for (int y = v0.y; y < v2.y; y++) {
-		// Calculate x-coordinates for the left and right edges of the triangle at the current scanline
-		int xLeft, xRight;
-		Emulator::Gpu::Color colorLeft, colorRight;
-		
-		if (y < v1.y) {
-			// Interpolate along the edges v0-v1 and v0-v2
-			float t01 = float(y - v0.y) / float(notZero(v1.y - v0.y));
-			float t02 = float(y - v0.y) / float(notZero(v2.y - v0.y));
-			
-			xLeft = lerp(v0.x, v2.x, t02);
-			if (attributes.usesColor())
-				colorLeft = interpolateColor(colors[0], colors[2], t02);
-			
-			xRight = lerp(v0.x, v1.x, t01);
-			if (attributes.usesColor())
-				colorRight = interpolateColor(colors[0], colors[1], t01);
+
+	bool recycled = false;
+	TextureCache::Slot& slot = gpu.vram->textures.find(key, recycled);
+
+	// Batches still drawing with the old texels have to be done first,
+	// the filling one is 'generation + 1', the one in flight 'generation'
+	if (recycled && !workers.empty()) {
+		if (slot.lastUse > generation)
+			flush();
+		else if (slot.lastUse == generation)
+			retire();
+	}
+
+	slot.lastUse = generation + 1;
+
+	// Only the rows it can reach, give or take one for rounding
+	uint32_t first = 0;
+	uint32_t count = TextureCache::SIZE;
+
+	if (s.windowAndV == 0xFF && s.windowOrV == 0) {
+		const Vertex* v = primitive.vertices;
+
+		if (primitive.kind == Primitive::Kind::Rectangle) {
+			count = primitive.bounds.bottom - primitive.bounds.top + 1;
+			first = v[0].v + v[1].v * (primitive.bounds.top - v[0].y);
+
+			if (v[1].v < 0)
+				first -= count - 1;
 		} else {
-			// Interpolate along edges v1-v2 and v0-v2
-			float t12 = float(y - v1.y) / float(notZero(v2.y - v1.y));
-			float t02 = float(y - v0.y) / float(notZero(v2.y - v0.y));
-			
-			xLeft = lerp(v1.x, v2.x, t12);
-			if (attributes.usesColor())
-				colorLeft = interpolateColor(colors[1], colors[2], t12);
-			
-			xRight = lerp(v0.x, v2.x, t02);
-			if (attributes.usesColor())
-				colorRight = interpolateColor(colors[0], colors[2], t02);
-		}
-		
-		// Ensure xLeft is always less than xRight
-		if (xLeft > xRight) {
-			std::swap(xLeft, xRight);
-			std::swap(colorLeft, colorRight);
-		}
-		
-		// Fill between the two intersection points
-		for (int x = xLeft; x < xRight; x++) {
-			float t = float(x - xLeft) / float(xRight - xLeft);
-			Emulator::Gpu::Color pixelColor = interpolateColor(colorLeft, colorRight, t);
-			
-			gpu.vram->writePixel(x, y, pixelColor.toU32());
-		}
-	}	
+			const int low = std::max(std::min({v[0].v, v[1].v, v[2].v}) - 1, 0);
+			const int high = std::min(std::max({v[0].v, v[1].v, v[2].v}) + 1, 255);
+
+			first = low;
+			count = high - low + 1;
+		}
+	}
+
+	gpu.vram->textures.decodeRows(slot, first, count);
+	s.texels = slot.texels.get();
+}
+
+void Emulator::Rasterizer::rasterize(const Primitive& primitive, int left, int top, int right, int bottom) const {
+	DrawState s = primitive.state;
+	s.clipLeft   = std::max(s.clipLeft, left);
+	s.clipTop    = std::max(s.clipTop, top);
+	s.clipRight  = std::min(s.clipRight, right);
+	s.clipBottom = std::min(s.clipBottom, bottom);
+
+	if (s.clipLeft > s.clipRight || s.clipTop > s.clipBottom)
+		return;
+
+	const Vertex* v = primitive.vertices;
+
+	switch (primitive.kind) {
+		case Primitive::Kind::Triangle:
+			if (primitive.textured) {
+				if (primitive.shaded)
+					fillTriangle<true, true>(s, v[0], v[1], v[2]);
+				else
+					fillTriangle<true, false>(s, v[0], v[1], v[2]);
+			} else {
+				if (primitive.shaded)
+					fillTriangle<false, true>(s, v[0], v[1], v[2]);
+				else
+					fillTriangle<false, false>(s, v[0], v[1], v[2]);
+			}
+			break;
+
+		case Primitive::Kind::Rectangle:
+			// 'bounds' already is the whole rectangle
+			s.clipRight  = std::min(s.clipRight, primitive.bounds.right);
+			s.clipBottom = std::min(s.clipBottom, primitive.bounds.bottom);
+
+			fillRectangle(s, v[0], v[1].u, v[1].v);
+			break;
+
+		case Primitive::Kind::Line:
+			fillLine(s, v[0], v[1]);
+			break;
+	}
+}
+
+void Emulator::Rasterizer::kick() {
+	retire();
+
+	if (filling->primitives.empty())
+		return;
+
+	std::swap(filling, inFlight);
+
+	nextTile.store(0, std::memory_order_relaxed);
+	remaining.store(static_cast<uint32_t>(workers.size()), std::memory_order_relaxed);
+	busy = true;
+
+	{
+		std::lock_guard lock(mutex);
+		generation++;
+	}
+
+	wake.notify_all();
+}
+
+void Emulator::Rasterizer::retire() {
+	if (!busy)
+		return;
+
+	{
+		std::unique_lock lock(mutex);
+		done.wait(lock, [this] { return remaining.load(std::memory_order_acquire) == 0; });
+	}
+
+	busy = false;
+
+	for (const Primitive& primitive : inFlight->primitives) {
+		const Rect& b = primitive.bounds;
+		gpu.vram->markDirty(b.left, b.top, b.right - b.left + 1, b.bottom - b.top + 1);
+	}
+
+	inFlight->clear();
+}
+
+void Emulator::Rasterizer::work() {
+	uint64_t seen = 0;
+
+	for (;;) {
+		{
+			std::unique_lock lock(mutex);
+			wake.wait(lock, [&] { return quit || generation != seen; });
+
+			if (quit)
+				return;
+
+			seen = generation;
+		}
+
+		const Batch& batch = *inFlight;
+
+		for (uint32_t i = nextTile.fetch_add(1); i < batch.tiles.size(); i = nextTile.fetch_add(1)) {
+			const uint32_t tile = batch.tiles[i];
+
+			const int left = static_cast<int>(tile % TILES_X) * TILE_SIZE;
+			const int top  = static_cast<int>(tile / TILES_X) * TILE_SIZE;
+
+			for (uint32_t index : batch.bins[tile])
+				rasterize(batch.primitives[index], left, top, left + TILE_SIZE - 1, top + TILE_SIZE - 1);
+		}
+
+		if (remaining.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+			std::lock_guard lock(mutex);
+			done.notify_one();
+		}
+	}
 }
@@ -1,21 +1,83 @@
 ﻿#pragma once
 
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
 #include "../Gpu.h"
 
 namespace Emulator {
+	/**
+	 * Software backend for the GPU, see 'Gpu::setSoftwareRendering'.
+	 *
+	 * Primitives are drawn straight into the 15-bit VRAM held by 'VRAM',
+	 * so VRAM to CPU transfers never have to wait for a GL readback.
+	 * Everything is integer math, edges follow the PSX fill rule (top-left
+	 * edges are drawn, right and bottom ones aren't) and colors/texture
+	 * coordinates are stepped as 16.16 fixed-point planes.
+	 *
+	 * With worker threads, primitives are binned into 32x32 tiles and
+	 * batched up. Each tile is drawn by a single worker in submission order
+	 * while the GP0 side keeps filling the next batch. Anything touching VRAM
+	 * directly has to go through 'sync' first.
+	 */
 	class Rasterizer {
 	public:
-		Rasterizer(Gpu& gpu);
-		
-		void drawTriangle (const Emulator::Gpu::Position positions[], const Emulator::Gpu::Color colors[], const Emulator::Gpu::UV uvs[], const Gpu::Attributes attributes) const;
-		void drawQuad     (const Emulator::Gpu::Position positions[], const Emulator::Gpu::Color colors[], const Emulator::Gpu::UV uvs[], const Gpu::Attributes attributes) const;
-		void drawRectangle(const Emulator::Gpu::Position positions[], const Emulator::Gpu::Color colors[], const Emulator::Gpu::UV uvs[], const Gpu::Attributes attributes) const;
-		
+		// 0 or 1 'threads' draws everything on the calling thread
+		explicit Rasterizer(Gpu& gpu, unsigned threads = 0);
+		~Rasterizer();
+
+		void drawTriangle (const Emulator::Gpu::Position positions[], const Emulator::Gpu::Color colors[], const Emulator::Gpu::UV uvs[], const Gpu::Attributes attributes);
+		void drawQuad     (const Emulator::Gpu::Position positions[], const Emulator::Gpu::Color colors[], const Emulator::Gpu::UV uvs[], const Gpu::Attributes attributes);
+		void drawRectangle(const Emulator::Gpu::Position positions[], const Emulator::Gpu::Color colors[], const Emulator::Gpu::UV uvs[], const Gpu::Attributes attributes);
+		void drawLine     (const Emulator::Gpu::Position positions[], const Emulator::Gpu::Color colors[], const Emulator::Gpu::UV uvs[], const Gpu::Attributes attributes);
+
+		// Waits for every queued primitive touching the area to land in VRAM.
+		// Before a 'write', also for those still reading 15-bit texels from it.
+		void sync(uint32_t x, uint32_t y, uint32_t width, uint32_t height, bool write = false);
+
+		// Waits for everything
+		void flush();
+
 	private:
-		void drawLine    (const Emulator::Gpu::Position& p1, const Emulator::Gpu::Position& p2, const Emulator::Gpu::Color& c1, const Emulator::Gpu::Color& c2) const;
-		void fillTrinagle(const Emulator::Gpu::Position positions[], const Emulator::Gpu::Color colors[], const Emulator::Gpu::UV uvs[], Gpu::Attributes attributes) const;
-		
+		struct Primitive;
+		struct Batch;
+
+		void submit(Primitive& primitive);
+
+		// Points the primitive at its decoded texture page, see 'TextureCache'
+		void prepareTexture(Primitive& primitive);
+		void rasterize(const Primitive& primitive, int left, int top, int right, int bottom) const;
+
+		// Hands 'filling' over to the workers
+		void kick();
+
+		// Waits for 'inFlight' and marks what it drew as dirty
+		void retire();
+
+		void work();
+
 	private:
 		Gpu& gpu;
+
+		std::vector<std::thread> workers;
+
+		std::mutex mutex;
+		std::condition_variable wake;
+		std::condition_variable done;
+
+		// Bumped for every batch, workers start drawing once it changes
+		uint64_t generation = 0;
+		bool quit = false;
+
+		std::unique_ptr<Batch> filling;
+		std::unique_ptr<Batch> inFlight;
+		bool busy = false;
+
+		std::atomic<uint32_t> nextTile{0};
+		std::atomic<uint32_t> remaining{0};
 	};
 }
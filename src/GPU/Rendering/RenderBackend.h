@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstdint>
+
+#include "../Gpu.h"
+
+namespace Emulator {
+    /**
+     * Where 'Gpu' sends primitives and state changes while the software
+     * 'Rasterizer' is off. That's the GL 'Renderer', or a 'NullRenderer'
+     * when there's no GL context (headless builds and 'Gpu(false)').
+     */
+    class RenderBackend {
+        public:
+            virtual ~RenderBackend() = default;
+
+            virtual void flushDrawCommands() = 0;
+            virtual void readbackToVram(uint32_t x, uint32_t y, uint32_t width, uint32_t height) = 0;
+            virtual void waitForReadbacks() = 0;
+
+            // GL calls have to stay on the thread owning the context, see 'Gpu::canRunThreaded'
+            [[nodiscard]] virtual bool ownsContext() const = 0;
+
+            // Texture the scene is drawn into, VRAM transfers get copied there
+            [[nodiscard]] virtual GLuint sceneTexture() const = 0;
+
+        public:
+            virtual void pushLine(Emulator::Gpu::Position positions[], Emulator::Gpu::Color colors[], Emulator::Gpu::UV uvs[], Emulator::Gpu::Attributes attributes) = 0;
+            virtual void pushTriangle(Emulator::Gpu::Position positions[], Emulator::Gpu::Color colors[], Emulator::Gpu::UV uvs[], Emulator::Gpu::Attributes attributes) = 0;
+            virtual void pushQuad(Emulator::Gpu::Position positions[], Emulator::Gpu::Color colors[], Emulator::Gpu::UV uvs[], Emulator::Gpu::Attributes attributes) = 0;
+            virtual void pushRectangle(Emulator::Gpu::Position positions[], Emulator::Gpu::Color colors[], Emulator::Gpu::UV uvs[], Emulator::Gpu::Attributes attributes) = 0;
+
+        public:
+            virtual void setDrawingOffset(int16_t x, int16_t y) = 0;
+            virtual void setDrawingArea(uint16_t left, uint16_t right, uint16_t top, uint16_t bottom) const = 0;
+            virtual void setTextureWindow(uint8_t textureWindowXMask, uint8_t textureWindowYMask, uint8_t textureWindowXOffset, uint8_t textureWindowYOffset) = 0;
+            virtual void setSemiTransparencyMode(uint8_t semiTransparencyMode) const = 0;
+    };
+}
@@ -1,6 +1,7 @@
 ﻿#include "Renderer.h"
 
 #include <algorithm>
+#include <cmath>
 #include <filesystem>
 #include <fstream>
 #include <iostream>
@@ -15,6 +16,7 @@
 #include "imgui.h"
 
 #include "../Gpu.h"
+#include "Rasterizer.h"
 
 // #define Test
 //  Ik I shouldn't do this but im lazy
@@ -216,7 +218,7 @@ enum { WIDTH = 1024, HEIGHT = 512 };
     }
 }*/
 
-Emulator::Renderer::Renderer(Emulator::Gpu &gpu) : gpu(gpu), _rasterizer(gpu) {
+Emulator::Renderer::Renderer(Emulator::Gpu &gpu) : gpu(gpu) {
     glfwSetErrorCallback(
             [](int code, const char *desc) { std::cerr << "GLFW error " << code << ": " << desc << '\n'; });
 
@@ -340,6 +342,21 @@ Emulator::Renderer::Renderer(Emulator::Gpu &gpu) : gpu(gpu), _rasterizer(gpu) {
 
         glVertexAttribIPointer(index, 1, GL_INT, 0, nullptr);
 
+        // Readback buffers
+        for (auto& slot : readbacks) {
+            const GLsizeiptr size = GLsizeiptr(WIDTH) * HEIGHT * 4;
+            const GLbitfield flags = GL_MAP_READ_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+            glCreateBuffers(1, &slot.pbo);
+            glNamedBufferStorage(slot.pbo, size, nullptr, flags);
+
+            slot.map = static_cast<const uint8_t*>(glMapNamedBufferRange(slot.pbo, 0, size, flags));
+
+            if (!slot.map) {
+                throw std::runtime_error("glMapNamedBufferRange failed");
+            }
+        }
+
         // Uniforms
         offsetUni = glGetUniformLocation(program, "offset");
         setDrawingOffset(0, 0);
@@ -669,14 +686,40 @@ void Emulator::Renderer::renderFrame() {
 
     // gpu.vram->copyToTexture(0, 0, 1024, 512, sceneTex[curTex]);
 
+    // Software rendered frames only exist in VRAM, bring the scene up to date
+    if (gpu.rasterizer) {
+        gpu.rasterizer->flush();
+        gpu.vram->endTransfer();
+        gpu.vram->copyToTexture(0, 0, 0, 0, WIDTH, HEIGHT, sceneTex[curTex]);
+    }
+
     display(!cropToDisplayArea);
 
     curTex    = 0;
-    nVertices = 0;
+    nVertices = firstVertex;
+
+    primitives.clear();
+}
+
+namespace {
+    void waitSync(GLsync& fence) {
+        if (!fence) {
+            return;
+        }
+
+        GLenum result;
+
+        do {
+            result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1'000'000);
+        } while (result == GL_TIMEOUT_EXPIRED);
+
+        glDeleteSync(fence);
+        fence = nullptr;
+    }
 }
 
 void Emulator::Renderer::flushDrawCommands() {
-    if (nVertices == 0) {
+    if (nVertices == firstVertex) {
         return;
     }
 
@@ -684,9 +727,26 @@ void Emulator::Renderer::flushDrawCommands() {
     glViewport(0, 0, WIDTH, HEIGHT);
 
     draw();
-    glFinish();
 
-    nVertices = 0;
+    firstVertex = nVertices;
+}
+
+void Emulator::Renderer::reserveVertices(uint32_t count) {
+    if (nVertices + count <= (vertexRegion + 1) * VERTEX_REGION_LEN) {
+        return;
+    }
+
+    flushDrawCommands();
+
+    // Everything drawn from this region is behind this fence
+    regionFences[vertexRegion] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+    vertexRegion = (vertexRegion + 1) % VERTEX_REGIONS;
+
+    // Normally long done, it's been three regions
+    waitSync(regionFences[vertexRegion]);
+
+    nVertices = firstVertex = vertexRegion * VERTEX_REGION_LEN;
 }
 
 void Emulator::Renderer::readbackToVram(uint32_t x, uint32_t y, uint32_t width, uint32_t height) {
@@ -696,21 +756,34 @@ void Emulator::Renderer::readbackToVram(uint32_t x, uint32_t y, uint32_t width,
 
     flushDrawCommands();
 
+    // Every slot is still waiting to be read, the oldest has to make room
+    if (pendingReadbacks == READBACK_SLOTS) {
+        resolveReadback();
+    }
+
+    auto& slot = readbacks[nextReadback];
+
+    nextReadback = (nextReadback + 1) % READBACK_SLOTS;
+    pendingReadbacks++;
+
     x %= WIDTH;
     y %= HEIGHT;
 
-    auto* const vram = gpu.vram->gpu15;
-
     glPixelStorei(GL_PACK_ALIGNMENT, 1);
     glPixelStorei(GL_PACK_ROW_LENGTH, 0);
 
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.pbo);
+
+    GLintptr offset = 0;
+
     const auto readRegion = [&](uint32_t regionX, uint32_t regionY, uint32_t regionWidth, uint32_t regionHeight) {
         if (regionWidth == 0 || regionHeight == 0) {
             return;
         }
 
-        std::vector<uint8_t> pixels(regionWidth * regionHeight * 4);
+        const GLsizei size = GLsizei(regionWidth * regionHeight * 4);
 
+        // With a pack buffer bound the pointer is an offset into it
         glGetTextureSubImage(
             sceneTex[curTex],
             0,
@@ -722,28 +795,12 @@ void Emulator::Renderer::readbackToVram(uint32_t x, uint32_t y, uint32_t width,
             1,
             GL_RGBA,
             GL_UNSIGNED_BYTE,
-            static_cast<GLsizei>(pixels.size()),
-            pixels.data()
+            size,
+            reinterpret_cast<void*>(offset)
         );
 
-        for (uint32_t row = 0; row < regionHeight; row++) {
-            const uint32_t psxY = regionY + row;
-            const uint32_t dstY = HEIGHT - psxY - 1;
-            const uint32_t srcRow = regionHeight - row - 1;
-
-            uint16_t* dst = vram + dstY * WIDTH + regionX;
-
-            for (uint32_t column = 0; column < regionWidth; column++) {
-                const uint8_t* src = pixels.data() + ((srcRow * regionWidth + column) * 4);
-
-                const uint16_t r = uint16_t(src[0] >> 3);
-                const uint16_t g = uint16_t(src[1] >> 3);
-                const uint16_t b = uint16_t(src[2] >> 3);
-                const uint16_t m = src[3] >= 128 ? 0x8000 : 0;
-
-                dst[column] = uint16_t(r | (g << 5) | (b << 10) | m);
-            }
-        }
+        slot.regions.push_back({regionX, regionY, regionWidth, regionHeight, offset});
+        offset += size;
     };
 
     uint32_t remainingHeight = height;
@@ -767,15 +824,64 @@ void Emulator::Renderer::readbackToVram(uint32_t x, uint32_t y, uint32_t width,
         remainingHeight -= chunkHeight;
         currentY = 0;
     }
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+void Emulator::Renderer::waitForReadbacks() {
+    while (pendingReadbacks > 0) {
+        resolveReadback();
+    }
+}
+
+void Emulator::Renderer::resolveReadback() {
+    auto& slot = readbacks[(nextReadback + READBACK_SLOTS - pendingReadbacks) % READBACK_SLOTS];
+
+    // The map is coherent, once the copy is done the pixels are visible
+    waitSync(slot.fence);
+
+    auto* const vram = gpu.vram->gpu15;
+
+    for (const auto& region : slot.regions) {
+        const uint8_t* const pixels = slot.map + region.offset;
+
+        for (uint32_t row = 0; row < region.height; row++) {
+            const uint32_t psxY = region.y + row;
+            const uint32_t dstY = HEIGHT - psxY - 1;
+            const uint32_t srcRow = region.height - row - 1;
+
+            uint16_t* dst = vram + dstY * WIDTH + region.x;
+
+            for (uint32_t column = 0; column < region.width; column++) {
+                const uint8_t* src = pixels + ((srcRow * region.width + column) * 4);
+
+                const uint16_t r = uint16_t(src[0] >> 3);
+                const uint16_t g = uint16_t(src[1] >> 3);
+                const uint16_t b = uint16_t(src[2] >> 3);
+                const uint16_t m = src[3] >= 128 ? 0x8000 : 0;
+
+                dst[column] = uint16_t(r | (g << 5) | (b << 10) | m);
+            }
+        }
+        
+        // Nothing to upload, but cached texture pages under it are stale now
+        gpu.vram->touch(region.x, region.y, region.width, region.height);
+    }
+
+    slot.regions.clear();
+    pendingReadbacks--;
 }
 
 void Emulator::Renderer::draw() {
-    if (nVertices == 0)
+    if (nVertices == firstVertex)
         return;
 
     if (!positions.map || !colors.map || !uvs.map || !attributes.map) {
         std::cerr << "Persistent buffer unmapped or invalid!" << std::endl;
-        nVertices = 0;
+        nVertices = firstVertex;
+        primitives.clear();
         return;
     }
 
@@ -815,15 +921,17 @@ void Emulator::Renderer::draw() {
     glActiveTexture(GL_TEXTURE1);
     glBindTexture(GL_TEXTURE_2D, sceneTex[curTex]);
 
+    // Whatever earlier batches wrote has to be visible through 'sceneTex'
+    glTextureBarrier();
+
     if (primitiveMode == GL_TRIANGLES) {
-        for (uint32_t i = 0; i + 2 < nVertices; i += 3) {
-            glTextureBarrier();
-            glDrawArrays(GL_TRIANGLES, static_cast<GLint>(i), 3);
-        }
+        drawTriangles();
     } else {
-        glDrawArrays(primitiveMode, 0, static_cast<GLsizei>(nVertices));
+        glDrawArrays(primitiveMode, static_cast<GLint>(firstVertex), static_cast<GLsizei>(nVertices - firstVertex));
     }
 
+    primitives.clear();
+
     glBindVertexArray(0);
     glUseProgram(0);
 
@@ -886,6 +994,113 @@ void Emulator::Renderer::draw() {
     glUseProgram(0);*/
 }
 
+namespace {
+    struct Area {
+        int32_t left, top;
+        int32_t right, bottom;
+
+        [[nodiscard]] bool overlaps(const Area& other) const {
+            return left <= other.right && other.left <= right && top <= other.bottom && other.top <= bottom;
+        }
+    };
+
+    // Areas touched since the last texture barrier, merged into one
+    // once there's too many to check each of them
+    struct AreaList {
+        static constexpr size_t MAX_AREAS = 64;
+
+        std::vector<Area> areas;
+
+        [[nodiscard]] bool overlaps(const Area& area) const {
+            return std::any_of(areas.begin(), areas.end(), [&](const Area& a) { return a.overlaps(area); });
+        }
+
+        void add(const Area& area) {
+            if (areas.size() < MAX_AREAS) {
+                areas.push_back(area);
+                return;
+            }
+
+            Area merged = area;
+
+            for (const auto& a : areas) {
+                merged.left   = std::min(merged.left, a.left);
+                merged.top    = std::min(merged.top, a.top);
+                merged.right  = std::max(merged.right, a.right);
+                merged.bottom = std::max(merged.bottom, a.bottom);
+            }
+
+            areas.assign(1, merged);
+        }
+
+        void clear() { areas.clear(); }
+    };
+}
+
+void Emulator::Renderer::drawTriangles() {
+    /**
+     * Semi transparent primitives read the pixels under them from 'sceneTex',
+     * which is also what's being drawn to. That's only defined when no other
+     * primitive of the same draw call touches those pixels, so a barrier and
+     * a new draw is needed whenever a reader overlaps something drawn since
+     * the last barrier, or the other way around. Everything else goes out
+     * in as few draw calls as possible.
+     */
+    AreaList written;
+    AreaList read;
+
+    uint32_t runStart = firstVertex;
+    uint32_t start = firstVertex;
+
+    for (const auto& primitive : primitives) {
+        const Area area = {primitive.left, primitive.top, primitive.right, primitive.bottom};
+
+        const bool hazard = (primitive.readsScene && written.overlaps(area)) || read.overlaps(area);
+
+        if (hazard) {
+            glDrawArrays(GL_TRIANGLES, static_cast<GLint>(runStart), static_cast<GLsizei>(start - runStart));
+            glTextureBarrier();
+
+            written.clear();
+            read.clear();
+
+            runStart = start;
+        }
+
+        written.add(area);
+
+        if (primitive.readsScene) {
+            read.add(area);
+        }
+
+        start = primitive.end;
+    }
+
+    // The last run, along with anything that wasn't tracked
+    if (nVertices > runStart) {
+        glDrawArrays(GL_TRIANGLES, static_cast<GLint>(runStart), static_cast<GLsizei>(nVertices - runStart));
+    }
+}
+
+void Emulator::Renderer::trackPrimitive(const Gpu::Position positions[], int count, Gpu::Attributes attributes) {
+    float minX = positions[0].x, maxX = positions[0].x;
+    float minY = positions[0].y, maxY = positions[0].y;
+
+    for (int i = 1; i < count; i++) {
+        minX = std::min(minX, positions[i].x);
+        maxX = std::max(maxX, positions[i].x);
+        minY = std::min(minY, positions[i].y);
+        maxY = std::max(maxY, positions[i].y);
+    }
+
+    primitives.push_back({
+        nVertices,
+        int32_t(std::floor(minX)), int32_t(std::floor(minY)),
+        int32_t(std::ceil(maxX)), int32_t(std::ceil(maxY)),
+        attributes.isSemiTransparent() != 0
+    });
+}
+
 void Emulator::Renderer::clear() {
     /*glBindFramebuffer(GL_FRAMEBUFFER, sceneFBO);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
@@ -923,16 +1138,10 @@ static void biasTriangleForGL(const Emulator::Gpu::Position in[3], Emulator::Gpu
 
 void Emulator::Renderer::pushLine(Emulator::Gpu::Position positions[], Emulator::Gpu::Color colors[],
                                   Emulator::Gpu::UV uvs[], Gpu::Attributes attributes) {
-    if (nVertices + 2 > VERTEX_BUFFER_LEN) {
-        nVertices = 0;
-    }
-
     if (positions[0].x == positions[1].x && positions[0].y == positions[1].y) {
         setPrimitiveMode(GL_POINTS);
 
-        if (nVertices + 1 > VERTEX_BUFFER_LEN) {
-            flushDrawCommands();
-        }
+        reserveVertices(1);
 
         this->positions.set(nVertices, positions[0]);
 
@@ -952,9 +1161,7 @@ void Emulator::Renderer::pushLine(Emulator::Gpu::Position positions[], Emulator:
 
     setPrimitiveMode(GL_LINES);
 
-    if (nVertices + 2 > VERTEX_BUFFER_LEN) {
-        flushDrawCommands();
-    }
+    reserveVertices(2);
 
     for (int i = 0; i < 2; i++) {
         this->positions.set(nVertices, positions[i]);
@@ -975,9 +1182,7 @@ void Emulator::Renderer::pushLine(Emulator::Gpu::Position positions[], Emulator:
 
     setPrimitiveMode(GL_POINTS);
 
-    if (nVertices + 1 > VERTEX_BUFFER_LEN) {
-        flushDrawCommands();
-    }
+    reserveVertices(1);
 
     this->positions.set(nVertices, positions[1]);
 
@@ -1015,8 +1220,6 @@ void Emulator::Renderer::pushLine(Emulator::Gpu::Position positions[], Emulator:
 
     return;
 
-    //_rasterizer.drawLine(positions, colors, uvs, attributes);
-
     float dx = positions[1].x - positions[0].x;
     float dy = positions[1].y - positions[0].y;
 
@@ -1061,12 +1264,7 @@ void Emulator::Renderer::pushLine(Emulator::Gpu::Position positions[], Emulator:
 
 void Emulator::Renderer::pushTriangle(Emulator::Gpu::Position positions[], Emulator::Gpu::Color colors[],
                                       Emulator::Gpu::UV uvs[], Gpu::Attributes attributes) {
-    if (nVertices + 3 > VERTEX_BUFFER_LEN) {
-        // Reset the buffer size
-        nVertices = 0;
-
-        // display();
-    }
+    reserveVertices(3);
     setPrimitiveMode(GL_TRIANGLES);
 
     Emulator::Gpu::Position biased[3];
@@ -1087,6 +1285,8 @@ void Emulator::Renderer::pushTriangle(Emulator::Gpu::Position positions[], Emula
         nVertices++;
     }
 
+    trackPrimitive(biased, 3, attributes);
+
     return;
 
     /*drawDirectTriangle(gpu, positions, colors, uvs, attributes);
@@ -1110,12 +1310,7 @@ void Emulator::Renderer::pushTriangle(Emulator::Gpu::Position positions[], Emula
 
 void Emulator::Renderer::pushQuad(Emulator::Gpu::Position positions[], Emulator::Gpu::Color colors[],
                                   Emulator::Gpu::UV uvs[], Gpu::Attributes attributes) {
-    if (nVertices + 6 > VERTEX_BUFFER_LEN) {
-        // Reset the buffer size
-        nVertices = 0;
-
-        // display();
-    }
+    reserveVertices(6);
     setPrimitiveMode(GL_TRIANGLES);
 
     /*Emulator::Gpu::Position p0[3] = {positions[1], positions[3], positions[2]};
@@ -1148,9 +1343,11 @@ void Emulator::Renderer::pushQuad(Emulator::Gpu::Position positions[], Emulator:
         nVertices++;
     }
 
+    // Both halves count as one, GL never draws a pixel on their shared edge twice
+    trackPrimitive(positions, 4, attributes);
+
     return;
 
-    _rasterizer.drawQuad(positions, colors, uvs, attributes);
     // displayVRam();
 
     // First triangle
@@ -1220,12 +1417,7 @@ void Emulator::Renderer::pushRectangle(Emulator::Gpu::Position positions[], Emul
      * but it's fun to learn new stuff
      */
 
-    if (nVertices + 6 > VERTEX_BUFFER_LEN) {
-        // Reset the buffer size
-        nVertices = 0;
-
-        // display();
-    }
+    reserveVertices(6);
 
     setPrimitiveMode(GL_TRIANGLES);
 
@@ -1274,8 +1466,6 @@ void Emulator::Renderer::pushRectangle(Emulator::Gpu::Position positions[], Emul
 
     return;*/
 
-    _rasterizer.drawRectangle(positions, colors, uvs, attributes);
-
     // First triangle
     // [0, 1, 2]
     this->positions.set(nVertices, positions[0]);
@@ -1321,6 +1511,8 @@ void Emulator::Renderer::pushRectangle(Emulator::Gpu::Position positions[], Emul
         this->uvs.set(nVertices, uvs[3]);
     this->attributes.set(nVertices, attributes);
     nVertices++;
+
+    trackPrimitive(positions, 4, attributes);
 }
 
 void Emulator::Renderer::setDrawingOffset(int16_t x, int16_t y) {
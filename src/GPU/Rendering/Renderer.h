@@ -1,7 +1,10 @@
 ﻿#pragma once
 
+#include <vector>
+
 #include "Buffer.h"
-#include "Rasterizer.h"
+#include "RenderBackend.h"
+#include "../Gpu.h"
 
 #include "glm/vec2.hpp"
 
@@ -14,32 +17,46 @@
 class GLFWwindow;
 
 namespace Emulator {
-    class Renderer {
+    class Renderer : public RenderBackend {
         public:
             explicit Renderer(Emulator::Gpu& gpu);
             
             //void init();
             void display(bool displayEntireScreen = false);
             void renderFrame();
-            void flushDrawCommands();
-            void readbackToVram(uint32_t x, uint32_t y, uint32_t width, uint32_t height);
+            void flushDrawCommands() override;
+            
+            // Only queues the copy, VRAM is written once 'waitForReadbacks' is called
+            void readbackToVram(uint32_t x, uint32_t y, uint32_t width, uint32_t height) override;
+            void waitForReadbacks() override;
+            
+            [[nodiscard]] bool ownsContext() const override { return true; }
+            [[nodiscard]] GLuint sceneTexture() const override { return sceneTex[curTex]; }
             
             void clear();
             
         private:
             void draw();
+            void drawTriangles();
+            
+            // Makes room for 'count' vertices after 'nVertices'
+            void reserveVertices(uint32_t count);
+            
+            // Records the primitive whose 'count' vertices were just pushed
+            void trackPrimitive(const Gpu::Position positions[], int count, Gpu::Attributes attributes);
+            void resolveReadback();
             
         public:
-            void pushLine(Emulator::Gpu::Position positions[], Emulator::Gpu::Color colors[], Emulator::Gpu::UV uvs[], Emulator::Gpu::Attributes attributes);
-            void pushTriangle(Emulator::Gpu::Position positions[], Emulator::Gpu::Color colors[], Emulator::Gpu::UV uvs[], Emulator::Gpu::Attributes attributes);
-            void pushQuad(Emulator::Gpu::Position positions[], Emulator::Gpu::Color colors[], Emulator::Gpu::UV uvs[], Emulator::Gpu::Attributes attributes);
-            void pushRectangle(Emulator::Gpu::Position positions[], Emulator::Gpu::Color colors[], Emulator::Gpu::UV uvs[], Emulator::Gpu::Attributes attributes);
+            void pushLine(Emulator::Gpu::Position positions[], Emulator::Gpu::Color colors[], Emulator::Gpu::UV uvs[], Emulator::Gpu::Attributes attributes) override;
+            void pushTriangle(Emulator::Gpu::Position positions[], Emulator::Gpu::Color colors[], Emulator::Gpu::UV uvs[], Emulator::Gpu::Attributes attributes) override;
+            void pushQuad(Emulator::Gpu::Position positions[], Emulator::Gpu::Color colors[], Emulator::Gpu::UV uvs[], Emulator::Gpu::Attributes attributes) override;
+            void pushRectangle(Emulator::Gpu::Position positions[], Emulator::Gpu::Color colors[], Emulator::Gpu::UV uvs[], Emulator::Gpu::Attributes attributes) override;
             
         public:
-            void setDrawingOffset(int16_t x, int16_t y);
-            void setDrawingArea(uint16_t left, uint16_t right, uint16_t top, uint16_t bottom) const;
-            void setTextureWindow(uint8_t textureWindowXMask, uint8_t textureWindowYMask, uint8_t textureWindowXOffset, uint8_t textureWindowYOffset);
-            void setSemiTransparencyMode(uint8_t semiTransparencyMode) const;
+            void setDrawingOffset(int16_t x, int16_t y) override;
+            void setDrawingArea(uint16_t left, uint16_t right, uint16_t top, uint16_t bottom) const override;
+            void setTextureWindow(uint8_t textureWindowXMask, uint8_t textureWindowYMask, uint8_t textureWindowXOffset, uint8_t textureWindowYOffset) override;
+            void setSemiTransparencyMode(uint8_t semiTransparencyMode) const override;
             
             void bindFrameBuffer(GLuint buf);
             
@@ -121,6 +138,49 @@ namespace Emulator {
             // Current number of vertices in the buffers
             uint32_t nVertices;
             
+            // Vertices before this one were already handed to GL
+            uint32_t firstVertex = 0;
+            
+            // Area and framebuffer use of every triangle primitive in the batch,
+            // 'draw' only puts texture barriers between the ones that overlap
+            struct DrawPrimitive {
+                uint32_t end;
+                int32_t left, top;
+                int32_t right, bottom;
+                bool readsScene;
+            };
+            
+            std::vector<DrawPrimitive> primitives;
+            
+            // The vertex buffers are filled one region after the other, going back
+            // to a region waits on the fence of its draws instead of a 'glFinish'
+            static constexpr uint32_t VERTEX_REGIONS = 4;
+            static constexpr uint32_t VERTEX_REGION_LEN = VERTEX_BUFFER_LEN / VERTEX_REGIONS;
+            
+            uint32_t vertexRegion = 0;
+            GLsync regionFences[VERTEX_REGIONS] = {};
+            
+            // A VRAM area copied into a pack buffer, at 'offset'
+            struct Readback {
+                uint32_t x, y;
+                uint32_t width, height;
+                GLintptr offset;
+            };
+            
+            // Persistently mapped pack buffers, each big enough for all of VRAM
+            struct ReadbackSlot {
+                GLuint pbo = 0;
+                const uint8_t* map = nullptr;
+                GLsync fence = nullptr;
+                std::vector<Readback> regions;
+            };
+            
+            static constexpr uint32_t READBACK_SLOTS = 4;
+            
+            ReadbackSlot readbacks[READBACK_SLOTS];
+            uint32_t nextReadback = 0;
+            uint32_t pendingReadbacks = 0;
+            
             GLFWwindow* window;
         public:
             // Bloom
@@ -158,7 +218,5 @@ namespace Emulator {
 
         private:
             Emulator::Gpu& gpu;
-            
-            Rasterizer _rasterizer;
     };
 }
@@ -0,0 +1,124 @@
+#include "TextureCache.h"
+#include "VRAM.h"
+
+#include <algorithm>
+
+Emulator::TextureCache::Slot& Emulator::TextureCache::find(const Key& key, bool& recycled) {
+    finds++;
+
+    if (last && last->key == key) {
+        recycled = false;
+
+        if (current(*last)) {
+            last->lastFound = finds;
+            return *last;
+        }
+    }
+
+    Slot* victim = nullptr;
+
+    for (Slot& slot : slots) {
+        if (slot.texels && slot.key == key) {
+            victim = &slot;
+            break;
+        }
+
+        // Empty slots first, then the one found the longest time ago
+        if (!victim || (victim->texels && (!slot.texels || slot.lastFound < victim->lastFound)))
+            victim = &slot;
+    }
+
+    Slot& slot = *victim;
+    last = &slot;
+    slot.lastFound = finds;
+
+    if (slot.texels && slot.key == key && current(slot)) {
+        recycled = false;
+        return slot;
+    }
+
+    if (!slot.texels)
+        slot.texels = std::make_unique<uint16_t[]>(SIZE * SIZE);
+
+    recycled = std::any_of(slot.rows.begin(), slot.rows.end(), [](uint64_t row) { return row != 0; });
+
+    slot.key = key;
+    slot.serial = vram.writeSerial();
+    slot.rows.fill(0);
+
+    return slot;
+}
+
+void Emulator::TextureCache::decodeRows(Slot& slot, uint32_t first, uint32_t count) {
+    const Key& key = slot.key;
+
+    uint16_t clut[256];
+    bool clutRead = false;
+
+    for (uint32_t i = 0; i < std::min(count, SIZE); i++) {
+        const uint32_t v = (first + i) & (SIZE - 1);
+
+        if (slot.hasRow(v))
+            continue;
+
+        if (!clutRead) {
+            for (uint32_t index = 0; index < (key.depth == 0 ? 16u : 256u); index++)
+                clut[index] = vram.pixel15(key.clutX + index, key.clutY);
+
+            clutRead = true;
+        }
+
+        uint16_t* row = slot.texels.get() + v * SIZE;
+
+        if (key.depth == 0) {
+            for (uint32_t x = 0; x < SIZE / 4; x++) {
+                const uint16_t texel = vram.pixel15(key.pageX + x, key.pageY + v);
+
+                row[x * 4 + 0] = clut[ texel        & 0xF];
+                row[x * 4 + 1] = clut[(texel >> 4)  & 0xF];
+                row[x * 4 + 2] = clut[(texel >> 8)  & 0xF];
+                row[x * 4 + 3] = clut[(texel >> 12) & 0xF];
+            }
+        } else {
+            for (uint32_t x = 0; x < SIZE / 2; x++) {
+                const uint16_t texel = vram.pixel15(key.pageX + x, key.pageY + v);
+
+                row[x * 2 + 0] = clut[texel & 0xFF];
+                row[x * 2 + 1] = clut[texel >> 8];
+            }
+        }
+
+        slot.rows[v / 64] |= uint64_t(1) << (v % 64);
+    }
+}
+
+uint16_t Emulator::TextureCache::texel(const Key& key, uint32_t u, uint32_t v) {
+    u &= SIZE - 1;
+    v &= SIZE - 1;
+
+    bool recycled;
+    Slot& slot = find(key, recycled);
+
+    if (!slot.hasRow(v))
+        decodeRows(slot, v, 1);
+
+    return slot.texels[v * SIZE + u];
+}
+
+bool Emulator::TextureCache::current(Slot& slot) const {
+    const uint64_t now = vram.writeSerial();
+
+    if (slot.serial == now)
+        return true;
+
+    const Key& key = slot.key;
+
+    if (vram.lastWrite(key.pageX, key.pageY, 64u << key.depth, SIZE) > slot.serial ||
+        vram.lastWrite(key.clutX, key.clutY, key.depth == 0 ? 16 : 256, 1) > slot.serial)
+        return false;
+
+    // Nothing it reads from changed, no need to look again until the next write
+    slot.serial = now;
+
+    return true;
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <memory>
+
+namespace Emulator {
+    class VRAM;
+
+    /**
+     * 4-bit and 8-bit texture pages, already run through their CLUT.
+     *
+     * A slot holds the 256x256 texels of one page, CLUT and depth, decoded
+     * a row at a time as primitives ask for them. It stays good until 'VRAM'
+     * sees a write to the area under its page or CLUT, see 'VRAM::touch'.
+     */
+    class TextureCache {
+        public:
+            // Texels both ways
+            static constexpr uint32_t SIZE = 256;
+            static constexpr uint32_t SLOTS = 32;
+
+            struct Key {
+                uint16_t pageX, pageY;
+                uint16_t clutX, clutY;
+
+                // 0 for 4-bit, 1 for 8-bit
+                uint8_t depth;
+
+                bool operator==(const Key& other) const {
+                    return pageX == other.pageX && pageY == other.pageY && clutX == other.clutX &&
+                           clutY == other.clutY && depth == other.depth;
+                }
+            };
+
+            struct Slot {
+                Key key{};
+
+                // 'VRAM::writeSerial' the texels were last checked against
+                uint64_t serial = 0;
+                uint64_t lastFound = 0;
+
+                // Left to whoever reads 'texels', see 'Rasterizer::prepareTexture'
+                uint64_t lastUse = 0;
+
+                // One bit per decoded row
+                std::array<uint64_t, SIZE / 64> rows{};
+                std::unique_ptr<uint16_t[]> texels;
+
+                [[nodiscard]] bool hasRow(uint32_t v) const {
+                    return (rows[v / 64] >> (v % 64)) & 1;
+                }
+            };
+
+            explicit TextureCache(const VRAM& vram) : vram(vram) {}
+
+            // Slot for 'key', emptied if it was out of date or taken over from
+            // another key. 'recycled' says if rows decoded before got dropped,
+            // their texels get overwritten by the next 'decodeRows'.
+            Slot& find(const Key& key, bool& recycled);
+
+            // Makes 'count' rows starting at 'first' valid, wrapping at the bottom
+            void decodeRows(Slot& slot, uint32_t first, uint32_t count);
+
+            // A single texel, decoding its row if needed
+            uint16_t texel(const Key& key, uint32_t u, uint32_t v);
+
+        private:
+            // Checks the slot against the writes since it was last checked
+            bool current(Slot& slot) const;
+
+        private:
+            const VRAM& vram;
+
+            std::array<Slot, SLOTS> slots;
+            uint64_t finds = 0;
+
+            // Where the last 'find' ended up, texel lookups tend to repeat
+            Slot* last = nullptr;
+    };
+}
@@ -1,9 +1,52 @@
 ﻿#include "VRAM.h"
 #include "Gpu.h"
 
+#include <algorithm>
+#include <cstring>
 #include <iostream>
 
-Emulator::VRAM::VRAM(Gpu &gpu) : gpu(gpu) {
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace {
+    // Mask bit rules of GP0(E6h) for a run of pixels, 8 at a time
+    void copyMasked(uint16_t* dst, const uint8_t* src, uint32_t count, uint16_t setMask, bool preserve) {
+        if (!preserve && setMask == 0) {
+            std::memcpy(dst, src, count * sizeof(uint16_t));
+            return;
+        }
+        
+#if defined(__SSE2__)
+        const __m128i set = _mm_set1_epi16(static_cast<short>(setMask));
+        
+        for (; count >= 8; count -= 8, dst += 8, src += 16) {
+            __m128i pixels = _mm_or_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src)), set);
+            
+            if (preserve) {
+                const __m128i old = _mm_loadu_si128(reinterpret_cast<const __m128i*>(dst));
+                const __m128i keep = _mm_srai_epi16(old, 15);
+                
+                pixels = _mm_or_si128(_mm_and_si128(keep, old), _mm_andnot_si128(keep, pixels));
+            }
+            
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst), pixels);
+        }
+#endif
+        
+        for (; count > 0; count--, dst++, src += 2) {
+            if (preserve && (*dst & 0x8000))
+                continue;
+            
+            uint16_t pixel;
+            std::memcpy(&pixel, src, sizeof(pixel));
+            
+            *dst = pixel | setMask;
+        }
+    }
+}
+
+Emulator::VRAM::VRAM(Gpu &gpu, bool upload) : gpu(gpu), upload(upload) {
     tilesX = MAX_WIDTH / TILE_SIZE;
     tilesY = MAX_HEIGHT / TILE_SIZE;
     tileDirty.resize(tilesX * tilesY);
@@ -11,66 +54,50 @@ Emulator::VRAM::VRAM(Gpu &gpu) : gpu(gpu) {
     size15 = MAX_WIDTH * MAX_HEIGHT * sizeof(uint16_t);
     size24 = MAX_WIDTH * MAX_HEIGHT * sizeof(uint32_t);
     
-    glCreateTextures(GL_TEXTURE_2D, 1, &tex15);
-    glTextureStorage2D(tex15, 1, GL_RGBA8, MAX_WIDTH, MAX_HEIGHT);
-    
-    glTextureParameteri(tex15, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTextureParameteri(tex15, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glTextureParameteri(tex15, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTextureParameteri(tex15, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    
-    // 15-bit PBO
-    glCreateBuffers(1, &pbo15);
-    glNamedBufferStorage(
-        pbo15,
-        size15,
-        nullptr,
-        GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT
-    );
-    gpu15 = static_cast<uint16_t*>(glMapNamedBufferRange(
-        pbo15,
-        0,
-        size15,
-        GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT
-    ));
-    
-    glCreateTextures(GL_TEXTURE_2D, 1, &tex24);
-    glTextureStorage2D(tex24, 1, GL_RGBA8, MAX_WIDTH, MAX_HEIGHT);
-    
-    glTextureParameteri(tex24, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTextureParameteri(tex24, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glTextureParameteri(tex24, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTextureParameteri(tex24, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    
-    glCreateBuffers(1, &pbo24);
-    glNamedBufferStorage(
-        pbo24,
-        size24,
-        nullptr,
-        GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT
-    );
-    gpu24 = static_cast<uint32_t*>(glMapNamedBufferRange(
-        pbo24,
-        0,
-        size24,
-        GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT
-    ));
-
-    GLenum err = glGetError();
-    if(err != GL_NO_ERROR) {
-        std::cerr << "OpenGL Error during Renderer constructor: " << err << '\n';
+    host15.resize(MAX_WIDTH * MAX_HEIGHT);
+    host24.resize(MAX_WIDTH * MAX_HEIGHT);
+    gpu15 = host15.data();
+    gpu24 = host24.data();
+    
+#ifndef PSX_HEADLESS
+    if (this->upload) {
+        for (GLuint* tex : {&tex15, &tex24}) {
+            glCreateTextures(GL_TEXTURE_2D, 1, tex);
+            glTextureStorage2D(*tex, 1, GL_RGBA8, MAX_WIDTH, MAX_HEIGHT);
+            
+            glTextureParameteri(*tex, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+            glTextureParameteri(*tex, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+            glTextureParameteri(*tex, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTextureParameteri(*tex, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        }
+        
+        GLenum err = glGetError();
+        if(err != GL_NO_ERROR) {
+            std::cerr << "OpenGL Error during Renderer constructor: " << err << '\n';
+        }
     }
+#endif
     
     reset();
 }
 
 Emulator::VRAM::~VRAM() {
+#ifndef PSX_HEADLESS
+    if (!upload)
+        return;
+    
     glDeleteTextures(1, &tex15);
-    glDeleteBuffers(1, &pbo15);
-    glDeleteBuffers(1, &pbo24);
+    glDeleteTextures(1, &tex24);
+#endif
 }
 
 void Emulator::VRAM::endTransfer() {
+    if (!upload) {
+        std::fill(tileDirty.begin(), tileDirty.end(), 0);
+        return;
+    }
+    
+#ifndef PSX_HEADLESS
     /*glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo24);
     
     glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
@@ -93,40 +120,31 @@ void Emulator::VRAM::endTransfer() {
     
     return;*/
     
+    const std::vector<Rect> rects = takeDirtyRects();
+    
+    if (rects.empty())
+        return;
+    
+    const bool depth24 = gpu.displayDepth == DisplayDepth::D24Bits;
+    
+    // Straight from host memory, GL copies it before returning
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
     glPixelStorei(GL_UNPACK_ROW_LENGTH, MAX_WIDTH);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, depth24 ? 4 : 1);
     
-    for (int ty = 0; ty < tilesY; ty++) {
-        for (int tx = 0; tx < tilesX; tx++) {
-            const int i = ty * tilesX + tx;
-            
-            if (!tileDirty[i])
-                continue;
-            
-            tileDirty[i] = 0;
-            
-            const int x = tx * TILE_SIZE;
-            const int y = ty * TILE_SIZE;
-            
-            if (gpu.displayDepth == DisplayDepth::D24Bits) {
-                glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo24);
-                glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
-                
-                const size_t offset = (y * MAX_WIDTH + x) * sizeof(uint32_t);
-                
-                glTextureSubImage2D(tex24, 0, x, y, TILE_SIZE, TILE_SIZE, GL_RGBA, GL_UNSIGNED_BYTE, reinterpret_cast<void *>(offset));
-            } else {
-                glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo15);
-                glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
-                
-                glTextureSubImage2D(tex15, 0, x, y, TILE_SIZE, TILE_SIZE, GL_RGBA, GL_UNSIGNED_SHORT_1_5_5_5_REV,
-                                    reinterpret_cast<void *>((y * MAX_WIDTH + x) * sizeof(uint16_t)));
-            }
+    for (const Rect& rect : rects) {
+        if (depth24) {
+            glTextureSubImage2D(tex24, 0, rect.x, rect.y, rect.width, rect.height, GL_RGBA, GL_UNSIGNED_BYTE,
+                                gpu24 + rect.y * MAX_WIDTH + rect.x);
+        } else {
+            glTextureSubImage2D(tex15, 0, rect.x, rect.y, rect.width, rect.height, GL_RGBA, GL_UNSIGNED_SHORT_1_5_5_5_REV,
+                                gpu15 + rect.y * MAX_WIDTH + rect.x);
         }
     }
     
-    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
     //glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
     glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+#endif
 }
 
 void Emulator::VRAM::writePixel(uint32_t x, uint32_t y, const uint16_t pixel) {
@@ -143,6 +161,23 @@ void Emulator::VRAM::writePixel(uint32_t x, uint32_t y, const uint16_t pixel) {
     setPixel(x, y, pixel0 | mask);
 }
 
+void Emulator::VRAM::writeRow(uint32_t x, uint32_t y, const uint8_t* pixels, uint32_t count) {
+    uint16_t* line = line15(y);
+    const uint16_t setMask = gpu.forceSetMaskBit << 15;
+    
+    while (count > 0) {
+        x &= (MAX_WIDTH - 1);
+        
+        const uint32_t run = std::min<uint32_t>(count, MAX_WIDTH - x);
+        
+        copyMasked(line + x, pixels, run, setMask, gpu.preserveMaskedPixels);
+        
+        x += run;
+        pixels += run * sizeof(uint16_t);
+        count -= run;
+    }
+}
+
 // Test
 uint8_t fifo[6];
 int fifo_len = 0;
@@ -151,6 +186,12 @@ void Emulator::VRAM::setPixel(uint32_t x, uint32_t y, uint16_t color) {
     // https://stackoverflow.com/questions/73092064/is-there-a-way-to-convert-16-bit-color-to-24-bit-color-efficiently-while-avoidin
     uint32_t initalX = ((gpu.startX * 2) / 3);
     
+    x &= (MAX_WIDTH - 1);
+    y &= (MAX_HEIGHT - 1);
+    
+    // Guest visible VRAM is always 16-bit, even while displaying 24-bit
+    line15(y)[x] = color;
+    
     if (gpu.displayDepth == DisplayDepth::D24Bits) {
         if (gpu.startX24 >= MAX_WIDTH || gpu.startY24 >= MAX_HEIGHT) {
             printf("BAD PIXEL x=%u y=%u\n", x, y);
@@ -198,48 +239,35 @@ void Emulator::VRAM::setPixel(uint32_t x, uint32_t y, uint16_t color) {
             
             halfword_count = 0;
         }
-    } else {
-        if (x >= MAX_WIDTH || y >= MAX_HEIGHT) {
-            printf("BAD PIXEL x=%u y=%u\n", x, y);
-        }
-        
-        y = MAX_HEIGHT - y - 1;
-        
-        gpu15[y * MAX_WIDTH + x] = color;
-        markTile(x, y);
     }
 }
 
 uint16_t Emulator::VRAM::getPixel(uint32_t x, uint32_t y) const {
-    x %= MAX_WIDTH;
-    y %= MAX_HEIGHT;
-    
-    y = MAX_HEIGHT - y - 1;
-    
-    if (gpu.displayDepth == DisplayDepth::D24Bits)
-        return gpu24[y * MAX_WIDTH + x];
-    
-    return gpu15[y * MAX_WIDTH + x];
+    return pixel15(x, y);
 }
 
 uint16_t Emulator::VRAM::getPixel4(uint32_t x, uint32_t y, uint32_t clutX, uint32_t clutY, uint32_t pageX,
                                    uint32_t pageY) {
-    uint16_t texel = getPixel(pageX + x / 4, pageY + y);
-    uint32_t index = (texel >> (x % 4) * 4) & 0xF;
+    const TextureCache::Key key = {
+        static_cast<uint16_t>(pageX), static_cast<uint16_t>(pageY),
+        static_cast<uint16_t>(clutX), static_cast<uint16_t>(clutY), 0,
+    };
     
-    return getPixel(clutX + index, clutY);
+    return textures.texel(key, x, y);
 }
 
 uint16_t Emulator::VRAM::getPixel8(uint32_t x, uint32_t y, uint32_t clutX, uint32_t clutY, uint32_t pageX,
                                    uint32_t pageY) {
-    uint16_t texel = getPixel(pageX + x / 2, pageY + y);
-    uint32_t index = (texel >> (x % 2) * 8) & 0xFF;
+    const TextureCache::Key key = {
+        static_cast<uint16_t>(pageX), static_cast<uint16_t>(pageY),
+        static_cast<uint16_t>(clutX), static_cast<uint16_t>(clutY), 1,
+    };
     
-    return getPixel(clutX + index, clutY);
+    return textures.texel(key, x, y);
 }
 
 uint16_t Emulator::VRAM::getPixel16(uint32_t x, uint32_t y, uint32_t pageX, uint32_t pageY) {
-    return getPixel(x + pageX, y + pageY);
+    return pixel15(x + pageX, y + pageY);
 }
 
 uint16_t Emulator::VRAM::RGB555_to_RGB565(uint16_t color) {
@@ -255,6 +283,10 @@ uint16_t Emulator::VRAM::RGB555_to_RGB565(uint16_t color) {
 }
 
 void Emulator::VRAM::copyToTexture(uint32_t x, uint32_t y, uint32_t dx, uint32_t dy, uint32_t width, uint32_t height, GLuint tex) {
+    if (!upload)
+        return;
+    
+#ifndef PSX_HEADLESS
     auto curTex = getCurrentTexture();
     
     glCopyImageSubData(
@@ -264,6 +296,7 @@ void Emulator::VRAM::copyToTexture(uint32_t x, uint32_t y, uint32_t dx, uint32_t
         dx, dy, 0,
         width, height, 1
     );
+#endif
 }
 
 int Emulator::VRAM::getCurrentTexture() {
@@ -271,6 +304,10 @@ int Emulator::VRAM::getCurrentTexture() {
     if (gpu.displayDepth == DisplayDepth::D24Bits)
         curTex = tex24;
     
+    if (!upload)
+        return 0;
+    
+#ifndef PSX_HEADLESS
     GLint isTex = 0;
     glBindTexture(GL_TEXTURE_2D, curTex);
     glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &isTex);
@@ -278,6 +315,7 @@ int Emulator::VRAM::getCurrentTexture() {
         std::cerr << "ERROR: Current texture " << curTex << " is invalid!" << std::endl;
         return 0;
     }
+#endif
     
     return curTex;
 }
@@ -286,12 +324,165 @@ void Emulator::VRAM::reset() {
     std::fill_n(gpu24, MAX_WIDTH * MAX_HEIGHT, 0/*0xFFFFFFFF*/);
     std::fill_n(gpu15, MAX_WIDTH * MAX_HEIGHT, 0/*0x7FFF*/);
     
+    touch(0, 0, MAX_WIDTH, MAX_HEIGHT);
+    
     //std::fill(gpu24, gpu24 + MAX_WIDTH * MAX_HEIGHT, 0);
     //std::fill(gpu15, gpu15 + MAX_WIDTH * MAX_HEIGHT, 0);
     
     //std::fill(tileDirty.begin(), tileDirty.end(), 1);
 }
 
+void Emulator::VRAM::markDirty(uint32_t x, uint32_t y, uint32_t width, uint32_t height) {
+    if (width == 0 || height == 0)
+        return;
+    
+    x &= (MAX_WIDTH - 1);
+    y &= (MAX_HEIGHT - 1);
+    
+    width = std::min<uint32_t>(width, MAX_WIDTH);
+    height = std::min<uint32_t>(height, MAX_HEIGHT);
+    
+    // Split off whatever wraps around
+    if (x + width > static_cast<uint32_t>(MAX_WIDTH)) {
+        markDirty(0, y, x + width - MAX_WIDTH, height);
+        width = MAX_WIDTH - x;
+    }
+    
+    if (y + height > static_cast<uint32_t>(MAX_HEIGHT)) {
+        markDirty(x, 0, width, y + height - MAX_HEIGHT);
+        height = MAX_HEIGHT - y;
+    }
+    
+    touch(x, y, width, height);
+    
+    const uint32_t firstX = std::min<uint32_t>(x, MAX_WIDTH - 1) / TILE_SIZE;
+    const uint32_t lastX  = std::min<uint32_t>(x + width - 1, MAX_WIDTH - 1) / TILE_SIZE;
+    
+    // Rows are flipped, so the area's bottom line is the first tile row
+    const uint32_t bottom = MAX_HEIGHT - 1 - std::min<uint32_t>(y + height - 1, MAX_HEIGHT - 1);
+    const uint32_t top    = MAX_HEIGHT - 1 - std::min<uint32_t>(y, MAX_HEIGHT - 1);
+    
+    for (uint32_t ty = bottom / TILE_SIZE; ty <= top / TILE_SIZE; ty++) {
+        for (uint32_t tx = firstX; tx <= lastX; tx++)
+            tileDirty[ty * tilesX + tx] = 1;
+    }
+}
+
+void Emulator::VRAM::touch(uint32_t x, uint32_t y, uint32_t width, uint32_t height) {
+    if (width == 0 || height == 0)
+        return;
+    
+    writes++;
+    
+    x &= (MAX_WIDTH - 1);
+    y &= (MAX_HEIGHT - 1);
+    
+    const uint32_t columns = (x % BLOCK_WIDTH + std::min<uint32_t>(width, MAX_WIDTH) - 1) / BLOCK_WIDTH + 1;
+    const uint32_t rows = (y % BLOCK_HEIGHT + std::min<uint32_t>(height, MAX_HEIGHT) - 1) / BLOCK_HEIGHT + 1;
+    
+    for (uint32_t row = 0; row < std::min(rows, BLOCKS_Y); row++) {
+        const uint32_t by = (y / BLOCK_HEIGHT + row) % BLOCKS_Y;
+        
+        for (uint32_t column = 0; column < std::min(columns, BLOCKS_X); column++)
+            blockWrites[by * BLOCKS_X + (x / BLOCK_WIDTH + column) % BLOCKS_X] = writes;
+    }
+}
+
+uint64_t Emulator::VRAM::lastWrite(uint32_t x, uint32_t y, uint32_t width, uint32_t height) const {
+    uint64_t latest = 0;
+    
+    if (width == 0 || height == 0)
+        return latest;
+    
+    x &= (MAX_WIDTH - 1);
+    y &= (MAX_HEIGHT - 1);
+    
+    const uint32_t columns = (x % BLOCK_WIDTH + std::min<uint32_t>(width, MAX_WIDTH) - 1) / BLOCK_WIDTH + 1;
+    const uint32_t rows = (y % BLOCK_HEIGHT + std::min<uint32_t>(height, MAX_HEIGHT) - 1) / BLOCK_HEIGHT + 1;
+    
+    for (uint32_t row = 0; row < std::min(rows, BLOCKS_Y); row++) {
+        const uint32_t by = (y / BLOCK_HEIGHT + row) % BLOCKS_Y;
+        
+        for (uint32_t column = 0; column < std::min(columns, BLOCKS_X); column++)
+            latest = std::max(latest, blockWrites[by * BLOCKS_X + (x / BLOCK_WIDTH + column) % BLOCKS_X]);
+    }
+    
+    return latest;
+}
+
+std::vector<Emulator::VRAM::Rect> Emulator::VRAM::takeDirtyRects() {
+    std::vector<Rect> rects;
+    
+    // In tiles while merging
+    uint32_t dirtyTiles = 0;
+    uint32_t left = tilesX, right = 0;
+    uint32_t top = tilesY, bottom = 0;
+    
+    // Rectangles reaching the previous/current tile row, sorted by x.
+    // One grows downwards for as long as its exact span shows up again.
+    std::vector<size_t> previous;
+    std::vector<size_t> current;
+    
+    for (uint32_t ty = 0; ty < tilesY; ty++) {
+        const uint8_t* row = tileDirty.data() + ty * tilesX;
+        size_t candidate = 0;
+        
+        current.clear();
+        
+        for (uint32_t tx = 0; tx < tilesX;) {
+            if (!row[tx]) {
+                tx++;
+                continue;
+            }
+            
+            const uint32_t start = tx;
+            
+            while (tx < tilesX && row[tx])
+                tx++;
+            
+            dirtyTiles += tx - start;
+            left = std::min(left, start);
+            right = std::max(right, tx);
+            top = std::min(top, ty);
+            bottom = ty + 1;
+            
+            while (candidate < previous.size() && rects[previous[candidate]].x < start)
+                candidate++;
+            
+            if (candidate < previous.size() && rects[previous[candidate]].x == start &&
+                rects[previous[candidate]].width == tx - start) {
+                rects[previous[candidate]].height++;
+                current.push_back(previous[candidate]);
+            } else {
+                rects.push_back({start, ty, tx - start, 1});
+                current.push_back(rects.size() - 1);
+            }
+        }
+        
+        std::swap(previous, current);
+    }
+    
+    std::fill(tileDirty.begin(), tileDirty.end(), 0);
+    
+    if (rects.empty())
+        return rects;
+    
+    // Mostly dirty anyway, one upload of the bounding box beats many small ones
+    const uint32_t boundingTiles = (right - left) * (bottom - top);
+    
+    if (rects.size() > 1 && dirtyTiles * 4 >= boundingTiles * 3)
+        rects.assign(1, {left, top, right - left, bottom - top});
+    
+    for (Rect& rect : rects) {
+        rect.x *= TILE_SIZE;
+        rect.y *= TILE_SIZE;
+        rect.width *= TILE_SIZE;
+        rect.height *= TILE_SIZE;
+    }
+    
+    return rects;
+}
+
 void Emulator::VRAM::markTile(uint32_t x, uint32_t y) {
     uint32_t tx                 = x / TILE_SIZE;
     uint32_t ty                 = y / TILE_SIZE;
@@ -1,11 +1,15 @@
 ﻿#pragma once
 
+#include <array>
 #include <cstdint>
 #include <vector>
 #include <bits/move.h>
+#ifndef PSX_HEADLESS
 #include <GL/glew.h>
+#endif
 
 #include "Gpu.h"
+#include "TextureCache.h"
 
 // https://www.reddit.com/r/EmuDev/comments/fmhtcn/article_the_ps1_gpu_texture_pipeline_and_how_to/
 
@@ -15,7 +19,10 @@ namespace Emulator {
     
     class VRAM {
         public:
-            explicit VRAM(Gpu& gpu);
+            // Pixels always live in host memory, 'upload' only says whether
+            // dirty areas are copied to GL textures, which tests and headless
+            // builds go without.
+            explicit VRAM(Gpu& gpu, bool upload = true);
             ~VRAM();
             
             void endTransfer();
@@ -30,6 +37,10 @@ namespace Emulator {
             
             void setPixel(uint32_t x, uint32_t y, uint16_t color);
             
+            // 'writePixel' for 'count' little endian pixels straight out of RAM,
+            // wraps around the right edge
+            void writeRow(uint32_t x, uint32_t y, const uint8_t* pixels, uint32_t count);
+            
             [[nodiscard]] uint16_t getPixel(uint32_t x, uint32_t y) const;
             
             uint16_t getPixel4(uint32_t x, uint32_t y, uint32_t clutX, uint32_t clutY, uint32_t pageX, uint32_t pageY);
@@ -48,6 +59,39 @@ namespace Emulator {
             
             void reset();
             
+            // Plain 15-bit access for the software rasterizer, rows of
+            // 'gpu15' are stored bottom up so they can be uploaded as is
+            uint16_t* line15(uint32_t y) {
+                return gpu15 + (MAX_HEIGHT - 1 - (y & (MAX_HEIGHT - 1))) * MAX_WIDTH;
+            }
+            
+            [[nodiscard]] uint16_t pixel15(uint32_t x, uint32_t y) const {
+                return gpu15[(MAX_HEIGHT - 1 - (y & (MAX_HEIGHT - 1))) * MAX_WIDTH + (x & (MAX_WIDTH - 1))];
+            }
+            
+            // Flags an area for the next 'endTransfer', areas past the
+            // right or bottom edge wrap around like VRAM accesses do
+            void markDirty(uint32_t x, uint32_t y, uint32_t width, uint32_t height);
+            
+            // Records a write for 'textures' without flagging anything for upload,
+            // 'markDirty' does this as well. Wraps around like 'markDirty'.
+            void touch(uint32_t x, uint32_t y, uint32_t width, uint32_t height);
+            
+            // Bumped by every 'touch'
+            [[nodiscard]] uint64_t writeSerial() const { return writes; }
+            
+            // 'writeSerial' of the latest write to any block under the area
+            [[nodiscard]] uint64_t lastWrite(uint32_t x, uint32_t y, uint32_t width, uint32_t height) const;
+            
+            // Area of 'gpu15' in storage rows, so bottom up
+            struct Rect {
+                uint32_t x, y;
+                uint32_t width, height;
+            };
+            
+            // Merges the dirty tiles into as few rectangles as it can and clears them
+            std::vector<Rect> takeDirtyRects();
+            
         private:
             void markTile(uint32_t x, uint32_t y);
             
@@ -60,26 +104,43 @@ namespace Emulator {
             int halfword_count = 0;
             
         public:
-            GLuint tex15, tex24;
-            //GLuint pbo;
-            GLuint pbo24, pbo15;
+            GLuint tex15 = 0, tex24 = 0;
             
             static constexpr uint32_t TILE_SIZE = 32;
             uint32_t tilesX;
             uint32_t tilesY;
             
-            //uint16_t* ptr16;
-            uint8_t*  pboBase = nullptr;
+            // What the guest sees, bottom row first, see 'line15'
             uint16_t* gpu15;
+            
+            // 24-bit pixels decoded from transfers, for 24-bit display modes
             uint32_t* gpu24;
             
-            GLsizeiptr size24;
-            GLsizeiptr size15;
+            size_t size24;
+            size_t size15;
             
             std::vector<uint8_t> tileDirty;
             std::vector<uint32_t> buffer;
             
+            // Decoded 4/8-bit texture pages
+            TextureCache textures{*this};
+            
         private:
+            // Writes are tracked in blocks a texture page wide, short enough
+            // that drawing next to a CLUT doesn't count as writing to it
+            static constexpr uint32_t BLOCK_WIDTH = 64;
+            static constexpr uint32_t BLOCK_HEIGHT = 16;
+            static constexpr uint32_t BLOCKS_X = 1024 / BLOCK_WIDTH;
+            static constexpr uint32_t BLOCKS_Y = 512 / BLOCK_HEIGHT;
+            
+            std::array<uint64_t, BLOCKS_X * BLOCKS_Y> blockWrites{};
+            uint64_t writes = 0;
+            
             Gpu& gpu;
+            bool upload;
+            
+            // Backing for 'gpu15'/'gpu24'
+            std::vector<uint16_t> host15;
+            std::vector<uint32_t> host24;
     };
 }
\ No newline at end of file
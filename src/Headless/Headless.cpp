@@ -0,0 +1,211 @@
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../CPU/CPU.h"
+#include "../GPU/Gpu.h"
+#include "../Utils/FileSystem/FileManager.h"
+
+/**
+ * Entry point of the PS1Emulator-headless target.
+ *
+ * There's no window, no GL context and no audio device, the GPU gets a
+ * null renderer and the SPU drops its samples. Everything else runs the
+ * same as in the windowed build, so it's meant for test ROMs (their TTY
+ * output still gets printed) and for timing the core on its own.
+ *
+ * Usage: PS1Emulator-headless <bios> [--exe file] [--disc file.cue|file.chd] [--frames n] [--read-ahead sectors] [--preload] [--cpu interp|blocks|jit]
+ *
+ * Options take their value either after an '=' or as the next argument.
+ */
+
+namespace {
+    // Same layout as the PS-X EXE header in Core.cpp
+    struct Exe {
+        char header[8];
+
+        uint32_t text;
+        uint32_t data;
+
+        uint32_t pc0;
+        uint32_t gp0;
+
+        uint32_t tAddr;
+        uint32_t tSize;
+
+        uint32_t dAddr;
+        uint32_t dSize;
+
+        uint32_t bAddr;
+        uint32_t bSize;
+
+        uint32_t sAddr;
+        uint32_t sSize;
+
+        uint32_t sp, fp, gp, ret, base;
+
+        char license[60];
+    };
+
+    // Where the BIOS jumps into the shell, EXEs get side loaded there
+    constexpr uint32_t SHELL_ENTRY = 0x80030000;
+
+    bool loadExe(CPU& cpu, const std::string& path) {
+        std::vector<uint8_t> data = Emulator::Utils::FileManager::loadFile(path);
+
+        if (data.size() < 0x800) {
+            std::cerr << "Invalid exe: " << path << '\n';
+            return false;
+        }
+
+        Exe exe;
+        memcpy(&exe, data.data(), sizeof(exe));
+
+        if (exe.tSize > data.size() - 0x800) {
+            std::cerr << "Invalid exe size\n";
+            exe.tSize = data.size() - 0x800;
+        }
+
+        for (uint32_t j = 0; j < exe.tSize; j++)
+            cpu.interconnect.store<uint8_t>(exe.tAddr + j, data[0x800 + j]);
+
+        cpu.pc     = exe.pc0;
+        cpu.nextpc = exe.pc0 + 4;
+
+        cpu.set_reg(28, exe.gp0);
+
+        if (exe.sAddr != 0) {
+            cpu.set_reg(29, exe.sAddr + exe.sSize);
+            cpu.set_reg(30, exe.sAddr + exe.sSize);
+        }
+
+        cpu.branchSlot = false;
+
+        return true;
+    }
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        std::cerr << "Usage: " << argv[0] << " <bios> [--exe file] [--disc file.cue|file.chd] [--frames n] [--read-ahead sectors] [--preload] [--cpu interp|blocks|jit]\n";
+        return 1;
+    }
+
+    std::string biosPath = argv[1];
+    std::string exePath;
+    std::string discPath;
+    uint64_t frameLimit = 60 * 60;
+    size_t readAhead = ReadAhead::DEFAULT_WINDOW;
+    bool preload = false;
+    ExecutionMode mode = ExecutionMode::Interpreter;
+
+    for (int i = 2; i < argc; i++) {
+        std::string arg = argv[i];
+
+        if (arg == "--preload") {
+            preload = true;
+            continue;
+        }
+
+        std::string value;
+        const size_t equals = arg.find('=');
+
+        if (equals != std::string::npos) {
+            value = arg.substr(equals + 1);
+            arg.resize(equals);
+        } else if (i + 1 < argc) {
+            value = argv[++i];
+        } else {
+            std::cerr << "Missing value for " << arg << '\n';
+            return 1;
+        }
+
+        if (arg == "--exe")
+            exePath = value;
+        else if (arg == "--disc")
+            discPath = value;
+        else if (arg == "--frames")
+            frameLimit = std::stoull(value);
+        else if (arg == "--read-ahead")
+            readAhead = std::stoull(value);
+        else if (arg == "--cpu") {
+            if (value == "interp")
+                mode = ExecutionMode::Interpreter;
+            else if (value == "blocks")
+                mode = ExecutionMode::CachedBlocks;
+            else if (value == "jit")
+                mode = ExecutionMode::Recompiler;
+            else {
+                std::cerr << "Unknown CPU mode: " << value << '\n';
+                return 1;
+            }
+        } else {
+            std::cerr << "Unknown argument: " << arg << '\n';
+            return 1;
+        }
+    }
+
+    // No GL, it gets a 'NullRenderer'
+    auto gpu = std::make_unique<Emulator::Gpu>(false);
+
+    // Nothing gets presented, but VRAM should still hold what the guest drew
+    gpu->setSoftwareRendering(true);
+
+    // Only pays off when it doesn't have to share a core with the CPU
+    const bool threads = std::thread::hardware_concurrency() > 1;
+
+    if (threads)
+        gpu->setThreaded(true);
+    auto cpu = std::make_unique<CPU>(Interconnect(gpu.get(), biosPath));
+
+    if (threads)
+        cpu->interconnect.mdec.setThreaded(true);
+
+    if (mode == ExecutionMode::Recompiler && !cpu->recompiler.isSupported()) {
+        std::cerr << "No recompiler for this host, running cached blocks\n";
+        mode = ExecutionMode::CachedBlocks;
+    }
+
+    cpu->executionMode = mode;
+
+    // Mostly waits on the disc image, worth it even on one core
+    cpu->interconnect._cdrom.setReadAhead(readAhead);
+    cpu->interconnect._cdrom.setPreloadDisc(preload);
+
+    if (!discPath.empty())
+        cpu->interconnect._cdrom.swapDisk(discPath);
+
+    bool exePending = !exePath.empty();
+
+    uint64_t frames = 0;
+    uint64_t cycles = 0;
+
+    auto start = std::chrono::steady_clock::now();
+
+    while (frames < frameLimit) {
+        int ran = cpu->executeNext();
+
+        if (exePending && cpu->pc == SHELL_ENTRY) {
+            if (!loadExe(*cpu, exePath))
+                return 1;
+
+            exePending = false;
+        }
+
+        cycles += ran;
+
+        if (cpu->interconnect.advance(ran))
+            frames++;
+    }
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::cout << "Ran " << frames << " frames (" << cycles << " cycles) in " << seconds << "s, "
+              << (seconds > 0 ? frames / seconds : 0) << " fps\n";
+
+    return 0;
+}
@@ -30,6 +30,11 @@ public:
     
     void reset(const std::string& path);
     
+    // Null until a BIOS has been loaded
+    uint8_t* memory() {
+        return data.empty() ? nullptr : data.data();
+    }
+    
 public:
     // The SCPH-1001 bios is exactly 512 kbs. 
     static constexpr uint64_t BIOS_SIZE = 512 * 1024; // 512 KB
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * Reads a byte buffer as a stream of bits, most significant bit first.
+ * Reading past the end gives zeros and sets 'overrun'.
+ */
+class BitReader {
+public:
+	BitReader(const uint8_t* data, size_t size) : _data(data), _size(size) {}
+
+	// Up to 32 bits
+	uint32_t peek(int count) {
+		if (count == 0)
+			return 0;
+
+		fill();
+		return static_cast<uint32_t>(_cache >> (64 - count));
+	}
+
+	void skip(int count) {
+		fill();
+		_cache <<= count;
+		_bits -= count;
+	}
+
+	uint32_t read(int count) {
+		const uint32_t value = peek(count);
+		skip(count);
+		return value;
+	}
+
+	int32_t readSigned(int count) {
+		if (count == 0)
+			return 0;
+
+		// Sign extended from the top bit
+		return static_cast<int32_t>(read(count) << (32 - count)) >> (32 - count);
+	}
+
+	// Counts the zeros up to the next one, and skips all of them
+	uint32_t readUnary() {
+		uint32_t zeros = 0;
+
+		while (true) {
+			fill();
+
+			if (_cache >> 56 == 0) {
+				if (overrun())
+					return zeros;
+
+				skip(8);
+				zeros += 8;
+				continue;
+			}
+
+			while (!(_cache >> 63)) {
+				_cache <<= 1;
+				_bits--;
+				zeros++;
+			}
+
+			skip(1);
+			return zeros;
+		}
+	}
+
+	// To the start of the next byte
+	void align() { skip(_bits % 8); }
+
+	// Bytes taken out of the buffer, counting a partly read one
+	[[nodiscard]] size_t position() const { return _offset - _bits / 8; }
+
+	[[nodiscard]] bool overrun() const { return position() > _size; }
+
+private:
+	// Keeps at least 57 bits in the cache
+	void fill() {
+		while (_bits <= 56) {
+			const uint64_t byte = _offset < _size ? _data[_offset] : 0;
+			_cache |= byte << (56 - _bits);
+			_offset++;
+			_bits += 8;
+		}
+	}
+
+private:
+	const uint8_t* _data;
+	size_t _size;
+	size_t _offset = 0;
+
+	uint64_t _cache = 0;
+	int _bits = 0;
+};
@@ -50,20 +50,45 @@ void CDROM::step(uint32_t cycles) {
 	if(busyFor < 0)
 		transmittingCommand = false;
 	
-	const int sectorsPerSecond = _stats.play ? 75 : (mode.speed ? 150 : 75);
-	
-	// (44100 * 768) -> CPU clock speed
-	const int cyclesPerSector = (44100 * 768) / sectorsPerSecond;
+	const uint32_t cyclesPerSector = this->cyclesPerSector();
 	
 	this->cycles += cycles;
 	
-	for(int i = 0; i < this->cycles / cyclesPerSector; i++) {
+	for(uint32_t i = 0; i < this->cycles / cyclesPerSector; i++) {
 		handleSector();
 	}
 	
 	this->cycles %= cyclesPerSector;
 }
 
+uint32_t CDROM::cyclesPerSector() const {
+	const uint32_t sectorsPerSecond = _stats.play ? 75 : (mode.speed ? 150 : 75);
+	
+	// (44100 * 768) -> CPU clock speed
+	return (44100 * 768) / sectorsPerSecond;
+}
+
+uint32_t CDROM::cyclesUntilEvent() const {
+	uint32_t next = UINT32_MAX;
+	
+	if(!interrupts.is_empty()) {
+		const Interrupt interrupt = interrupts.peek();
+		
+		if(interrupt.delay > 0) {
+			next = interrupt.delay;
+		} else if((IE & 7) & (interrupt._interrupt & 7)) {
+			// Keeps getting raised until the CPU acknowledges it
+			return 0;
+		}
+	}
+	
+	if(_stats.read || _stats.play) {
+		next = std::min(next, cyclesPerSector() - cycles);
+	}
+	
+	return next;
+}
+
 void CDROM::handleSector() {
 	if(!_stats.read && !_stats.play)
 		return;
@@ -81,8 +106,11 @@ void CDROM::handleSector() {
 	const std::array<uint8_t, 12> sync = {{0x00, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x00}};
 	
 	Location pos = Location::fromLBA(readLocation);
-	auto rawSector = _disk.read(pos);
-	_readSector.set(rawSector);
+	SectorSpan rawSector;
+	
+	if (readLocation < 0 || !readAhead->fetch(readLocation, rawSector))
+		rawSector = _disk.read(pos);
+	_readSector.set(rawSector.data, rawSector.size);
 	
 	readLocation++;
 	
@@ -93,10 +121,19 @@ void CDROM::handleSector() {
 		return;
 	}
 	
+	const bool synced = rawSector.size >= Sector::RAW_BUFFER && memcmp(rawSector.data, sync.data(), sync.size()) == 0;
+	
+	// XA-ADPCM (Mode 2 with the audio and real time bits in the sub-mode)
+	// goes to the SPU, the CPU never gets these sectors
+	if (synced && mode.xaAdpcm && rawSector.data[15] == 2 && (rawSector.data[18] & 0x44) == 0x44) {
+		queueXaSector(rawSector);
+		return;
+	}
+	
 	INT(1, 3000);
 	addResponse(_stats._reg);
 	
-	if (memcmp(_readSector.data(), sync.data(), sync.size()) != 0) {
+	if (!synced) {
 		// TODO; This.. does happen on Tekken 3
 		//assert(false);
 		return;
@@ -117,25 +154,63 @@ void CDROM::handleSector() {
 	// TODO;
 }
 
-void CDROM::queueCdAudioSector(const std::vector<uint8_t>& sector) {
-	static constexpr size_t maxQueuedSamples = 44100 * 2;
+void CDROM::queueCdAudioSector(const SectorSpan& sector) {
+	CdAudioRing::Frame frames[SECTOR_FRAMES];
+	size_t count = 0;
+	
+	for (size_t i = 0; i + 3 < sector.size && count < SECTOR_FRAMES; i += 4) {
+		int16_t left = static_cast<int16_t>(sector.data[i] | (sector.data[i + 1] << 8));
+		int16_t right = static_cast<int16_t>(sector.data[i + 2] | (sector.data[i + 3] << 8));
+		
+		frames[count++] = {left, right};
+	}
+	
+	queueCdAudio(frames, count);
+}
+
+void CDROM::queueXaSector(const SectorSpan& sector) {
+	// Games interleave several streams, Setfilter picks the file and channel
+	if (mode.xaFilter && (sector.data[16] != filterFile || sector.data[17] != filterChannel)) {
+		return;
+	}
 	
-	for (size_t i = 0; i + 3 < sector.size(); i += 4) {
-		if (audioSamples.size() >= maxQueuedSamples) {
-			audioSamples.pop_front();
+	// Decoded even when muted, the next sector carries on from this one
+	const size_t frames = xaDecoder.decode(sector.data);
+	
+	if (mute || xaMute) {
+		return;
+	}
+	
+	const int16_t* samples = xaDecoder.samples();
+	CdAudioRing::Frame chunk[SECTOR_FRAMES];
+	
+	// A CD-DA sector's worth at a time
+	for (size_t i = 0; i < frames; i += SECTOR_FRAMES) {
+		const size_t count = std::min(frames - i, SECTOR_FRAMES);
+		
+		for (size_t j = 0; j < count; j++) {
+			chunk[j] = {samples[(i + j) * 2], samples[(i + j) * 2 + 1]};
 		}
 		
-		int16_t left = static_cast<int16_t>(sector[i] | (sector[i + 1] << 8));
-		int16_t right = static_cast<int16_t>(sector[i + 2] | (sector[i + 3] << 8));
+		queueCdAudio(chunk, count);
+	}
+}
+
+void CDROM::queueCdAudio(CdAudioRing::Frame* frames, size_t count) {
+	for (size_t i = 0; i < count; i++) {
+		const int32_t left = frames[i].left;
+		const int32_t right = frames[i].right;
 		
 		int32_t mixedLeft = (left * cdLeftToLeft + right * cdRightToLeft) >> 7;
 		int32_t mixedRight = (left * cdLeftToRight + right * cdRightToRight) >> 7;
 		
-		audioSamples.emplace_back(
+		frames[i] = {
 		    static_cast<int16_t>(std::clamp<int32_t>(mixedLeft, -32768, 32767)),
 		    static_cast<int16_t>(std::clamp<int32_t>(mixedRight, -32768, 32767))
-		);
+		};
 	}
+	
+	audio->push(frames, count);
 }
 
 void CDROM::applyPendingVolume() {
@@ -145,20 +220,6 @@ void CDROM::applyPendingVolume() {
 	cdRightToRight = pendingCdRightToRight;
 }
 
-bool CDROM::popAudioSample(int16_t& left, int16_t& right) {
-	if (audioSamples.empty()) {
-		left = 0;
-		right = 0;
-		return false;
-	}
-	
-	auto sample = audioSamples.front();
-	audioSamples.pop_front();
-	left = sample.first;
-	right = sample.second;
-	return true;
-}
-
 uint8_t CDROM::load(uint32_t addr) {
 	//printf("CDROM Load %x\n", addr);
 	//std::cerr << "";
@@ -293,6 +354,9 @@ void CDROM::store(uint32_t addr, uint8_t val) {
 			}
 			
 			case 3: {
+				// 0 ADPMUTE, 5 Apply volume changes
+				xaMute = val & 0x01;
+				
 				if (val & 0x20) {
 					applyPendingVolume();
 				}
@@ -417,7 +481,8 @@ void CDROM::reset() {
 	
 	isBufferEmpty = false;
 	mute = false;
-	audioSamples.clear();
+	xaMute = false;
+	audio->clear();
 	
 	pendingCdLeftToLeft = 0x80;
 	pendingCdLeftToRight = 0x00;
@@ -428,10 +493,15 @@ void CDROM::reset() {
 	_stats = {};
 	mode = {};
 	
+	readAhead->stop();
 	_disk = {};
 	_readSector = {};
 	_sector = {};
 	
+	filterFile = 0;
+	filterChannel = 0;
+	xaDecoder.reset();
+	
 	while(!parameters.empty())
 		parameters.pop();
 	
@@ -439,11 +509,17 @@ void CDROM::reset() {
 }
 
 void CDROM::swapDisk(const std::string& path) {
-	_disk.set(path);
+	readAhead->stop();
+	_disk.set(path, preloadDisc);
 	
 	diskPresent = true;
 }
 
+void CDROM::restartReadAhead(int lba) {
+	if (diskPresent && lba >= 0)
+		readAhead->restart(_disk, lba);
+}
+
 void CDROM::decodeAndExecute(uint8_t command) {
 	//while(!interrupts.empty())
 	//	interrupts.pop();
@@ -528,6 +604,7 @@ void CDROM::decodeAndExecute(uint8_t command) {
 			}
 			
 			readLocation = pos.toLba();
+			restartReadAhead(readLocation);
 			_stats.setMode(Stats::Mode::Playing);
 			
 			INT(3);
@@ -627,6 +704,7 @@ void CDROM::decodeAndExecute(uint8_t command) {
 		// SeekP - Command 16h --> INT3(stat) --> INT2(stat)
 		readLocation = seekLocation;
 		seekLocation = 0;
+		restartReadAhead(readLocation);
 		
 		auto prevStat = _stats._reg;
 		
@@ -649,6 +727,9 @@ void CDROM::decodeAndExecute(uint8_t command) {
 		// Demute - Command 0Ch --> INT3(stat)
 		mute = false;
 		INT3();
+	} else if (command == 0x0D) {
+		// Setfilter - Command 0Dh,file,channel --> INT3(stat)
+		SetFilter();
 	} else if (command == 0x50 || command == 0x51 || command == 0x52 || command == 0x53 || command == 0x54 ||
 	           command == 0x55 || command == 0x56 || command == 0x57) {
 		INT(5);
@@ -794,6 +875,9 @@ void CDROM::SetLoc() {
 		return;
 	}
 	
+	// Whatever was read ahead is somewhere else now
+	restartReadAhead(seekLocation);
+	
 	INT(3, 5000);
 	addResponse(_stats._reg);
 }
@@ -812,6 +896,8 @@ void CDROM::ReadN() {
 	}
 	
 	readLocation = seekLocation;
+	restartReadAhead(readLocation);
+	xaDecoder.reset();
 	_stats.setMode(Stats::Mode::Reading);
 	
 	INT(3, 1000);
@@ -830,8 +916,9 @@ void CDROM::Stop() {
 	// moves the drive head to the beginning of the first track.
 	_stats.setMode(Stats::Mode::None);
 	// TODO; Stop audio
-	audioSamples.clear();
+	audio->clear();
 	_stats.motor = 0;
+	readAhead->cancel();
 	
 	INT2();
 }
@@ -842,7 +929,7 @@ void CDROM::Pause() {
 	
 	_stats.setMode(Stats::Mode::None);
 	// TODO: Handle audio pausing
-	audioSamples.clear();
+	audio->clear();
 	//_stats.motor = 1;
 	
 	INT(2, 20000);
@@ -903,6 +990,7 @@ void CDROM::SeekL() {
 	// TODO; Seek to Setloc's location in data mode
 	
 	readLocation = seekLocation;
+	restartReadAhead(readLocation);
 	
 	/**
 	 * E = Error 80h appears on some commands (02h..09h, 0Bh..0Dh, 10h..16h, 1Ah, 1Bh?, and 1Dh)
@@ -987,6 +1075,8 @@ void CDROM::GetID() {
 
 void CDROM::ReadS() {
 	readLocation = seekLocation;
+	restartReadAhead(readLocation);
+	xaDecoder.reset();
 	
 	// TODO; Clear audio?
 	_stats.setMode(Stats::Mode::Reading);
@@ -995,6 +1085,22 @@ void CDROM::ReadS() {
 	addResponse(_stats._reg);
 }
 
+void CDROM::SetFilter() {
+	// Setfilter - Command 0Dh,file,channel --> INT3(stat)
+	if (parameters.size() < 2) {
+		INT(5);
+		addResponse(0x01);
+		addResponse(0x20);
+		
+		return;
+	}
+	
+	filterFile = getParamater();
+	filterChannel = getParamater();
+	
+	INT3();
+}
+
 void CDROM::INT2() {
 	INT(2);
 	addResponse(_stats._reg);
@@ -1,14 +1,18 @@
 ﻿#pragma once
 
 #include <stdint.h>
-#include <deque>
+#include <memory>
 #include <queue>
 #include <utility>
 #include <glm/ext/scalar_uint_sized.hpp>
 
 #include "Disk.h"
+#include "ReadAhead.h"
+#include "XaDecoder.h"
 #include "fifo.h"
 
+#include "../../SPU/CdAudioRing.h"
+
 #include "../IRQ.h"
 
 class CDROM {
@@ -96,8 +100,14 @@ public:
 	
 	void step(uint32_t cycles);
 	
+	// CPU cycles until 'step' has to run again for an IRQ or a sector,
+	// UINT32_MAX if nothing is pending
+	uint32_t cyclesUntilEvent() const;
+	
 	void handleSector();
-	bool popAudioSample(int16_t& left, int16_t& right);
+	
+	// CD-DA and XA-ADPCM frames, the SPU takes them from the other end
+	[[nodiscard]] const std::shared_ptr<CdAudioRing>& audioOutput() const { return audio; }
 	
 	uint8_t load(uint32_t addr);
 	void store(uint32_t addr, uint8_t val);
@@ -109,14 +119,34 @@ public:
 public:
 	void swapDisk(const std::string& path);
 	
+	// Sectors read ahead on a background thread, 0 turns it off
+	void setReadAhead(size_t sectors) { readAhead->setWindow(sectors); }
+	[[nodiscard]] size_t readAheadWindow() const { return readAhead->window(); }
+	
+	// Discs swapped in after this are read into memory when loaded
+	void setPreloadDisc(bool preload) { preloadDisc = preload; }
+	[[nodiscard]] bool preloadsDisc() const { return preloadDisc; }
+	
 	void decodeAndExecute(uint8_t command);
 	void decodeAndExecuteSub();
 
 private:
+	// Stereo frames in a CD-DA sector
+	static constexpr size_t SECTOR_FRAMES = Sector::RAW_BUFFER / 4;
+	
 	bool isEmpty();	
-	void queueCdAudioSector(const std::vector<uint8_t>& sector);
+	uint32_t cyclesPerSector() const;
+	void queueCdAudioSector(const SectorSpan& sector);
+	void queueXaSector(const SectorSpan& sector);
+	
+	// Through the CD volume matrix (in place) and into 'audio'
+	void queueCdAudio(CdAudioRing::Frame* frames, size_t count);
+	
 	void applyPendingVolume();
 	
+	// Points the read-ahead at where the drive is going to read next
+	void restartReadAhead(int lba);
+	
 private:
 	// CDROM Commands
 	void GetStat();
@@ -129,6 +159,7 @@ private:
 	void SeekL();
 	void GetID();
 	void ReadS();
+	void SetFilter();
 	
 private:
 	/*void triggerInterrupt() {
@@ -190,7 +221,8 @@ private:
 	bool isBufferEmpty = true;
 	
 	bool mute = false;
-	std::deque<std::pair<int16_t, int16_t>> audioSamples;
+	bool xaMute = false;
+	std::shared_ptr<CdAudioRing> audio = std::make_shared<CdAudioRing>();
 	
 	uint8_t pendingCdLeftToLeft = 0x80;
 	uint8_t pendingCdLeftToRight = 0x00;
@@ -208,7 +240,14 @@ private:
 
 private:
 	Disk _disk;
+	std::unique_ptr<ReadAhead> readAhead = std::make_unique<ReadAhead>();
+	bool preloadDisc = false;
 	Sector _readSector;
+	
+	// Setfilter, the one XA-ADPCM stream that plays when Mode.xaFilter is set
+	uint8_t filterFile = 0;
+	uint8_t filterChannel = 0;
+	XaDecoder xaDecoder;
 	Sector _sector;
 	
 private:
@@ -0,0 +1,875 @@
+#include "CDROMTests.h"
+
+#include <array>
+#include <cstdint>
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <initializer_list>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "CDROM.h"
+#include "ChdFile.h"
+#include "FlacDecoder.h"
+#include "XaDecoder.h"
+
+#include "../../Utils/SpscRing.h"
+#include "../../Utils/Worker.h"
+
+namespace {
+	struct Runner {
+		int passed = 0;
+		int failed = 0;
+		std::vector<std::string> failures;
+		
+		void expect(const std::string& name, bool ok, const std::string& detail = {}) {
+			if (ok) {
+				passed++;
+				return;
+			}
+			
+			failed++;
+			failures.push_back(detail.empty() ? name : name + ": " + detail);
+		}
+		
+		void expectEq(const std::string& name, int64_t got, int64_t wanted) {
+			expect(name, got == wanted, "got " + std::to_string(got) + ", wanted " + std::to_string(wanted));
+		}
+		
+		template <typename Fn>
+		void test(const std::string& name, Fn&& fn) {
+			try {
+				fn();
+				passed++;
+			} catch (const std::exception& e) {
+				failed++;
+				failures.push_back(name + ": threw " + e.what());
+			} catch (...) {
+				failed++;
+				failures.push_back(name + ": threw unknown exception");
+			}
+		}
+	};
+	
+	// Coding info bits, see 'XaDecoder::decode'
+	constexpr uint8_t STEREO = 0x01;
+	constexpr uint8_t HALF_RATE = 0x04;
+	constexpr uint8_t EIGHT_BIT = 0x10;
+	
+	constexpr size_t GROUP_SAMPLES = 28;
+	
+	// Raw Mode 2 Form 2 audio sector, every sample zero with filter 0 and range 0
+	std::vector<uint8_t> xaSector(uint8_t codingInfo, uint8_t file = 1, uint8_t channel = 0) {
+		std::vector<uint8_t> sector(Sector::RAW_BUFFER);
+		
+		std::fill(sector.begin() + 1, sector.begin() + 11, uint8_t{0xFF});
+		sector[15] = 2;
+		
+		// Sub-header and its copy, audio + real time + form 2
+		const uint8_t subHeader[] = {file, channel, 0x64, codingInfo};
+		std::copy(subHeader, subHeader + 4, sector.begin() + 16);
+		std::copy(subHeader, subHeader + 4, sector.begin() + 20);
+		
+		return sector;
+	}
+	
+	// Sets the header of every sound unit
+	void setUnitHeaders(std::vector<uint8_t>& sector, int filter, int range) {
+		for (size_t group = 0; group < 18; group++) {
+			for (size_t i = 0; i < 16; i++)
+				sector[24 + group * 128 + i] = static_cast<uint8_t>((filter << 4) | range);
+		}
+	}
+	
+	// 'raw' is the 4 or 8 bit value as stored, before the range shift
+	void setSample(std::vector<uint8_t>& sector, size_t group, size_t unit, size_t index, uint8_t raw) {
+		const bool eightBit = (sector[19] & EIGHT_BIT) != 0;
+		uint8_t& byte = sector[24 + group * 128 + 16 + index * 4 + (eightBit ? unit : unit / 2)];
+		
+		if (eightBit)
+			byte = raw;
+		else
+			byte = static_cast<uint8_t>((byte & ~(0x0F << ((unit & 1) * 4))) | ((raw & 0x0F) << ((unit & 1) * 4)));
+	}
+	
+	std::vector<int16_t> decode(XaDecoder& decoder, const std::vector<uint8_t>& sector) {
+		const size_t frames = decoder.decode(sector.data());
+		return {decoder.samples(), decoder.samples() + frames * 2};
+	}
+	
+	// An impulse of -32768 comes out of the interpolation as the zigzag taps,
+	// negated and exact. Taps 5, 11, 17 and 23 of the 7 tables for an impulse
+	// at the first sample, the only ones landing on every sixth input.
+	constexpr int32_t IMPULSE_RESPONSE[4][7] = {
+		{-0x0002, 0x0003, -0x0005, 0x0005, 0x000A, 0x001A, -0x0044},
+		{0x0009, 0x0132, -0x039E, 0x09B8, -0x1780, 0x53E0, 0x53E0},
+		{-0x1780, 0x09B8, -0x039E, 0x0132, 0x0009, -0x0044, 0x001A},
+		{0x000A, 0x0005, -0x0005, 0x0003, -0x0002, 0, 0},
+	};
+	
+	// Frames out of one sector, 18 groups of 224 4 bit or 112 8 bit samples
+	// split over the channels, doubled at 18.9 kHz and then 7 for every 6
+	size_t expectedFrames(uint8_t codingInfo) {
+		size_t samples = 18 * ((codingInfo & EIGHT_BIT) ? 112 : 224);
+		
+		if (codingInfo & STEREO)
+			samples /= 2;
+		
+		if (codingInfo & HALF_RATE)
+			samples *= 2;
+		
+		return samples * 7 / 6;
+	}
+	
+	std::string formatName(uint8_t codingInfo) {
+		return std::string((codingInfo & EIGHT_BIT) ? "8 bit " : "4 bit ") + ((codingInfo & STEREO) ? "stereo " : "mono ") +
+		       ((codingInfo & HALF_RATE) ? "18.9 kHz" : "37.8 kHz");
+	}
+	
+	void testXaImpulse(Runner& runner) {
+		runner.test("XA impulse response", [&] {
+			std::vector<uint8_t> sector = xaSector(0);
+			setSample(sector, 0, 0, 0, 0x8);
+			
+			XaDecoder decoder;
+			const std::vector<int16_t> samples = decode(decoder, sector);
+			
+			runner.expectEq("frames", samples.size() / 2, 4704);
+			
+			int mismatches = 0;
+			
+			for (size_t frame = 0; frame < samples.size() / 2; frame++) {
+				const int32_t wanted = frame < 28 ? -IMPULSE_RESPONSE[frame / 7][frame % 7] : 0;
+				
+				mismatches += samples[frame * 2] != wanted;
+				mismatches += samples[frame * 2 + 1] != wanted;
+			}
+			
+			runner.expectEq("samples differing", mismatches, 0);
+		});
+	}
+	
+	void testXaFormats(Runner& runner) {
+		runner.test("XA formats", [&] {
+			// Two impulses in a row at 37.8 kHz are what one gives at 18.9 kHz
+			std::vector<uint8_t> pair = xaSector(0);
+			setSample(pair, 0, 0, 0, 0x8);
+			setSample(pair, 0, 0, 1, 0x8);
+			
+			XaDecoder pairDecoder;
+			const std::vector<int16_t> pairSamples = decode(pairDecoder, pair);
+			
+			for (uint8_t codingInfo = 0; codingInfo < 8; codingInfo++) {
+				const uint8_t coding = ((codingInfo & 1) ? STEREO : 0) | ((codingInfo & 2) ? HALF_RATE : 0) | ((codingInfo & 4) ? EIGHT_BIT : 0);
+				const std::string name = formatName(coding);
+				const bool stereo = (coding & STEREO) != 0;
+				
+				// Right only gets its own impulse in stereo
+				for (size_t channel = 0; channel < (stereo ? 2u : 1u); channel++) {
+					std::vector<uint8_t> sector = xaSector(coding);
+					setSample(sector, 0, channel, 0, (coding & EIGHT_BIT) ? 0x80 : 0x8);
+					
+					XaDecoder decoder;
+					const std::vector<int16_t> samples = decode(decoder, sector);
+					
+					runner.expectEq(name + " frames", samples.size() / 2, expectedFrames(coding));
+					
+					int mismatches = 0;
+					
+					for (size_t frame = 0; frame < samples.size() / 2; frame++) {
+						int32_t wanted = 0;
+						
+						if (coding & HALF_RATE)
+							wanted = frame < pairSamples.size() / 2 ? pairSamples[frame * 2] : 0;
+						else
+							wanted = frame < 28 ? -IMPULSE_RESPONSE[frame / 7][frame % 7] : 0;
+						
+						for (size_t side = 0; side < 2; side++) {
+							const bool hit = !stereo || side == channel;
+							mismatches += samples[frame * 2 + side] != (hit ? wanted : 0);
+						}
+					}
+					
+					runner.expectEq(name + " channel " + std::to_string(channel) + " samples differing", mismatches, 0);
+				}
+			}
+		});
+	}
+	
+	void testXaStateAcrossSectors(Runner& runner) {
+		runner.test("XA state across sectors", [&] {
+			// Ends on a loud sample
+			std::vector<uint8_t> loud = xaSector(0);
+			setSample(loud, 17, 7, 27, 0x7);
+			
+			// Silent, but predicts from what came before
+			std::vector<uint8_t> predicted = xaSector(0);
+			setUnitHeaders(predicted, 1, 0);
+			
+			std::vector<uint8_t> silent = xaSector(0);
+			
+			// Past the interpolation's tail, 29 inputs at most
+			auto quietAfter = [](const std::vector<int16_t>& samples, size_t from) {
+				for (size_t i = from * 2; i < samples.size(); i++) {
+					if (samples[i] != 0)
+						return false;
+				}
+				
+				return true;
+			};
+			
+			XaDecoder decoder;
+			decode(decoder, loud);
+			runner.expect("prediction carries over", !quietAfter(decode(decoder, predicted), 35));
+			
+			decoder.reset();
+			decode(decoder, loud);
+			const std::vector<int16_t> tail = decode(decoder, silent);
+			runner.expect("interpolation carries over", !quietAfter(tail, 0));
+			runner.expect("interpolation tail ends", quietAfter(tail, 35));
+			
+			decoder.reset();
+			decode(decoder, loud);
+			decoder.reset();
+			runner.expect("nothing left after reset", quietAfter(decode(decoder, predicted), 0));
+		});
+	}
+	
+	// 64 sectors alternating between channel 0 and 1 of file 1
+	std::string writeInterleavedDisc() {
+		const std::filesystem::path directory = std::filesystem::temp_directory_path();
+		const std::filesystem::path bin = directory / "cdrom-tests-xa.bin";
+		const std::filesystem::path cue = directory / "cdrom-tests-xa.cue";
+		
+		std::ofstream image(bin, std::ios::binary);
+		
+		for (int i = 0; i < 64; i++) {
+			std::vector<uint8_t> sector = xaSector(STEREO, 1, static_cast<uint8_t>(i % 2));
+			setUnitHeaders(sector, 0, 4);
+			
+			for (size_t index = 0; index < GROUP_SAMPLES; index++)
+				setSample(sector, 0, 0, index, static_cast<uint8_t>(index));
+			
+			image.write(reinterpret_cast<const char*>(sector.data()), static_cast<std::streamsize>(sector.size()));
+		}
+		
+		std::ofstream(cue) << "FILE \"" << bin.filename().string() << "\" BINARY\n  TRACK 01 MODE2/2352\n    INDEX 01 00:00:00\n";
+		
+		return cue.string();
+	}
+	
+	// Sends a command and acknowledges whatever comes back
+	void command(CDROM& cdrom, uint8_t opcode, std::initializer_list<uint8_t> parameters) {
+		cdrom.store(0, 0);
+		
+		for (uint8_t parameter : parameters)
+			cdrom.store(2, parameter);
+		
+		cdrom.store(1, opcode);
+		
+		// Second responses come a while later
+		for (int response = 0; response < 2; response++) {
+			cdrom.step(100000);
+			
+			while (cdrom.load(0) & 0x20)
+				cdrom.load(1);
+			
+			cdrom.store(0, 1);
+			cdrom.store(3, 0x1F);
+			cdrom.store(0, 0);
+		}
+	}
+	
+	// Frames that made it to the SPU after reading the disc for a while,
+	// ReadS with XA-ADPCM on and the filter set to channel 'channel'
+	size_t playInterleaved(const std::string& cue, bool filter, uint8_t channel) {
+		CDROM cdrom;
+		cdrom.swapDisk(cue);
+		
+		command(cdrom, 0x0D, {1, channel});
+		command(cdrom, 0x0E, {static_cast<uint8_t>(0x40 | (filter ? 0x08 : 0))});
+		command(cdrom, 0x02, {0x00, 0x02, 0x00});
+		command(cdrom, 0x1B, {});
+		
+		size_t frames = 0;
+		CdAudioRing::Frame chunk[256];
+		
+		for (int i = 0; i < 40; i++) {
+			cdrom.step(44100 * 768 / 150);
+			
+			while (const size_t count = cdrom.audioOutput()->pop(chunk, 256))
+				frames += count;
+		}
+		
+		return frames;
+	}
+	
+	void testXaFilter(Runner& runner) {
+		runner.test("CDROM XA Setfilter", [&] {
+			const std::string cue = writeInterleavedDisc();
+			
+			const size_t everything = playInterleaved(cue, false, 0);
+			const size_t first = playInterleaved(cue, true, 0);
+			const size_t second = playInterleaved(cue, true, 1);
+			
+			runner.expect("played something", everything > 0);
+			runner.expectEq("whole sectors", everything % expectedFrames(STEREO), 0);
+			runner.expectEq("channel 0 drops every other sector", first * 2, everything);
+			runner.expectEq("channel 1 drops every other sector", second * 2, everything);
+			runner.expectEq("channel 2 drops everything", playInterleaved(cue, true, 2), 0);
+			
+			std::error_code ignored;
+			std::filesystem::remove(std::filesystem::path(cue).replace_extension(".bin"), ignored);
+			std::filesystem::remove(cue, ignored);
+		});
+	}
+	// Most significant bit first, the way FLAC and the CHD map are read
+	struct BitWriter {
+		std::vector<uint8_t> bytes;
+		int used = 0;
+		
+		void write(uint32_t value, int count) {
+			for (int i = count - 1; i >= 0; i--) {
+				if (used == 0)
+					bytes.push_back(0);
+				
+				bytes.back() |= static_cast<uint8_t>(((value >> i) & 1) << (7 - used));
+				used = (used + 1) % 8;
+			}
+		}
+		
+		void writeSigned(int32_t value, int count) {
+			write(static_cast<uint32_t>(value) & (count == 32 ? ~0u : (1u << count) - 1), count);
+		}
+		
+		void writeUnary(uint32_t zeros) {
+			for (uint32_t i = 0; i < zeros; i++)
+				write(0, 1);
+			
+			write(1, 1);
+		}
+		
+		void writeRice(int32_t value, int parameter) {
+			const uint32_t folded = (static_cast<uint32_t>(value) << 1) ^ static_cast<uint32_t>(value >> 31);
+			writeUnary(folded >> parameter);
+			write(folded & ((1u << parameter) - 1), parameter);
+		}
+		
+		void align() { used = 0; }
+	};
+	
+	constexpr size_t FLAC_BLOCK = 16;
+	
+	using FlacChannel = std::array<int32_t, FLAC_BLOCK>;
+	
+	// Fixed block size in the header, no sample rate, 16 bits. CRCs are left
+	// zero, the decoder leaves them to the CHD.
+	void flacHeader(BitWriter& bits, uint32_t channelCode, uint32_t frame) {
+		bits.write(0x3FFE, 14);
+		bits.write(0, 2);
+		bits.write(6, 4);
+		bits.write(0, 4);
+		bits.write(channelCode, 4);
+		bits.write(4, 3);
+		bits.write(0, 1);
+		bits.write(frame, 8);
+		bits.write(FLAC_BLOCK - 1, 8);
+		bits.write(0, 8);
+	}
+	
+	void flacSubframe(BitWriter& bits, uint32_t type, int wasted = 0) {
+		bits.write(0, 1);
+		bits.write(type, 6);
+		bits.write(wasted > 0, 1);
+		
+		if (wasted > 0)
+			bits.writeUnary(wasted - 1);
+	}
+	
+	// One Rice partition, or two with the second one escaped to plain 16 bit numbers
+	void flacResidual(BitWriter& bits, const int32_t* residual, int order, int parameter, bool escapeSecondHalf) {
+		bits.write(0, 2);
+		bits.write(escapeSecondHalf ? 1 : 0, 4);
+		bits.write(parameter, 4);
+		
+		const size_t half = escapeSecondHalf ? FLAC_BLOCK / 2 : FLAC_BLOCK;
+		
+		for (size_t i = order; i < half; i++)
+			bits.writeRice(residual[i], parameter);
+		
+		if (escapeSecondHalf) {
+			bits.write(15, 4);
+			bits.write(16, 5);
+			
+			for (size_t i = half; i < FLAC_BLOCK; i++)
+				bits.writeSigned(residual[i], 16);
+		}
+	}
+	
+	void flacVerbatim(BitWriter& bits, const FlacChannel& samples, int sampleBits, int wasted = 0) {
+		flacSubframe(bits, 1, wasted);
+		
+		for (int32_t sample : samples)
+			bits.writeSigned(sample >> wasted, sampleBits - wasted);
+	}
+	
+	void flacFixed(BitWriter& bits, const FlacChannel& samples, int sampleBits, int order, int parameter, bool escape = false) {
+		flacSubframe(bits, 8 + order);
+		
+		for (int i = 0; i < order; i++)
+			bits.writeSigned(samples[i], sampleBits);
+		
+		FlacChannel residual{};
+		
+		for (size_t i = order; i < FLAC_BLOCK; i++) {
+			const int32_t* s = samples.data() + i;
+			const int32_t predictions[] = {0, s[-1], 2 * s[-1] - s[-2]};
+			residual[i] = s[0] - predictions[order];
+		}
+		
+		flacResidual(bits, residual.data(), order, parameter, escape);
+	}
+	
+	// Second order, 12 bit coefficients shifted down by 9
+	void flacLpc(BitWriter& bits, const FlacChannel& samples, int sampleBits, int32_t first, int32_t second) {
+		flacSubframe(bits, 32 + 1);
+		
+		for (int i = 0; i < 2; i++)
+			bits.writeSigned(samples[i], sampleBits);
+		
+		bits.write(12 - 1, 4);
+		bits.writeSigned(9, 5);
+		bits.writeSigned(first, 12);
+		bits.writeSigned(second, 12);
+		
+		FlacChannel residual{};
+		
+		for (size_t i = 2; i < FLAC_BLOCK; i++)
+			residual[i] = samples[i] - static_cast<int32_t>((int64_t{first} * samples[i - 1] + int64_t{second} * samples[i - 2]) >> 9);
+		
+		flacResidual(bits, residual.data(), 2, 10, false);
+	}
+	
+	void flacFooter(BitWriter& bits) {
+		bits.align();
+		bits.write(0, 16);
+	}
+	
+	void testFlac(Runner& runner) {
+		runner.test("FLAC frames", [&] {
+			std::vector<FlacChannel> left, right;
+			BitWriter bits;
+			
+			// Independent, verbatim and second order fixed with an escaped partition
+			left.push_back({0, 1000, -1000, 32767, -32768, 5, -5, 77, 12345, -12345, 1, -1, 300, 200, 100, 0});
+			right.push_back({});
+			
+			for (size_t i = 0; i < FLAC_BLOCK; i++)
+				right.back()[i] = static_cast<int32_t>(100 * i) - static_cast<int32_t>(3 * i * i) + ((i * 37) % 11 == 3 ? 900 : 0);
+			
+			flacHeader(bits, 1, 0);
+			flacVerbatim(bits, left.back(), 16);
+			flacFixed(bits, right.back(), 16, 2, 3, true);
+			flacFooter(bits);
+			
+			// Mid/side, LPC on the mid channel and verbatim 17 bit side
+			left.push_back({});
+			right.push_back({});
+			
+			for (size_t i = 0; i < FLAC_BLOCK; i++) {
+				left.back()[i] = static_cast<int32_t>(20000 - 2600 * i);
+				right.back()[i] = static_cast<int32_t>(-30000 + 3999 * i);
+			}
+			
+			FlacChannel mid, side;
+			
+			for (size_t i = 0; i < FLAC_BLOCK; i++) {
+				mid[i] = (left.back()[i] + right.back()[i]) >> 1;
+				side[i] = left.back()[i] - right.back()[i];
+			}
+			
+			flacHeader(bits, 10, 1);
+			flacLpc(bits, mid, 16, 1000, -490);
+			flacVerbatim(bits, side, 17);
+			flacFooter(bits);
+			
+			// Left/side, a constant and a side with wasted bits
+			left.push_back({});
+			right.push_back({});
+			
+			for (size_t i = 0; i < FLAC_BLOCK; i++) {
+				left.back()[i] = -1234;
+				right.back()[i] = -1234 - static_cast<int32_t>(i * 4) * (i % 2 ? 1 : -1);
+				side[i] = left.back()[i] - right.back()[i];
+			}
+			
+			flacHeader(bits, 8, 2);
+			flacSubframe(bits, 0);
+			bits.writeSigned(-1234, 16);
+			flacVerbatim(bits, side, 17, 2);
+			flacFooter(bits);
+			
+			// Side/right, first order side and the right channel as all residual
+			left.push_back({});
+			right.push_back({});
+			
+			for (size_t i = 0; i < FLAC_BLOCK; i++) {
+				right.back()[i] = static_cast<int32_t>(i * i) - 20;
+				left.back()[i] = right.back()[i] + static_cast<int32_t>(50 * i);
+				side[i] = left.back()[i] - right.back()[i];
+			}
+			
+			flacHeader(bits, 9, 3);
+			flacFixed(bits, side, 17, 1, 4);
+			flacFixed(bits, right.back(), 16, 0, 5);
+			flacFooter(bits);
+			
+			std::vector<uint8_t> wanted;
+			
+			for (size_t frame = 0; frame < left.size(); frame++) {
+				for (size_t i = 0; i < FLAC_BLOCK; i++) {
+					for (int32_t sample : {left[frame][i], right[frame][i]}) {
+						wanted.push_back(static_cast<uint8_t>(static_cast<uint16_t>(sample) >> 8));
+						wanted.push_back(static_cast<uint8_t>(sample));
+					}
+				}
+			}
+			
+			FlacDecoder decoder;
+			std::vector<uint8_t> out(wanted.size());
+			
+			const size_t used = decoder.decode(bits.bytes.data(), bits.bytes.size(), out.data(), left.size() * FLAC_BLOCK);
+			
+			runner.expectEq("bytes used", used, bits.bytes.size());
+			runner.expect("samples", out == wanted);
+			
+			// Cut short, it has to notice instead of making samples up
+			std::vector<uint8_t> cut(bits.bytes.begin(), bits.bytes.end() - 40);
+			runner.expectEq("truncated", decoder.decode(cut.data(), cut.size(), out.data(), left.size() * FLAC_BLOCK), 0);
+		});
+	}
+	
+	constexpr uint32_t CHD_HUNK_FRAMES = 8;
+	constexpr uint32_t CHD_HUNK_BYTES = CHD_HUNK_FRAMES * ChdFile::FRAME_BYTES;
+	constexpr uint32_t CHD_HUNKS = 20;
+	
+	// Hunk 5 is left out of the file, the map points it at offset 0
+	constexpr uint32_t CHD_HOLE = 5;
+	
+	uint8_t chdByte(uint64_t offset) {
+		if (offset / CHD_HUNK_BYTES == CHD_HOLE)
+			return 0;
+		
+		return static_cast<uint8_t>((offset * 7) ^ (offset >> 11));
+	}
+	
+	void writeBig(std::vector<uint8_t>& out, size_t at, uint64_t value, int bytes) {
+		for (int i = 0; i < bytes; i++)
+			out[at + i] = static_cast<uint8_t>(value >> ((bytes - 1 - i) * 8));
+	}
+	
+	// Version 5 with no compressors, header, map and metadata in the space
+	// of the first hunk and the hunks after it. Uncompressed maps count in hunks.
+	std::string writeChd() {
+		const std::filesystem::path path = std::filesystem::temp_directory_path() / "cdrom-tests.chd";
+		const std::string track = "TRACK:1 TYPE:MODE2_RAW SUBTYPE:NONE FRAMES:160 PREGAP:0 PGTYPE:MODE1 PGSUB:RW POSTGAP:0";
+		
+		std::vector<uint8_t> file(CHD_HUNK_BYTES);
+		const size_t mapOffset = 124;
+		const size_t metaOffset = mapOffset + CHD_HUNKS * 4;
+		
+		std::copy_n("MComprHD", 8, file.begin());
+		writeBig(file, 8, 124, 4);
+		writeBig(file, 12, 5, 4);
+		writeBig(file, 32, uint64_t{CHD_HUNKS} * CHD_HUNK_BYTES, 8);
+		writeBig(file, 40, mapOffset, 8);
+		writeBig(file, 48, metaOffset, 8);
+		writeBig(file, 56, CHD_HUNK_BYTES, 4);
+		writeBig(file, 60, ChdFile::FRAME_BYTES, 4);
+		
+		// Stored in reverse, so the map has to be followed
+		uint32_t slot = 1;
+		
+		for (uint32_t hunk = CHD_HUNKS; hunk-- > 0;)
+			writeBig(file, mapOffset + hunk * 4, hunk == CHD_HOLE ? 0 : slot++, 4);
+		
+		std::copy_n("CHT2", 4, file.begin() + metaOffset);
+		file[metaOffset + 4] = 1;
+		writeBig(file, metaOffset + 5, track.size() + 1, 3);
+		std::copy(track.begin(), track.end(), file.begin() + metaOffset + 16);
+		
+		for (uint32_t hunk = CHD_HUNKS; hunk-- > 0;) {
+			if (hunk == CHD_HOLE)
+				continue;
+			
+			for (uint32_t i = 0; i < CHD_HUNK_BYTES; i++)
+				file.push_back(chdByte(uint64_t{hunk} * CHD_HUNK_BYTES + i));
+		}
+		
+		std::ofstream(path, std::ios::binary).write(reinterpret_cast<const char*>(file.data()), static_cast<std::streamsize>(file.size()));
+		
+		return path.string();
+	}
+	
+	void testChd(Runner& runner) {
+		const std::string path = writeChd();
+		
+		runner.test("CHD uncompressed", [&] {
+			ChdFile chd(path);
+				
+			runner.expect("open", chd.isOpen());
+			runner.expectEq("size", chd.size(), uint64_t{CHD_HUNKS} * CHD_HUNK_BYTES);
+			
+			const std::vector<std::string> tracks = chd.metadata("CHT2");
+			runner.expect("track metadata", tracks.size() == 1 && tracks[0].rfind("TRACK:1 TYPE:MODE2_RAW", 0) == 0);
+			
+			// Everything in one go, across every hunk boundary and the hole
+			std::vector<uint8_t> data(chd.size());
+			runner.expect("read everything", chd.read(0, data.data(), data.size()));
+			
+			int mismatches = 0;
+			
+			for (size_t i = 0; i < data.size(); i++)
+				mismatches += data[i] != chdByte(i);
+			
+			runner.expectEq("bytes differing", mismatches, 0);
+			
+			uint8_t byte;
+			runner.expect("nothing past the end", !chd.read(chd.size(), &byte, 1));
+			runner.expect("last byte", chd.read(chd.size() - 1, &byte, 1) && byte == chdByte(chd.size() - 1));
+		});
+		
+		runner.test("CHD cache eviction", [&] {
+			ChdFile chd(path);
+			uint8_t byte = 0;
+			
+			auto touch = [&](uint32_t hunk) {
+				chd.read(uint64_t{hunk} * CHD_HUNK_BYTES + 100, &byte, 1);
+				return chd.misses();
+			};
+			
+			for (uint32_t hunk = 0; hunk < ChdFile::CACHE_HUNKS; hunk++)
+				touch(hunk);
+			
+			runner.expectEq("filling the cache", chd.misses(), ChdFile::CACHE_HUNKS);
+			runner.expectEq("every hunk still there", touch(0), ChdFile::CACHE_HUNKS);
+			
+			// Hunk 0 was just used, 1 is the oldest now
+			runner.expectEq("one past the cache", touch(16), ChdFile::CACHE_HUNKS + 1);
+			runner.expectEq("recently used one kept", touch(0), ChdFile::CACHE_HUNKS + 1);
+			runner.expectEq("oldest one dropped", touch(1), ChdFile::CACHE_HUNKS + 2);
+			
+			// Which pushed out 2, and 3 stays
+			runner.expectEq("next oldest kept", touch(3), ChdFile::CACHE_HUNKS + 2);
+			runner.expectEq("next oldest dropped", touch(2), ChdFile::CACHE_HUNKS + 3);
+			runner.expect("right data after eviction", byte == chdByte(uint64_t{2} * CHD_HUNK_BYTES + 100));
+		});
+		
+		runner.test("CHD reads from two threads", [&] {
+			ChdFile chd(path);
+			chd.setPrefetch(true);
+			
+			// Both decompress misses without the lock, each with its own codecs
+			auto readAll = [&](int& mismatches) {
+				for (int pass = 0; pass < 4; pass++) {
+					std::vector<uint8_t> data(chd.size());
+					
+					if (!chd.read(0, data.data(), data.size())) {
+						mismatches++;
+						continue;
+					}
+					
+					for (size_t i = 0; i < data.size(); i++)
+						mismatches += data[i] != chdByte(i);
+				}
+			};
+			
+			int first = 0;
+			int second = 0;
+			
+			std::thread other([&] { readAll(second); });
+			readAll(first);
+			other.join();
+			
+			runner.expectEq("bytes differing on this thread", first, 0);
+			runner.expectEq("bytes differing on the other", second, 0);
+		});
+		
+
+		std::error_code ignored;
+		std::filesystem::remove(path, ignored);
+	}
+	
+	// Frames numbered from 'first' on, left and right apart
+	std::vector<CdAudioRing::Frame> numberedFrames(size_t count, int first) {
+		std::vector<CdAudioRing::Frame> frames(count);
+		
+		for (size_t i = 0; i < count; i++) {
+			const auto value = static_cast<int16_t>(first + static_cast<int>(i));
+			frames[i] = {value, static_cast<int16_t>(-value)};
+		}
+		
+		return frames;
+	}
+	
+	// Index of the first frame not numbered from 'first' on, 'count' if there's none
+	size_t firstMisnumbered(const CdAudioRing::Frame* frames, size_t count, int first) {
+		const std::vector<CdAudioRing::Frame> wanted = numberedFrames(count, first);
+		
+		for (size_t i = 0; i < count; i++) {
+			if (frames[i].left != wanted[i].left || frames[i].right != wanted[i].right)
+				return i;
+		}
+		
+		return count;
+	}
+	
+	void testRings(Runner& runner) {
+		runner.test("CD audio ring wraparound", [&] {
+			CdAudioRing ring;
+			std::vector<CdAudioRing::Frame> out(CdAudioRing::CAPACITY);
+			
+			// Leaves the next push 100 frames before the end
+			const std::vector<CdAudioRing::Frame> filler = numberedFrames(CdAudioRing::CAPACITY - 100, 0);
+			ring.push(filler.data(), filler.size());
+			ring.pop(out.data(), filler.size());
+			
+			const std::vector<CdAudioRing::Frame> frames = numberedFrames(300, 1000);
+			
+			runner.expectEq("frames across the end pushed", ring.push(frames.data(), frames.size()), 300);
+			runner.expectEq("size", ring.size(), 300);
+			runner.expectEq("frames across the end popped", ring.pop(out.data(), 300), 300);
+			runner.expectEq("in order", firstMisnumbered(out.data(), 300, 1000), 300);
+			runner.expectEq("empty after", ring.size(), 0);
+			
+			// Not a power of two, single items and reservations
+			Emulator::Utils::SpscRing<uint32_t> words(6);
+			
+			for (uint32_t i = 0; i < 4; i++)
+				words.push(i);
+			
+			words.pop(4);
+			
+			runner.expect("reservation that would wrap refused", words.reserve(3) == nullptr);
+			runner.expect("reservation up to the end", words.reserve(2) != nullptr);
+			
+			for (uint32_t i = 4; i < 10; i++)
+				runner.expect("push " + std::to_string(i), words.push(i));
+			
+			runner.expect("push when full", !words.push(10));
+			
+			for (uint32_t i = 4; i < 10; i++) {
+				const uint32_t* word = words.front();
+				runner.expectEq("word " + std::to_string(i), word ? *word : UINT32_MAX, i);
+				words.pop();
+			}
+			
+			runner.expect("empty after", words.front() == nullptr);
+		});
+		
+		runner.test("CD audio ring clear", [&] {
+			CdAudioRing ring;
+			std::vector<CdAudioRing::Frame> out(CdAudioRing::CAPACITY);
+			
+			const std::vector<CdAudioRing::Frame> stale = numberedFrames(CdAudioRing::CAPACITY, 0);
+			runner.expectEq("filled", ring.push(stale.data(), stale.size()), CdAudioRing::CAPACITY);
+			
+			ring.clear();
+			runner.expectEq("size after clear", ring.size(), 0);
+			
+			// The consumer never took the stale frames, they still don't take up room
+			const std::vector<CdAudioRing::Frame> fresh = numberedFrames(CdAudioRing::CAPACITY, 5000);
+			runner.expectEq("room after clear", ring.push(fresh.data(), fresh.size()), CdAudioRing::CAPACITY);
+			runner.expectEq("no overflow", ring.overflows(), 0);
+			
+			runner.expectEq("popped", ring.pop(out.data(), out.size()), CdAudioRing::CAPACITY);
+			runner.expectEq("only frames after the clear", firstMisnumbered(out.data(), out.size(), 5000), CdAudioRing::CAPACITY);
+		});
+		
+		runner.test("CD audio ring overflow and underflow", [&] {
+			CdAudioRing ring;
+			std::vector<CdAudioRing::Frame> out(64);
+			
+			// An idle ring running dry isn't a gap
+			runner.expectEq("nothing on an idle ring", ring.pop(out.data(), 64), 0);
+			runner.expectEq("idle underflows", ring.underflows(), 0);
+			
+			const std::vector<CdAudioRing::Frame> frames = numberedFrames(CdAudioRing::CAPACITY + 10, 0);
+			runner.expectEq("pushed on a full ring", ring.push(frames.data(), frames.size()), CdAudioRing::CAPACITY);
+			runner.expectEq("overflows", ring.overflows(), 10);
+			
+			std::vector<CdAudioRing::Frame> all(CdAudioRing::CAPACITY - 32);
+			ring.pop(all.data(), all.size());
+			
+			runner.expectEq("short pop", ring.pop(out.data(), 64), 32);
+			runner.expectEq("underflow after running dry", ring.underflows(), 1);
+			
+			ring.pop(out.data(), 64);
+			runner.expectEq("stays dry without counting again", ring.underflows(), 1);
+			
+			ring.push(frames.data(), 64);
+			ring.pop(out.data(), 64);
+			ring.pop(out.data(), 64);
+			runner.expectEq("underflow after the next gap", ring.underflows(), 2);
+		});
+		
+		runner.test("Ring across threads", [&] {
+			constexpr uint32_t WORDS = 1000000;
+			
+			Emulator::Utils::SpscRing<uint32_t> ring(1000);
+			Emulator::Utils::Worker worker;
+			
+			uint32_t expected = 0;
+			uint32_t misordered = 0;
+			
+			worker.start([&] {
+				const uint32_t* word = ring.front();
+				
+				if (!word)
+					return false;
+				
+				do {
+					misordered += *word != expected++;
+					ring.pop();
+				} while ((word = ring.front()));
+				
+				return true;
+			});
+			
+			for (uint32_t i = 0; i < WORDS; i++) {
+				while (!ring.push(i))
+					std::this_thread::yield();
+				
+				worker.wake();
+			}
+			
+			worker.waitUntil([&] { return ring.empty(); });
+			worker.stop();
+			
+			runner.expectEq("words taken", expected, WORDS);
+			runner.expectEq("out of order", misordered, 0);
+		});
+	}
+} // namespace
+
+bool CdromTests::runAll() {
+	Runner runner;
+	
+	testXaImpulse(runner);
+	testXaFormats(runner);
+	testXaStateAcrossSectors(runner);
+	testXaFilter(runner);
+	testFlac(runner);
+	testChd(runner);
+	testRings(runner);
+	
+	std::cerr << "CDROM tests: " << runner.passed << " passed, " << runner.failed << " failed\n";
+	
+	for (const std::string& failure : runner.failures)
+		std::cerr << "  " << failure << '\n';
+	
+	return runner.failed == 0;
+}
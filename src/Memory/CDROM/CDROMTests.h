@@ -0,0 +1,5 @@
+#pragma once
+
+namespace CdromTests {
+	bool runAll();
+}
@@ -0,0 +1,822 @@
+#include "ChdFile.h"
+
+#include <algorithm>
+#include <array>
+#include <cstdio>
+#include <cstring>
+
+#include "BitReader.h"
+#include "FlacDecoder.h"
+
+#ifdef PSX_ZLIB
+#include <zlib.h>
+#endif
+
+#ifdef PSX_LZMA
+#include <lzma.h>
+#endif
+
+namespace {
+	constexpr uint32_t makeTag(const char (&name)[5]) {
+		return (static_cast<uint32_t>(static_cast<uint8_t>(name[0])) << 24) |
+		       (static_cast<uint32_t>(static_cast<uint8_t>(name[1])) << 16) |
+		       (static_cast<uint32_t>(static_cast<uint8_t>(name[2])) << 8) |
+		       static_cast<uint32_t>(static_cast<uint8_t>(name[3]));
+	}
+
+	constexpr uint32_t CODEC_ZLIB = makeTag("zlib");
+	constexpr uint32_t CODEC_LZMA = makeTag("lzma");
+	constexpr uint32_t CODEC_CD_ZLIB = makeTag("cdzl");
+	constexpr uint32_t CODEC_CD_LZMA = makeTag("cdlz");
+	constexpr uint32_t CODEC_CD_FLAC = makeTag("cdfl");
+
+	// How a hunk is stored, 0 to 3 being the codecs in the header.
+	// The ones after 'HUNK_PARENT' only show up in the compressed map.
+	enum : uint8_t {
+		HUNK_NONE = 4,
+		HUNK_SELF = 5,
+		HUNK_PARENT = 6,
+		HUNK_RLE_SMALL = 7,
+		HUNK_RLE_LARGE = 8,
+		HUNK_SELF_0 = 9,
+		HUNK_SELF_1 = 10,
+		HUNK_PARENT_SELF = 11,
+		HUNK_PARENT_0 = 12,
+		HUNK_PARENT_1 = 13,
+	};
+
+	constexpr size_t HEADER_BYTES = 124;
+	constexpr size_t MAP_HEADER_BYTES = 16;
+	constexpr size_t METADATA_HEADER_BYTES = 16;
+
+	constexpr uint32_t SECTOR_BYTES = 2352;
+	constexpr uint32_t SUBCODE_BYTES = 96;
+
+	constexpr uint8_t SYNC[12] = {0x00, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0x00};
+
+	uint64_t readBig(const uint8_t* data, int bytes) {
+		uint64_t value = 0;
+
+		for (int i = 0; i < bytes; i++)
+			value = (value << 8) | data[i];
+
+		return value;
+	}
+
+	// CRC-16/CCITT, what the map and every hunk are checked with
+	uint16_t crc16(const uint8_t* data, size_t size, uint16_t crc = 0xFFFF) {
+		static const auto table = [] {
+			std::array<uint16_t, 256> table{};
+
+			for (uint32_t i = 0; i < 256; i++) {
+				uint32_t value = i << 8;
+
+				for (int bit = 0; bit < 8; bit++)
+					value = (value & 0x8000) ? (value << 1) ^ 0x1021 : value << 1;
+
+				table[i] = static_cast<uint16_t>(value);
+			}
+
+			return table;
+		}();
+
+		for (size_t i = 0; i < size; i++)
+			crc = static_cast<uint16_t>((crc << 8) ^ table[(crc >> 8) ^ data[i]]);
+
+		return crc;
+	}
+
+	// P and Q parity of a data sector, which the CD codecs leave out when
+	// they can be worked out again. Mode 2 doesn't count the header.
+	void generateEcc(uint8_t* sector) {
+		struct Tables {
+			uint8_t low[256];
+			uint8_t high[256];
+		};
+
+		// Multiplying by 2, and dividing by 3, in GF(2^8)
+		static const Tables tables = [] {
+			Tables tables{};
+
+			for (uint32_t i = 0; i < 256; i++) {
+				const uint32_t low = (i << 1) ^ ((i & 0x80) ? 0x11D : 0);
+
+				tables.low[i] = static_cast<uint8_t>(low);
+				tables.high[(low ^ i) & 0xFF] = static_cast<uint8_t>(i);
+			}
+
+			return tables;
+		}();
+
+		const bool mode2 = sector[15] == 2;
+
+		auto source = [&](uint32_t offset) -> uint8_t {
+			return (mode2 && offset < 4) ? 0 : sector[12 + offset];
+		};
+
+		auto parity = [&](uint8_t* out, uint32_t stride, int components, auto offsetOf) {
+			for (uint32_t byte = 0; byte < stride; byte++) {
+				uint8_t first = 0;
+				uint8_t second = 0;
+
+				for (int component = 0; component < components; component++) {
+					const uint8_t value = source(offsetOf(byte, component));
+
+					first = tables.low[first ^ value];
+					second ^= value;
+				}
+
+				first = tables.high[tables.low[first] ^ second];
+
+				out[byte] = first;
+				out[stride + byte] = second ^ first;
+			}
+		};
+
+		// P goes down the columns of 43 words, Q along the diagonals
+		parity(sector + 0x81C, 86, 24, [](uint32_t byte, int component) {
+			return byte + 86 * component;
+		});
+
+		parity(sector + 0x8C8, 52, 43, [](uint32_t byte, int component) {
+			return 2 * ((43 * (byte / 2) + 44 * component) % 1118) + (byte & 1);
+		});
+	}
+
+	bool isSupported(uint32_t codec) {
+		if (codec == 0)
+			return true;
+
+#ifdef PSX_ZLIB
+		// The CD codecs all keep the subcode in zlib
+		if (codec == CODEC_ZLIB || codec == CODEC_CD_ZLIB || codec == CODEC_CD_FLAC)
+			return true;
+#ifdef PSX_LZMA
+		if (codec == CODEC_CD_LZMA)
+			return true;
+#endif
+#endif
+#ifdef PSX_LZMA
+		if (codec == CODEC_LZMA)
+			return true;
+#endif
+
+		return false;
+	}
+
+	// The map stores hunk types with a Huffman code of 16 symbols, up to 8 bits long
+	class HuffmanDecoder {
+	public:
+		bool import(BitReader& bits) {
+			uint8_t lengths[16]{};
+			int symbol = 0;
+
+			// Run length coded lengths, 1 is an escape
+			while (symbol < 16) {
+				uint32_t length = bits.read(4);
+
+				if (length != 1) {
+					lengths[symbol++] = length;
+					continue;
+				}
+
+				length = bits.read(4);
+
+				if (length == 1) {
+					lengths[symbol++] = 1;
+					continue;
+				}
+
+				const int repeat = static_cast<int>(bits.read(4)) + 3;
+
+				if (symbol + repeat > 16)
+					return false;
+
+				for (int i = 0; i < repeat; i++)
+					lengths[symbol++] = length;
+			}
+
+			// Canonical codes, the longest ones first
+			uint32_t starts[9]{};
+
+			for (uint8_t length : lengths) {
+				if (length > 8)
+					return false;
+
+				starts[length]++;
+			}
+
+			uint32_t start = 0;
+
+			for (int length = 8; length > 0; length--) {
+				const uint32_t next = (start + starts[length]) >> 1;
+
+				if (length != 1 && next * 2 != start + starts[length])
+					return false;
+
+				starts[length] = start;
+				start = next;
+			}
+
+			for (int i = 0; i < 16; i++) {
+				const int length = lengths[i];
+
+				if (length == 0)
+					continue;
+
+				const uint32_t code = starts[length]++;
+				const uint32_t first = code << (8 - length);
+				const uint32_t last = (code + 1) << (8 - length);
+
+				for (uint32_t entry = first; entry < last && entry < 256; entry++)
+					_lookup[entry] = static_cast<uint16_t>((i << 5) | length);
+			}
+
+			return !bits.overrun();
+		}
+
+		uint8_t decode(BitReader& bits) const {
+			const uint16_t entry = _lookup[bits.peek(8)];
+			bits.skip(entry & 0x1F);
+
+			return static_cast<uint8_t>(entry >> 5);
+		}
+
+	private:
+		uint16_t _lookup[256]{};
+	};
+}
+
+struct ChdFile::Codecs {
+	Codecs() {
+#ifdef PSX_ZLIB
+		inflateInit2(&zlib, -MAX_WBITS);
+#endif
+	}
+
+	~Codecs() {
+#ifdef PSX_ZLIB
+		inflateEnd(&zlib);
+#endif
+#ifdef PSX_LZMA
+		lzma_end(&lzma);
+#endif
+	}
+
+	Codecs(const Codecs&) = delete;
+	Codecs& operator=(const Codecs&) = delete;
+
+	// Raw deflate, without the zlib header
+	bool inflate(const uint8_t* data, size_t size, uint8_t* out, size_t outSize) {
+#ifdef PSX_ZLIB
+		if (inflateReset(&zlib) != Z_OK)
+			return false;
+
+		zlib.next_in = const_cast<Bytef*>(data);
+		zlib.avail_in = static_cast<uInt>(size);
+		zlib.next_out = out;
+		zlib.avail_out = static_cast<uInt>(outSize);
+
+		::inflate(&zlib, Z_FINISH);
+
+		return zlib.total_out == outSize;
+#else
+		return false;
+#endif
+	}
+
+	// Raw LZMA without an end marker, as the LZMA SDK writes it at level 9
+	bool unlzma(const uint8_t* data, size_t size, uint8_t* out, size_t outSize) {
+#ifdef PSX_LZMA
+		// The SDK shrinks the dictionary to fit what's being compressed
+		uint32_t dictionary = 1u << 26;
+
+		for (int i = 11; i <= 30; i++) {
+			if (outSize <= (2ull << i)) {
+				dictionary = 2u << i;
+				break;
+			}
+
+			if (outSize <= (3ull << i)) {
+				dictionary = 3u << i;
+				break;
+			}
+		}
+
+		lzma_options_lzma options{};
+		options.dict_size = dictionary;
+		options.lc = 3;
+		options.lp = 0;
+		options.pb = 2;
+
+		const lzma_filter filters[] = {
+			{LZMA_FILTER_LZMA1, &options},
+			{LZMA_VLI_UNKNOWN, nullptr},
+		};
+
+		if (lzma_raw_decoder(&lzma, filters) != LZMA_OK)
+			return false;
+
+		lzma.next_in = data;
+		lzma.avail_in = size;
+		lzma.next_out = out;
+		lzma.avail_out = outSize;
+
+		// Done once the output is full, there's nothing marking the end
+		while (lzma.avail_out > 0 && lzma_code(&lzma, LZMA_RUN) == LZMA_OK) {
+		}
+
+		return lzma.avail_out == 0;
+#else
+		return false;
+#endif
+	}
+
+#ifdef PSX_ZLIB
+	z_stream zlib{};
+#endif
+#ifdef PSX_LZMA
+	lzma_stream lzma = LZMA_STREAM_INIT;
+#endif
+
+	FlacDecoder flac;
+
+	// Sectors and then subcode of a CD hunk, before they're put back together
+	std::vector<uint8_t> buffer;
+};
+
+ChdFile::ChdFile(const std::string& path, bool preload) : _file(path, preload) {
+	if (!_file.isOpen())
+		return;
+
+	if (!readHeader() || !readMap()) {
+		std::printf("Unable to read CHD file %s\n", path.c_str());
+		_map.clear();
+		return;
+	}
+
+	for (uint32_t codec : _compressors) {
+		if (!isSupported(codec)) {
+			std::printf("CHD file %s uses the unsupported codec '%c%c%c%c'\n", path.c_str(),
+			            codec >> 24, (codec >> 16) & 0xFF, (codec >> 8) & 0xFF, codec & 0xFF);
+		}
+	}
+
+	_spareCodecs.push_back(std::make_unique<Codecs>());
+	_cache.resize(CACHE_HUNKS);
+
+	for (CachedHunk& hunk : _cache) {
+		hunk.index = NONE;
+		hunk.used = 0;
+		hunk.data.resize(_hunkBytes);
+	}
+}
+
+ChdFile::~ChdFile() {
+	setPrefetch(false);
+}
+
+bool ChdFile::readHeader() {
+	const uint8_t* header = _file.data();
+
+	if (_file.size() < HEADER_BYTES || std::memcmp(header, "MComprHD", 8) != 0)
+		return false;
+
+	const auto version = static_cast<uint32_t>(readBig(header + 12, 4));
+
+	if (version != 5) {
+		std::printf("Only version 5 CHD files are supported, not %u\n", version);
+		return false;
+	}
+
+	for (int i = 0; i < 4; i++)
+		_compressors[i] = static_cast<uint32_t>(readBig(header + 16 + i * 4, 4));
+
+	_logicalBytes = readBig(header + 32, 8);
+	_mapOffset = readBig(header + 40, 8);
+	_metaOffset = readBig(header + 48, 8);
+	_hunkBytes = static_cast<uint32_t>(readBig(header + 56, 4));
+	_unitBytes = static_cast<uint32_t>(readBig(header + 60, 4));
+
+	if (_hunkBytes == 0 || _unitBytes == 0)
+		return false;
+
+	const uint64_t hunks = (_logicalBytes + _hunkBytes - 1) / _hunkBytes;
+
+	if (hunks == 0 || hunks >= NONE)
+		return false;
+
+	_hunkCount = static_cast<uint32_t>(hunks);
+
+	// Differences against a parent image, which we'd need to have too
+	if (std::any_of(header + 104, header + 124, [](uint8_t byte) { return byte != 0; }))
+		std::printf("CHD files depending on a parent aren't supported, hunks from it can't be read\n");
+
+	return true;
+}
+
+bool ChdFile::readMap() {
+	const uint8_t* data = _file.data();
+	const size_t size = _file.size();
+
+	// Uncompressed, just where each hunk is in hunks (0 when it's all zeros)
+	if (_compressors[0] == 0) {
+		if (_mapOffset + static_cast<uint64_t>(_hunkCount) * 4 > size)
+			return false;
+
+		_map.resize(_hunkCount);
+
+		for (uint32_t i = 0; i < _hunkCount; i++)
+			_map[i] = {HUNK_NONE, _hunkBytes, readBig(data + _mapOffset + i * 4, 4) * _hunkBytes, 0};
+
+		return true;
+	}
+
+	if (_mapOffset + MAP_HEADER_BYTES > size)
+		return false;
+
+	const uint8_t* header = data + _mapOffset;
+
+	const uint64_t mapBytes = readBig(header, 4);
+	const uint64_t firstOffset = readBig(header + 4, 6);
+	const auto mapCrc = static_cast<uint16_t>(readBig(header + 10, 2));
+	const int lengthBits = header[12];
+	const int selfBits = header[13];
+	const int parentBits = header[14];
+
+	if (_mapOffset + MAP_HEADER_BYTES + mapBytes > size || lengthBits > 32 || selfBits > 32 || parentBits > 32)
+		return false;
+
+	BitReader bits(header + MAP_HEADER_BYTES, mapBytes);
+	HuffmanDecoder huffman;
+
+	if (!huffman.import(bits))
+		return false;
+
+	_map.resize(_hunkCount);
+
+	// Types first, with runs of the same one
+	uint8_t last = 0;
+	uint32_t repeat = 0;
+
+	for (MapEntry& entry : _map) {
+		if (repeat > 0) {
+			entry.type = last;
+			repeat--;
+			continue;
+		}
+
+		const uint8_t type = huffman.decode(bits);
+
+		if (type == HUNK_RLE_SMALL) {
+			repeat = 2 + huffman.decode(bits);
+		} else if (type == HUNK_RLE_LARGE) {
+			repeat = 2 + 16 + (huffman.decode(bits) << 4);
+			repeat += huffman.decode(bits);
+		} else {
+			last = type;
+		}
+
+		entry.type = last;
+	}
+
+	// Then where each one is, compressed hunks follow each other in the file
+	uint64_t offset = firstOffset;
+	uint64_t lastSelf = 0;
+	uint64_t lastParent = 0;
+	uint16_t crc = 0xFFFF;
+
+	for (uint32_t hunk = 0; hunk < _hunkCount; hunk++) {
+		MapEntry& entry = _map[hunk];
+
+		entry.offset = offset;
+		entry.length = 0;
+		entry.crc = 0;
+
+		switch (entry.type) {
+			case 0:
+			case 1:
+			case 2:
+			case 3:
+				entry.length = bits.read(lengthBits);
+				entry.crc = static_cast<uint16_t>(bits.read(16));
+				offset += entry.length;
+				break;
+
+			case HUNK_NONE:
+				entry.length = _hunkBytes;
+				entry.crc = static_cast<uint16_t>(bits.read(16));
+				offset += entry.length;
+				break;
+
+			case HUNK_SELF:
+				entry.offset = lastSelf = bits.read(selfBits);
+				break;
+
+			case HUNK_PARENT:
+				entry.offset = lastParent = bits.read(parentBits);
+				break;
+
+			case HUNK_SELF_1:
+				lastSelf++;
+				[[fallthrough]];
+			case HUNK_SELF_0:
+				entry.type = HUNK_SELF;
+				entry.offset = lastSelf;
+				break;
+
+			case HUNK_PARENT_SELF:
+				entry.type = HUNK_PARENT;
+				entry.offset = lastParent = static_cast<uint64_t>(hunk) * _hunkBytes / _unitBytes;
+				break;
+
+			case HUNK_PARENT_1:
+				lastParent += _hunkBytes / _unitBytes;
+				[[fallthrough]];
+			case HUNK_PARENT_0:
+				entry.type = HUNK_PARENT;
+				entry.offset = lastParent;
+				break;
+
+			default:
+				return false;
+		}
+
+		// The CRC is of the map as it's laid out uncompressed
+		uint8_t raw[12] = {
+			entry.type,
+			static_cast<uint8_t>(entry.length >> 16), static_cast<uint8_t>(entry.length >> 8), static_cast<uint8_t>(entry.length),
+			static_cast<uint8_t>(entry.offset >> 40), static_cast<uint8_t>(entry.offset >> 32), static_cast<uint8_t>(entry.offset >> 24),
+			static_cast<uint8_t>(entry.offset >> 16), static_cast<uint8_t>(entry.offset >> 8), static_cast<uint8_t>(entry.offset),
+			static_cast<uint8_t>(entry.crc >> 8), static_cast<uint8_t>(entry.crc),
+		};
+
+		crc = crc16(raw, sizeof(raw), crc);
+	}
+
+	return !bits.overrun() && crc == mapCrc;
+}
+
+std::vector<std::string> ChdFile::metadata(const char* tag) const {
+	std::vector<std::string> entries;
+
+	const uint8_t* data = _file.data();
+	const size_t size = _file.size();
+
+	// A list of tag, flags, length and the next entry, each followed by its data
+	uint64_t offset = _metaOffset;
+
+	while (offset != 0 && offset + METADATA_HEADER_BYTES <= size) {
+		const uint8_t* entry = data + offset;
+		const auto length = static_cast<size_t>(readBig(entry + 5, 3));
+		const uint64_t next = readBig(entry + 8, 8);
+
+		if (std::memcmp(entry, tag, 4) == 0 && offset + METADATA_HEADER_BYTES + length <= size) {
+			const char* text = reinterpret_cast<const char*>(entry + METADATA_HEADER_BYTES);
+			entries.emplace_back(text, std::find(text, text + length, '\0'));
+		}
+
+		// New entries always go after the old ones
+		if (next <= offset)
+			break;
+
+		offset = next;
+	}
+
+	return entries;
+}
+
+bool ChdFile::read(uint64_t offset, uint8_t* buffer, size_t size) {
+	if (!isOpen() || offset + size > _logicalBytes)
+		return false;
+
+	std::unique_lock lock(_mutex);
+
+	while (size > 0) {
+		const auto hunk = static_cast<uint32_t>(offset / _hunkBytes);
+		const size_t within = offset % _hunkBytes;
+		const size_t count = std::min<size_t>(size, _hunkBytes - within);
+
+		CachedHunk* cached = find(hunk);
+
+		if (!cached) {
+			_misses.fetch_add(1, std::memory_order_relaxed);
+
+			std::unique_ptr<Codecs> codecs;
+
+			if (_spareCodecs.empty()) {
+				codecs = std::make_unique<Codecs>();
+			} else {
+				codecs = std::move(_spareCodecs.back());
+				_spareCodecs.pop_back();
+			}
+
+			// Like 'prefetchNext', so other readers and the prefetch thread
+			// don't wait on a whole hunk being decompressed
+			std::vector<uint8_t> data(_hunkBytes);
+
+			lock.unlock();
+			const bool decompressed = decompress(*codecs, hunk, data.data());
+			lock.lock();
+
+			_spareCodecs.push_back(std::move(codecs));
+
+			if (!decompressed)
+				return false;
+
+			// Another reader might have needed it in the meantime
+			cached = find(hunk);
+
+			if (!cached) {
+				cached = &oldest();
+				cached->index = hunk;
+				cached->data.swap(data);
+			}
+		}
+
+		cached->used = ++_uses;
+		std::memcpy(buffer, cached->data.data() + within, count);
+
+		prefetch(hunk + 1);
+
+		buffer += count;
+		offset += count;
+		size -= count;
+	}
+
+	return true;
+}
+
+bool ChdFile::decompress(Codecs& codecs, uint32_t hunk, uint8_t* out) const {
+	const MapEntry& entry = _map[hunk];
+
+	if (entry.type == HUNK_SELF) {
+		// Same data as an earlier hunk
+		return entry.offset < hunk && decompress(codecs, static_cast<uint32_t>(entry.offset), out);
+	}
+
+	if (entry.type == HUNK_PARENT)
+		return false;
+
+	if (entry.offset + entry.length > _file.size())
+		return false;
+
+	const uint8_t* data = _file.data() + entry.offset;
+
+	if (entry.type == HUNK_NONE) {
+		// Uncompressed images leave a hole for hunks of zeros
+		if (_compressors[0] == 0) {
+			if (entry.offset == 0)
+				std::memset(out, 0, _hunkBytes);
+			else
+				std::memcpy(out, data, _hunkBytes);
+
+			return true;
+		}
+
+		std::memcpy(out, data, _hunkBytes);
+
+		return crc16(out, _hunkBytes) == entry.crc;
+	}
+
+	const uint32_t codec = _compressors[entry.type];
+	bool decompressed = false;
+
+	if (codec == CODEC_ZLIB)
+		decompressed = codecs.inflate(data, entry.length, out, _hunkBytes);
+	else if (codec == CODEC_LZMA)
+		decompressed = codecs.unlzma(data, entry.length, out, _hunkBytes);
+	else if (codec == CODEC_CD_ZLIB || codec == CODEC_CD_LZMA || codec == CODEC_CD_FLAC)
+		decompressed = decompressCd(codecs, codec, data, entry.length, out);
+
+	return decompressed && crc16(out, _hunkBytes) == entry.crc;
+}
+
+bool ChdFile::decompressCd(Codecs& codecs, uint32_t codec, const uint8_t* data, size_t size, uint8_t* out) const {
+	const uint32_t frames = _hunkBytes / FRAME_BYTES;
+	const size_t sectorBytes = static_cast<size_t>(frames) * SECTOR_BYTES;
+	const size_t subcodeBytes = static_cast<size_t>(frames) * SUBCODE_BYTES;
+
+	codecs.buffer.resize(sectorBytes + subcodeBytes);
+
+	uint8_t* sectors = codecs.buffer.data();
+	uint8_t* subcode = sectors + sectorBytes;
+
+	// Bit per frame that had its sync and ECC taken out
+	const uint8_t* eccFlags = nullptr;
+
+	if (codec == CODEC_CD_FLAC) {
+		// Sectors as 16 bit stereo, the subcode right after the last frame
+		const size_t used = codecs.flac.decode(data, size, sectors, sectorBytes / 4);
+
+		if (used == 0 || used > size || !codecs.inflate(data + used, size - used, subcode, subcodeBytes))
+			return false;
+	} else {
+		// ECC flags, then the length of the compressed sectors
+		const size_t eccBytes = (frames + 7) / 8;
+		const int lengthBytes = _hunkBytes < 65536 ? 2 : 3;
+		const size_t headerBytes = eccBytes + lengthBytes;
+
+		if (size < headerBytes)
+			return false;
+
+		const auto baseBytes = static_cast<size_t>(readBig(data + eccBytes, lengthBytes));
+
+		if (headerBytes + baseBytes > size)
+			return false;
+
+		const uint8_t* base = data + headerBytes;
+
+		const bool decompressed = codec == CODEC_CD_LZMA
+		                          ? codecs.unlzma(base, baseBytes, sectors, sectorBytes)
+		                          : codecs.inflate(base, baseBytes, sectors, sectorBytes);
+
+		if (!decompressed || !codecs.inflate(base + baseBytes, size - headerBytes - baseBytes, subcode, subcodeBytes))
+			return false;
+
+		eccFlags = data;
+	}
+
+	for (uint32_t frame = 0; frame < frames; frame++) {
+		uint8_t* sector = out + frame * FRAME_BYTES;
+
+		std::memcpy(sector, sectors + frame * SECTOR_BYTES, SECTOR_BYTES);
+		std::memcpy(sector + SECTOR_BYTES, subcode + frame * SUBCODE_BYTES, SUBCODE_BYTES);
+
+		if (eccFlags && (eccFlags[frame / 8] & (1 << (frame % 8)))) {
+			std::memcpy(sector, SYNC, sizeof(SYNC));
+			generateEcc(sector);
+		}
+	}
+
+	return true;
+}
+
+ChdFile::CachedHunk* ChdFile::find(uint32_t hunk) {
+	for (CachedHunk& cached : _cache) {
+		if (cached.index == hunk)
+			return &cached;
+	}
+
+	return nullptr;
+}
+
+ChdFile::CachedHunk& ChdFile::oldest() {
+	return *std::min_element(_cache.begin(), _cache.end(), [](const CachedHunk& a, const CachedHunk& b) {
+		return a.used < b.used;
+	});
+}
+
+void ChdFile::setPrefetch(bool enabled) {
+	if (enabled == prefetching() || !isOpen())
+		return;
+
+	if (enabled) {
+		_prefetchCodecs = std::make_unique<Codecs>();
+		_prefetchBuffer.resize(_hunkBytes);
+
+		_worker.start([this] { return prefetchNext(); });
+
+		return;
+	}
+
+	_worker.stop();
+	_prefetch = NONE;
+}
+
+void ChdFile::prefetch(uint32_t hunk) {
+	if (!_worker.running() || hunk >= _hunkCount || find(hunk))
+		return;
+
+	_prefetch = hunk;
+	_worker.wake();
+}
+
+bool ChdFile::prefetchNext() {
+	const uint32_t hunk = _prefetch.exchange(NONE);
+
+	if (hunk == NONE)
+		return false;
+
+	bool cached;
+
+	{
+		std::lock_guard lock(_mutex);
+		cached = find(hunk) != nullptr;
+	}
+
+	if (!cached && decompress(*_prefetchCodecs, hunk, _prefetchBuffer.data())) {
+		std::lock_guard lock(_mutex);
+
+		// A reader might have needed it in the meantime
+		if (!find(hunk)) {
+			CachedHunk& slot = oldest();
+
+			slot.index = hunk;
+			slot.used = ++_uses;
+			slot.data.swap(_prefetchBuffer);
+		}
+	}
+
+	return true;
+}
@@ -0,0 +1,123 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "MappedFile.h"
+
+#include "../../Utils/Worker.h"
+
+/**
+ * Disc image in MAME's compressed hunks of data format (CHD, version 5).
+ *
+ * 'read' works like reading a file with the uncompressed data in it: CD
+ * frames of a 2352 byte sector and 96 bytes of subcode, audio big endian,
+ * tracks padded to 4 frames. Decompressed hunks go into a small cache,
+ * and a background thread can decompress the hunk after the one last read
+ * (see 'setPrefetch'), so reading straight through doesn't wait on it.
+ *
+ * Handles the CD codecs (zlib, LZMA and FLAC for sectors, zlib for the
+ * subcode) and plain zlib and LZMA. zlib and LZMA come from the system,
+ * images using them can't be read without 'PSX_ZLIB' or 'PSX_LZMA'.
+ */
+class ChdFile {
+public:
+	// Sector and subcode
+	static constexpr uint32_t FRAME_BYTES = 2448;
+
+	// Hunks kept decompressed, CD images use 8 frames per hunk
+	static constexpr size_t CACHE_HUNKS = 16;
+
+	// 'preload' reads the compressed file into memory, see 'MappedFile'
+	explicit ChdFile(const std::string& path, bool preload = false);
+
+	ChdFile(const ChdFile&) = delete;
+	ChdFile& operator=(const ChdFile&) = delete;
+
+	~ChdFile();
+
+	[[nodiscard]] bool isOpen() const { return !_map.empty(); }
+
+	// Of the uncompressed data
+	[[nodiscard]] uint64_t size() const { return _logicalBytes; }
+
+	// Text of every metadata entry tagged 'tag' ("CHT2" for CD tracks), in order
+	[[nodiscard]] std::vector<std::string> metadata(const char* tag) const;
+
+	// Copies 'size' bytes starting at 'offset' of the uncompressed data,
+	// false if they're past the end or can't be decompressed. Thread safe.
+	bool read(uint64_t offset, uint8_t* buffer, size_t size);
+
+	void setPrefetch(bool enabled);
+	[[nodiscard]] bool prefetching() const { return _worker.running(); }
+
+	// Hunks 'read' didn't find in the cache and decompressed itself
+	[[nodiscard]] uint64_t misses() const { return _misses.load(std::memory_order_relaxed); }
+
+private:
+	struct MapEntry {
+		uint8_t type;
+		uint32_t length;
+		uint64_t offset;
+		uint16_t crc;
+	};
+
+	struct CachedHunk {
+		uint32_t index;
+		uint64_t used;
+		std::vector<uint8_t> data;
+	};
+
+	// Decompressor state, one set per thread decompressing
+	struct Codecs;
+
+	bool readHeader();
+	bool readMap();
+
+	bool decompress(Codecs& codecs, uint32_t hunk, uint8_t* out) const;
+	bool decompressCd(Codecs& codecs, uint32_t codec, const uint8_t* data, size_t size, uint8_t* out) const;
+
+	// Under '_mutex'
+	CachedHunk* find(uint32_t hunk);
+	CachedHunk& oldest();
+	void prefetch(uint32_t hunk);
+
+	// Decompresses the hunk '_prefetch' asks for, false if there isn't one
+	bool prefetchNext();
+
+private:
+	static constexpr uint32_t NONE = UINT32_MAX;
+
+	MappedFile _file;
+
+	uint32_t _compressors[4]{};
+	uint64_t _logicalBytes = 0;
+	uint64_t _mapOffset = 0;
+	uint64_t _metaOffset = 0;
+	uint32_t _hunkBytes = 0;
+	uint32_t _unitBytes = 0;
+	uint32_t _hunkCount = 0;
+
+	std::vector<MapEntry> _map;
+
+	// Readers decompress a missed hunk without '_mutex', each with codecs
+	// taken from '_spareCodecs' and put back afterwards
+	std::mutex _mutex;
+	std::vector<std::unique_ptr<Codecs>> _spareCodecs;
+	std::vector<CachedHunk> _cache;
+	uint64_t _uses = 0;
+	std::atomic<uint64_t> _misses{0};
+
+	// Prefetching, the thread decompresses into its own buffer and only
+	// takes '_mutex' to check the cache and swap the result in
+	std::unique_ptr<Codecs> _prefetchCodecs;
+	std::vector<uint8_t> _prefetchBuffer;
+	std::atomic<uint32_t> _prefetch{NONE};
+
+	// Last, so it stops before anything it uses goes away
+	Emulator::Utils::Worker _worker;
+};
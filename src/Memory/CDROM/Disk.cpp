@@ -1,41 +1,104 @@
 ﻿#include "Disk.h"
 
 #include <algorithm>
+#include <atomic>
 #include <iostream>
 #include <memory>
 #include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <thread>
+#include <unordered_map>
 
 #include "CDROM.h"
 
 Disk::Disk() = default;
 
-std::vector<uint8_t> Disk::read(Location location) {
-	auto buffer = std::vector<uint8_t>(Sector::RAW_BUFFER, 0);
+SectorSpan Disk::read(Location location) {
+	FilePosition position{};
 	
-	int pos = getTrackPosition(location);
-	
-	if(pos == -1) {
-		printf("");
+	if (!locate(location, position)) {
 		return {};
 	}
+	
+	const MappedFile* file = position.file;
+	
+	// Raw sectors come straight from the mapping
+	if (file && position.modeType >= Sector::RAW_BUFFER && position.offset >= 0 &&
+	    position.offset + Sector::RAW_BUFFER <= static_cast<int64_t>(file->size())) {
+		return {file->data() + position.offset, Sector::RAW_BUFFER};
+	}
+	
+	// Cooked or compressed sectors and anything past the end of the file
+	readInto(location, _padded.data());
+	
+	return {_padded.data(), _padded.size()};
+}
+
+bool Disk::readInto(Location location, uint8_t* buffer) const {
+	FilePosition position{};
+	
+	if (!locate(location, position)) {
+		return false;
+	}
+	
+	const int64_t offset = position.offset;
+	
+	std::memset(buffer, 0, Sector::RAW_BUFFER);
+	
+	if (position.chd) {
+		const size_t count = std::min<size_t>(position.modeType, Sector::RAW_BUFFER);
 		
-	auto f = fopen(tracks[pos].filePath.c_str(), "rb");
-	if (!f) {
-		std::printf("Unable to load file %s\n", tracks[pos].filePath.c_str());
-		return {};
+		// Anything that doesn't decompress reads as zeros
+		if (offset >= 0 && !position.chd->read(offset, buffer, count)) {
+			std::memset(buffer, 0, Sector::RAW_BUFFER);
+		}
+		
+		if (position.swapBytes) {
+			for (size_t i = 0; i + 1 < count; i += 2) {
+				std::swap(buffer[i], buffer[i + 1]);
+			}
+		}
+		
+		return true;
+	}
+	
+	const MappedFile& file = *position.file;
+	const int64_t size = static_cast<int64_t>(file.size());
+	
+	if (offset >= 0 && offset < size) {
+		const size_t count = std::min<int64_t>({position.modeType, Sector::RAW_BUFFER, size - offset});
+		std::memcpy(buffer, file.data() + offset, count);
+	}
+	
+	return true;
+}
+
+bool Disk::locate(Location location, FilePosition& position) const {
+	int pos = getTrackPosition(location);
+	
+	if (pos == -1) {
+		return false;
 	}
 	
-	auto seek = location - (getTrackBegin(pos) + tracks[pos].pregap);
+	const TrackIndex& track = _index[pos];
 	
-	// 0 -> track num
-	long offset = tracks[pos].fileDataOffset
-	              + (tracks[pos].trackIndex + seek.toLba()) * tracks[pos].modeType;
+	if (track.file ? !track.file->isOpen() : !track.chd->isOpen()) {
+		return false;
+	}
+	
+	position.file = track.file;
+	position.chd = track.chd;
+	position.modeType = tracks[pos].modeType;
+	position.offset = track.fileOffset + (static_cast<int64_t>(location.toLba()) - track.start) * track.stride;
+	position.swapBytes = track.chd && tracks[pos].mode == "AUDIO";
 	
-	fseek(f, offset, SEEK_SET);
-	fread(buffer.data(), 1, std::min<size_t>(tracks[pos].modeType, buffer.size()), f);
-	fclose(f);
+	// A pregap that isn't in the file
+	if (position.offset < track.fileStart) {
+		position.offset = -1;
+	}
 	
-	return buffer;
+	return true;
 }
 
 bool Disk::isAudio(Location location) {
@@ -43,48 +106,119 @@ bool Disk::isAudio(Location location) {
 	return pos >= 0 && tracks[pos].mode == "AUDIO";
 }
 
-void Disk::set(const std::string& path) {
+void Disk::set(const std::string& path, bool preload) {
 	tracks.clear();
 	tracks = _builder.parseFile(path);
+	
+	_files.clear();
+	_chds.clear();
+	_index.clear();
+	_end = 75 * 2;
+	
+	// Every file once, tracks tend to share one
+	std::vector<std::string> paths;
+	std::unordered_map<std::string, size_t> fileIndices;
+	
+	for (const Track& track : tracks) {
+		if (fileIndices.emplace(track.filePath, paths.size()).second) {
+			paths.push_back(track.filePath);
+		}
+	}
+	
+	openFiles(paths, preload);
+	
+	for (const Track& track : tracks) {
+		const size_t file = fileIndices[track.filePath];
+		
+		TrackIndex index{};
+		index.file = _files[file].get();
+		index.chd = _chds[file].get();
+		index.stride = index.chd ? ChdFile::FRAME_BYTES : track.modeType;
+		index.begin = _end;
+		index.start = _end + track.pregap.toLba();
+		index.end = index.start + track.sectorCount;
+		index.fileOffset = track.fileDataOffset + static_cast<int64_t>(track.trackIndex) * index.stride;
+		index.fileStart = track.fileDataOffset;
+		
+		_index.push_back(index);
+		_end = index.end;
+	}
 }
 
-Location Disk::getSize() {
-	size_t frames = 75 * 2;
+void Disk::openFiles(const std::vector<std::string>& paths, bool preload) {
+	// One of the two for each path
+	_files.resize(paths.size());
+	_chds.resize(paths.size());
+	
+	auto open = [&](size_t i) {
+		if (std::filesystem::path(paths[i]).extension() == ".chd") {
+			_chds[i] = std::make_unique<ChdFile>(paths[i], preload);
+		} else {
+			_files[i] = std::make_unique<MappedFile>(paths[i], preload);
+		}
+	};
 	
-	for(auto t : tracks) {
-		frames += t.pregap.toLba() + t.sectorCount;
+	if (!preload || paths.size() == 1) {
+		for (size_t i = 0; i < paths.size(); i++) {
+			open(i);
+		}
+	} else {
+		// Loading is mostly waiting on storage, so the threads don't need a core each
+		std::atomic<size_t> next{0};
+		std::vector<std::thread> loaders(std::min(paths.size(), PRELOAD_THREADS));
+		
+		for (std::thread& loader : loaders) {
+			loader = std::thread([&] {
+				for (size_t i = next++; i < paths.size(); i = next++) {
+					open(i);
+				}
+			});
+		}
+		
+		for (std::thread& loader : loaders) {
+			loader.join();
+		}
+	}
+	
+	for (const std::unique_ptr<ChdFile>& chd : _chds) {
+		// Reading goes straight through a track, keep the next hunk ready
+		if (chd) {
+			chd->setPrefetch(true);
+		}
 	}
 	
-	return Location::fromLBA(frames);
+	if (preload) {
+		std::cerr << "Preloaded " << paths.size() << " disc image file(s) into memory\n";
+	}
+}
+
+Location Disk::getSize() {
+	return Location::fromLBA(_end);
 }
 
 Location Disk::getTrackStart(int track) {
-	return getTrackBegin(track) + tracks[track].pregap;
+	return Location::fromLBA(_index[track].start);
 }
 
-int Disk::getTrackPosition(Location loc) {
-	for(int i = 0; i < tracks.size(); i++) {
-		auto begin = getTrackBegin(i);
-		auto end = getTrackLength(i);
-		
-		if(loc >= begin && loc < begin + end) {
-			return i;
-		}
+int Disk::getTrackPosition(Location loc) const {
+	const uint32_t lba = loc.toLba();
+	
+	// First track ending after it
+	auto it = std::upper_bound(_index.begin(), _index.end(), lba, [](uint32_t lba, const TrackIndex& track) {
+		return lba < track.end;
+	});
+	
+	if (it == _index.end() || lba < it->begin) {
+		return -1;
 	}
 	
-	return -1;
+	return static_cast<int>(it - _index.begin());
 }
 
 Location Disk::getTrackBegin(int track) {
-	size_t total = 75 * 2;
-	
-	for (int i = 0; i < track; i++) {
-		total += tracks[i].pregap.toLba() + tracks[i].sectorCount;
-	}
-	
-	return Location::fromLBA(total);
+	return Location::fromLBA(_index[track].begin);
 }
 
 Location Disk::getTrackLength(int track) {
-	return Location::fromLBA(tracks[track].pregap.toLba() + tracks[track].sectorCount);
+	return Location::fromLBA(_index[track].end - _index[track].begin);
 }
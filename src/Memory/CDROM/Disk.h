@@ -1,6 +1,10 @@
 ﻿#pragma once
+#include <array>
+#include <memory>
 #include <string>
 
+#include "ChdFile.h"
+#include "MappedFile.h"
 #include "Sector.h"
 #include "TrackBuilder.h"
 
@@ -8,28 +12,89 @@
 
 class Location;
 
+// The bytes of a sector, pointing straight into the disc image.
+// Only good until the next 'Disk::read' or 'Disk::set'.
+struct SectorSpan {
+	const uint8_t* data = nullptr;
+	size_t size = 0;
+	
+	[[nodiscard]] bool empty() const { return size == 0; }
+};
+
 class Disk {
 public:
 	Disk();
 	
-	std::vector<uint8_t> read(Location location);
+	SectorSpan read(Location location);
 	bool isAudio(Location location);
 	
-	void set(const std::string& path);
+	// Copy of the sector (zero padded like 'read'), false if it's not on the disc.
+	// Doesn't touch anything 'read' does, so it can run on another thread.
+	bool readInto(Location location, uint8_t* buffer) const;
+	
+	// 'preload' reads every file into memory up front (in parallel), so
+	// reading never waits on storage after this
+	void set(const std::string& path, bool preload = false);
 	
 public:
 	Location getSize();
 	Location getTrackStart(int i);
 
 private:
-	int getTrackPosition(Location location);
+	static constexpr size_t PRELOAD_THREADS = 8;
+	
+	void openFiles(const std::vector<std::string>& paths, bool preload);
+	
+	int getTrackPosition(Location location) const;
 	
 	Location getTrackBegin(int track);
 	Location getTrackLength(int track);
 	
 private:
+	// Where a sector is in its file, one of 'file' and 'chd'
+	struct FilePosition {
+		const MappedFile* file;
+		ChdFile* chd;
+		int64_t offset;
+		uint32_t modeType;
+		
+		// CHD audio is stored big endian
+		bool swapBytes;
+	};
+	
+	bool locate(Location location, FilePosition& position) const;
+	
+	// Where a track is on the disc and in its file, see 'set'
+	struct TrackIndex {
+		// LBAs, 'begin' includes the pregap and 'start' doesn't
+		uint32_t begin;
+		uint32_t start;
+		uint32_t end;
+		
+		// Of 'start', can be negative if the pregap isn't in the file.
+		// Sectors before 'fileStart' aren't in it either.
+		int64_t fileOffset;
+		int64_t fileStart;
+		
+		// Bytes from one sector to the next, CHD frames carry subcode
+		uint32_t stride;
+		
+		const MappedFile* file;
+		ChdFile* chd;
+	};
+	
 	TrackBuilder _builder;
 	
+	// Every file once, tracks tend to share one. Same index in both,
+	// only one of them is set.
+	std::vector<std::unique_ptr<MappedFile>> _files;
+	std::vector<std::unique_ptr<ChdFile>> _chds;
+	std::vector<TrackIndex> _index;
+	uint32_t _end = 75 * 2;
+	
+	// Sectors the file doesn't have all 2352 bytes of, zero padded
+	std::array<uint8_t, Sector::RAW_BUFFER> _padded{};
+	
 public:
 	std::vector<Track> tracks;
 };
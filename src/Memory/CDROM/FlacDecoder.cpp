@@ -0,0 +1,252 @@
+#include "FlacDecoder.h"
+
+#include <algorithm>
+
+#include "BitReader.h"
+
+size_t FlacDecoder::decode(const uint8_t* data, size_t size, uint8_t* out, size_t samples) {
+	BitReader bits(data, size);
+
+	while (samples > 0) {
+		size_t blockSize = 0;
+
+		if (!decodeFrame(bits, blockSize) || bits.overrun())
+			return 0;
+
+		const size_t count = std::min(blockSize, samples);
+
+		for (size_t i = 0; i < count; i++) {
+			for (const std::vector<int32_t>& channel : _channels) {
+				const auto sample = static_cast<uint16_t>(channel[i]);
+				*out++ = static_cast<uint8_t>(sample >> 8);
+				*out++ = static_cast<uint8_t>(sample);
+			}
+		}
+
+		samples -= count;
+	}
+
+	return bits.position();
+}
+
+bool FlacDecoder::decodeFrame(BitReader& bits, size_t& blockSize) {
+	// Sync code, then a reserved bit and the blocking strategy
+	if (bits.read(14) != 0x3FFE)
+		return false;
+
+	bits.skip(2);
+
+	const uint32_t blockCode = bits.read(4);
+	const uint32_t rateCode = bits.read(4);
+	const uint32_t channelCode = bits.read(4);
+	const uint32_t sizeCode = bits.read(3);
+	bits.skip(1);
+
+	// Frame or sample number, UTF-8 style, nothing needs it
+	const uint32_t first = bits.read(8);
+	int ones = 0;
+
+	while (ones < 8 && (first & (0x80 >> ones)))
+		ones++;
+
+	if (ones == 1 || ones > 7)
+		return false;
+
+	if (ones > 0)
+		bits.skip(8 * (ones - 1));
+
+	if (blockCode == 0)
+		return false;
+	else if (blockCode == 1)
+		blockSize = 192;
+	else if (blockCode <= 5)
+		blockSize = 576 << (blockCode - 2);
+	else if (blockCode == 6)
+		blockSize = bits.read(8) + 1;
+	else if (blockCode == 7)
+		blockSize = bits.read(16) + 1;
+	else
+		blockSize = 256 << (blockCode - 8);
+
+	if (rateCode == 12)
+		bits.skip(8);
+	else if (rateCode == 13 || rateCode == 14)
+		bits.skip(16);
+	else if (rateCode == 15)
+		return false;
+
+	// 0 means the stream header's, which is always 16 bits for a CHD
+	static constexpr int SAMPLE_SIZES[8] = {16, 8, 12, 0, 16, 20, 24, 0};
+	const int bitsPerSample = SAMPLE_SIZES[sizeCode];
+
+	if (bitsPerSample == 0)
+		return false;
+
+	// CRC-8 of the header, the CHD has its own checks
+	bits.skip(8);
+
+	// Independent stereo, left/side, side/right or mid/side
+	if (channelCode != 1 && (channelCode < 8 || channelCode > 10))
+		return false;
+
+	for (int channel = 0; channel < 2; channel++) {
+		_channels[channel].resize(blockSize);
+
+		const bool side = (channelCode == 9) ? channel == 0 : (channelCode != 1 && channel == 1);
+
+		if (!decodeSubframe(bits, _channels[channel].data(), blockSize, bitsPerSample + side) || bits.overrun())
+			return false;
+	}
+
+	// Padding and the CRC-16 of the frame
+	bits.align();
+	bits.skip(16);
+
+	int32_t* left = _channels[0].data();
+	int32_t* right = _channels[1].data();
+
+	for (size_t i = 0; i < blockSize; i++) {
+		if (channelCode == 8) {
+			right[i] = left[i] - right[i];
+		} else if (channelCode == 9) {
+			left[i] += right[i];
+		} else if (channelCode == 10) {
+			const int32_t mid = static_cast<int32_t>(static_cast<uint32_t>(left[i]) << 1) | (right[i] & 1);
+			const int32_t side = right[i];
+
+			left[i] = (mid + side) >> 1;
+			right[i] = (mid - side) >> 1;
+		}
+	}
+
+	return true;
+}
+
+bool FlacDecoder::decodeSubframe(BitReader& bits, int32_t* samples, size_t blockSize, int bitsPerSample) {
+	if (bits.read(1) != 0)
+		return false;
+
+	const uint32_t type = bits.read(6);
+	int wasted = 0;
+
+	if (bits.read(1))
+		wasted = static_cast<int>(bits.readUnary()) + 1;
+
+	bitsPerSample -= wasted;
+
+	if (bitsPerSample <= 0)
+		return false;
+
+	if (type == 0) {
+		// Constant
+		std::fill_n(samples, blockSize, bits.readSigned(bitsPerSample));
+	} else if (type == 1) {
+		// Verbatim
+		for (size_t i = 0; i < blockSize; i++)
+			samples[i] = bits.readSigned(bitsPerSample);
+	} else if (type >= 8 && type <= 12) {
+		// Fixed polynomial predictor
+		const int order = static_cast<int>(type) - 8;
+
+		if (static_cast<size_t>(order) > blockSize)
+			return false;
+
+		for (int i = 0; i < order; i++)
+			samples[i] = bits.readSigned(bitsPerSample);
+
+		if (!decodeResidual(bits, samples, blockSize, order))
+			return false;
+
+		for (size_t i = order; i < blockSize; i++) {
+			switch (order) {
+				case 1: samples[i] += samples[i - 1]; break;
+				case 2: samples[i] += 2 * samples[i - 1] - samples[i - 2]; break;
+				case 3: samples[i] += 3 * samples[i - 1] - 3 * samples[i - 2] + samples[i - 3]; break;
+				case 4: samples[i] += 4 * samples[i - 1] - 6 * samples[i - 2] + 4 * samples[i - 3] - samples[i - 4]; break;
+				default: break;
+			}
+		}
+	} else if (type >= 32) {
+		// Linear predictor
+		const int order = static_cast<int>(type) - 31;
+
+		if (static_cast<size_t>(order) > blockSize)
+			return false;
+
+		for (int i = 0; i < order; i++)
+			samples[i] = bits.readSigned(bitsPerSample);
+
+		const int precision = static_cast<int>(bits.read(4)) + 1;
+		const int shift = bits.readSigned(5);
+
+		if (precision == 16 || shift < 0)
+			return false;
+
+		int32_t coefficients[32];
+
+		for (int i = 0; i < order; i++)
+			coefficients[i] = bits.readSigned(precision);
+
+		if (!decodeResidual(bits, samples, blockSize, order))
+			return false;
+
+		for (size_t i = order; i < blockSize; i++) {
+			int64_t sum = 0;
+
+			for (int j = 0; j < order; j++)
+				sum += static_cast<int64_t>(coefficients[j]) * samples[i - 1 - j];
+
+			samples[i] += static_cast<int32_t>(sum >> shift);
+		}
+	} else {
+		return false;
+	}
+
+	if (wasted > 0) {
+		for (size_t i = 0; i < blockSize; i++)
+			samples[i] = static_cast<int32_t>(static_cast<uint32_t>(samples[i]) << wasted);
+	}
+
+	return true;
+}
+
+bool FlacDecoder::decodeResidual(BitReader& bits, int32_t* residual, size_t blockSize, int order) {
+	const uint32_t method = bits.read(2);
+
+	if (method > 1)
+		return false;
+
+	// Rice parameters are 4 or 5 bits, all ones escapes to plain numbers
+	const int parameterBits = method ? 5 : 4;
+	const uint32_t escape = method ? 31 : 15;
+
+	const uint32_t partitionOrder = bits.read(4);
+	const size_t partitionSize = blockSize >> partitionOrder;
+
+	if ((partitionSize << partitionOrder) != blockSize || partitionSize < static_cast<size_t>(order))
+		return false;
+
+	size_t i = order;
+
+	for (uint32_t partition = 0; partition < (1u << partitionOrder); partition++) {
+		const size_t end = (partition + 1) * partitionSize;
+		const uint32_t parameter = bits.read(parameterBits);
+
+		if (parameter == escape) {
+			const int size = static_cast<int>(bits.read(5));
+
+			for (; i < end; i++)
+				residual[i] = bits.readSigned(size);
+		} else {
+			for (; i < end; i++) {
+				const uint32_t value = (bits.readUnary() << parameter) | bits.read(static_cast<int>(parameter));
+				residual[i] = static_cast<int32_t>(value >> 1) ^ -static_cast<int32_t>(value & 1);
+			}
+		}
+
+		if (bits.overrun())
+			return false;
+	}
+
+	return true;
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class BitReader;
+
+/**
+ * Just enough of FLAC for the audio hunks of a CHD ('cdfl'): bare frames
+ * without the stream header, two channels of up to 24 bits, and every
+ * subframe type.
+ */
+class FlacDecoder {
+public:
+	// Decodes frames until there are 'samples' stereo samples in 'out', as
+	// interleaved big endian 16 bit words (the way the CHD stores audio).
+	// Returns the bytes of 'data' it went through, 0 if it's broken.
+	size_t decode(const uint8_t* data, size_t size, uint8_t* out, size_t samples);
+
+private:
+	bool decodeFrame(BitReader& bits, size_t& blockSize);
+	bool decodeSubframe(BitReader& bits, int32_t* samples, size_t blockSize, int bitsPerSample);
+	bool decodeResidual(BitReader& bits, int32_t* residual, size_t blockSize, int order);
+
+private:
+	std::vector<int32_t> _channels[2];
+};
@@ -0,0 +1,102 @@
+#include "MappedFile.h"
+
+#include <cstdio>
+
+#include "../../Utils/FileSystem/FileManager.h"
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile(const std::string& path, bool preload) {
+	if (!preload) {
+		map(path);
+		return;
+	}
+	
+	_buffer = Emulator::Utils::FileManager::loadFile(path);
+	
+	if (!_buffer.empty()) {
+		_data = _buffer.data();
+		_size = _buffer.size();
+	}
+}
+
+MappedFile::~MappedFile() {
+	if (!_data || !_buffer.empty())
+		return;
+	
+#if defined(_WIN32)
+	UnmapViewOfFile(_data);
+#else
+	munmap(const_cast<uint8_t*>(_data), _size);
+#endif
+}
+
+#if defined(_WIN32)
+void MappedFile::map(const std::string& path) {
+	HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+	                          FILE_ATTRIBUTE_NORMAL, nullptr);
+	
+	if (file == INVALID_HANDLE_VALUE) {
+		std::printf("Unable to load file %s\n", path.c_str());
+		return;
+	}
+	
+	LARGE_INTEGER size{};
+	
+	if (GetFileSizeEx(file, &size) && size.QuadPart > 0) {
+		HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		
+		if (mapping) {
+			void* memory = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+			
+			if (memory) {
+				_data = static_cast<const uint8_t*>(memory);
+				_size = static_cast<size_t>(size.QuadPart);
+			}
+			
+			// The view keeps the mapping alive
+			CloseHandle(mapping);
+		}
+	}
+	
+	if (!_data)
+		std::printf("Unable to map file %s\n", path.c_str());
+	
+	CloseHandle(file);
+}
+#else
+void MappedFile::map(const std::string& path) {
+	int fd = open(path.c_str(), O_RDONLY);
+	
+	if (fd < 0) {
+		std::printf("Unable to load file %s\n", path.c_str());
+		return;
+	}
+	
+	struct stat info{};
+	
+	if (fstat(fd, &info) == 0 && info.st_size > 0) {
+		void* memory = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		
+		if (memory != MAP_FAILED) {
+			_data = static_cast<const uint8_t*>(memory);
+			_size = info.st_size;
+		}
+	}
+	
+	if (!_data)
+		std::printf("Unable to map file %s\n", path.c_str());
+	
+	// The mapping keeps its own reference to the file
+	close(fd);
+}
+#endif
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * Read only view of a whole file, memory mapped (mmap, or a file mapping
+ * on Windows). 'preload' loads it into memory instead, so reading never
+ * has to wait on storage.
+ */
+class MappedFile {
+public:
+	MappedFile() = default;
+	explicit MappedFile(const std::string& path, bool preload = false);
+	
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+	
+	~MappedFile();
+	
+	[[nodiscard]] bool isOpen() const { return _data != nullptr; }
+	
+	[[nodiscard]] const uint8_t* data() const { return _data; }
+	[[nodiscard]] size_t size() const { return _size; }
+	
+private:
+	void map(const std::string& path);
+	
+private:
+	const uint8_t* _data = nullptr;
+	size_t _size = 0;
+	
+	// Only used when loaded
+	std::vector<uint8_t> _buffer;
+};
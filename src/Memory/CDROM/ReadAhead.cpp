@@ -0,0 +1,124 @@
+#include "ReadAhead.h"
+
+void ReadAhead::setWindow(size_t sectors) {
+	if (sectors == _window)
+		return;
+	
+	stop();
+	
+	_window = sectors;
+	_slots = sectors ? std::make_unique<Emulator::Utils::SpscRing<Slot>>(sectors) : nullptr;
+}
+
+void ReadAhead::restart(const Disk& disk, uint32_t lba) {
+	if (_window == 0)
+		return;
+	
+	if (!_worker.running()) {
+		_disk = &disk;
+		_current = IDLE;
+		_reading = IDLE;
+		_worker.start([this] { return readNext(); });
+	} else if (lba == _next) {
+		// Already on its way there, SetLoc and then ReadN for example
+		return;
+	}
+	
+	_generation++;
+	_next = lba;
+	
+	_request.store((static_cast<uint64_t>(_generation) << 32) | lba);
+	_worker.wake();
+}
+
+void ReadAhead::cancel() {
+	if (!_worker.running())
+		return;
+	
+	_generation++;
+	_next = IDLE;
+	
+	_request.store((static_cast<uint64_t>(_generation) << 32) | IDLE);
+}
+
+void ReadAhead::stop() {
+	if (!_worker.running())
+		return;
+	
+	_worker.stop();
+	
+	_slots->reset();
+	_holding = false;
+	_next = IDLE;
+	_request = IDLE;
+	_disk = nullptr;
+}
+
+bool ReadAhead::fetch(uint32_t lba, SectorSpan& sector) {
+	if (!_worker.running())
+		return false;
+	
+	// Done with the one handed out last time
+	if (_holding) {
+		pop();
+		_holding = false;
+	}
+	
+	while (const Slot* slot = _slots->front()) {
+		if (slot->generation == _generation && slot->lba == lba) {
+			sector = slot->onDisc ? SectorSpan{slot->data, Sector::RAW_BUFFER} : SectorSpan{};
+			
+			_holding = true;
+			_next = lba + 1;
+			
+			return true;
+		}
+		
+		// Went back, start over
+		if (slot->generation == _generation && slot->lba > lba)
+			break;
+		
+		// From an old request, or skipped over
+		pop();
+	}
+	
+	// Behind on the sequence 'lba' is in, it'll catch up on its own
+	if (lba == _next) {
+		_next = lba + 1;
+		return false;
+	}
+	
+	restart(*_disk, lba + 1);
+	
+	return false;
+}
+
+void ReadAhead::pop() {
+	_slots->pop();
+	_worker.wake();
+}
+
+bool ReadAhead::readNext() {
+	const uint64_t request = _request.load();
+	
+	if (request != _current) {
+		_current = request;
+		_reading = static_cast<uint32_t>(request);
+	}
+	
+	Slot* slot = _reading != IDLE ? _slots->reserve(1) : nullptr;
+	
+	if (!slot)
+		return false;
+	
+	slot->generation = static_cast<uint32_t>(_current >> 32);
+	slot->lba = _reading;
+	slot->onDisc = _disk->readInto(Location::fromLBA(_reading), slot->data);
+	
+	_slots->commit(1);
+	
+	// Nothing to read past the end
+	_reading = slot->onDisc ? _reading + 1 : IDLE;
+	
+	return true;
+}
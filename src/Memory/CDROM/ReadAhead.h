@@ -0,0 +1,83 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+
+#include "Disk.h"
+
+#include "../../Utils/SpscRing.h"
+#include "../../Utils/Worker.h"
+
+/**
+ * Reads the sectors after the current read position on a background
+ * thread, so a slow disc image doesn't stall the frame that needs them.
+ *
+ * The thread fills a single producer/single consumer ring, tagging every
+ * sector with the request it was read for. 'restart' moves the window
+ * (and makes whatever is in the ring stale), 'fetch' hands out sectors
+ * and reads nothing itself, a miss is left to 'Disk::read'.
+ */
+class ReadAhead {
+public:
+	// Sectors, about a second and a half at double speed
+	static constexpr size_t DEFAULT_WINDOW = 256;
+	
+	ReadAhead() = default;
+	
+	ReadAhead(const ReadAhead&) = delete;
+	ReadAhead& operator=(const ReadAhead&) = delete;
+	
+	~ReadAhead() { stop(); }
+	
+	// 0 turns it off
+	void setWindow(size_t sectors);
+	[[nodiscard]] size_t window() const { return _window; }
+	
+	// Reads ahead from 'lba' on, dropping what's been read so far
+	void restart(const Disk& disk, uint32_t lba);
+	
+	// Stops reading ahead, until the next 'restart'
+	void cancel();
+	
+	// Waits for the thread to let go of the disc, it has to before it changes
+	void stop();
+	
+	// The sector at 'lba' if it was read ahead, good until the next 'fetch'.
+	// Moves the window along with it, or over to 'lba' if it was somewhere else.
+	bool fetch(uint32_t lba, SectorSpan& sector);
+	
+private:
+	struct Slot {
+		uint32_t generation;
+		uint32_t lba;
+		bool onDisc;
+		uint8_t data[Sector::RAW_BUFFER];
+	};
+	
+	// One sector, false once the ring is full or there's nothing to read
+	bool readNext();
+	
+	void pop();
+	
+private:
+	size_t _window = 0;
+	std::unique_ptr<Emulator::Utils::SpscRing<Slot>> _slots;
+	
+	const Disk* _disk = nullptr;
+	Emulator::Utils::Worker _worker;
+	
+	// Generation in the top half and the first LBA in the bottom one,
+	// 'IDLE' for the LBA while there's nothing to read
+	static constexpr uint32_t IDLE = UINT32_MAX;
+	std::atomic<uint64_t> _request{IDLE};
+	
+	// Consumer side only, what 'fetch' expects to find next
+	uint32_t _generation = 0;
+	uint32_t _next = IDLE;
+	bool _holding = false;
+	
+	// Thread side only, the request it's reading for and the LBA it's at
+	uint64_t _current = IDLE;
+	uint32_t _reading = IDLE;
+};
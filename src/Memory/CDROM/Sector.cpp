@@ -1,11 +1,16 @@
 ﻿#include "Sector.h"
 
 void Sector::set(const std::vector<uint8_t>& data) {
+	set(data.data(), data.size());
+}
+
+void Sector::set(const uint8_t* data, size_t size) {
 	_pointer = 0;
-	_size = data.size();
+	_size = size;
 	_buffer.resize(_size);
 	
-	std::memcpy(_buffer.data(), data.data(), _size);
+	if (_size != 0)
+		std::memcpy(_buffer.data(), data, _size);
 }
 
 uint8_t Sector::loadAt(uint32_t pos) {
@@ -27,6 +27,7 @@ public:
 	}
 	
 	void set(const std::vector<uint8_t>& data);
+	void set(const uint8_t* data, size_t size);
 	
 	uint8_t loadAt(uint32_t pos);
 	uint8_t& load8();
@@ -1,10 +1,14 @@
 ﻿#include "TrackBuilder.h"
 
+#include <algorithm>
+#include <cstdio>
 #include <filesystem>
 #include <fstream>
 #include <iostream>
 #include <unordered_map>
 
+#include "ChdFile.h"
+
 struct FileAudioData {
     uint32_t offset = 0;
     uint32_t size = 0;
@@ -81,6 +85,9 @@ std::vector<Track> TrackBuilder::parseFile(const std::string& filePath) {
 	if(extension == (".cue")) {
 		std::cerr << "Building a cue file\n";
 		return parseCueFile(filePath);
+	} else if(extension == (".chd")) {
+		std::cerr << "Building a chd file\n";
+		return parseChdFile(filePath);
 	} else if(extension == (".bin")) {
 		std::cerr << "Building a bin file\n";
 	} else {
@@ -193,6 +200,85 @@ std::vector<Track> TrackBuilder::parseCueFile(const std::string& path) {
 	return tracks;
 }
 
+std::vector<Track> TrackBuilder::parseChdFile(const std::string& path) {
+	ChdFile chd(path);
+	
+	if (!chd.isOpen()) {
+		throw std::runtime_error("Couldn't open CHD file through the provided path.");
+	}
+	
+	std::vector<Track> tracks;  // NOLINT(clang-diagnostic-shadow)
+	
+	// Tracks follow each other in the CHD, each padded to 4 frames
+	uint32_t frame = 0;
+	
+	for (const std::string& entry : chd.metadata("CHT2")) {
+		int number = 0;
+		int frames = 0;
+		int pregap = 0;
+		char type[32]{};
+		char subtype[32]{};
+		char pregapType[32]{};
+		
+		if (std::sscanf(entry.c_str(), "TRACK:%d TYPE:%31s SUBTYPE:%31s FRAMES:%d PREGAP:%d PGTYPE:%31s",
+		                &number, type, subtype, &frames, &pregap, pregapType) < 4 || frames <= 0) {
+			continue;
+		}
+		
+		const std::string mode = type;
+		
+		// The pregap is only in the file when its type starts with 'V'
+		const bool pregapInFile = pregapType[0] == 'V';
+		
+		Track track;
+		track.filePath = path;
+		track.type = entry;
+		
+		if (mode == "AUDIO") {
+			track.mode = "AUDIO";
+			track.modeType = 2352;
+		} else {
+			static const std::unordered_map<std::string, uint32_t> sizes = {
+				{"MODE1", 2048}, {"MODE1_RAW", 2352},
+				{"MODE2", 2336}, {"MODE2_FORM1", 2048}, {"MODE2_FORM2", 2324},
+				{"MODE2_FORM_MIX", 2336}, {"MODE2_RAW", 2352},
+			};
+			
+			auto size = sizes.find(mode);
+			
+			if (size == sizes.end()) {
+				std::cerr << "Skipping track " << number << " of unknown type " << mode << "\n";
+				frame += (frames + 3) & ~3;
+				continue;
+			}
+			
+			track.mode = mode.substr(0, 5);
+			track.modeType = size->second;
+		}
+		
+		// Offsets are into the uncompressed data, 'trackIndex' is where INDEX 01 is
+		track.fileDataOffset = frame * ChdFile::FRAME_BYTES;
+		track.trackIndex = pregapInFile ? pregap : 0;
+		track.sectorCount = frames - track.trackIndex;
+		
+		// The first two seconds before track 1 are always there
+		track.pregap = Location::fromLBA(tracks.empty() ? std::max(pregap - 150, 0) : pregap);
+		
+		std::cerr << "Track " << (tracks.size() + 1)
+		          << " contains " << track.sectorCount
+		          << " sectors (" << track.mode << ")\n";
+		
+		tracks.push_back(track);
+		frame += (frames + 3) & ~3;
+	}
+	
+	if (tracks.empty()) {
+		throw std::runtime_error("CHD file has no CD tracks.");
+	}
+	
+	return tracks;
+}
+
 void TrackBuilder::parseBinFile(const std::string& path) {
 	std::ifstream binFile(path);
 	if (!binFile.is_open()) {
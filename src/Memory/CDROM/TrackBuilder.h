@@ -29,6 +29,7 @@ public:
 	std::vector<Track> parseFile(const std::string& path);
 	
 	std::vector<Track> parseCueFile(const std::string& path);
+	std::vector<Track> parseChdFile(const std::string& path);
 	void parseBinFile(const std::string& path);
 	
 private:
@@ -0,0 +1,172 @@
+#include "XaDecoder.h"
+
+#include <algorithm>
+
+namespace {
+	// Prediction filters, XA only has the first four of SPU-ADPCM's
+	constexpr int32_t POSITIVE[4] = {0, 60, 115, 98};
+	constexpr int32_t NEGATIVE[4] = {0, 0, -52, -55};
+
+	// The drive's 37.8 to 44.1 kHz interpolation (psx-spx, "CDROM XA Audio
+	// ADPCM Compression"). Tap 0 goes with the newest sample.
+	constexpr int16_t ZIGZAG[7][29] = {
+		{0, 0, 0, 0, 0, -0x0002, 0x000A, -0x0022, 0x0041, -0x0054, 0x0034, 0x0009, -0x010A, 0x0400, -0x0A78,
+		 0x234C, 0x6794, -0x1780, 0x0BCD, -0x0623, 0x0350, -0x016D, 0x006B, 0x000A, -0x0010, 0x0011, -0x0008, 0x0003, -0x0001},
+		{0, 0, 0, -0x0002, 0, 0x0003, -0x0013, 0x003C, -0x004B, 0x00A2, -0x00E3, 0x0132, -0x0043, -0x0267, 0x0C9D,
+		 0x74BB, -0x11B4, 0x09B8, -0x05BF, 0x0372, -0x01A8, 0x00A6, -0x001B, 0x0005, 0x0006, -0x0008, 0x0003, -0x0001, 0},
+		{0, 0, -0x0001, 0x0003, -0x0002, -0x0005, 0x001F, -0x004A, 0x00B3, -0x0192, 0x02B1, -0x039E, 0x04F8, -0x05A6, 0x7939,
+		 -0x05A6, 0x04F8, -0x039E, 0x02B1, -0x0192, 0x00B3, -0x004A, 0x001F, -0x0005, -0x0002, 0x0003, -0x0001, 0, 0},
+		{0, -0x0001, 0x0003, -0x0008, 0x0006, 0x0005, -0x001B, 0x00A6, -0x01A8, 0x0372, -0x05BF, 0x09B8, -0x11B4, 0x74BB, 0x0C9D,
+		 -0x0267, -0x0043, 0x0132, -0x00E3, 0x00A2, -0x004B, 0x003C, -0x0013, 0x0003, 0, -0x0002, 0, 0, 0},
+		{-0x0001, 0x0003, -0x0008, 0x0011, -0x0010, 0x000A, 0x006B, -0x016D, 0x0350, -0x0623, 0x0BCD, -0x1780, 0x6794, 0x234C, -0x0A78,
+		 0x0400, -0x010A, 0x0009, 0x0034, -0x0054, 0x0041, -0x0022, 0x000A, -0x0002, 0, 0, 0, 0, 0},
+		{0x0002, -0x0008, 0x0010, -0x0023, 0x002B, 0x001A, -0x00EB, 0x027B, -0x0548, 0x0AFA, -0x16FA, 0x53E0, 0x3C07, -0x1249, 0x080E,
+		 -0x0347, 0x015B, -0x0044, -0x0017, 0x0046, -0x0023, 0x0011, -0x0005, 0, 0, 0, 0, 0, 0},
+		{-0x0005, 0x0011, -0x0023, 0x0046, -0x0017, -0x0044, 0x015B, -0x0347, 0x080E, -0x1249, 0x3C07, 0x53E0, -0x16FA, 0x0AFA, -0x0548,
+		 0x027B, -0x00EB, 0x001A, 0x002B, -0x0023, 0x0010, -0x0008, 0x0002, 0, 0, 0, 0, 0, 0},
+	};
+
+	constexpr int GROUPS = 18;
+	constexpr int GROUP_BYTES = 128;
+	constexpr int UNIT_SAMPLES = 28;
+
+	int16_t clamp16(int32_t value) {
+		return static_cast<int16_t>(std::clamp<int32_t>(value, -32768, 32767));
+	}
+
+	// 'samples' newest first
+	int16_t interpolate(const int16_t* samples, const int16_t* table) {
+		int32_t sum = 0;
+
+		for (int i = 0; i < 29; i++)
+			sum += samples[i] * table[i];
+
+		return clamp16(sum >> 15);
+	}
+}
+
+void XaDecoder::reset() {
+	_channels[0] = {};
+	_channels[1] = {};
+
+	std::fill(&_ring[0][0], &_ring[0][0] + 2 * 64, int16_t{0});
+	_position = 0;
+	_sixStep = 6;
+}
+
+size_t XaDecoder::decode(const uint8_t* sector) {
+	// Coding info, the last byte of the sub-header
+	const uint8_t codingInfo = sector[19];
+	const bool stereo = (codingInfo & 0x03) == 1;
+	const bool halfRate = ((codingInfo >> 2) & 0x03) == 1;
+	const bool eightBit = ((codingInfo >> 4) & 0x03) == 1;
+
+	// Sound groups start right after the sub-header and its copy
+	const uint8_t* data = sector + 24;
+
+	_frames = 0;
+
+	if (eightBit) {
+		if (stereo)
+			decodeGroups<true, true>(data, halfRate);
+		else
+			decodeGroups<true, false>(data, halfRate);
+	} else {
+		if (stereo)
+			decodeGroups<false, true>(data, halfRate);
+		else
+			decodeGroups<false, false>(data, halfRate);
+	}
+
+	return _frames;
+}
+
+template <bool EightBit>
+void XaDecoder::decodeUnit(const uint8_t* group, int unit, Channel& channel, int16_t* out) {
+	const uint8_t header = group[4 + unit];
+
+	// Ranges past 12 act like 9
+	const int range = (header & 0x0F) > 12 ? 9 : header & 0x0F;
+	const int filter = (header >> 4) & 0x03;
+
+	// Samples of a unit are a word apart, 4 bit ones share their byte with
+	// the next unit. Nothing in here depends on the sample before, so this
+	// part is left to the compiler to vectorize.
+	const uint8_t* bytes = group + 16 + (EightBit ? unit : unit / 2);
+	const int nibble = (unit & 1) * 4;
+
+	int32_t expanded[UNIT_SAMPLES];
+
+	for (int i = 0; i < UNIT_SAMPLES; i++) {
+		const uint8_t byte = bytes[i * 4];
+		const auto value = static_cast<int16_t>(EightBit ? byte << 8 : ((byte >> nibble) & 0x0F) << 12);
+
+		expanded[i] = value >> range;
+	}
+
+	// The prediction only ever goes one sample at a time
+	const int32_t positive = POSITIVE[filter];
+	const int32_t negative = NEGATIVE[filter];
+
+	int32_t old = channel.old;
+	int32_t older = channel.older;
+
+	for (int i = 0; i < UNIT_SAMPLES; i++) {
+		const int16_t sample = clamp16(expanded[i] + ((old * positive + older * negative + 32) >> 6));
+
+		out[i] = sample;
+		older = old;
+		old = sample;
+	}
+
+	channel.old = old;
+	channel.older = older;
+}
+
+template <bool EightBit, bool Stereo>
+void XaDecoder::decodeGroups(const uint8_t* data, bool halfRate) {
+	// 4 bit groups have 8 units, 8 bit ones 4. Stereo alternates left and right.
+	constexpr int UNITS = EightBit ? 4 : 8;
+	const int repeats = halfRate ? 2 : 1;
+
+	for (int group = 0; group < GROUPS; group++, data += GROUP_BYTES) {
+		int16_t left[UNIT_SAMPLES];
+		int16_t right[UNIT_SAMPLES];
+
+		for (int unit = 0; unit < UNITS; unit += Stereo ? 2 : 1) {
+			decodeUnit<EightBit>(data, unit, _channels[0], left);
+
+			if constexpr (Stereo)
+				decodeUnit<EightBit>(data, unit + 1, _channels[1], right);
+
+			for (int i = 0; i < UNIT_SAMPLES; i++) {
+				for (int repeat = 0; repeat < repeats; repeat++)
+					push<Stereo>(left[i], Stereo ? right[i] : left[i]);
+			}
+		}
+	}
+}
+
+template <bool Stereo>
+void XaDecoder::push(int16_t left, int16_t right) {
+	_position = (_position - 1) & 31;
+
+	_ring[0][_position] = _ring[0][_position + 32] = left;
+
+	if constexpr (Stereo)
+		_ring[1][_position] = _ring[1][_position + 32] = right;
+
+	if (--_sixStep > 0)
+		return;
+
+	_sixStep = 6;
+
+	for (const int16_t* table : ZIGZAG) {
+		const int16_t outLeft = interpolate(_ring[0] + _position, table);
+		const int16_t outRight = Stereo ? interpolate(_ring[1] + _position, table) : outLeft;
+
+		_output[_frames * 2] = outLeft;
+		_output[_frames * 2 + 1] = outRight;
+		_frames++;
+	}
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * XA-ADPCM audio sectors (Mode 2 Form 2, "audio" and "real time" set in
+ * the sub-header) decoded to 44.1 kHz stereo for the SPU's CD input.
+ *
+ * Handles 4 and 8 bit samples, mono and stereo, 37.8 and 18.9 kHz. The
+ * 37.8 kHz samples go through the drive's zigzag interpolation, 7 outputs
+ * for every 6 inputs; 18.9 kHz feeds every sample in twice. Prediction and
+ * interpolation state carries over from one sector to the next, 'reset'
+ * drops it when the stream changes.
+ */
+class XaDecoder {
+public:
+	// 4 bit mono at 18.9 kHz, 18 groups of 224 samples, doubled and then 7/6 of that
+	static constexpr size_t MAX_FRAMES = 18 * 224 * 2 * 7 / 6;
+
+	void reset();
+
+	// 'sector' is a whole raw sector (2352 bytes, sync included). Returns the
+	// stereo frames decoded into 'samples()'.
+	size_t decode(const uint8_t* sector);
+
+	// Interleaved left/right
+	[[nodiscard]] const int16_t* samples() const { return _output.data(); }
+
+private:
+	// Last two samples out of the prediction filter
+	struct Channel {
+		int32_t old = 0;
+		int32_t older = 0;
+	};
+
+	template <bool EightBit>
+	static void decodeUnit(const uint8_t* group, int unit, Channel& channel, int16_t* out);
+
+	template <bool EightBit, bool Stereo>
+	void decodeGroups(const uint8_t* data, bool halfRate);
+
+	// One 37.8 kHz sample in, every sixth one puts out 7 frames
+	template <bool Stereo>
+	void push(int16_t left, int16_t right);
+
+private:
+	Channel _channels[2];
+
+	// Newest sample first from '_position' on, every sample is written twice
+	// (32 apart) so the 29 taps are always one contiguous run
+	int16_t _ring[2][64]{};
+	uint32_t _position = 0;
+	uint32_t _sixStep = 6;
+
+	std::array<int16_t, MAX_FRAMES * 2> _output{};
+	size_t _frames = 0;
+};
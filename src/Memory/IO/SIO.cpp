@@ -16,6 +16,32 @@ void Emulator::IO::SIO::step(uint32_t cycles) {
 	}
 }
 
+uint32_t Emulator::IO::SIO::cyclesUntilEvent() const {
+	uint64_t next = UINT32_MAX;
+
+	for(uint32_t port = 0; port < channels.size(); port++) {
+		const auto& channel = channels[port];
+
+		if(irqCondition(port)) {
+			return 0;
+		}
+
+		if(channel.dsrTimer > 0) {
+			next = std::min<uint64_t>(next, channel.dsrTimer);
+		}
+
+		if(channel.txActive) {
+			next = std::min<uint64_t>(next, channel.txCycles);
+		} else if(channel.txHoldingFull && (channel.txEnabled || channel.txArmed)
+			&& !(port == 0 && !channel.dtrOutput)) {
+			// Starts on the next step
+			next = std::min<uint64_t>(next, 1);
+		}
+	}
+
+	return static_cast<uint32_t>(next);
+}
+
 uint32_t Emulator::IO::SIO::load(uint32_t addr, uint32_t size) {
 	const uint32_t port = (addr - 0x1F801040) / 0x10;
 	const uint32_t reg = addr - port * 0x10;
@@ -372,15 +398,21 @@ void Emulator::IO::SIO::pushRx(uint32_t port, uint8_t value) {
 	channel.stat.RX_FIFO_NOT_EMPTY = true;
 }
 
-void Emulator::IO::SIO::evaluateIrq(uint32_t port) {
-	auto& channel = channels[port];
+bool Emulator::IO::SIO::irqCondition(uint32_t port) const {
+	const auto& channel = channels[port];
 	const uint32_t rxThreshold = 1u << channel.rxInterruptMode;
 	const bool txIrq = channel.txInterruptEnabled
 		&& (channel.stat.TX_FIFO_NOT_FULL || channel.stat.TX_IDLE);
 	const bool rxIrq = channel.rxInterruptEnabled && channel.rxCount >= rxThreshold;
 	const bool dsrIrq = channel.dsrInterruptEnabled && channel.dsrIrqPending;
 
-	if((txIrq || rxIrq || dsrIrq) && !channel.stat.INTERRUPT_REQUEST) {
+	return (txIrq || rxIrq || dsrIrq) && !channel.stat.INTERRUPT_REQUEST;
+}
+
+void Emulator::IO::SIO::evaluateIrq(uint32_t port) {
+	auto& channel = channels[port];
+
+	if(irqCondition(port)) {
 		channel.stat.INTERRUPT_REQUEST = true;
 		channel.dsrIrqPending = false;
 		IRQ::trigger(port == 0 ? IRQ::PadMemCard : IRQ::SIO);
@@ -2,7 +2,9 @@
 #include <array>
 #include <cstdio>
 #include <stdint.h>
+#ifndef PSX_HEADLESS
 #include <GLFW/glfw3.h>
+#endif
 
 #include "Peripherals/DigitalController.h"
 #include "Peripherals/MemoryCard.h"
@@ -58,11 +60,16 @@ namespace Emulator {
 			public:
 				void step(uint32_t cycles);
 				
+				// CPU cycles until a transfer or DSR pulse finishes, or an IRQ
+				// is due, UINT32_MAX if both ports are idle
+				uint32_t cyclesUntilEvent() const;
+				
 				uint32_t load(uint32_t addr, uint32_t size);
 				void store(uint32_t addr, uint32_t val, uint32_t size);
 				
 				void setCtrl(uint32_t port, uint32_t val);
 				
+#ifndef PSX_HEADLESS
 				static void keyCallback(GLFWwindow* window, int key, int scancode, int action, int mods) {
 					if (action == GLFW_PRESS || action == GLFW_RELEASE) {
 						bool isPressed = (action == GLFW_PRESS);
@@ -91,6 +98,7 @@ namespace Emulator {
 						}
 					}
 				}
+#endif
 				
 			private:
 				struct Channel {
@@ -140,6 +148,7 @@ namespace Emulator {
 				void completeTransfer(uint32_t port);
 				void pushRx(uint32_t port, uint8_t value);
 				void evaluateIrq(uint32_t port);
+				bool irqCondition(uint32_t port) const;
 				void resetChannel(uint32_t port);
 
 				std::array<Channel, 2> channels = {};
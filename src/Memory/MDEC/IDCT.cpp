@@ -0,0 +1,201 @@
+#include "IDCT.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+namespace {
+    // Second pass rounding, (sum >> 32) plus bit 31
+    inline int16_t roundOff(int64_t sum) {
+        return static_cast<int16_t>(static_cast<uint16_t>((sum >> 32) + ((sum >> 31) & 1)));
+    }
+}
+
+void IDCT::scalar(int16_t* blk, const int16_t* scale) {
+    // Most blocks only have a few coefficients in the top rows
+    uint8_t rows = 0;
+
+    for (int i = 0; i < 8; i++) {
+        uint32_t row = 0;
+
+        for (int x = 0; x < 8; x++)
+            row |= static_cast<uint16_t>(blk[i * 8 + x]);
+
+        rows |= (row != 0) << i;
+    }
+
+    int32_t tmp[64] = {};
+
+    // tmp[y][x] = sum of S[i][y] * blk[i][x]
+    for (int i = 0; i < 8; i++) {
+        if (!((rows >> i) & 1))
+            continue;
+
+        for (int y = 0; y < 8; y++) {
+            const int32_t s = scale[i * 8 + y];
+
+            for (int x = 0; x < 8; x++)
+                tmp[y * 8 + x] += s * blk[i * 8 + x];
+        }
+    }
+
+    // blk[y][x] = sum of tmp[y][i] * S[i][x]
+    for (int y = 0; y < 8; y++) {
+        int64_t sum[8] = {};
+
+        for (int i = 0; i < 8; i++) {
+            const int64_t t = tmp[y * 8 + i];
+
+            if (t == 0)
+                continue;
+
+            for (int x = 0; x < 8; x++)
+                sum[x] += t * scale[i * 8 + x];
+        }
+
+        for (int x = 0; x < 8; x++)
+            blk[y * 8 + x] = roundOff(sum[x]);
+    }
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+
+namespace {
+    // Two scale entries for pmaddwd, one per interleaved row
+    inline int32_t scalePair(const int16_t* scale, int p, int y) {
+        return static_cast<uint16_t>(scale[(2 * p) * 8 + y]) |
+               (static_cast<uint32_t>(static_cast<uint16_t>(scale[(2 * p + 1) * 8 + y])) << 16);
+    }
+
+    // Adding 2^31 and taking the floor of a 2^32 division is what 'roundOff' does,
+    // every step is exact for sums that fit in 53 bits
+    constexpr double HALF = 2147483648.0;
+    constexpr double UNIT = 1.0 / 4294967296.0;
+}
+
+__attribute__((target("sse4.1")))
+void IDCT::sse41(int16_t* blk, const int16_t* scale) {
+    // Rows interleaved in pairs, pmaddwd then does two rows per multiply
+    __m128i lo[4], hi[4];
+
+    for (int p = 0; p < 4; p++) {
+        const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(blk + (2 * p) * 8));
+        const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(blk + (2 * p + 1) * 8));
+
+        lo[p] = _mm_unpacklo_epi16(a, b);
+        hi[p] = _mm_unpackhi_epi16(a, b);
+    }
+
+    alignas(16) double tmp[64];
+    alignas(16) double s[64];
+
+    for (int y = 0; y < 8; y++) {
+        __m128i sumLo = _mm_setzero_si128();
+        __m128i sumHi = _mm_setzero_si128();
+
+        for (int p = 0; p < 4; p++) {
+            const __m128i pair = _mm_set1_epi32(scalePair(scale, p, y));
+
+            sumLo = _mm_add_epi32(sumLo, _mm_madd_epi16(lo[p], pair));
+            sumHi = _mm_add_epi32(sumHi, _mm_madd_epi16(hi[p], pair));
+        }
+
+        _mm_store_pd(tmp + y * 8 + 0, _mm_cvtepi32_pd(sumLo));
+        _mm_store_pd(tmp + y * 8 + 2, _mm_cvtepi32_pd(_mm_srli_si128(sumLo, 8)));
+        _mm_store_pd(tmp + y * 8 + 4, _mm_cvtepi32_pd(sumHi));
+        _mm_store_pd(tmp + y * 8 + 6, _mm_cvtepi32_pd(_mm_srli_si128(sumHi, 8)));
+    }
+
+    for (int i = 0; i < 64; i++)
+        s[i] = scale[i];
+
+    const __m128d half = _mm_set1_pd(HALF);
+    const __m128d unit = _mm_set1_pd(UNIT);
+
+    for (int y = 0; y < 8; y++) {
+        __m128d acc[4] = { _mm_setzero_pd(), _mm_setzero_pd(), _mm_setzero_pd(), _mm_setzero_pd() };
+
+        for (int i = 0; i < 8; i++) {
+            const __m128d t = _mm_set1_pd(tmp[y * 8 + i]);
+
+            for (int k = 0; k < 4; k++)
+                acc[k] = _mm_add_pd(acc[k], _mm_mul_pd(t, _mm_load_pd(s + i * 8 + k * 2)));
+        }
+
+        __m128i out[4];
+
+        for (int k = 0; k < 4; k++)
+            out[k] = _mm_cvttpd_epi32(_mm_floor_pd(_mm_mul_pd(_mm_add_pd(acc[k], half), unit)));
+
+        const __m128i left  = _mm_unpacklo_epi64(out[0], out[1]);
+        const __m128i right = _mm_unpacklo_epi64(out[2], out[3]);
+
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(blk + y * 8), _mm_packs_epi32(left, right));
+    }
+}
+
+__attribute__((target("avx2")))
+void IDCT::avx2(int16_t* blk, const int16_t* scale) {
+    // Same as 'sse41', a whole row of 8 per pmaddwd
+    __m256i pairs[4];
+
+    for (int p = 0; p < 4; p++) {
+        const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(blk + (2 * p) * 8));
+        const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(blk + (2 * p + 1) * 8));
+
+        pairs[p] = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_unpacklo_epi16(a, b)), _mm_unpackhi_epi16(a, b), 1);
+    }
+
+    alignas(32) double tmp[64];
+    alignas(32) double s[64];
+
+    for (int y = 0; y < 8; y++) {
+        __m256i sum = _mm256_setzero_si256();
+
+        for (int p = 0; p < 4; p++)
+            sum = _mm256_add_epi32(sum, _mm256_madd_epi16(pairs[p], _mm256_set1_epi32(scalePair(scale, p, y))));
+
+        _mm256_store_pd(tmp + y * 8 + 0, _mm256_cvtepi32_pd(_mm256_castsi256_si128(sum)));
+        _mm256_store_pd(tmp + y * 8 + 4, _mm256_cvtepi32_pd(_mm256_extracti128_si256(sum, 1)));
+    }
+
+    for (int i = 0; i < 64; i += 4) {
+        const __m128i entries = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(scale + i));
+        _mm256_store_pd(s + i, _mm256_cvtepi32_pd(_mm_cvtepi16_epi32(entries)));
+    }
+
+    const __m256d half = _mm256_set1_pd(HALF);
+    const __m256d unit = _mm256_set1_pd(UNIT);
+
+    for (int y = 0; y < 8; y++) {
+        __m256d left  = _mm256_setzero_pd();
+        __m256d right = _mm256_setzero_pd();
+
+        for (int i = 0; i < 8; i++) {
+            const __m256d t = _mm256_broadcast_sd(tmp + y * 8 + i);
+
+            left  = _mm256_add_pd(left,  _mm256_mul_pd(t, _mm256_load_pd(s + i * 8)));
+            right = _mm256_add_pd(right, _mm256_mul_pd(t, _mm256_load_pd(s + i * 8 + 4)));
+        }
+
+        left  = _mm256_floor_pd(_mm256_mul_pd(_mm256_add_pd(left, half), unit));
+        right = _mm256_floor_pd(_mm256_mul_pd(_mm256_add_pd(right, half), unit));
+
+        const __m128i out = _mm_packs_epi32(_mm256_cvttpd_epi32(left), _mm256_cvttpd_epi32(right));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(blk + y * 8), out);
+    }
+}
+
+#endif
+
+IDCT::Kernel IDCT::select() {
+#if defined(__x86_64__) || defined(__i386__)
+    if (__builtin_cpu_supports("avx2"))
+        return avx2;
+
+    if (__builtin_cpu_supports("sse4.1"))
+        return sse41;
+#endif
+
+    return scalar;
+}
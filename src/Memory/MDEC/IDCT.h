@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstdint>
+
+/**
+ * IDCT kernels for the MDEC, all giving the exact same results as
+ * 'MDEC::real_idct_core': out = S^T * blk * S, with the second pass
+ * rounded off by 32 bits.
+ *
+ * The scale matrix comes from the game (MDEC(3)), so the AAN butterflies
+ * can't be used, the usual table isn't even exactly symmetric. The kernels
+ * rely on the coefficients being clamped to 11 bits by 'MDEC::rl_decode_block',
+ * which keeps the first pass in 32 bits and every sum of the second one exact
+ * as a double.
+ */
+namespace IDCT {
+    using Kernel = void (*)(int16_t* blk, const int16_t* scale);
+
+    // Integer version, skips whatever is zero
+    void scalar(int16_t* blk, const int16_t* scale);
+
+#if defined(__x86_64__) || defined(__i386__)
+    void sse41(int16_t* blk, const int16_t* scale);
+    void avx2(int16_t* blk, const int16_t* scale);
+#endif
+
+    // Best kernel the CPU we're running on supports
+    Kernel select();
+}
@@ -6,8 +6,169 @@
 #include <cstdlib>
 #include <cstring>
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 // https://github.com/Laxer3a/MDEC/blob/master/hdlMDEC/doc/PSX%20FPGA%20MDEC%20DOC.pdf
 
+namespace {
+    // 8 pixels of a macroblock row, 'cb' and 'cr' hold the 4 samples under them.
+    // Components come out as bytes, two's complement if signed.
+    //  R = Y + ((1436 * Cr + 512) >> 10)
+    //  G = Y - ((352 * Cb + 731 * Cr + 512) >> 10)
+    //  B = Y + ((1815 * Cb + 512) >> 10)
+    void convertRow(const int16_t* y, const int16_t* cb, const int16_t* cr, bool isSigned,
+                    uint8_t* r, uint8_t* g, uint8_t* b) {
+#if defined(__SSE2__)
+        const __m128i luma = _mm_loadu_si128(reinterpret_cast<const __m128i*>(y));
+        
+        // Every chroma sample twice, one per pixel
+        const __m128i cbs = _mm_unpacklo_epi16(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(cb)),
+                                               _mm_loadl_epi64(reinterpret_cast<const __m128i*>(cb)));
+        const __m128i crs = _mm_unpacklo_epi16(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(cr)),
+                                               _mm_loadl_epi64(reinterpret_cast<const __m128i*>(cr)));
+        
+        // pmaddwd pairs, the rounding rides along as a multiply by 1
+        const __m128i one = _mm_set1_epi16(1);
+        const __m128i rFactors = _mm_set1_epi32((512 << 16) | 1436);
+        const __m128i gFactors = _mm_set1_epi32((731 << 16) | 352);
+        const __m128i bFactors = _mm_set1_epi32((512 << 16) | 1815);
+        const __m128i round = _mm_set1_epi32(512);
+        
+        // Sign extended to 32 bits
+        const __m128i lumaLo = _mm_srai_epi32(_mm_unpacklo_epi16(luma, luma), 16);
+        const __m128i lumaHi = _mm_srai_epi32(_mm_unpackhi_epi16(luma, luma), 16);
+        
+        const __m128i rLo = _mm_add_epi32(lumaLo, _mm_srai_epi32(_mm_madd_epi16(_mm_unpacklo_epi16(crs, one), rFactors), 10));
+        const __m128i rHi = _mm_add_epi32(lumaHi, _mm_srai_epi32(_mm_madd_epi16(_mm_unpackhi_epi16(crs, one), rFactors), 10));
+        
+        const __m128i gLo = _mm_sub_epi32(lumaLo, _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(_mm_unpacklo_epi16(cbs, crs), gFactors), round), 10));
+        const __m128i gHi = _mm_sub_epi32(lumaHi, _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(_mm_unpackhi_epi16(cbs, crs), gFactors), round), 10));
+        
+        const __m128i bLo = _mm_add_epi32(lumaLo, _mm_srai_epi32(_mm_madd_epi16(_mm_unpacklo_epi16(cbs, one), bFactors), 10));
+        const __m128i bHi = _mm_add_epi32(lumaHi, _mm_srai_epi32(_mm_madd_epi16(_mm_unpackhi_epi16(cbs, one), bFactors), 10));
+        
+        const __m128i low  = _mm_set1_epi16(isSigned ? -128 : 0);
+        const __m128i high = _mm_set1_epi16(isSigned ?  127 : 255);
+        const __m128i bias = _mm_set1_epi16(isSigned ?    0 : 128);
+        
+        const auto store = [&](__m128i lo, __m128i hi, uint8_t* dst) {
+            __m128i c = _mm_packs_epi32(lo, hi);
+            
+            c = _mm_min_epi16(_mm_max_epi16(_mm_adds_epi16(c, bias), low), high);
+            c = isSigned ? _mm_packs_epi16(c, c) : _mm_packus_epi16(c, c);
+            
+            _mm_storel_epi64(reinterpret_cast<__m128i*>(dst), c);
+        };
+        
+        store(rLo, rHi, r);
+        store(gLo, gHi, g);
+        store(bLo, bHi, b);
+#else
+        for (int x = 0; x < 8; x++) {
+            const int32_t Y = y[x];
+            const int32_t Cb = cb[x >> 1];
+            const int32_t Cr = cr[x >> 1];
+            
+            int32_t R = Y + ((1436 * Cr + 512) >> 10);
+            int32_t G = Y - ((352 * Cb + 731 * Cr + 512) >> 10);
+            int32_t B = Y + ((1815 * Cb + 512) >> 10);
+            
+            if (isSigned) {
+                R = std::clamp(R, -128, 127);
+                G = std::clamp(G, -128, 127);
+                B = std::clamp(B, -128, 127);
+            } else {
+                R = std::clamp(R + 128, 0, 255);
+                G = std::clamp(G + 128, 0, 255);
+                B = std::clamp(B + 128, 0, 255);
+            }
+            
+            r[x] = static_cast<uint8_t>(R);
+            g[x] = static_cast<uint8_t>(G);
+            b[x] = static_cast<uint8_t>(B);
+        }
+#endif
+    }
+    
+    // 16 pixels as 15-bit halfwords, BGR555
+    void packRow15(const uint8_t* r, const uint8_t* g, const uint8_t* b, bool bit15, uint8_t* dst) {
+        const uint16_t mask = bit15 ? 0x8000 : 0;
+        
+#if defined(__SSE2__)
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i rs = _mm_loadu_si128(reinterpret_cast<const __m128i*>(r));
+        const __m128i gs = _mm_loadu_si128(reinterpret_cast<const __m128i*>(g));
+        const __m128i bs = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b));
+        
+        const auto pack = [&](__m128i r8, __m128i g8, __m128i b8) {
+            __m128i pixel = _mm_set1_epi16(static_cast<int16_t>(mask));
+            
+            pixel = _mm_or_si128(pixel, _mm_srli_epi16(r8, 3));
+            pixel = _mm_or_si128(pixel, _mm_slli_epi16(_mm_srli_epi16(g8, 3), 5));
+            pixel = _mm_or_si128(pixel, _mm_slli_epi16(_mm_srli_epi16(b8, 3), 10));
+            
+            return pixel;
+        };
+        
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst),
+                         pack(_mm_unpacklo_epi8(rs, zero), _mm_unpacklo_epi8(gs, zero), _mm_unpacklo_epi8(bs, zero)));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 16),
+                         pack(_mm_unpackhi_epi8(rs, zero), _mm_unpackhi_epi8(gs, zero), _mm_unpackhi_epi8(bs, zero)));
+#else
+        for (int x = 0; x < 16; x++) {
+            const uint16_t pixel = mask | ((b[x] >> 3) << 10) | ((g[x] >> 3) << 5) | (r[x] >> 3);
+            
+            dst[x * 2 + 0] = pixel & 0xFF;
+            dst[x * 2 + 1] = pixel >> 8;
+        }
+#endif
+    }
+    
+    // 16 pixels as 24-bit, R, G, B bytes one after another
+    void packRow24(const uint8_t* r, const uint8_t* g, const uint8_t* b, uint8_t* dst) {
+        for (int x = 0; x < 16; x++) {
+            dst[x * 3 + 0] = r[x];
+            dst[x * 3 + 1] = g[x];
+            dst[x * 3 + 2] = b[x];
+        }
+    }
+    
+    // The 64 pixels of a Y block as bytes: 9-bit signed, clamped to -128..127,
+    // then moved up to 0..255 if unsigned
+    void convertMono(const int16_t* blk, bool isSigned, uint8_t* dst) {
+#if defined(__SSE2__)
+        const __m128i flip = _mm_set1_epi8(isSigned ? 0 : static_cast<char>(0x80));
+        
+        for (int i = 0; i < 64; i += 16) {
+            __m128i lo = _mm_loadu_si128(reinterpret_cast<const __m128i*>(blk + i));
+            __m128i hi = _mm_loadu_si128(reinterpret_cast<const __m128i*>(blk + i + 8));
+            
+            lo = _mm_srai_epi16(_mm_slli_epi16(lo, 7), 7);
+            hi = _mm_srai_epi16(_mm_slli_epi16(hi, 7), 7);
+            
+            // Saturating already clamps
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_xor_si128(_mm_packs_epi16(lo, hi), flip));
+        }
+#else
+        for (int i = 0; i < 64; i++) {
+            int32_t Y = static_cast<int16_t>(blk[i] << 7) >> 7;
+            
+            Y = std::clamp(Y, -128, 127);
+            
+            dst[i] = static_cast<uint8_t>(Y) ^ (isSigned ? 0 : 0x80);
+        }
+#endif
+    }
+    
+    // Top nibble of every pixel, two per byte with the first one in the low nibble
+    void packMono4(const uint8_t* y, uint8_t* dst) {
+        for (int i = 0; i < 32; i++)
+            dst[i] = (y[i * 2] >> 4) | (y[i * 2 + 1] & 0xF0);
+    }
+}
+
 MDEC::MDEC() {
     reset();
     /*control.reg = 0;
@@ -28,35 +189,16 @@ MDEC::MDEC() {
 uint32_t MDEC::load(uint32_t addr) {
     if (addr < 4) {
         // 1F801820h.Read - MDEC Data/Response Register (R)
-        if (outputIndex > output.size()) {
-            printf("OUT OF BOUNDS! MODE; %d\n", status.DataOutputDepth);
-            return 0;
-        }
-        
         // (or Garbage if there's no data available)
-        if (output.empty() || outputIndex >= output.size())
+        if (!outputAvailable())
             return 0;
         
-        uint32_t v = 0;
-        
-        if (status.DataOutputDepth == 3) {
-            if (outputIndex + 1 >= output.size())
-                return 0;
-            
-            uint16_t lo = output[outputIndex++] & 0xFFFF;
-            uint16_t hi = output[outputIndex++] & 0xFFFF;
-            
-            v = lo | (hi << 16);
-        } else if (status.DataOutputDepth == 2) {
-            v = output[outputIndex];
-            outputIndex++;
-        }
+        // Already packed for every depth
+        const uint32_t v = *output->front();
+        output->pop();
         
-        if (outputIndex >= output.size()) {
-            //printf("OUT OF2 BOUNDS! MODE; %d %d times. Data left; %lu\n", status.DataOutputDepth, amount++, (output.size() - outputIndex));
-            output.clear();
-            outputIndex = 0;
-        }
+        // Room for another macroblock maybe
+        worker.wake();
         
         //return 0x7C007C00; // BLUE
         //return 0x001F001F; // RED
@@ -64,16 +206,16 @@ uint32_t MDEC::load(uint32_t addr) {
     } else if (addr == 4) {
         // 1F801824h - MDEC1 - MDEC Status Register (R)
         
-        status.DataOutFifoEmpty = output.empty();
+        const bool available = outputAvailable();
         
         // Data-Out Fifo Empty (0=No, 1=Empty)
-        //status.DataOutFifoEmpty = output.empty();
+        status.DataOutFifoEmpty = !available;
         
         // Data-In Fifo Full   (0=No, 1=Full, or Last word received)
-        status.DataInFifoFull   = !input.empty();
+        status.DataInFifoFull   = command.Op == 1 && paramCount != 0 && paramCount < command.NumberOfParameterWords;
         
         // (0=Ready, 1=Busy receiving or processing parameters)
-        status.CommandBusy      = !output.empty();
+        status.CommandBusy      = available;
         //printf("RETURND; %x\n", status.reg);
         
         return status.reg;
@@ -162,10 +304,7 @@ void MDEC::handleCommand() {
             
             paramCount = command.NumberOfParameterWords;
             
-            input.clear();
-            input.reserve(paramCount*2);
-            output.resize(0);
-            outputIndex = 0;
+            restartDecoder();
             
             break;
         }
@@ -243,15 +382,9 @@ void MDEC::handleCommandProcessing(uint32_t val) {
     switch (command.Op) {
         case 1: {
             // MDEC(1) - Decode Macroblock(s)
-            input.push_back(val         & 0xFFFF);
-            input.push_back((val >> 16) & 0xFFFF);
-            counter += 2;
-            
-            if (counter >= command.NumberOfParameterWords * 2) {
-                decodeBlocks();
-                input.clear();
-                counter = 0;
-            }
+            // Never full, it has room for the most parameters a command can have
+            input->push(val);
+            worker.wake();
             
             break;
         }
@@ -323,121 +456,100 @@ void MDEC::reset() {
     command = DecodeCommand(0);
     
     // Abort command
-    outputIndex = 0;
     command.reg = 0;
     paramCount = 0;
     
-    output.clear();
-    input.clear();
-    blocks.fill(DCTBlock());
+    restartDecoder();
     counter = 0;
 }
 
-void MDEC::decodeBlocks() {
-    auto src = input.begin();
-    int blockCount = 0;
-    
-    while (src != input.end()) {
-        auto block = decodeMarcoBlocks(src);
-        if (!block.has_value()) {
-            //printf("Block %d failed to decode!\n", blockCount);
-            continue;
-        }
-        
-        //printf("Block %d: data size = %zu\n", blockCount, block->data.size());
-        blockCount++;
-        
-        // TODO; Handle 4-8bit
-        const uint32_t words = (command.DataOutputDepth == 2) ? 192 : 256;
-        
-        for (uint32_t i = 0; i < words; i++)
-            output.push_back(block->data[i]);
+void MDEC::restartDecoder() {
+    auto lock = worker.pause();
+    
+    input->reset();
+    output->reset();
+    
+    decodeCommand = command;
+    decodeLuminance = luminanceQuantTable;
+    decodeColor = colorQuantTable;
+    decodeScale = scaleTable;
+    
+    currentBlock = 0;
+    rlIndex = -1;
+    upperHalf = false;
+}
+
+bool MDEC::outputAvailable() {
+    if (!output->empty())
+        return true;
+    
+    // Caught up with the decoder, whatever it was doing comes first
+    auto lock = worker.pause();
+    
+    while (output->empty()) {
+        if (!decodeMacroblock())
+            return !output->empty();
     }
     
-    //printf("Total blocks decoded: %d\n", blockCount);
+    return true;
 }
 
-struct RGB { uint8_t r, g, b; };
-std::array<RGB, 256> p;
-std::optional<MDEC::DCTBlock> MDEC::decodeMarcoBlocks(std::vector<uint16_t>::iterator &src) {
-    DCTBlock block;
-    block.data.clear();
-    //block.data.resize(256);
+bool MDEC::decodeMacroblock() {
+    const bool colored = decodeCommand.DataOutputDepth > 1;
     
-    p.fill({0,0,0});
+    // 16x16 pixels at 15-bit (2 per word) or 24-bit (3 bytes each),
+    // 8x8 pixels at 8-bit or 4-bit for monochrome
+    static constexpr size_t WORDS[4] = { 8, 16, 192, 128 };
+    const size_t words = WORDS[decodeCommand.DataOutputDepth];
     
-    if (command.DataOutputDepth > 1) {
-        // 15bpp or 24bpp depth
-        // decode_colored_macroblock
-        // Inverting those results in BGR??? and not RGB?? what?
-        if (!rl_decode_block(Crblk, src, colorQuantTable)) return std::nullopt; // ;Cr (low resolution)
-        if (!rl_decode_block(Cbblk, src, colorQuantTable)) return std::nullopt; // ;Cb (low resolution)
+    if (output->space() < words)
+        return false;
+    
+    // decode_colored_macroblock: Cr, Cb (low resolution), then Y1..Y4
+    // decode_monochrome_macroblock: Y
+    std::array<int16_t, 64>* const blocks[6] = { &Crblk, &Cbblk, &Yblk0, &Yblk1, &Yblk2, &Yblk3 };
+    
+    while (const uint32_t* word = input->front()) {
+        const uint16_t halfword = upperHalf ? (*word >> 16) : (*word & 0xFFFF);
         
-        // ;Y1 (and upper-left  Cr,Cb)
-        if (!rl_decode_block(Yblk0, src, luminanceQuantTable)) return std::nullopt;
+        if (upperHalf)
+            input->pop();
         
-        // ;Y2 (and upper-right Cr,Cb)
-        if (!rl_decode_block(Yblk1, src, luminanceQuantTable)) return std::nullopt;
+        upperHalf = !upperHalf;
         
-        // ;Y3 (and lower-left  Cr,Cb)
-        if (!rl_decode_block(Yblk2, src, luminanceQuantTable)) return std::nullopt;
+        std::array<int16_t, 64>& blk = colored ? *blocks[currentBlock] : Yblk0;
+        const std::array<uint8_t, 64>& qt = (colored && currentBlock < 2) ? decodeColor : decodeLuminance;
         
-        // ;Y4 (and lower-right Cr,Cb)
-        if (!rl_decode_block(Yblk3, src, luminanceQuantTable)) return std::nullopt;
+        if (!rl_decode_next(blk, halfword, qt))
+            continue;
         
-        // TODO; I can't figure out why tf
-        // swapping top-right and bottom-left,
-        // gives correct results????? For 15bit at least 
-        yuv_to_rgb(block, 0, 0,  Yblk0); // top-left
-        yuv_to_rgb(block, 8, 0,  Yblk1); // top-right
-        yuv_to_rgb(block, 0, 8,  Yblk2); // bottom-left
-        yuv_to_rgb(block, 8, 8,  Yblk3); // bottom-right
+        if (colored && ++currentBlock < 6)
+            continue;
         
-        block.data.clear();
+        currentBlock = 0;
         
-        if (command.DataOutputDepth == 3) {
-            block.data.resize(256);
-            
-            for (int i = 0; i < 256; i++) {
-                auto &p0 = p[i];
-                
-                uint16_t r5 = (p0.r >> 3);
-                uint16_t g5 = (p0.g >> 3);
-                uint16_t b5 = (p0.b >> 3);
-            
-                block.data[i] =
-                        (b5 << 10) |
-                        (g5 << 5)  |
-                        (r5);
-            }
-        } else if (command.DataOutputDepth == 2) {
-            block.data.reserve(192);
-            
-            for (int i = 0; i < 256; i += 4) {
-                auto& p0 = p[i + 0];
-                auto& p1 = p[i + 1];
-                auto& p2 = p[i + 2];
-                auto& p3 = p[i + 3];
-                
-                uint32_t w0 = p0.r | (p0.g << 8) | (p0.b << 16) | (p1.r << 24);
-                uint32_t w1 = p1.g | (p1.b << 8) | (p2.r << 16) | (p2.g << 24);
-                uint32_t w2 = p2.b | (p3.r << 8) | (p3.g << 16) | (p3.b << 24);
-                
-                block.data.push_back(w0);
-                block.data.push_back(w1);
-                block.data.push_back(w2);
-            }
-        }
-    } else {
-        // 4bpp or 8bpp depth
-        // decode_monochrome_macroblock
-        if (!rl_decode_block(Yblk0, src, luminanceQuantTable)) return std::nullopt;
-        y_to_mono(block, Yblk0); // ;Y
+        uint32_t* dst = output->reserve(words);
         
-        assert(false);
+        if (colored)
+            yuv_to_rgb(dst);
+        else
+            y_to_mono(dst, Yblk0);
+        
+        output->commit(words);
+        
+        return true;
+    }
+    
+    return false;
+}
+
+void MDEC::setThreaded(bool enabled) {
+    if (!enabled) {
+        worker.stop();
+        return;
     }
     
-    return block;
+    worker.start([this] { return decodeMacroblock(); });
 }
 
 template <size_t bit_size, typename T = int16_t>
@@ -452,45 +564,52 @@ T extend_sign(uint64_t n) {
     return val;
 }
 
-bool MDEC::rl_decode_block(std::array<int16_t, 64> &blk, std::vector<uint16_t>::iterator &src, const std::array<uint8_t, 64> &qt) {
-    blk.fill(0);
-    
-    while (src != input.end() && *src == 0xFE00) {
-        src++;
-    }
-    
-    if (src == input.end()) return false;
-    const DCT dct = *src++;
-    int32_t cur = extend_sign<10>(dct.DC);
-    int32_t val = cur * qt[0];
+bool MDEC::rl_decode_next(std::array<int16_t, 64> &blk, uint16_t halfword, const std::array<uint8_t, 64> &qt) {
+    int32_t cur, val;
     
-    for (int k = 0; k < 64;) {
-        if (dct.Q == 0) {
-            val = cur * 2;
-        }
+    if (rlIndex < 0) {
+        // Padding in between blocks
+        if (halfword == 0xFE00)
+            return false;
         
-        val = std::clamp<int32_t>(val, -0x400, 0x3FF);
-        //val = val * scalezag[i]; // ONLY FOR 'fast_idct_core'
+        blk.fill(0);
+        rlDct = DCT(halfword);
+        rlIndex = 0;
         
-        // Normal case
-        if (dct.Q > 0) {
-            blk.at(zagzig[k]) = val;
-        } else if (dct.Q == 0) {
-            // Special, no zigzag
-            blk.at(k) = val;
-        }
-        
-        if (src == input.end()) break;
-        const RLE rle = *src++;
+        cur = extend_sign<10>(rlDct.DC);
+        val = cur * qt[0];
+    } else {
+        const RLE rle = halfword;
         cur = extend_sign<10>(rle.AC);
-        k += rle.LEN + 1;
+        rlIndex += rle.LEN + 1;
         
-        val = (cur * qt[k] * dct.Q + 4) / 8;
+        // EOB (FE00h) always ends up here
+        if (rlIndex >= 64) {
+            rlIndex = -1;
+            fast_idct_core(blk.data());
+            
+            return true;
+        }
+        
+        val = (cur * qt[rlIndex] * rlDct.Q + 4) / 8;
     }
     
-    real_idct_core(blk);
+    if (rlDct.Q == 0) {
+        val = cur * 2;
+    }
     
-    return true;
+    val = std::clamp<int32_t>(val, -0x400, 0x3FF);
+    //val = val * scalezag[i]; // ONLY FOR 'fast_idct_core'
+    
+    if (rlDct.Q > 0) {
+        // Normal case
+        blk[zagzig[rlIndex]] = val;
+    } else {
+        // Special, no zigzag
+        blk[rlIndex] = val;
+    }
+    
+    return false;
 }
 
 /*bool MDEC::rl_decode_block(std::array<uint16_t, 64> &blk, std::vector<uint16_t>::iterator &src, const std::array<uint8_t, 64> &qt) {
@@ -586,7 +705,7 @@ bool MDEC::rl_decode_block(std::array<int16_t, 64> &blk, std::vector<uint16_t>::
 }*/
 
 void MDEC::fast_idct_core(int16_t *blk) {
-    
+    idct(blk, decodeScale.data());
 }
 
 void MDEC::real_idct_core(std::array<int16_t, 64> &blk) const {
@@ -597,7 +716,7 @@ void MDEC::real_idct_core(std::array<int16_t, 64> &blk) const {
             int64_t sum = 0;
             
             for (int i = 0; i < 8; i++) {
-                sum += scaleTable[i * 8 + y] * blk[x + i * 8];
+                sum += decodeScale[i * 8 + y] * blk[x + i * 8];
             }
             
             tmp[x + y * 8] = sum;
@@ -609,7 +728,7 @@ void MDEC::real_idct_core(std::array<int16_t, 64> &blk) const {
             int64_t sum = 0;
             
             for (int i = 0; i < 8; i++) {
-                sum += tmp[i + y * 8] * scaleTable[x + i * 8];
+                sum += tmp[i + y * 8] * decodeScale[x + i * 8];
             }
             
             int round = (sum >> 31) & 1;
@@ -692,194 +811,38 @@ void MDEC::real_idct_core(std::array<int16_t, 64> &blk) const {
     }
 }*/
 
-void MDEC::yuv_to_rgb(DCTBlock& block, uint16_t xx, uint16_t yy, std::array<int16_t, 64> &blk) {
-    /*for (int y = 0; y < 8; y++) {
-        for (int x = 0; x < 8; x++) {
-            // int idxY = y * 2 + x;
-            // int cx = x / 2;
-            // int cy = y / 2;
-            // int idxC = cy * 8 + cx;
-            int idxY = y * 8 + x;
-            
-            int cx = (xx + x) / 2;
-            int cy = (yy + y) / 2;
-            int idxC = cy * 8 + cx;
-            
-            int16_t Y = blk[idxY] + 128;
-            int16_t Cb = Cbblk[idxC];
-            int16_t Cr = Crblk[idxC];
-            
-            int R = Y + static_cast<int>(1.402 * Cr);
-            int G = Y - static_cast<int>(0.344136 * Cb + 0.714136 * Cr);
-            int B = Y + static_cast<int>(1.772 * Cb);
-            
-            uint8_t r = clamp(R , 0, 255);
-            uint8_t g = clamp(G, 0, 255);
-            uint8_t b = clamp(B, 0, 255);
-            
-            uint16_t rgb =
-                ((b >> 3) << 10) |
-                ((g >> 3) << 5)  |
-                 (r >> 3);
-            
-            // if (command.DataOutputDepth == 2) {
-            //     block.data[(yy + y) * 16 + (xx + x)] = 
-            //         (r) | (g << 8) | (b << 16) | (0xFF << 24);
-            // } else {
-            //     uint16_t rgb = ((b >> 3) << 10) | ((g >> 3) << 5) | (r >> 3);
-            //     block.data[(yy + y) * 16 + (xx + x)] = rgb;
-            // }
-            block.data[(yy + y) * 16 + (xx + x)] = rgb;
-            //block.data[(yy + y) * 16 + (xx + x)] = (b << 16) | (g << 8) | r;
-        }
-    }*/
-    
-    //return;
-    
-    for (int y = 0; y < 8; y++) {
-        for (int x = 0; x < 8; x++) {
-            int px = xx + x;
-            int py = yy + y;
-            
-            int uv_x = (xx + x) >> 1;
-            int uv_y = (yy + y) >> 1;
-            //int uv_x = (xx >> 1) + (x >> 1);
-            //int uv_y = (yy >> 1) + (y >> 1);
-            
-            int16_t Y = blk[y * 8 + x];
-            const int16_t Cb = Cbblk[uv_y * 8 + uv_x];
-            const int16_t Cr = Crblk[uv_y * 8 + uv_x];
-            
-            /*int R = y + ((1436 * Cr) >> 10);
-            int G = y - ((352 * Cb + 731 * Cr) >> 10);
-            int B = y + ((1815 * Cb) >> 10);*/
-            int R = Y + ((1436 * Cr + 512) >> 10);
-            int G = Y - ((352 * Cb + 731 * Cr + 512) >> 10);
-            int B = Y + ((1815 * Cb + 512) >> 10);
-            
-           // R = std::clamp(R, -128, 127);
-           // G = std::clamp(G, -128, 127);
-            //B = std::clamp(B, -128, 127);
-
-            if (!command.DataOutputSigned) {
-                R = std::clamp(R + 128, 0, 255);
-                G = std::clamp(G + 128, 0, 255);
-                B = std::clamp(B + 128, 0, 255);
-            } else {
-                R = std::clamp(R, -128, 127);
-                G = std::clamp(G, -128, 127);
-                B = std::clamp(B, -128, 127);
-            }
-            
-            uint8_t r = R;
-            uint8_t g = G;
-            uint8_t b = B;
-            
-            /*if (!command.DataOutputSigned/* && command.DataOutputDepth == 3#1#) {
-                r ^= 0x80;
-                g ^= 0x80;
-                b ^= 0x80;
-            }*/
-            
-            p[py * 16 + px] = { r, g, b };
-        }
-    }
-    
-    return;
+void MDEC::yuv_to_rgb(uint32_t *dst) const {
+    const bool isSigned = decodeCommand.DataOutputSigned;
+    auto* bytes = reinterpret_cast<uint8_t*>(dst);
     
-    if (command.DataOutputDepth == 3) {
-        block.data.resize(256);
+    for (int py = 0; py < 16; py++) {
+        // Y1/Y2 on the top half, Y3/Y4 on the bottom one
+        const int16_t* left  = (py < 8 ? Yblk0 : Yblk2).data() + (py & 7) * 8;
+        const int16_t* right = (py < 8 ? Yblk1 : Yblk3).data() + (py & 7) * 8;
         
-        for (int i = 0; i < 256; i++) {
-            auto &p0 = p[i];
-            
-            uint16_t r5 = (p0.r >> 3);
-            uint16_t g5 = (p0.g >> 3);
-            uint16_t b5 = (p0.b >> 3);
-            
-            block.data[i] =
-                    (b5 << 10) |
-                    (g5 << 5)  |
-                    (r5);
-        }
+        // Each Cr/Cb sample covers 2x2 pixels
+        const int16_t* cb = Cbblk.data() + (py >> 1) * 8;
+        const int16_t* cr = Crblk.data() + (py >> 1) * 8;
         
-        return;
-    }
-    
-    block.data.clear();
-    block.data.reserve(192);
-    
-    uint16_t hw[3];
-    uint32_t word = 0;
-    bool low = true;
-    
-    for (int i = 0; i < 256; i += 2) {
-        auto& p0 = p[i + 0];
-        auto& p1 = p[i + 1];
+        uint8_t r[16], g[16], b[16];
         
-        hw[0] = uint16_t(p0.r) | (uint16_t(p0.g) << 8);
-        hw[1] = uint16_t(p0.b) | (uint16_t(p1.r) << 8);
-        hw[2] = uint16_t(p1.g) | (uint16_t(p1.b) << 8);
+        convertRow(left,  cb,     cr,     isSigned, r,     g,     b);
+        convertRow(right, cb + 4, cr + 4, isSigned, r + 8, g + 8, b + 8);
         
-        for (int j = 0; j < 3; j++) {
-            if (low) {
-                word = hw[j];
-                low = false;
-            } else {
-                word |= uint32_t(hw[j]) << 16;
-                block.data.push_back(word);
-                word = 0;
-                low = true;
-            }
-        }
-    }
-    
-    // flush dangling halfword
-    if (!low)
-        block.data.push_back(word);
-    
-    return;
-    
-    for (int i = 0; i < 256; i++) {
-        /*
-        auto& p0 = p[i + 0];
-        auto& p1 = p[i + 1];
-        auto& p2 = p[i + 2];
-        auto& p3 = p[i + 3];
-        
-        uint32_t w0 =
-            (p0.b) |
-            (p0.g << 8) |
-            (p0.r << 16) |
-            (p1.b << 24);
-        
-        uint32_t w1 =
-            (p1.g) |
-            (p1.r << 8) |
-            (p2.b << 16) |
-            (p2.g << 24);
-        
-        uint32_t w2 =
-            (p2.r) |
-            (p3.b << 8) |
-            (p3.g << 16) |
-            (p3.r << 24);
-        
-        block.data.push_back(w0);
-        block.data.push_back(w1);
-        block.data.push_back(w2);*/
+        if (decodeCommand.DataOutputDepth == 3)
+            packRow15(r, g, b, decodeCommand.DataOutputBit15, bytes + py * 32);
+        else
+            packRow24(r, g, b, bytes + py * 48);
     }
 }
 
-void MDEC::y_to_mono(DCTBlock &block, std::array<int16_t, 64> &blk) {
-    for (int i = 0; i < 64; i++) {
-        int v = blk[i] & 0x1FF;
-        if (v & 0x100) v |= ~0x1FF;
-        v = std::clamp(v, -128, 127);
-        
-        if (!command.DataOutputSigned)
-            v ^= 0x80;
-        
-        block.data[i] = (uint16_t)(v & 0xFF);
-    }
+void MDEC::y_to_mono(uint32_t *dst, const std::array<int16_t, 64> &blk) const {
+    uint8_t y[64];
+    
+    convertMono(blk.data(), decodeCommand.DataOutputSigned, y);
+    
+    if (decodeCommand.DataOutputDepth == 1)
+        std::memcpy(dst, y, sizeof(y));
+    else
+        packMono4(y, reinterpret_cast<uint8_t*>(dst));
 }
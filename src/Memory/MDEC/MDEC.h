@@ -4,8 +4,11 @@
 #include <array>
 #include <cstdint>
 #include <memory>
-#include <optional>
-#include <vector>
+
+#include "IDCT.h"
+
+#include "../../Utils/SpscRing.h"
+#include "../../Utils/Worker.h"
 
 class MDEC {
     private:
@@ -82,17 +85,6 @@ class MDEC {
             RLE(uint16_t reg) : reg(reg) {}
         };
         
-        struct DCTBlock {
-            DCT dct;
-            //std::array<uint16_t, 16*16> data;
-            std::vector<uint32_t> data;
-            uint16_t EOB{}; // Fixed to FE00h
-            
-            DCTBlock() : dct(0) {
-                
-            }
-        };
-        
     public:
         MDEC();
         
@@ -102,48 +94,84 @@ class MDEC {
         
         void reset();
         
-        [[nodiscard]] bool dataInRequest () const { return status.DataInRequest  &&  output.empty(); };
-        [[nodiscard]] bool dataOutRequest() const { return status.DataOutRequest && !output.empty(); };
+        [[nodiscard]] bool dataInRequest () const { return status.DataInRequest && input->space() != 0; };
+        [[nodiscard]] bool dataOutRequest()       { return status.DataOutRequest && outputAvailable(); };
+        
+        // Decodes on a 'Worker' ahead of DMA1, instead of when it runs out
+        void setThreaded(bool enabled);
+        [[nodiscard]] bool threaded() const { return worker.running(); }
         
     private:
         void handleCommand();
         void handleCommandProcessing(uint32_t val);
         
+        // Drops whatever MDEC(1) left behind, with the decoder taken over
+        void restartDecoder();
+        
+        // Waits for (or decodes) output if the decoder has input left,
+        // false once everything sent so far has been read
+        bool outputAvailable();
+        
     public:
-        void                    decodeBlocks();
-        std::optional<DCTBlock> decodeMarcoBlocks(std::vector<uint16_t>::iterator &src);
+        // Runs 'input' through the decoder until a macroblock lands in 'output',
+        // false if the input ran out first or there isn't room for it
+        bool decodeMacroblock();
         
-        bool rl_decode_block(std::array<int16_t, 64> &blk, std::vector<uint16_t>::iterator &src, const std::array<uint8_t, 64> &qt);
+        // Feeds one halfword to the block being decoded, true once it's complete
+        bool rl_decode_next(std::array<int16_t, 64> &blk, uint16_t halfword, const std::array<uint8_t, 64> &qt);
         
+        // Same output as 'real_idct_core', see 'IDCT'
         void fast_idct_core(int16_t *blk);
         void real_idct_core(std::array<int16_t, 64>& blk) const;
         
-        void yuv_to_rgb(DCTBlock& block, uint16_t xx, uint16_t yy, std::array<int16_t, 64> &blk);
-        void y_to_mono(DCTBlock &block, std::array<int16_t, 64> &blk);
+        // Write the output words of a macroblock straight to 'dst',
+        // 128 (15-bit) or 192 (24-bit) for colour, 8 (4-bit) or 16 (8-bit) for mono
+        void yuv_to_rgb(uint32_t *dst) const;
+        void y_to_mono(uint32_t *dst, const std::array<int16_t, 64> &blk) const;
         
     private:
         bool color = false; // (0=Luminance only, 1=Luminance and Color)
         
         uint32_t paramCount = 0;
         uint32_t counter = 0;
-        uint32_t outputIndex = 0;
+        
+        IDCT::Kernel idct = IDCT::select();
+        
+        // Words, the input holds a whole MDEC(1) and the output a multiple of
+        // every macroblock size, so one never wraps around the end
+        static constexpr size_t INPUT_WORDS  = 0x10000;
+        static constexpr size_t OUTPUT_WORDS = 192 * 32;
+        
+        using WordRing = Emulator::Utils::SpscRing<uint32_t>;
+        
+        // Parameters of MDEC(1), and the words decoded from them
+        std::unique_ptr<WordRing> input  = std::make_unique<WordRing>(INPUT_WORDS);
+        std::unique_ptr<WordRing> output = std::make_unique<WordRing>(OUTPUT_WORDS);
+        
+        // Decoder state, owned by whoever holds 'worker.pause'. It has its own
+        // copy of the command and tables, MDEC(2) and (3) can come in while
+        // the output of the last MDEC(1) is still being read.
+        DecodeCommand decodeCommand = DecodeCommand(0);
+        std::array<uint8_t, 64> decodeLuminance{};
+        std::array<uint8_t, 64> decodeColor{};
+        std::array<int16_t, 64> decodeScale{};
+        
+        // Block of the macroblock, position in it (-1 while waiting for the DC)
+        uint32_t currentBlock = 0;
+        int32_t rlIndex = -1;
+        DCT rlDct = DCT(0);
+        bool upperHalf = false;
+        
+        // Runs 'decodeMacroblock' until there's nothing to decode or no room
+        // for the result
+        Emulator::Utils::Worker worker;
         
     public:
         Status status = Status(0);
         Control control = Control(0);
         DecodeCommand command = DecodeCommand(0);
         
-    private:
-        // Uhh ig this is meant to be 2d, 8x8
-        std::array<DCTBlock, 64> blocks;
-        
     public:
-        // Input from idk DMA or whatever
-        std::vector<uint16_t> input;
-        
-        // Output data from algorithm
-        std::vector<uint32_t> output;
-        
         std::array<uint8_t, 64> luminanceQuantTable;
         std::array<uint8_t, 64> colorQuantTable;
         std::array<int16_t, 64> scaleTable;
@@ -0,0 +1,234 @@
+#include "MDECTests.h"
+
+#include <array>
+#include <cstdint>
+#include <exception>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "IDCT.h"
+#include "MDEC.h"
+
+namespace {
+    struct Runner {
+            int                      passed = 0;
+            int                      failed = 0;
+            std::vector<std::string> failures;
+
+            void expect(const std::string &name, bool ok, const std::string &detail = {}) {
+                if (ok) {
+                    passed++;
+                    return;
+                }
+
+                failed++;
+                failures.push_back(detail.empty() ? name : name + ": " + detail);
+            }
+
+            void expectEq(const std::string &name, uint64_t got, uint64_t wanted) {
+                expect(name, got == wanted, "got " + std::to_string(got) + ", wanted " + std::to_string(wanted));
+            }
+
+            template<typename Fn>
+            void test(const std::string &name, Fn &&fn) {
+                try {
+                    fn();
+                    passed++;
+                } catch (const std::exception &e) {
+                    failed++;
+                    failures.push_back(name + ": threw " + e.what());
+                } catch (...) {
+                    failed++;
+                    failures.push_back(name + ": threw unknown exception");
+                }
+            }
+    };
+
+    using Block = std::array<int16_t, 64>;
+
+    // What games send with MDEC(3), see 'MDEC::store'
+    constexpr Block STANDARD_SCALE = {
+        0x5A82, 0x5A82, 0x5A82, 0x5A82, 0x5A82, 0x5A82, 0x5A82, 0x5A82,
+        0x7D8A, 0x6A6D, 0x471C, 0x18F8, -0x18F9, -0x471D, -0x6A6E, -0x7D8B,
+        0x7641, 0x30FB, -0x30FC, -0x7642, -0x7642, -0x30FC, 0x30FB, 0x7641,
+        0x6A6D, -0x18F9, -0x7D8B, -0x471D, 0x471C, 0x7D8A, 0x18F8, -0x6A6E,
+        0x5A82, -0x5A83, -0x5A83, 0x5A82, 0x5A82, -0x5A83, -0x5A83, 0x5A82,
+        0x471C, -0x7D8B, 0x18F8, 0x6A6D, -0x6A6E, -0x18F9, 0x7D8A, -0x471D,
+        0x30FB, -0x7642, 0x7641, -0x30FC, -0x30FC, 0x7641, -0x7642, 0x30FB,
+        0x18F8, -0x471D, 0x6A6D, -0x7D8B, 0x7D8A, -0x6A6E, 0x471C, -0x18F9,
+    };
+
+    // Coefficients come out of 'MDEC::rl_decode_block' clamped to 11 bits
+    constexpr int16_t MIN_COEFFICIENT = -0x400;
+    constexpr int16_t MAX_COEFFICIENT = 0x3FF;
+
+    struct Random {
+        uint32_t seed;
+
+        uint32_t next() {
+            seed = seed * 1103515245 + 12345;
+            return seed >> 8;
+        }
+
+        int16_t between(int low, int high) {
+            return static_cast<int16_t>(low + static_cast<int>(next() % static_cast<uint32_t>(high - low + 1)));
+        }
+    };
+
+    struct Kernel {
+        std::string name;
+        IDCT::Kernel run;
+    };
+
+    std::vector<Kernel> kernels() {
+        std::vector<Kernel> all = {{"scalar", IDCT::scalar}};
+
+#if defined(__x86_64__) || defined(__i386__)
+        if (__builtin_cpu_supports("sse4.1"))
+            all.push_back({"sse41", IDCT::sse41});
+
+        if (__builtin_cpu_supports("avx2"))
+            all.push_back({"avx2", IDCT::avx2});
+#endif
+
+        all.push_back({"select", IDCT::select()});
+
+        return all;
+    }
+
+    // Runs every block through every kernel, counting the blocks that
+    // differ anywhere from 'MDEC::real_idct_core'
+    void compareKernels(Runner &runner, const std::string &name, const Block &scale, const std::vector<Block> &blocks) {
+        MDEC mdec;
+        mdec.scaleTable = scale;
+
+        // Takes the table over for decoding
+        mdec.reset();
+
+        for (const Kernel &kernel : kernels()) {
+            uint64_t mismatches = 0;
+
+            for (const Block &block : blocks) {
+                Block wanted = block;
+                mdec.real_idct_core(wanted);
+
+                Block got = block;
+                kernel.run(got.data(), scale.data());
+
+                mismatches += got != wanted;
+            }
+
+            runner.expectEq(name + ", " + kernel.name + " blocks differing", mismatches, 0);
+        }
+    }
+
+    // Dense, sparse like real video, and the clamp limits
+    std::vector<Block> testBlocks(Random &random) {
+        std::vector<Block> blocks;
+
+        for (int16_t value : {MIN_COEFFICIENT, MAX_COEFFICIENT}) {
+            Block block;
+            block.fill(value);
+            blocks.push_back(block);
+        }
+
+        for (int i = 0; i < 64; i++) {
+            Block block{};
+            block[i] = MIN_COEFFICIENT;
+            blocks.push_back(block);
+
+            block[i] = MAX_COEFFICIENT;
+            blocks.push_back(block);
+        }
+
+        // Signs picked to push every sum of the first pass as far as it goes
+        for (int i = 0; i < 256; i++) {
+            Block block;
+
+            for (int16_t &value : block)
+                value = random.next() & 1 ? MAX_COEFFICIENT : MIN_COEFFICIENT;
+
+            blocks.push_back(block);
+        }
+
+        for (int i = 0; i < 2000; i++) {
+            Block block;
+
+            for (int16_t &value : block)
+                value = random.between(MIN_COEFFICIENT, MAX_COEFFICIENT);
+
+            blocks.push_back(block);
+        }
+
+        for (int i = 0; i < 2000; i++) {
+            Block block{};
+            block[0] = random.between(MIN_COEFFICIENT, MAX_COEFFICIENT);
+
+            for (uint32_t count = random.next() % 8; count > 0; count--)
+                block[random.next() % 64] = random.between(-64, 64);
+
+            blocks.push_back(block);
+        }
+
+        return blocks;
+    }
+
+    void testStandardScale(Runner &runner) {
+        runner.test("IDCT kernels, standard scale table", [&] {
+            Random random{1};
+            compareKernels(runner, "standard", STANDARD_SCALE, testBlocks(random));
+        });
+    }
+
+    void testRandomScales(Runner &runner) {
+        runner.test("IDCT kernels, random scale tables", [&] {
+            Random random{2};
+
+            for (int table = 0; table < 8; table++) {
+                Block scale;
+
+                for (int16_t &value : scale)
+                    value = random.between(-32768, 32767);
+
+                compareKernels(runner, "random " + std::to_string(table), scale, testBlocks(random));
+            }
+        });
+    }
+
+    void testExtremeScales(Runner &runner) {
+        runner.test("IDCT kernels, extreme scale tables", [&] {
+            Random random{3};
+
+            Block lowest;
+            lowest.fill(-32768);
+            compareKernels(runner, "all -32768", lowest, testBlocks(random));
+
+            Block highest;
+            highest.fill(32767);
+            compareKernels(runner, "all 32767", highest, testBlocks(random));
+
+            Block mixed;
+
+            for (size_t i = 0; i < mixed.size(); i++)
+                mixed[i] = (i * 5) % 3 ? -32768 : 32767;
+
+            compareKernels(runner, "mixed extremes", mixed, testBlocks(random));
+        });
+    }
+} // namespace
+
+bool MdecTests::runAll() {
+    Runner runner;
+
+    testStandardScale(runner);
+    testRandomScales(runner);
+    testExtremeScales(runner);
+
+    std::cerr << "MDEC tests: " << runner.passed << " passed, " << runner.failed << " failed\n";
+
+    for (const std::string &failure : runner.failures)
+        std::cerr << "  " << failure << '\n';
+
+    return runner.failed == 0;
+}
@@ -0,0 +1,5 @@
+#pragma once
+
+namespace MdecTests {
+    bool runAll();
+}
@@ -37,6 +37,10 @@ class ScratchPad {
             std::fill(data.begin(), data.end(), 0xCA);
         }
 
+        uint8_t* memory() {
+            return data.data();
+        }
+
     private:
         std::vector<uint8_t> data;
 };
\ No newline at end of file
@@ -0,0 +1,169 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <vector>
+
+#include "Range.h"
+
+namespace map {
+    // Which register block an I/O address belongs to
+    enum class Device : uint8_t {
+        None,
+        MemControl,
+        RamSize,
+        PadMemCard,
+        IrqControl,
+        Dma,
+        Timers,
+        Cdrom,
+        Gpu,
+        Mdec,
+        Spu,
+        Expansion2,
+        PcsxRedux,
+    };
+
+    enum class Region : uint8_t {
+        Unmapped,
+        Ram,
+        Bios,
+        ScratchPad,
+        Io,
+    };
+
+    struct Page {
+        // Memory backing the page, null for I/O and unmapped pages
+        uint8_t* host = nullptr;
+
+        // How many bytes from the start of the page 'host' covers
+        uint16_t size = 0;
+
+        Region region = Region::Unmapped;
+
+        // Cycles spent on a load or store to this page
+        uint8_t cycles = 1;
+    };
+}
+
+/**
+ * Maps every 4KB page of the physical address space (the first 512MB,
+ * after 'map::maskRegion') to host memory, or to the I/O registers.
+ *
+ * The two I/O pages at 0x1F801000 are looked up a word at a time,
+ * so every register block gets its own device index and wait states.
+ * Anything above 512MB (cache control) isn't in the table.
+ */
+class PageTable {
+    public:
+        static constexpr uint32_t PAGE_SHIFT = 12;
+        static constexpr uint32_t PAGE_MASK  = (1u << PAGE_SHIFT) - 1;
+        static constexpr uint32_t PAGES      = 0x20000000 >> PAGE_SHIFT;
+
+        static constexpr uint32_t IO_BASE  = 0x1F801000;
+        static constexpr uint32_t IO_WORDS = 0x2000 / 4;
+
+        PageTable() : pages(PAGES) {}
+
+        void build(uint8_t* ram, uint8_t* bios, uint8_t* scratchPad) {
+            std::fill(pages.begin(), pages.end(), map::Page{});
+
+            // Main RAM is 2MB mirrored four times over the first 8MB
+            for (uint32_t addr = 0; addr < map::RAM.length; addr += PAGE_SIZE)
+                setPage(addr, {ram + (addr & 0x1FFFFF), PAGE_SIZE, map::Region::Ram, 3});
+
+            if (bios) {
+                for (uint32_t offset = 0; offset < map::BIOS.length; offset += PAGE_SIZE)
+                    setPage(map::BIOS.start + offset, {bios + offset, PAGE_SIZE, map::Region::Bios, 5});
+            }
+
+            setPage(map::SCRATCHPAD.start, {scratchPad, static_cast<uint16_t>(map::SCRATCHPAD.length), map::Region::ScratchPad, 0});
+
+            for (uint32_t offset = 0; offset < map::EXPANSION1.length; offset += PAGE_SIZE)
+                setPage(map::EXPANSION1.start + offset, {nullptr, 0, map::Region::Unmapped, 8});
+
+            setPage(IO_BASE, {nullptr, 0, map::Region::Io, 1});
+            setPage(IO_BASE + PAGE_SIZE, {nullptr, 0, map::Region::Io, 1});
+
+            io.fill({map::Device::None, 1});
+
+            // Same order as the old lookup chain, later entries win
+            mapDevice(map::EXPANSION2, map::Device::Expansion2, 2);
+            mapDevice(map::PCSX_REDUX_EXPANSION, map::Device::PcsxRedux, 2);
+            mapDevice(map::RAM_SIZE, map::Device::RamSize, 1);
+            mapDevice(map::MEMCONTROL, map::Device::MemControl, 2);
+            mapDevice(map::PADMEMCARD, map::Device::PadMemCard, 2);
+            mapDevice(map::SPU, map::Device::Spu, 2);
+            mapDevice(map::MDEC, map::Device::Mdec, 2);
+            mapDevice(map::CDROM, map::Device::Cdrom, 2);
+            mapDevice(map::TIMERS, map::Device::Timers, 2);
+            mapDevice(map::GPU, map::Device::Gpu, 2);
+            mapDevice(map::DMA, map::Device::Dma, 2);
+            mapDevice(map::IRQ_CONTROL, map::Device::IrqControl, 2);
+        }
+
+        // 'absAddr' has to already be masked with 'map::maskRegion'
+        [[nodiscard]] inline const map::Page& lookup(uint32_t absAddr) const {
+            if (absAddr >= 0x20000000)
+                return unmapped;
+
+            return pages[absAddr >> PAGE_SHIFT];
+        }
+
+        // Returns the device behind an I/O address, and the offset into its registers
+        [[nodiscard]] inline map::Device device(uint32_t absAddr, uint32_t& offset) const {
+            if (absAddr < IO_BASE || absAddr >= IO_BASE + IO_WORDS * 4)
+                return map::Device::None;
+
+            map::Device device = io[(absAddr - IO_BASE) >> 2].device;
+            offset = absAddr - deviceBase[static_cast<size_t>(device)];
+
+            return device;
+        }
+
+        // Every page in order, so generated code can look them up itself
+        [[nodiscard]] const map::Page* data() const { return pages.data(); }
+
+        [[nodiscard]] inline int accessCycles(uint32_t absAddr) const {
+            if (absAddr >= 0x20000000)
+                return map::CACHECONTROL.contains(absAddr) ? 2 : 1;
+
+            const map::Page& page = pages[absAddr >> PAGE_SHIFT];
+
+            if (page.region == map::Region::Io)
+                return io[(absAddr - IO_BASE) >> 2].cycles;
+
+            // Past the end of the scratchpad
+            if (page.host && (absAddr & PAGE_MASK) >= page.size)
+                return 1;
+
+            return page.cycles;
+        }
+
+    private:
+        static constexpr uint16_t PAGE_SIZE = 1u << PAGE_SHIFT;
+
+        struct IoSlot {
+            map::Device device;
+            uint8_t cycles;
+        };
+
+        void setPage(uint32_t addr, const map::Page& page) {
+            pages[addr >> PAGE_SHIFT] = page;
+        }
+
+        void mapDevice(const map::Range& range, map::Device device, uint8_t cycles) {
+            deviceBase[static_cast<size_t>(device)] = range.start;
+
+            for (uint32_t addr = range.start & ~3u; addr < range.start + range.length; addr += 4)
+                io[(addr - IO_BASE) >> 2] = {device, cycles};
+        }
+
+    private:
+        std::vector<map::Page> pages;
+        std::array<IoSlot, IO_WORDS> io{};
+        std::array<uint32_t, static_cast<size_t>(map::Device::PcsxRedux) + 1> deviceBase{};
+
+        map::Page unmapped;
+};
@@ -1,6 +1,7 @@
 ﻿#pragma once
 
 #include <array>
+#include <stdexcept>
 #include <stdint.h>
 
 #ifndef MAP_H
@@ -80,14 +81,9 @@ namespace map {
     };
     
     inline uint32_t maskRegion(uint32_t addr) {
-        // Index address space in 512 chunks
-        size_t index = addr >> 29;
-        
-        if(index >= REGION_MASK.size()) {
-            throw std::out_of_range("Address index out of range");
-        }
-        
-        return addr & REGION_MASK[index];
+        // Index address space in 512 chunks, there's exactly
+        // one mask per chunk so the index can't go out of range
+        return addr & REGION_MASK[addr >> 29];
     }
     inline bool isExecutableAddress(uint32_t addr) {
         uint32_t masked = map::maskRegion(addr);
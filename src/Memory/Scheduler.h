@@ -0,0 +1,61 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <limits>
+
+/**
+ * Keeps the CPU timestamp and the next deadline of every device.
+ *
+ * Devices used to be stepped once per CPU cycle, now they're only
+ * run once the CPU passes the earliest deadline, or when one of
+ * their registers is accessed, see 'Interconnect::catchUp'.
+ */
+class Scheduler {
+    public:
+        enum class Event : uint8_t {
+            Crtc,
+            Timers,
+            Cdrom,
+            Sio,
+            Dma,
+            Spu,
+            Count,
+        };
+
+        static constexpr uint64_t NEVER = std::numeric_limits<uint64_t>::max();
+
+        // Moves the CPU timestamp forward, returns true once a deadline has passed
+        inline bool advance(uint32_t cycles) {
+            now += cycles;
+
+            return now >= next;
+        }
+
+        // Sets when 'event' is due, UINT32_MAX means it isn't pending
+        void schedule(Event event, uint32_t cycles) {
+            deadlines[static_cast<size_t>(event)] = cycles == UINT32_MAX ? NEVER : now + cycles;
+
+            next = NEVER;
+
+            for (uint64_t deadline : deadlines)
+                next = deadline < next ? deadline : next;
+        }
+
+        [[nodiscard]] uint64_t timestamp() const { return now; }
+        [[nodiscard]] uint64_t nextDeadline() const { return next; }
+
+        void reset() {
+            now = 0;
+            next = 0;
+            deadlines.fill(0);
+        }
+
+    private:
+        uint64_t now = 0;
+
+        // Earliest entry of 'deadlines'
+        uint64_t next = 0;
+
+        std::array<uint64_t, static_cast<size_t>(Event::Count)> deadlines{};
+};
@@ -1,6 +1,6 @@
 ﻿#include "Timer.h"
 
-#include <GLFW/glfw3native.h>
+#include <algorithm>
 
 #include "../../GPU/Gpu.h"
 #include "../IRQ.h"
@@ -238,6 +238,43 @@ void Emulator::IO::Timer::finishTick(uint32_t ticks) {
 }
 */
 
+uint32_t Emulator::IO::Timer::cyclesUntilIrq() const {
+	if (!mode.interruptTarget && !mode.interruptWrap)
+		return UINT32_MAX;
+	
+	// One-shot that already fired
+	if (mode.interruptMode == 0 && !mode.interrupt)
+		return UINT32_MAX;
+	
+	// Counting HBlanks, those are CRTC events already
+	if (type == TimerType::Timer1_HBlank && (mode.source & 1))
+		return UINT32_MAX;
+	
+	uint32_t ticks = 0x10000 - counter;
+	
+	if (mode.interruptTarget) {
+		if (target == 0)
+			ticks = 1;
+		else if (resetPending)
+			ticks = 1 + target; // The next tick only clears the counter
+		else if (counter < target)
+			ticks = std::min<uint32_t>(ticks, target - counter);
+	}
+	
+	if (type == TimerType::Timer0_DotClock && (mode.source & 1)) {
+		// The first dot may be just about done, and assume the fastest
+		// video clock, so this always errs on the early side
+		uint64_t cycles = uint64_t(ticks - 1) * std::max(dotClockDivisor, 1u) * Gpu::CRTC_DEN / Gpu::NTSC_CRTC_NUM;
+		
+		return static_cast<uint32_t>(std::max<uint64_t>(cycles, 2) - 1);
+	}
+	
+	if (type == TimerType::Timer2_SystemClock8 && mode.source >= 2)
+		return std::max<uint32_t>(ticks * 8 - _cycles, 1);
+	
+	return ticks;
+}
+
 void Emulator::IO::Timer::requestIRQ() {
 	if (mode.interruptMode == 0) {
 		// One-shot: only fire if not already fired
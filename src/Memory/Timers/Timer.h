@@ -61,6 +61,10 @@ namespace Emulator {
 				void setMode(uint16_t val);
 				uint16_t getMode();
 				
+				// CPU cycles until the timer could raise an IRQ, UINT32_MAX if it can't.
+				// Never late, it may be early for timers counting dots.
+				uint32_t cyclesUntilIrq() const;
+				
 				void reset();
 				
 			private:
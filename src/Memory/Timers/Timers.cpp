@@ -1,5 +1,6 @@
 ﻿#include "Timers.h"
 
+#include <algorithm>
 #include <cstdio>
 
 Emulator::IO::Timers::Timers()
@@ -20,6 +21,21 @@ void Emulator::IO::Timers::sync(bool isInHBlank, bool isInVBlank, uint32_t dot,
 	// Timer 3 only uses system clock
 }
 
+uint32_t Emulator::IO::Timers::cyclesUntilIrq() const {
+	uint32_t cycles = UINT32_MAX;
+	
+	for (const Timer* timer : timers)
+		cycles = std::min(cycles, timer->cyclesUntilIrq());
+	
+	return cycles;
+}
+
+bool Emulator::IO::Timers::hasBlankingEdge() const {
+	const Timer& timer = *timers[0];
+	
+	return timer.wasInHBlank != timer.isInHBlank || timer.wasInVBlank != timer.isInVBlank;
+}
+
 uint32_t Emulator::IO::Timers::load(uint32_t addr) {
 	auto index = addr >> 4;
 	
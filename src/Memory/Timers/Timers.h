@@ -12,6 +12,12 @@ namespace Emulator {
 			void step(uint32_t cycles, uint32_t dotTicks);
 			void sync(bool isInHBlank, bool isInVBlank, uint32_t dot, uint8_t dotClockDivisor);
 			
+			// Earliest 'Timer::cyclesUntilIrq' of the three
+			uint32_t cyclesUntilIrq() const;
+			
+			// True until the timers have been stepped once since the last blanking edge
+			bool hasBlankingEdge() const;
+			
 			uint32_t load(uint32_t addr);
 			void store(uint32_t addr, uint32_t val);
 			
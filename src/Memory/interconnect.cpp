@@ -1,5 +1,6 @@
 ﻿#include "interconnect.h"
 
+#include <algorithm>
 #include <string>
 
 #include "Memories/Ram.h"
@@ -8,13 +9,6 @@
 
 bool Interconnect::step(uint32_t cycles) {
     _cdrom.step(cycles);
-    
-    int16_t cdLeft = 0;
-    int16_t cdRight = 0;
-    while (_cdrom.popAudioSample(cdLeft, cdRight)) {
-        spu.pushCdAudioSample(cdLeft, cdRight);
-    }
-    
     _sio.step(cycles);
     _dma.step();
     spu.step(cycles);
@@ -31,6 +25,56 @@ bool Interconnect::step(uint32_t cycles) {
     return didVBlank;
 }
 
+bool Interconnect::advance(uint32_t cycles) {
+    if (scheduler.advance(cycles))
+        catchUp();
+
+    bool didVBlank = vblankPending;
+    vblankPending = false;
+
+    return didVBlank;
+}
+
+void Interconnect::catchUp() {
+    uint64_t pending = scheduler.timestamp() - syncedCycles;
+
+    if (pending == 0 || !_gpu)
+        return;
+
+    syncedCycles = scheduler.timestamp();
+
+    while (pending > 0) {
+        uint32_t run;
+
+        // Timers act on a blanking edge during the first cycle after it,
+        // that cycle runs on its own like it did when stepping every cycle.
+        // Otherwise never run past a CRTC event, or the edge would be missed.
+        if (_timers.hasBlankingEdge())
+            run = 1;
+        else
+            run = static_cast<uint32_t>(std::min<uint64_t>(pending, _gpu->cyclesUntilNextCRTCEvent()));
+
+        if (step(run))
+            vblankPending = true;
+
+        pending -= run;
+    }
+
+    reschedule();
+}
+
+void Interconnect::reschedule() {
+    if (_gpu)
+        scheduler.schedule(Scheduler::Event::Crtc, _gpu->cyclesUntilNextCRTCEvent());
+
+    // A blanking edge can reset or unpause a counter, the timers can only tell once it's been stepped
+    scheduler.schedule(Scheduler::Event::Timers, _timers.hasBlankingEdge() ? 1 : _timers.cyclesUntilIrq());
+    scheduler.schedule(Scheduler::Event::Cdrom, _cdrom.cyclesUntilEvent());
+    scheduler.schedule(Scheduler::Event::Sio, _sio.cyclesUntilEvent());
+    scheduler.schedule(Scheduler::Event::Dma, _dma.interruptPending ? 0 : UINT32_MAX);
+    scheduler.schedule(Scheduler::Event::Spu, spu.cyclesUntilEvent());
+}
+
 uint32_t Interconnect::dmaReg(uint32_t offset) {
     uint32_t align = offset & 3;
     offset = offset & ~3;
@@ -117,10 +161,24 @@ void Interconnect::dmaBlock(Port port) {
                 auto srcWord = _ram.load<uint32_t>(curAddr);
                 
                 switch (port) {
-                    case Gpu:
+                    case Gpu: {
+                        if (increment > 0) {
+                            // Image data goes into VRAM a row at a time, as far as RAM goes
+                            const size_t words = std::min<size_t>(remsz.value(), (0x200000 - curAddr) / 4);
+                            const size_t taken = _gpu->gp0ImageBlock(_ram.data.data() + curAddr, words);
+                            
+                            if (taken > 0) {
+                                addr += taken * 4;
+                                remsz.value() -= taken;
+                                
+                                continue;
+                            }
+                        }
+                        
                         _gpu->gp0(srcWord);
                         
                         break;
+                    }
                     case MdecIn:
                         if (!mdec.dataInRequest())
                             break;
@@ -199,6 +257,7 @@ void Interconnect::dmaBlock(Port port) {
                 }
                 
                 _ram.store<uint32_t>(curAddr, srcWord);
+                invalidateCode(curAddr);
                 
                 break;
             }
@@ -1,11 +1,14 @@
 ﻿#pragma once
 
+#include <cstring>
 #include <iostream>
 #include <stdint.h>
 #include <optional>
 #include <sstream>
 #include <string>
 
+#include "../CPU/BlockCache.h"
+#include "../CPU/DecodeCache.h"
 #include "../DMA/Dma.h"
 #include "../GPU/Gpu.h"
 #include "../Memory/CDROM/CDROM.h"
@@ -17,7 +20,9 @@
 #include "Bios/Bios.h"
 #include "MDEC/MDEC.h"
 #include "Memories/Ram.h"
+#include "PageTable.h"
 #include "Range.h"
+#include "Scheduler.h"
 #include "SPU/SPU.h"
 
 //#include "CDROM/cdrom.h"
@@ -56,16 +61,17 @@ struct ICache {
 class Interconnect {
 public:
     Interconnect()  : memControl{}, _gpu(nullptr), _spu(nullptr) {
-        
+        spu.setCdAudioInput(_cdrom.audioOutput());
+        mapMemory();
     }
     
-    Interconnect(Emulator::Gpu* gpu/*, Emulator::SPU spu*/)
+    Interconnect(Emulator::Gpu* gpu/*, Emulator::SPU spu*/, const std::string& biosPath = "../../BIOS/ps-22a.bin")
         : memControl{}, _gpu(gpu), _spu(new spu::SPU())
     /*, spu(spu)*/ {
         _ram = Ram();
         
         // TODO;
-        _bios = Bios("../../BIOS/ps-22a.bin");
+        _bios = Bios(biosPath);
         //_bios = Bios("../../BIOS/openbios.bin");
         //_bios = Bios("../BIOS/openbios2.bin");
         //_bios = Bios("../BIOS/openbios-fastboot.bin");
@@ -73,6 +79,11 @@ public:
         
         _dma = Dma();
         
+        // CD audio goes straight from the drive to the SPU
+        spu.setCdAudioInput(_cdrom.audioOutput());
+        
+        mapMemory();
+        
         if (false) {
             mdec.reset();
             mdec.luminanceQuantTable.fill(1);
@@ -83,12 +94,6 @@ public:
             // Structure: DCT(DC=Y, Q=1), RLE(AC=0, LEN=0)
             std::vector<uint16_t> testInput;
             
-            mdec.command.DataOutputSigned = 1;
-            // For colored macroblock (DataOutputDepth=3)
-            mdec.command.DataOutputDepth = 3;
-            mdec.command.Op = 1; // Decode macroblock
-            mdec.command.NumberOfParameterWords = 10;
-            
             auto makeDCT = [](uint16_t dc) -> uint16_t {
                 return (1 << 10) | (dc & 0x3FF); // Q=1, DC in lower 10 bits
             };
@@ -97,21 +102,33 @@ public:
             for (int i = 0; i < 64; i++) testInput.push_back(makeDCT(512)); // Cb
             for (int i = 0; i < 64*4; i++) testInput.push_back(makeDCT(512)); // Yblk0..3
             
-            mdec.input = testInput;
-            mdec.command.NumberOfParameterWords = testInput.size();
+            // Decode macroblock, signed, colored macroblock (DataOutputDepth=3)
+            mdec.store(0, (1u << 29) | (3u << 27) | (1u << 26) | (testInput.size() / 2));
             
-            mdec.decodeBlocks();
+            for (size_t i = 0; i < testInput.size(); i += 2)
+                mdec.store(0, testInput[i] | (testInput[i + 1] << 16));
             
             std::cout << "Decoded RGB555 pixels (first 16):\n";
-            for (int i = 0; i < 16; i++) {
-                std::cout << std::hex << mdec.output[i] << " ";
+            for (int i = 0; i < 8; i++) {
+                std::cout << std::hex << mdec.load(0) << " ";
             }
             std::cout << std::endl;
         }
     }
     
+    // Runs every device for 'cycles' at once
     bool step(uint32_t cycles);
     
+    // Moves the CPU timestamp forward and runs the devices if one of
+    // them is due, returns true once a VBlank has started since the last call
+    bool advance(uint32_t cycles);
+    
+    // Brings every device up to the scheduler's timestamp
+    void catchUp();
+    
+    // Asks every device when it needs to run next
+    void reschedule();
+    
     inline uint32_t loadInstruction(uint32_t addr) {
         lastICacheMiss = false;
 
@@ -155,162 +172,186 @@ public:
         return data;
     }
     
+    // Reads an instruction word from RAM or the BIOS without
+    // touching the I-Cache, used when building code blocks.
+    inline uint32_t peekInstruction(uint32_t addr) {
+        uint32_t abs_addr = map::maskRegion(addr);
+        uint32_t offset = 0;
+
+        if (map::RAM.contains(abs_addr, offset))
+            return _ram.load<uint32_t>(offset);
+
+        if (map::BIOS.contains(abs_addr, offset))
+            return _bios.load<uint32_t>(offset);
+
+        throw std::runtime_error("Can't peek an instruction outside of RAM or the BIOS");
+    }
+
+    // Drops any cached code for the given RAM offset
+    inline void invalidateCode(uint32_t offset) {
+        decodeCache.invalidateRam(offset);
+        blockCache.markDirty(offset);
+    }
+    
+    // Same I-Cache bookkeeping as 'loadInstruction' for a word the
+    // CPU already has decoded, without going through the memory map.
+    // Returns true if the fetch would've missed the cache.
+    inline bool instructionCacheMiss(uint32_t addr, uint32_t word) {
+        if(_cacheControl.isCacheEnabled() == 0 || addr >= 0xA0000000)
+            return true;
+        
+        uint32_t tag = (addr & 0xFFFFF000) >> 12;
+        uint16_t index = (addr & 0xFFC) >> 2;
+        
+        ICache& line = icache[index];
+        
+        if (line.valid && line.tag == tag)
+            return false;
+        
+        line.valid = true;
+        line.tag = tag;
+        line.data = word;
+        
+        return true;
+    }
+    
     template<typename T>
     T load(uint32_t addr) {
         uint32_t abs_addr = map::maskRegion(addr);
-        uint32_t offset = 0;
+        const map::Page& page = pageTable.lookup(abs_addr);
         
-        if (map::RAM.contains(abs_addr, offset)) {
-            T value = _ram.load<T>(offset);
+        // RAM, the scratchpad and the BIOS are read straight from host memory
+        if (page.host && (abs_addr & PageTable::PAGE_MASK) < page.size) {
+            T value;
+            std::memcpy(&value, page.host + (abs_addr & PageTable::PAGE_MASK), sizeof(T));
 
             // For psx-redux
             if constexpr (sizeof(T) == 4) {
-                uint32_t biu = _cacheControl.val;
+                if (page.region == map::Region::Ram) {
+                    uint32_t biu = _cacheControl.val;
 
-                bool dsOnly = (biu & (1u << 7)) && !(biu & (1u << 3));
-                bool cached = addr < 0xa0000000;
+                    bool dsOnly = (biu & (1u << 7)) && !(biu & (1u << 3));
+                    bool cached = addr < 0xa0000000;
 
-                if (dsOnly && cached) {
-                    _scratchPad.store<uint32_t>(((addr >> 2) & 0xff) * 4, static_cast<uint32_t>(value));
+                    if (dsOnly && cached) {
+                        _scratchPad.store<uint32_t>(((addr >> 2) & 0xff) * 4, static_cast<uint32_t>(value));
+                    }
                 }
             }
 
             return value;
         }
         
-        if (map::SCRATCHPAD.contains(abs_addr, offset)) {
-            if (addr > 0xa0000000) {
-                //throw std::runtime_error("ScratchPad access through uncached memory");
-            }
-            
-            return _scratchPad.load<T>(offset);
-        }
+        // Anything else is a register, so the devices have to be up to date
+        catchUp();
         
-        if (map::BIOS.contains(abs_addr, offset)) {
-            return _bios.load<T>(offset);
-        }
+        T value = loadIo<T>(addr, abs_addr);
+        
+        // The access may have moved a device's next deadline
+        reschedule();
         
-        if (map::IRQ_CONTROL.contains(abs_addr, offset)) {
-            switch (offset) {
-                case 0: {
-                    return _irq.getStatus();
+        return value;
+    }
+    
+    template<typename T>
+    T loadIo(uint32_t addr, uint32_t abs_addr) {
+        uint32_t offset = 0;
+        
+        switch (pageTable.device(abs_addr, offset)) {
+            case map::Device::IrqControl: {
+                switch (offset) {
+                    case 0: {
+                        return _irq.getStatus();
+                    }
+                    
+                    case 4: {
+                        return _irq.getMask();
+                    }
+                    
+                    default: {
+                        throw std::runtime_error("Error; Unsupported IRQ offset");
+                    }
                 }
-                
-                case 4: {
-                    return _irq.getMask();
+            }
+            
+            case map::Device::Dma:
+                return dmaReg(offset);
+            
+            case map::Device::PcsxRedux:
+                // Read "PCSX" expansion ID, console putchar, breakpoints etc.. aren't supported
+                return 0;
+            
+            // 0x1f801810
+            case map::Device::Gpu: {
+                switch (offset) {
+                    case 0:
+                        return _gpu->read();
+                    case 4: {
+                        return _gpu->status();
+                    }
+                    default:
+                        throw std::runtime_error("Unhandled GPU load at address 0x");
                 }
+            }
+            
+            case map::Device::Timers:
+                return _timers.load(offset);
+            
+            case map::Device::Cdrom:
+                return _cdrom.load(offset);
+            
+            case map::Device::Mdec:
+                return mdec.load(offset);
+            
+            case map::Device::Spu: {
+                // https://github.com/psx-spx/psx-spx.github.io/blob/master/docs/soundprocessingunitspu.md
+                uint16_t v = _spu->read(offset) | _spu->read(offset + 1) << 8;
                 
-                default: {
-                    throw std::runtime_error("Error; Unsupported IRQ offset");
-                }
+                return v;
             }
-        }
-        
-        if (map::DMA.contains(abs_addr, offset)) {
-            return dmaReg(offset);
-        }
-        
-        if (map::PCSX_REDUX_EXPANSION.contains(abs_addr, offset)) {
-            /*switch (offset) {
-                case 0:
-                        // Read "PCSX" expansion ID
-                        return 0;
-                case 1: 
-                        // Handle console putchar (write character to console)
-                        return 0;
-                case 2: 
-                        // Handle debug breakpoint (pause emulator)
-                        return 0;
-                case 3: 
-                        // Handle exit code (set exit code)
-                        return 0;
-                case 4: 
-                        // Handle notification message pointer (show pop-up)
-                        return 0;
-                default:
-                    throw std::runtime_error("Unhandled PCSX-Redux Expansion access");
-            }*/
             
-            return 0;
-        }
-        
-        // 0x1f801810
-        if (map::GPU.contains(abs_addr, offset)) {
-            switch (offset) {
-                case 0:
-                    return _gpu->read();
-                case 4: {
-                    return _gpu->status();
+            case map::Device::PadMemCard:
+                return _sio.load(abs_addr, sizeof(T));
+            
+            case map::Device::RamSize:
+                return _ramSize;
+            
+            case map::Device::MemControl: {
+                if (sizeof(T) != 4) {
+                    throw std::runtime_error("Unhandled MEM_CONTROL access (" + std::to_string(sizeof(T)) + ")");
                 }
-                default:
-                    throw std::runtime_error("Unhandled GPU load at address 0x");
+                
+                uint32_t index = (offset >> 2);
+                return memControl[index];
             }
             
-            printf("broo");
-        }
-        
-        if (map::TIMERS.contains(abs_addr, offset)) {
-            return _timers.load(offset);
-        }
-        
-        if (map::CDROM.contains(abs_addr, offset)) {
-            return _cdrom.load(offset);
-            //return psx_cdrom_read8(_cdrom, offset);
-        }
-        
-        if (map::MDEC.contains(abs_addr, offset)) {
-            //throw std::runtime_error("Unhandled MDEC load at address 0x" + to_hex(addr));
-            return mdec.load(offset);
-        }
-        
-        if (map::SPU.contains(abs_addr, offset)) {
-            // https://github.com/psx-spx/psx-spx.github.io/blob/master/docs/soundprocessingunitspu.md
-            //std::cerr << "SPU load register; " << to_hex(addr) << "\n";
-            //static int h = 0;
-            uint16_t v = _spu->read(offset) | _spu->read(offset + 1) << 8;
-
-            /*if constexpr (sizeof(T) == 1) {
-                uint32_t regAddr = abs_addr & ~1u;
-                uint16_t reg = static_cast<uint16_t>(spu.load(regAddr));
-                return static_cast<T>((reg >> ((abs_addr & 1u) * 8)) & 0xFF);
-            } else if constexpr (sizeof(T) == 2) {
-                return static_cast<T>(spu.load(abs_addr & ~1u));
-            } else if constexpr (sizeof(T) == 4) {
-                uint32_t lo = spu.load(abs_addr & ~1u);
-                uint32_t hi = spu.load((abs_addr & ~1u) + 2);
-                return static_cast<T>(lo | (hi << 16));
-            }*/
-            
-            //auto f = spu.load(addr);
-            //h++;
-
-            //if (f != v) {
-           //     v = _spu->read(offset) | _spu->read(offset + 1) << 8;
-            //    f = spu.load(addr);
-                //printf("AYO %x != %x\n", v, f);
-            //}
-
-            //return f;
-            return v;
-
-            //return spu.load(addr);
-        }
-
-        if (auto _ = map::PADMEMCARD.contains(abs_addr, offset)) {
-            return _sio.load(abs_addr, sizeof(T));
-        }
-
-        if (auto _ = map::RAM_SIZE.contains(abs_addr, offset)) {
-            return _ramSize;
-        }
-
-        if (map::MEMCONTROL.contains(abs_addr, offset)) {
-            if (sizeof(T) != 4) {
-                throw std::runtime_error("Unhandled MEM_CONTROL access (" + std::to_string(sizeof(T)) + ")");
+            case map::Device::Expansion2: {
+                // https://psx-spx.consoledev.net/expansionportpio/#1f802021hread-sra-duart-status-register-a-r
+                if (offset == 0) {
+                    /**
+                     * 0    Unknown, used for something
+                     * 1    Unknown/unused
+                     * 2    Unknown, used for something
+                     * 3    TTY/Atcons TX Ready     (0=Busy, 1=Ready)
+                     * 4    TTY/Atcons RX Available (0=None, 1=Yes)
+                     * 5-7  Unknown/unused
+                     */
+                    return 0x04 | 0x08;
+                }
+                
+                if(offset == 0x21) {
+                    // UART status register A.
+                    // Just indicating that,
+                    // the bit for "Tx ready" is set.
+                    //return 1 << 2; // 4
+                    return 0x04 | 0x08;
+                }
+                
+                throw std::runtime_error("Unhandled EXPANSION_2 load at address 0x");
             }
-
-            uint32_t index = (offset >> 2);
-            return memControl[index];
+            
+            case map::Device::None:
+                break;
         }
 
         if (auto _ = map::CACHECONTROL.contains(abs_addr, offset)) {
@@ -322,41 +363,8 @@ public:
         }
 
         if (auto _ = map::EXPANSION1.contains(abs_addr, offset)) {
-            T r = 0;
-
-            /*for(size_t i = 0; i < sizeof(T); i++) {
-                // Simulate that nothing is connected
-                uint8_t data = 0;
-
-                r |= (static_cast<uint32_t>(data) << (8 * i));
-            }*/
-
-            return r;
-        }
-
-        if (map::EXPANSION2.contains(abs_addr, offset)) {
-            // https://psx-spx.consoledev.net/expansionportpio/#1f802021hread-sra-duart-status-register-a-r
-            if (offset == 0) {
-                /**
-                 * 0    Unknown, used for something
-                 * 1    Unknown/unused
-                 * 2    Unknown, used for something
-                 * 3    TTY/Atcons TX Ready     (0=Busy, 1=Ready)
-                 * 4    TTY/Atcons RX Available (0=None, 1=Yes)
-                 * 5-7  Unknown/unused
-                 */
-                return 0x04 | 0x08;
-            }
-
-            if(offset == 0x21) {
-                // UART status register A.
-                // Just indicating that,
-                // the bit for "Tx ready" is set.
-                //return 1 << 2; // 4
-                return 0x04 | 0x08;
-            }
-
-            throw std::runtime_error("Unhandled EXPANSION_2 load at address 0x");
+            // Simulate that nothing is connected
+            return 0;
         }
 
         // TODO: Hardcoded due to a test
@@ -378,147 +386,141 @@ public:
     template<typename T>
     void store(uint32_t addr, T val) {
         uint32_t abs_addr = map::maskRegion(addr);
-        uint32_t offset = 0;
+        const map::Page& page = pageTable.lookup(abs_addr);
 
-        if (map::RAM.contains(abs_addr, offset)) {
-            _ram.store<T>(offset, val);
+        // RAM and the scratchpad are written straight to host memory
+        if (page.host && page.region != map::Region::Bios && (abs_addr & PageTable::PAGE_MASK) < page.size) {
+            std::memcpy(page.host + (abs_addr & PageTable::PAGE_MASK), &val, sizeof(T));
+
+            if (page.region == map::Region::Ram)
+                invalidateCode(abs_addr);
 
             return;
         }
 
-        if (map::SCRATCHPAD.contains(abs_addr, offset)) {
-            if (addr > 0xa0000000) {
-                //throw std::runtime_error("ScratchPad access through uncached memory");
-            }
-
-            _scratchPad.store<T>(offset, val);
+        catchUp();
+        storeIo<T>(addr, abs_addr, val);
+        reschedule();
+    }
 
-            return;
-        }
+    template<typename T>
+    void storeIo(uint32_t addr, uint32_t abs_addr, T val) {
+        uint32_t offset = 0;
 
-        if (map::IRQ_CONTROL.contains(abs_addr, offset)) {
-            switch (offset) {
-                case 0: {
-                    _irq.acknowledge(static_cast<uint16_t>(val));
-                    break;
+        switch (pageTable.device(abs_addr, offset)) {
+            case map::Device::IrqControl: {
+                switch (offset) {
+                    case 0: {
+                        _irq.acknowledge(static_cast<uint16_t>(val));
+                        break;
+                    }
+
+                    case 4: {
+                        _irq.setMask(static_cast<uint16_t>(val));
+                        break;
+                    }
+
+                    default: {
+                        throw std::runtime_error("Unhandled IRQ control: 0x");
+                    }
                 }
 
-                case 4: {
-                    _irq.setMask(static_cast<uint16_t>(val));
-                    break;
-                }
+                return;
+            }
+
+            case map::Device::Dma:
+                setDmaReg(offset, val);
 
-                default: {
-                    throw std::runtime_error("Unhandled IRQ control: 0x");
+                return;
+
+            case map::Device::Gpu: {
+                switch (offset) {
+                    case 0:
+                        _gpu->gp0(val);
+                        break;
+                    case 4:
+                        _gpu->gp1(val);
+                        break;
+                    default:
+                        throw std::runtime_error("GPU write " + std::to_string(offset) + ": 0x");
                 }
+
+                return;
             }
 
-            return;
-        }
+            case map::Device::Timers:
+                _timers.store(offset, val);
 
-        if (map::DMA.contains(abs_addr, offset)) {
-            setDmaReg(offset, val);
+                return;
 
-            return;
-        }
+            case map::Device::Cdrom:
+                _cdrom.store(offset, val);
 
-        if (map::GPU.contains(abs_addr, offset)) {
-            switch (offset) {
-                case 0:
-                    _gpu->gp0(val);
-                    break;
-                case 4:
-                    _gpu->gp1(val);
-                    break;
-                default:
-                    throw std::runtime_error("GPU write " + std::to_string(offset) + ": 0x");
-            }
+                return;
 
-            return;
-        }
+            case map::Device::Mdec:
+                mdec.store(offset, val);
 
-        if (map::TIMERS.contains(abs_addr, offset)) {
-            _timers.store(offset, val);
+                return;
 
-            return;
-        }
+            case map::Device::Spu:
+                _spu->write(offset, (val) & 0xFF);
+                _spu->write(offset + 1, (val >> 8) & 0xFF);
 
-        if (map::CDROM.contains(abs_addr, offset)) {
-            _cdrom.store(offset, val);
-            //psx_cdrom_write8(_cdrom, offset, val);
+                return;
 
-            return;
-        }
+            // Peripheral I/O Ports
+            case map::Device::PadMemCard:
+                _sio.store(abs_addr, val, sizeof(T));
 
-        if (map::MDEC.contains(abs_addr, offset)) {
-            mdec.store(offset, val);
+                return;
 
-            return;
-        }
+            case map::Device::MemControl: {
+                if (sizeof(T) != 4) {
+                    throw std::runtime_error("Unbalanced MEM_CONTROL access (" + std::to_string(sizeof(T)) + ")");
+                }
 
-        if (map::SPU.contains(abs_addr, offset)) {
-            //throw std::runtime_error(": 0x" + to_hex(offset) + " <- 0x" + to_hex(val));
+                uint32_t index = (offset >> 2);
+                memControl[index] = val;
 
-            _spu->write(offset, (val) & 0xFF);
-            _spu->write(offset + 1, (val >> 8) & 0xFF);
+                return;
+            }
 
-            /*if constexpr (sizeof(T) == 1) {
-                uint32_t regAddr = abs_addr & ~1u;
-                uint16_t reg = static_cast<uint16_t>(spu.load(regAddr));
-                uint16_t byteVal = static_cast<uint8_t>(val);
-                
-                if (abs_addr & 1u) {
-                    reg = static_cast<uint16_t>((reg & 0x00FF) | (byteVal << 8));
-                } else {
-                    reg = static_cast<uint16_t>((reg & 0xFF00) | byteVal);
+            case map::Device::RamSize: {
+                if (sizeof(T) != 4) {
+                    throw std::runtime_error("Unhandled RAM_SIZE access");
                 }
-                
-                spu.store(regAddr, reg);
-            } else if constexpr (sizeof(T) == 2) {
-                spu.store(abs_addr & ~1u, static_cast<uint16_t>(val));
-            } else if constexpr (sizeof(T) == 4) {
-                spu.store(abs_addr & ~1u, static_cast<uint16_t>(val & 0xFFFF));
-                spu.store((abs_addr & ~1u) + 2, static_cast<uint16_t>((val >> 16) & 0xFFFF));
-            }*/
-            
-            return;
-        }
-        
-        // Peripheral I/O Ports
-        if (map::PADMEMCARD.contains(abs_addr, offset)) {
-            _sio.store(abs_addr, val, sizeof(T));
-            
-            return;
+
+                _ramSize = val;
+
+                return;
+            }
+
+            // Stores don't know about the PCSX-Redux registers,
+            // they're just part of the expansion region
+            case map::Device::PcsxRedux:
+            case map::Device::Expansion2: {
+                offset = abs_addr - map::EXPANSION2.start;
+
+                // TTY
+                if(offset == 0x23) {
+                    std::cerr << static_cast<char>(val) << "";
+                }
+
+                return;
+            }
+
+            case map::Device::None:
+                break;
         }
-        
+
         if (auto _ = map::CACHECONTROL.contains(abs_addr, offset)) {
             if (sizeof(T) != 4) {
                 throw std::runtime_error("Unhandled cache control access");
             }
-            
+
             _cacheControl.val = val;
-            
-            return;
-        }
-        
-        if (map::MEMCONTROL.contains(abs_addr, offset)) {
-            if (sizeof(T) != 4) {
-                throw std::runtime_error("Unbalanced MEM_CONTROL access (" + std::to_string(sizeof(T)) + ")");
-            }
-            
-            uint32_t index = (offset >> 2);
-            memControl[index] = val;
-            
-            return;
-        }
-        
-        if (auto _ = map::RAM_SIZE.contains(abs_addr, offset)) {
-            if (sizeof(T) != 4) {
-                throw std::runtime_error("Unhandled RAM_SIZE access");
-            }
-            
-            _ramSize = val;
-            
+
             return;
         }
 
@@ -530,15 +532,6 @@ public:
 
             throw std::runtime_error("Unhandled EXPANSION1 load at address 0x");
         }
-        
-        if (map::EXPANSION2.contains(abs_addr, offset)) {
-            // TTY
-            if(offset == 0x23) {
-                std::cerr << static_cast<char>(val) << "";
-            }
-            
-            return;
-        }
 
         // TOOD: ???
         if (addr == 0xBFC00000) {
@@ -607,11 +600,27 @@ public:
         for(auto& i : icache)
             i = {};
         
+        decodeCache.reset();
+        blockCache.reset();
+        
+        scheduler.reset();
+        syncedCycles = 0;
+        vblankPending = false;
+        
         // TODO;
         _bios.reset("../BIOS/ps-22a.bin");
         _dma.reset();
         _gpu->reset();
         //spu.reset();
+        
+        mapMemory();
+    }
+    
+    // Points the page table at the RAM, BIOS and scratchpad buffers,
+    // has to be called again whenever one of them is reallocated.
+    // Moving the interconnect is fine, the buffers stay where they are.
+    void mapMemory() {
+        pageTable.build(_ram.data.data(), _bios.memory(), _scratchPad.memory());
     }
     
 private:
@@ -643,6 +652,20 @@ public:
     // The i-Cache can hold 4096 bytes, or 1024 instructions.
     ICache icache[1024];
     
+    // Decoded instructions for RAM and the BIOS, used by the CPU
+    DecodeCache decodeCache;
+    
+    // Basic blocks built from the same memory, see 'CPU::executeBlock'
+    BlockCache blockCache;
+    
+    // Where every 4KB page of the address space goes, see 'load' and 'store'
+    PageTable pageTable;
+    
+    // CPU time and device deadlines, devices have been run up to 'syncedCycles'
+    Scheduler scheduler;
+    uint64_t syncedCycles = 0;
+    bool vblankPending = false;
+    
     Bios _bios;
     Dma _dma;
     Emulator::Gpu* _gpu;
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+#include "../Utils/SpscRing.h"
+
+/**
+ * Single producer/single consumer ring of stereo frames, from the CD-ROM
+ * (CD-DA and XA-ADPCM, already through the CD volume matrix) to the SPU's
+ * CD audio input.
+ *
+ * A full ring drops what doesn't fit and an empty one leaves the SPU with
+ * silence, both get counted. 'clear' is for the producer, the consumer
+ * skips whatever was pushed before it.
+ */
+class CdAudioRing {
+    public:
+        struct Frame {
+            int16_t left;
+            int16_t right;
+        };
+
+        // Frames, about three seconds
+        static constexpr size_t CAPACITY = 1 << 17;
+
+        // Returns how many of 'count' fit, the rest count as overflow
+        size_t push(const Frame* in, size_t count) {
+            const size_t fits = frames.push(in, count);
+
+            if (fits < count)
+                overflow.fetch_add(count - fits, std::memory_order_relaxed);
+
+            return fits;
+        }
+
+        // Returns how many frames went into 'out', up to 'count'
+        size_t pop(Frame* out, size_t count) {
+            const size_t got = frames.pop(out, count);
+
+            // Running dry after getting frames is a gap in the audio (or the
+            // end of it), an idle ring isn't
+            if (got < count && draining)
+                underflow.fetch_add(1, std::memory_order_relaxed);
+
+            draining = got == count;
+
+            return got;
+        }
+
+        // Drops everything pushed so far, from the producer
+        void clear() { frames.clear(); }
+
+        [[nodiscard]] size_t size() const { return frames.size(); }
+
+        // Frames dropped on a full ring
+        [[nodiscard]] uint64_t overflows() const { return overflow.load(std::memory_order_relaxed); }
+
+        // Times the consumer ran out of frames in the middle of taking them
+        [[nodiscard]] uint64_t underflows() const { return underflow.load(std::memory_order_relaxed); }
+
+    private:
+        Emulator::Utils::SpscRing<Frame> frames{CAPACITY};
+
+        // Consumer side
+        bool draining = false;
+        std::atomic<uint64_t> underflow{0};
+
+        // Producer side
+        std::atomic<uint64_t> overflow{0};
+};
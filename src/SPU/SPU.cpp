@@ -14,6 +14,7 @@ typedef unsigned   uint32_t;
 //-#define LOG
 
 Emulator::SPU::SPU () {
+#ifndef PSX_HEADLESS
     if (SDL_InitSubSystem(SDL_INIT_AUDIO) != 0) {
         printf("Failed to init SDL audio: %s\n", SDL_GetError());
     }
@@ -38,30 +39,34 @@ Emulator::SPU::SPU () {
                have.samples);
         SDL_PauseAudioDevice(device, 0);
     }
+#endif
 }
 
 static uint32_t curCycles = 0;
+
+// Every 768 CPU cycles -> ~44.1 kHz
+static const uint32_t CYCLES_PER_SAMPLE = 768;
 static const int AUDIO_BUFFER_SIZE = 1024 * 2;
 int16_t audioBuffer[AUDIO_BUFFER_SIZE];
 int audioIndex = 0;
 
-void Emulator::SPU::pushCdAudioSample(int16_t left, int16_t right) {
-    static constexpr size_t maxQueuedSamples = 44100 * 2;
-    
-    if (cdAudioSamples.size() >= maxQueuedSamples) {
-        cdAudioSamples.pop_front();
-    }
-    
-    cdAudioSamples.emplace_back(left, right);
-}
-
 void Emulator::SPU::step(uint32_t cycles) {
     curCycles += cycles;
 
-    stepTransfer();
+    // One halfword is moved into sound RAM per cycle
+    for (uint32_t i = 0; i < cycles; i++) {
+        stepTransfer();
+
+        if (!status.Data_Transfer_Busy_Flag)
+            break;
+    }
 
-    // Every 768 CPU cycles -> ~44.1 kHz
-    const int CYCLES_PER_SAMPLE = 768;
+    // CD audio gets taken out of the ring a batch at a time, never more
+    // than the samples this call still has to make
+    static constexpr size_t CD_AUDIO_BATCH = 64;
+    CdAudioRing::Frame cdFrames[CD_AUDIO_BATCH];
+    size_t cdCount = 0;
+    size_t cdIndex = 0;
 
     while (curCycles >= CYCLES_PER_SAMPLE) {
         curCycles -= CYCLES_PER_SAMPLE;
@@ -86,11 +91,15 @@ void Emulator::SPU::step(uint32_t cycles) {
             right += voice.currentRight;
         }
         
-        if (!cdAudioSamples.empty()) {
-            auto sample = cdAudioSamples.front();
-            cdAudioSamples.pop_front();
-            cdLeft = sample.first;
-            cdRight = sample.second;
+        if (cdIndex == cdCount && cdAudio) {
+            cdCount = cdAudio->pop(cdFrames, std::min<size_t>(CD_AUDIO_BATCH, curCycles / CYCLES_PER_SAMPLE + 1));
+            cdIndex = 0;
+        }
+
+        if (cdIndex < cdCount) {
+            cdLeft = cdFrames[cdIndex].left;
+            cdRight = cdFrames[cdIndex].right;
+            cdIndex++;
         }
         
         left = (left * static_cast<int16_t>(mainValLeft)) >> 15;
@@ -109,7 +118,7 @@ void Emulator::SPU::step(uint32_t cycles) {
         
         if (audioIndex >= AUDIO_BUFFER_SIZE) {
             if (device != 0) {
-                SDL_QueueAudio(device, audioBuffer, sizeof(audioBuffer));
+                queueAudio(audioBuffer, sizeof(audioBuffer));
                 queuedBufferCount++;
             }
 
@@ -144,6 +153,17 @@ void Emulator::SPU::step(uint32_t cycles) {
     SDL_QueueAudio(device, frame, sizeof(frame));*/
 }
 
+uint32_t Emulator::SPU::cyclesUntilEvent() const {
+    // There's no IRQ9 (sound RAM address match) yet, so that's all
+    uint32_t next = CYCLES_PER_SAMPLE - curCycles;
+
+    // A halfword a cycle, the busy flag drops on the one after the last
+    if (status.Data_Transfer_Busy_Flag)
+        next = std::min(next, buffer.count + 1);
+
+    return next;
+}
+
 void Emulator::SPU::stepTransfer() {
     uint8_t mode = (spunct.Sound_RAM_Transfer) & 0x3;
 
@@ -855,5 +875,12 @@ void Emulator::SPU::handleVoiceInternalStore(uint32_t addr, uint32_t val) {
 }
 
 void Emulator::SPU::pushSamples(int16_t* samples, int sampleCount) {
-    SDL_QueueAudio(device, samples, sampleCount * sizeof(int16_t) * 2);
+    queueAudio(samples, sampleCount * sizeof(int16_t) * 2);
+}
+
+void Emulator::SPU::queueAudio(const void* data, uint32_t bytes) {
+#ifndef PSX_HEADLESS
+    if (device != 0)
+        SDL_QueueAudio(device, data, bytes);
+#endif
 }
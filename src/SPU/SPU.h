@@ -2,13 +2,17 @@
 
 #include <cstdio>
 #include <stdint.h>
-#include <deque>
+#include <memory>
 #include <vector>
 #include <utility>
+#ifndef PSX_HEADLESS
 #define SDL_MAIN_HANDLED
 #include <SDL2/SDL.h>
+#endif
 #include <algorithm>
 
+#include "CdAudioRing.h"
+
 namespace Emulator {
     struct Fifo {
         static constexpr uint32_t SIZE = 32;
@@ -592,17 +596,30 @@ namespace Emulator {
             void step(uint32_t cycles);
             void stepTransfer();
 
+            // CPU cycles until the next sample gets mixed, or a sound RAM
+            // transfer moves its last halfword
+            uint32_t cyclesUntilEvent() const;
+
             uint32_t load(uint32_t addr);
             void store(uint32_t addr, uint32_t val);
-            void pushCdAudioSample(int16_t left, int16_t right);
+
+            // Where CD-DA and XA-ADPCM come in from, see 'CDROM::audioOutput'
+            void setCdAudioInput(std::shared_ptr<CdAudioRing> ring) { cdAudio = std::move(ring); }
+
             uint16_t mainVolumeLeft() const { return mainValLeft; }
             uint16_t mainVolumeRight() const { return mainValRight; }
             int32_t lastMixedSampleLeft() const { return lastMixedLeft; }
             int32_t lastMixedSampleRight() const { return lastMixedRight; }
             uint64_t queuedAudioBuffers() const { return queuedBufferCount; }
-            size_t queuedCdAudioSamples() const { return cdAudioSamples.size(); }
+            size_t queuedCdAudioSamples() const { return cdAudio ? cdAudio->size() : 0; }
+            uint64_t cdAudioOverflows() const { return cdAudio ? cdAudio->overflows() : 0; }
+            uint64_t cdAudioUnderflows() const { return cdAudio ? cdAudio->underflows() : 0; }
             uint32_t queuedAudioBytes() const {
+#ifndef PSX_HEADLESS
                 return device ? SDL_GetQueuedAudioSize(device) : 0;
+#else
+                return 0;
+#endif
             }
 
         private:
@@ -654,7 +671,7 @@ namespace Emulator {
             // 1F801DB0h - CD Audio Input Volume (for normal CD-DA, and compressed XA-ADPCM)
             int16_t cdInputVolLeft = 0;
             int16_t cdInputVolRight = 0;
-            std::deque<std::pair<int16_t, int16_t>> cdAudioSamples;
+            std::shared_ptr<CdAudioRing> cdAudio;
 
             // 1F801DB4h - External Audio Input Volume
             uint16_t exVolLeft = 0;
@@ -694,6 +711,15 @@ namespace Emulator {
             Fifo buffer;
 
         private:
-            SDL_AudioDeviceID device;
+            // Hands mixed samples to the audio device, they're dropped if there's none
+            void queueAudio(const void* data, uint32_t bytes);
+
+        private:
+#ifndef PSX_HEADLESS
+            SDL_AudioDeviceID device = 0;
+#else
+            // Headless builds have no audio device
+            uint32_t device = 0;
+#endif
     };
 }
@@ -1,5 +1,6 @@
 #pragma once
 #include <array>
+#include <cstddef>
 #include "noise.h"
 #include "regs.h"
 #include "voice.h"
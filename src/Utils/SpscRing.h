@@ -0,0 +1,170 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <memory>
+
+namespace Emulator {
+	namespace Utils {
+		/**
+		 * Single producer/single consumer ring, between the emulator thread and
+		 * a 'Worker' (or the SPU, for CD audio).
+		 *
+		 * Allocated once, the positions only ever go up until 'reset', so it
+		 * holds 'tail - head' items. The consumer can look at 'front' and pop
+		 * it once it's done with it, the producer can 'reserve' room and write
+		 * in place. Power of two capacities wrap with a mask, anything else
+		 * with a modulo.
+		 */
+		template <typename T>
+		class SpscRing {
+		public:
+			explicit SpscRing(size_t capacity)
+				: _capacity(capacity), _mask((capacity & (capacity - 1)) == 0 ? capacity - 1 : 0),
+				  _items(std::make_unique<T[]>(capacity)) {}
+
+			SpscRing(const SpscRing&) = delete;
+			SpscRing& operator=(const SpscRing&) = delete;
+
+			[[nodiscard]] size_t capacity() const { return _capacity; }
+
+			[[nodiscard]] size_t size() const {
+				// Oldest first, so it can't be past the tail
+				const size_t first = oldest(_head.load(std::memory_order_acquire));
+				return _tail.load(std::memory_order_seq_cst) - first;
+			}
+
+			[[nodiscard]] bool empty() const { return size() == 0; }
+			[[nodiscard]] size_t space() const { return _capacity - size(); }
+
+			// Producer side. Returns false when full.
+			bool push(const T& item) {
+				const size_t t = _tail.load(std::memory_order_relaxed);
+
+				if (free(t) == 0)
+					return false;
+
+				_items[index(t)] = item;
+				_tail.store(t + 1, std::memory_order_seq_cst);
+
+				return true;
+			}
+
+			// Returns how many of 'count' fit
+			size_t push(const T* in, size_t count) {
+				const size_t t = _tail.load(std::memory_order_relaxed);
+				const size_t fits = std::min(count, free(t));
+
+				// At most two runs, before and after the end of the buffer
+				const size_t first = std::min(fits, _capacity - index(t));
+
+				std::copy_n(in, first, _items.get() + index(t));
+				std::copy_n(in + first, fits - first, _items.get());
+
+				_tail.store(t + fits, std::memory_order_seq_cst);
+
+				return fits;
+			}
+
+			// 'count' items to fill in before 'commit', nullptr if they don't fit
+			// or would wrap around the end
+			T* reserve(size_t count) {
+				const size_t t = _tail.load(std::memory_order_relaxed);
+
+				if (free(t) < count || index(t) + count > _capacity)
+					return nullptr;
+
+				return _items.get() + index(t);
+			}
+
+			void commit(size_t count) {
+				_tail.store(_tail.load(std::memory_order_relaxed) + count, std::memory_order_seq_cst);
+			}
+
+			// Drops everything pushed so far, the consumer skips it. Whatever it's
+			// in the middle of taking can get overwritten right away, so this is
+			// for items that get copied out with 'pop(out, count)'.
+			void clear() {
+				_clearedTo.store(_tail.load(std::memory_order_relaxed), std::memory_order_release);
+			}
+
+			// Consumer side. Oldest item that hasn't been popped, nullptr when empty.
+			T* front() {
+				_read = oldest(_read);
+
+				if (_read == _tail.load(std::memory_order_acquire))
+					return nullptr;
+
+				return &_items[index(_read)];
+			}
+
+			// Same, 'run' gets how many items there are from it on before the
+			// end of the buffer
+			T* front(size_t& run) {
+				T* item = front();
+
+				if (item)
+					run = std::min(_tail.load(std::memory_order_acquire) - _read, _capacity - index(_read));
+
+				return item;
+			}
+
+			void pop(size_t count = 1) {
+				_read += count;
+				_head.store(_read, std::memory_order_seq_cst);
+			}
+
+			// Returns how many items went into 'out', up to 'count'
+			size_t pop(T* out, size_t count) {
+				const size_t h = _read = oldest(_read);
+				const size_t got = std::min(count, _tail.load(std::memory_order_acquire) - h);
+				const size_t first = std::min(got, _capacity - index(h));
+
+				std::copy_n(_items.get() + index(h), first, out);
+				std::copy_n(_items.get(), got - first, out + first);
+
+				pop(got);
+
+				return got;
+			}
+
+			// Back to the start of the buffer, only while neither side is using it
+			void reset() {
+				_read = 0;
+				_head.store(0);
+				_tail.store(0);
+				_clearedTo.store(0);
+			}
+
+		private:
+			size_t index(size_t position) const {
+				return _mask ? position & _mask : position % _capacity;
+			}
+
+			// Both only go up, anything before 'clearedTo' is stale
+			size_t oldest(size_t head) const {
+				return std::max(head, _clearedTo.load(std::memory_order_acquire));
+			}
+
+			// Room the producer has from 't' on, stale items count as free
+			size_t free(size_t t) const {
+				return _capacity - (t - oldest(_head.load(std::memory_order_acquire)));
+			}
+
+		private:
+			const size_t _capacity;
+			const size_t _mask;
+			std::unique_ptr<T[]> _items;
+
+			// Consumer side, kept apart so both threads don't fight over the same
+			// cache line. '_read' is '_head' without having to load it.
+			alignas(64) std::atomic<size_t> _head{0};
+			size_t _read = 0;
+
+			// Producer side
+			alignas(64) std::atomic<size_t> _tail{0};
+			std::atomic<size_t> _clearedTo{0};
+		};
+	}
+}
@@ -0,0 +1,142 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+namespace Emulator {
+	namespace Utils {
+		/**
+		 * Background thread calling 'work' for as long as it has something to
+		 * do, see 'GpuThread', 'MDEC::setThreaded', 'ReadAhead' and 'ChdFile'.
+		 *
+		 * 'work' returns false once it runs out, then the thread sleeps until
+		 * 'wake'. A 'wake' while it's working gets it another go. Every call
+		 * runs under 'pause', so the owner can take over whatever it works on.
+		 */
+		class Worker {
+		public:
+			Worker() = default;
+
+			// Copies start out stopped, the 'Interconnect' (and the MDEC in it)
+			// gets copied into the 'CPU'
+			Worker(const Worker&) {}
+			Worker& operator=(const Worker&) = delete;
+
+			~Worker() { stop(); }
+
+			// 'spins' more calls (yielding in between) after 'work' runs out before
+			// going to sleep, for work that comes in bursts
+			void start(std::function<bool()> work, int spins = 0) {
+				if (running())
+					return;
+
+				_work = std::move(work);
+				_spins = spins;
+				_quit = false;
+
+				_thread = std::thread(&Worker::run, this);
+			}
+
+			void stop() {
+				if (!running())
+					return;
+
+				{
+					std::lock_guard lock(_mutex);
+					_quit = true;
+				}
+
+				_wakeup.notify_one();
+				_thread.join();
+			}
+
+			[[nodiscard]] bool running() const { return _thread.joinable(); }
+
+			// There might be something new for 'work' to do
+			void wake() {
+				_signalled = true;
+
+				if (_sleeping) {
+					std::lock_guard lock(_mutex);
+					_wakeup.notify_one();
+				}
+			}
+
+			// Keeps the thread out of 'work' until the lock goes away, an empty
+			// lock when it isn't running
+			std::unique_lock<std::mutex> pause() {
+				if (!running())
+					return {};
+
+				return std::unique_lock(_busy);
+			}
+
+			// Blocks until 'done' holds, it's checked again every time 'work' runs out
+			void waitUntil(const std::function<bool()>& done) {
+				if (!running() || done())
+					return;
+
+				std::unique_lock lock(_mutex);
+				_idle.wait(lock, done);
+			}
+
+		private:
+			void run() {
+				int idle = 0;
+
+				// Checked before every call, not just when it runs out of work
+				while (!_quit) {
+					// Cleared first, a 'wake' while working means there might be more to do
+					_signalled = false;
+
+					bool more;
+
+					{
+						std::lock_guard lock(_busy);
+						more = _work();
+					}
+
+					if (more) {
+						idle = 0;
+						continue;
+					}
+
+					if (idle == 0) {
+						// 'waitUntil' might be waiting on this
+						std::lock_guard lock(_mutex);
+						_idle.notify_all();
+					}
+
+					if (idle++ < _spins) {
+						std::this_thread::yield();
+						continue;
+					}
+
+					idle = 0;
+
+					std::unique_lock lock(_mutex);
+					_sleeping = true;
+					_wakeup.wait(lock, [this] { return _quit || _signalled; });
+					_sleeping = false;
+				}
+			}
+
+		private:
+			std::function<bool()> _work;
+			int _spins = 0;
+			std::thread _thread;
+
+			std::mutex _busy;
+
+			std::mutex _mutex;
+			std::condition_variable _wakeup;
+			std::condition_variable _idle;
+			std::atomic<bool> _sleeping{false};
+			std::atomic<bool> _signalled{false};
+			std::atomic<bool> _quit{false};
+		};
+	}
+}